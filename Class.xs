@@ -96,33 +96,6 @@ CODE:
 #endif
 
 
-#/*****************************************************************************
-# * CLONE()
-# *****************************************************************************/
-
-#ifdef USE_ITHREADS
-
-void
-CLONE( ... )
-PREINIT:
-	socket_class_t *sc;
-	int i;
-PPCODE:
-	GLOBAL_LOCK();
-	for( i = 0; i <= SC_CASCADE; i ++ ) {
-		for( sc = sc_global.socket[i]; sc != NULL; sc = sc->next ) {
-			if( sc->do_clone )
-				sc->refcnt ++;
-#ifdef SC_DEBUG
-			_debug( "CLONE called for sc %lu refcnt: %d\n", sc->id, sc->refcnt );
-#endif
-		}
-	}
-	GLOBAL_UNLOCK();
-
-#endif
-
-
 #/*****************************************************************************
 # * DESTROY( this )
 # *****************************************************************************/
@@ -137,14 +110,6 @@ PPCODE:
 		XSRETURN_EMPTY;
 #ifdef SC_DEBUG
 	_debug( "DESTROY called for sc %lu refcnt: %d\n", sc->id, sc->refcnt - 1 );
-#endif
-#ifdef USE_ITHREADS
-	if( sc->do_clone && sc->thread_id == THREAD_ID() ) {
-		sc->do_clone = FALSE;
-#ifdef SC_DEBUG
-		_debug( "Disabled futher CLONE for sc %lu\n", sc->id );
-#endif
-	}
 #endif
 	mod_sc_refcnt_dec( sc );
 
@@ -204,6 +169,9 @@ PPCODE:
 	case AF_INET6:
 	default:
 		switch( items ) {
+		case 1:
+			/* reconnect to the last address */
+			break;
 		case 4:
 		default:
 			if( SvNOK( ST(3) ) || SvIOK( ST(3) ) )
@@ -219,6 +187,8 @@ PPCODE:
 		break;
 	case AF_UNIX:
 		switch( items ) {
+		case 1:
+			break;
 		case 3:
 		default:
 			if( SvNOK( ST(2) ) || SvIOK( ST(2) ) )
@@ -349,30 +319,34 @@ PPCODE:
 
 
 #/*****************************************************************************
-# * recv( this, buf, len [, flags] )
+# * recv( this, buf, len [, flags [, offset]] )
 # *****************************************************************************/
 
 void
-recv( this, buf, len, flags = 0 )
+recv( this, buf, len, flags = 0, offset = NULL )
 	SV *this;
 	SV *buf;
 	unsigned int len;
 	unsigned int flags;
+	SV *offset;
 PREINIT:
 	socket_class_t *sc;
 	int rlen;
+	char *p;
+	STRLEN pos;
 PPCODE:
 	if( (sc = mod_sc_get_socket( this )) == NULL )
 		XSRETURN_EMPTY;
-	if( sc->buffer_len < len ) {
-		sc->buffer_len = len;
-		Renew( sc->buffer, len, char );
+	if( (p = my_sv_recv_start( buf, offset, len, &pos )) == NULL ) {
+		mod_sc_set_errno( sc, EINVAL );
+		XSRETURN_EMPTY;
 	}
-	if( mod_sc_recv( sc, sc->buffer, len, flags, &rlen ) != SC_OK )
+	if( mod_sc_recv( sc, p, len, flags, &rlen ) != SC_OK )
 		XSRETURN_EMPTY;
 	if( rlen == 0 )
 		XSRETURN_NO;
-	sv_setpvn( buf, sc->buffer, rlen );
+	/* MSG_TRUNC may report the real length of the packet */
+	my_sv_recv_end( buf, pos, (unsigned int) rlen < len ? rlen : len );
 	XSRETURN_IV( rlen );
 
 
@@ -402,30 +376,33 @@ PPCODE:
 
 
 #/*****************************************************************************
-# * recvfrom( this, buf, len [, flags] )
+# * recvfrom( this, buf, len [, flags [, offset]] )
 # *****************************************************************************/
 
 void
-recvfrom( this, buf, len, flags = 0 )
+recvfrom( this, buf, len, flags = 0, offset = NULL )
 	SV *this;
 	SV *buf;
 	size_t len;
 	unsigned int flags;
+	SV *offset;
 PREINIT:
 	socket_class_t *sc;
 	int rlen;
+	char *p;
+	STRLEN pos;
 PPCODE:
 	if( (sc = mod_sc_get_socket( this )) == NULL )
 		XSRETURN_EMPTY;
-	if( sc->buffer_len < len ) {
-		sc->buffer_len = len;
-		Renew( sc->buffer, len, char );
+	if( (p = my_sv_recv_start( buf, offset, len, &pos )) == NULL ) {
+		mod_sc_set_errno( sc, EINVAL );
+		XSRETURN_EMPTY;
 	}
-	if( mod_sc_recvfrom( sc, sc->buffer, (int) len, flags, &rlen ) != SC_OK )
+	if( mod_sc_recvfrom( sc, p, (int) len, flags, &rlen ) != SC_OK )
 		XSRETURN_EMPTY;
 	if( rlen == 0 )
 		XSRETURN_NO;
-	sv_setpvn( buf, sc->buffer, rlen );
+	my_sv_recv_end( buf, pos, (size_t) rlen < len ? (size_t) rlen : len );
 	ST(0) = sv_2mortal( newSVpvn(
 		(char *) &sc->r_addr, SC_ADDR_SIZE( sc->r_addr ) ) );
 	XSRETURN(1);
@@ -469,29 +446,164 @@ PPCODE:
 
 
 #/*****************************************************************************
-# * read( this, buf, len )
+# * recv_many( this, max, maxlen [, flags] )
+# *****************************************************************************/
+
+void
+recv_many( this, max, maxlen, flags = 0 )
+	SV *this;
+	int max;
+	int maxlen;
+	unsigned int flags;
+PREINIT:
+	socket_class_t *sc;
+	sc_msg_t *msgs;
+	AV *av_bufs, *av_peers;
+	size_t size;
+	int count = 0, i;
+PPCODE:
+	if( (sc = mod_sc_get_socket( this )) == NULL )
+		XSRETURN_EMPTY;
+	if( max <= 0 || maxlen <= 0 || (size_t) max > (size_t) -1 / maxlen ) {
+		mod_sc_set_errno( sc, EINVAL );
+		XSRETURN_EMPTY;
+	}
+	/* receive into the buffer of the socket, only the datagrams received
+	 * are copied into scalars */
+	size = (size_t) max * maxlen;
+	if( sc->buffer_len < size ) {
+		sc->buffer_len = size;
+		Renew( sc->buffer, sc->buffer_len, char );
+	}
+	Newx( msgs, max, sc_msg_t );
+	for( i = 0; i < max; i ++ ) {
+		msgs[i].buf = sc->buffer + (size_t) i * maxlen;
+		msgs[i].len = maxlen;
+	}
+	if( mod_sc_recv_many( sc, msgs, max, flags, &count ) != SC_OK ) {
+		Safefree( msgs );
+		XSRETURN_EMPTY;
+	}
+	av_bufs = newAV();
+	av_peers = newAV();
+	if( count > 0 ) {
+		av_extend( av_bufs, count - 1 );
+		av_extend( av_peers, count - 1 );
+	}
+	for( i = 0; i < count; i ++ ) {
+		/* MSG_TRUNC may report the real length of the datagram */
+		av_push( av_bufs, newSVpvn(
+			msgs[i].buf, msgs[i].len < maxlen ? msgs[i].len : maxlen ) );
+		av_push( av_peers, newSVpvn(
+			(char *) &msgs[i].peer, SC_ADDR_SIZE( msgs[i].peer ) ) );
+	}
+	Safefree( msgs );
+	ST(0) = sv_2mortal( newRV_noinc( (SV *) av_bufs ) );
+	ST(1) = sv_2mortal( newRV_noinc( (SV *) av_peers ) );
+	XSRETURN(2);
+
+
+#/*****************************************************************************
+# * send_many( this, bufs [, peers [, flags]] )
 # *****************************************************************************/
 
 void
-read( this, buf, len )
+send_many( this, bufs, peers = NULL, flags = 0 )
+	SV *this;
+	SV *bufs;
+	SV *peers;
+	unsigned int flags;
+PREINIT:
+	socket_class_t *sc;
+	sc_msg_t *msgs;
+	AV *av_bufs, *av_peers = NULL;
+	SV **psv;
+	STRLEN len;
+	sc_addr_t *peer;
+	int count, i, r;
+PPCODE:
+	if( (sc = mod_sc_get_socket( this )) == NULL )
+		XSRETURN_EMPTY;
+	if( ! SvROK( bufs ) || SvTYPE( SvRV( bufs ) ) != SVt_PVAV ) {
+		mod_sc_set_errno( sc, EINVAL );
+		XSRETURN_EMPTY;
+	}
+	av_bufs = (AV *) SvRV( bufs );
+	if( peers != NULL && SvOK( peers ) ) {
+		if( ! SvROK( peers ) || SvTYPE( SvRV( peers ) ) != SVt_PVAV ) {
+			mod_sc_set_errno( sc, EINVAL );
+			XSRETURN_EMPTY;
+		}
+		av_peers = (AV *) SvRV( peers );
+	}
+	if( (count = av_len( av_bufs ) + 1) == 0 )
+		XSRETURN_IV( 0 );
+	Newx( msgs, count, sc_msg_t );
+	for( i = 0; i < count; i ++ ) {
+		psv = av_fetch( av_bufs, i, 0 );
+		if( psv != NULL ) {
+			msgs[i].buf = SvPV( *psv, len );
+			msgs[i].len = (int) len;
+		}
+		else {
+			msgs[i].buf = (char *) "";
+			msgs[i].len = 0;
+		}
+		msgs[i].peer.l = 0;
+		if( av_peers == NULL )
+			continue;
+		psv = av_fetch( av_peers, i, 0 );
+		if( psv == NULL || ! SvOK( *psv ) )
+			continue;
+		peer = (sc_addr_t *) SvPVbyte( *psv, len );
+		if( len < sizeof( int ) || len != SC_ADDR_SIZE(*peer) ) {
+			Safefree( msgs );
+			goto invalid;
+		}
+		Copy( peer, &msgs[i].peer, len, char );
+	}
+	r = mod_sc_send_many( sc, msgs, count, flags, &count );
+	Safefree( msgs );
+	if( r != SC_OK )
+		XSRETURN_EMPTY;
+	if( count == 0 )
+		XSRETURN_NO;
+	XSRETURN_IV( count );
+invalid:
+	my_snprintf_(
+		sc->last_error, sizeof( sc->last_error ),
+		"Invalid address"
+	);
+	XSRETURN_EMPTY;
+
+
+#/*****************************************************************************
+# * read( this, buf, len [, offset] )
+# *****************************************************************************/
+
+void
+read( this, buf, len, offset = NULL )
 	SV *this;
 	SV *buf;
 	unsigned int len;
+	SV *offset;
 PREINIT:
 	socket_class_t *sc;
 	int rlen;
+	char *p;
+	STRLEN pos;
 PPCODE:
 	if( (sc = mod_sc_get_socket( this )) == NULL )
 		XSRETURN_EMPTY;
-	if( sc->buffer_len < len ) {
-		sc->buffer_len = len;
-		Renew( sc->buffer, len, char );
+	if( (p = my_sv_recv_start( buf, offset, len, &pos )) == NULL ) {
+		mod_sc_set_errno( sc, EINVAL );
+		XSRETURN_EMPTY;
 	}
-	if( mod_sc_read( sc, sc->buffer, len, &rlen ) != SC_OK )
+	if( mod_sc_read( sc, p, len, &rlen ) != SC_OK )
 		XSRETURN_EMPTY;
 	if( rlen == 0 )
 		XSRETURN_NO;
-	sv_setpvn( buf, sc->buffer, rlen );
+	my_sv_recv_end( buf, pos, rlen );
 	XSRETURN_IV( rlen );
 
 
@@ -541,6 +653,177 @@ PPCODE:
 	XSRETURN_IV( len );
 
 
+#/*****************************************************************************
+# * sendfile( this, file [, offset [, length]] )
+# *****************************************************************************/
+
+void
+sendfile( this, file, offset = 0, length = 0 )
+	SV *this;
+	SV *file;
+	IV offset;
+	IV length;
+PREINIT:
+	socket_class_t *sc;
+	IO *io;
+	int fd, r;
+	size_t len;
+PPCODE:
+	if( (sc = mod_sc_get_socket( this )) == NULL )
+		XSRETURN_EMPTY;
+	if( offset < 0 || length < 0 ) {
+		mod_sc_set_errno( sc, EINVAL );
+		XSRETURN_EMPTY;
+	}
+	if( SvROK( file ) || isGV( file ) ) {
+		/* file handle */
+		io = sv_2io( file );
+		if( io == NULL || IoIFP( io ) == NULL
+			|| (fd = PerlIO_fileno( IoIFP( io ) )) < 0
+		) {
+			mod_sc_set_errno( sc, EBADF );
+			XSRETURN_EMPTY;
+		}
+		r = mod_sc_sendfile(
+			sc, fd, (off_t) offset, (size_t) length, &len );
+	}
+	else {
+		/* file name */
+#ifdef O_BINARY
+		fd = open( SvPV_nolen( file ), O_RDONLY | O_BINARY );
+#else
+		fd = open( SvPV_nolen( file ), O_RDONLY );
+#endif
+		if( fd < 0 ) {
+			mod_sc_set_errno( sc, errno );
+			XSRETURN_EMPTY;
+		}
+		r = mod_sc_sendfile(
+			sc, fd, (off_t) offset, (size_t) length, &len );
+		close( fd );
+	}
+	if( r != SC_OK )
+		XSRETURN_EMPTY;
+	if( len == 0 )
+		XSRETURN_NO;
+	XSRETURN_IV( (IV) len );
+
+
+#/*****************************************************************************
+# * relay( this, other [, max] )
+# *****************************************************************************/
+
+void
+relay( this, other, max = 0 )
+	SV *this;
+	SV *other;
+	IV max;
+PREINIT:
+	socket_class_t *sc, *sc2;
+	size_t len;
+PPCODE:
+	if( (sc = mod_sc_get_socket( this )) == NULL )
+		XSRETURN_EMPTY;
+	if( (sc2 = mod_sc_get_socket( other )) == NULL ) {
+		mod_sc_set_errno( sc, EINVAL );
+		XSRETURN_EMPTY;
+	}
+	switch( mod_sc_relay( sc, sc2, max > 0 ? (size_t) max : 0, &len ) ) {
+	case SC_OK:
+		break;
+	case SC_EOF:
+		XSRETURN_IV( 0 );
+	default:
+		XSRETURN_EMPTY;
+	}
+	if( len == 0 )
+		XSRETURN_NO;
+	XSRETURN_IV( (IV) len );
+
+
+#/*****************************************************************************
+# * proxy( this, other [, timeout] )
+# *****************************************************************************/
+
+void
+proxy( this, other, timeout = NULL )
+	SV *this;
+	SV *other;
+	SV *timeout;
+PREINIT:
+	socket_class_t *sc, *sc2;
+	size_t len_out, len_in;
+	double ms;
+PPCODE:
+	if( (sc = mod_sc_get_socket( this )) == NULL )
+		XSRETURN_EMPTY;
+	if( (sc2 = mod_sc_get_socket( other )) == NULL ) {
+		mod_sc_set_errno( sc, EINVAL );
+		XSRETURN_EMPTY;
+	}
+	ms = timeout != NULL && SvOK( timeout ) ? SvNV( timeout ) : -1;
+	if( mod_sc_proxy( sc, sc2, ms, &len_out, &len_in ) != SC_OK )
+		XSRETURN_EMPTY;
+	XPUSHs( sv_2mortal( newSVuv( (UV) len_out ) ) );
+	XPUSHs( sv_2mortal( newSVuv( (UV) len_in ) ) );
+
+
+#/*****************************************************************************
+# * write_all( this, buf [, timeout] )
+# *****************************************************************************/
+
+void
+write_all( this, buf, timeout = NULL )
+	SV *this;
+	SV *buf;
+	SV *timeout;
+PREINIT:
+	socket_class_t *sc;
+	const char *msg;
+	STRLEN len;
+	size_t rlen;
+	int r;
+PPCODE:
+	if( (sc = mod_sc_get_socket( this )) == NULL )
+		XSRETURN_EMPTY;
+	msg = SvPV( buf, len );
+	r = mod_sc_write_all( sc, msg, len,
+		timeout != NULL && SvOK( timeout ) ? SvNV( timeout ) : -1, &rlen );
+	/* report the progress on timeout and errors too */
+	if( r != SC_OK && rlen == 0 )
+		XSRETURN_EMPTY;
+	XSRETURN_IV( (IV) rlen );
+
+
+#/*****************************************************************************
+# * read_exact( this, len [, timeout] )
+# *****************************************************************************/
+
+void
+read_exact( this, len, timeout = NULL )
+	SV *this;
+	UV len;
+	SV *timeout;
+PREINIT:
+	socket_class_t *sc;
+	SV *sv;
+	size_t rlen;
+	int r;
+PPCODE:
+	if( (sc = mod_sc_get_socket( this )) == NULL )
+		XSRETURN_EMPTY;
+	sv = sv_2mortal( newSV( (STRLEN) len + 1 ) );
+	SvPOK_only( sv );
+	r = mod_sc_read_exact( sc, SvPVX( sv ), (size_t) len,
+		timeout != NULL && SvOK( timeout ) ? SvNV( timeout ) : -1, &rlen );
+	if( r != SC_OK && rlen == 0 && len > 0 )
+		XSRETURN_EMPTY;
+	SvCUR_set( sv, rlen );
+	*SvEND( sv ) = '\0';
+	ST(0) = sv;
+	XSRETURN(1);
+
+
 #/*****************************************************************************
 # * readline( this [, separator [, maxsize]] )
 # *****************************************************************************/
@@ -554,6 +837,7 @@ PREINIT:
 	socket_class_t *sc;
 	int rlen, r;
 	char *rbuf;
+	dXSTARG;
 PPCODE:
 	if( (sc = mod_sc_get_socket( this )) == NULL )
 		XSRETURN_EMPTY;
@@ -567,7 +851,9 @@ PPCODE:
 		if( mod_sc_readline( sc, &rbuf, &rlen ) != SC_OK )
 			XSRETURN_EMPTY;
 	}
-	ST(0) = sv_2mortal( newSVpvn( rbuf, rlen ) );
+	/* reuse the target of the call instead of a new scalar per line */
+	sv_setpvn( TARG, rbuf, rlen );
+	ST(0) = TARG;
 	XSRETURN(1);
 
 
@@ -604,33 +890,74 @@ print( this, ... )
 	SV *this;
 PREINIT:
 	socket_class_t *sc;
-	const char *s1;
-	char *tmp = NULL;
-	STRLEN l1, len = 0, pos = 0;
-	int r, rlen;
+	sc_iovec_t tmp[SC_IOV_STATIC], *vec = tmp;
+	STRLEN l1;
+	int r, count = 0, rlen;
 PPCODE:
 	if( (sc = mod_sc_get_socket( this )) == NULL )
 		XSRETURN_EMPTY;
+	if( items - 1 > SC_IOV_STATIC )
+		Newx( vec, items - 1, sc_iovec_t );
 	for( r = 1; r < items; r ++ ) {
 		if( ! SvOK( ST(r) ) )
 			continue;
-		s1 = SvPV( ST(r), l1 );
-		if( pos + l1 > len ) {
-			len = pos + l1 + 64;
-			Renew( tmp, len, char );
-		}
-		Copy( s1, tmp + pos, l1, char );
-		pos += l1;
+		vec[count].buf = SvPV( ST(r), l1 );
+		vec[count ++].len = l1;
 	}
-	if( tmp != NULL ) {
-		r = mod_sc_write( sc, tmp, (int) pos, &rlen );
-		Safefree( tmp );
+	if( count > 0 ) {
+		r = mod_sc_writev( sc, vec, count, &rlen );
+		if( vec != tmp )
+			Safefree( vec );
 		if( r != SC_OK )
 			XSRETURN_EMPTY;
 		if( rlen == 0 )
 			XSRETURN_NO;
 		XSRETURN_IV( rlen );
 	}
+	if( vec != tmp )
+		Safefree( vec );
+
+
+#/*****************************************************************************
+# * writev( this, chunks )
+# *****************************************************************************/
+
+void
+writev( this, chunks )
+	SV *this;
+	SV *chunks;
+PREINIT:
+	socket_class_t *sc;
+	sc_iovec_t tmp[SC_IOV_STATIC], *vec = tmp;
+	AV *av;
+	SV **psv;
+	STRLEN l1;
+	int i, r, count = 0, rlen;
+PPCODE:
+	if( (sc = mod_sc_get_socket( this )) == NULL )
+		XSRETURN_EMPTY;
+	if( ! SvROK( chunks ) || SvTYPE( SvRV( chunks ) ) != SVt_PVAV ) {
+		mod_sc_set_errno( sc, EINVAL );
+		XSRETURN_EMPTY;
+	}
+	av = (AV *) SvRV( chunks );
+	if( av_len( av ) + 1 > SC_IOV_STATIC )
+		Newx( vec, av_len( av ) + 1, sc_iovec_t );
+	for( i = 0; i <= av_len( av ); i ++ ) {
+		psv = av_fetch( av, i, 0 );
+		if( psv == NULL || ! SvOK( *psv ) )
+			continue;
+		vec[count].buf = SvPV( *psv, l1 );
+		vec[count ++].len = l1;
+	}
+	r = mod_sc_writev( sc, vec, count, &rlen );
+	if( vec != tmp )
+		Safefree( vec );
+	if( r != SC_OK )
+		XSRETURN_EMPTY;
+	if( rlen == 0 )
+		XSRETURN_NO;
+	XSRETURN_IV( rlen );
 
 
 #/*****************************************************************************
@@ -646,13 +973,15 @@ PREINIT:
 	socket_class_t *sc;
 	int rlen, r;
 	char *rbuf;
+	dXSTARG;
 PPCODE:
 	if( (sc = mod_sc_get_socket( this )) == NULL )
 		XSRETURN_EMPTY;
 	r = mod_sc_read_packet( sc, separator, (size_t) maxsize, &rbuf, &rlen );
 	if( r != SC_OK )
 		XSRETURN_EMPTY;
-	ST(0) = sv_2mortal( newSVpvn( rbuf, rlen ) );
+	sv_setpvn( TARG, rbuf, rlen );
+	ST(0) = TARG;
 	XSRETURN(1);
 
 
@@ -1260,6 +1589,67 @@ PPCODE:
 	XSRETURN_IV( mode );
 
 
+#/*****************************************************************************
+# * set_output_buffer( this, size [, cork [, max_age]] )
+# *****************************************************************************/
+
+void
+set_output_buffer( this, size, cork = 0, max_age = 0 )
+	SV *this;
+	IV size;
+	int cork;
+	int max_age;
+PREINIT:
+	socket_class_t *sc;
+PPCODE:
+	if( (sc = mod_sc_get_socket( this )) == NULL )
+		XSRETURN_EMPTY;
+	if( size < 0 || max_age < 0 ) {
+		mod_sc_set_errno( sc, EINVAL );
+		XSRETURN_EMPTY;
+	}
+	if( mod_sc_set_output_buffer(
+		sc, (size_t) size, cork ? SC_OUTPUT_CORK : 0, max_age ) != SC_OK
+	)
+		XSRETURN_EMPTY;
+	XSRETURN_YES;
+
+
+#/*****************************************************************************
+# * flush( this )
+# *****************************************************************************/
+
+void
+flush( this )
+	SV *this;
+PREINIT:
+	socket_class_t *sc;
+	size_t pending;
+PPCODE:
+	if( (sc = mod_sc_get_socket( this )) == NULL )
+		XSRETURN_EMPTY;
+	if( mod_sc_flush( sc, &pending ) != SC_OK )
+		XSRETURN_EMPTY;
+	if( pending > 0 )
+		XSRETURN_NO;
+	XSRETURN_YES;
+
+
+#/*****************************************************************************
+# * output_pending( this )
+# *****************************************************************************/
+
+void
+output_pending( this )
+	SV *this;
+PREINIT:
+	socket_class_t *sc;
+PPCODE:
+	if( (sc = mod_sc_get_socket( this )) == NULL )
+		XSRETURN_EMPTY;
+	XSRETURN_IV( (IV) mod_sc_get_output_pending( sc ) );
+
+
 #/*****************************************************************************
 # * set_option( this, level, optname, value )
 # *****************************************************************************/
@@ -1775,3 +2165,173 @@ PPCODE:
 	msg = mod_sc_get_error( sc );
 	ST(0) = sv_2mortal( newSVpvn( msg, strlen( msg ) ) );
 	XSRETURN(1);
+
+
+MODULE = Socket::Class		PACKAGE = Socket::Class::Poller
+
+
+#/*****************************************************************************
+# * new( class [, size] )
+# *****************************************************************************/
+
+void
+new( class, size = 0 )
+	SV *class;
+	int size;
+PREINIT:
+	sc_poller_t *poller;
+	HV *stash;
+PPCODE:
+	if( mod_sc_poller_create( size, my_poller_free_sv, &poller ) != SC_OK )
+		XSRETURN_EMPTY;
+	stash = gv_stashsv( class, GV_ADD );
+	ST(0) = sv_2mortal( sv_bless(
+		newRV_noinc( newSViv( PTR2IV( poller ) ) ), stash ) );
+	XSRETURN(1);
+
+
+#/*****************************************************************************
+# * CLONE_SKIP()
+# *****************************************************************************/
+
+void
+CLONE_SKIP( ... )
+PPCODE:
+	(void) items; /* avoid compiler warning */
+	/* pollers belong to the thread they have been created in */
+	XSRETURN_YES;
+
+
+#/*****************************************************************************
+# * DESTROY( this )
+# *****************************************************************************/
+
+void
+DESTROY( this )
+	SV *this;
+PREINIT:
+	sc_poller_t *poller;
+PPCODE:
+	if( (poller = my_poller_from_class( this )) == NULL )
+		XSRETURN_EMPTY;
+	mod_sc_poller_destroy( poller );
+	sv_setiv( SvRV( this ), 0 );
+
+
+#/*****************************************************************************
+# * add( this, sock [, events] )
+# *****************************************************************************/
+
+void
+add( this, sock, events = SC_POLL_READ )
+	SV *this;
+	SV *sock;
+	int events;
+PREINIT:
+	sc_poller_t *poller;
+	socket_class_t *sc;
+	SV *sv;
+PPCODE:
+	if( (poller = my_poller_from_class( this )) == NULL )
+		XSRETURN_EMPTY;
+	if( (sc = mod_sc_get_socket( sock )) == NULL )
+		XSRETURN_EMPTY;
+	sv = newSVsv( sock );
+	if( mod_sc_poller_add( poller, sc, events, sv ) != SC_OK ) {
+		SvREFCNT_dec( sv );
+		XSRETURN_EMPTY;
+	}
+	XSRETURN_YES;
+
+
+#/*****************************************************************************
+# * modify( this, sock, events )
+# *****************************************************************************/
+
+void
+modify( this, sock, events )
+	SV *this;
+	SV *sock;
+	int events;
+PREINIT:
+	sc_poller_t *poller;
+	socket_class_t *sc;
+PPCODE:
+	if( (poller = my_poller_from_class( this )) == NULL )
+		XSRETURN_EMPTY;
+	if( (sc = mod_sc_get_socket( sock )) == NULL )
+		XSRETURN_EMPTY;
+	if( mod_sc_poller_modify( poller, sc, events ) != SC_OK )
+		XSRETURN_EMPTY;
+	XSRETURN_YES;
+
+
+#/*****************************************************************************
+# * remove( this, sock )
+# *****************************************************************************/
+
+void
+remove( this, sock )
+	SV *this;
+	SV *sock;
+PREINIT:
+	sc_poller_t *poller;
+	socket_class_t *sc;
+PPCODE:
+	if( (poller = my_poller_from_class( this )) == NULL )
+		XSRETURN_EMPTY;
+	if( (sc = mod_sc_get_socket( sock )) == NULL )
+		XSRETURN_EMPTY;
+	if( mod_sc_poller_remove( poller, sc ) != SC_OK )
+		XSRETURN_EMPTY;
+	XSRETURN_YES;
+
+
+#/*****************************************************************************
+# * count( this )
+# *****************************************************************************/
+
+void
+count( this )
+	SV *this;
+PREINIT:
+	sc_poller_t *poller;
+PPCODE:
+	if( (poller = my_poller_from_class( this )) == NULL )
+		XSRETURN_EMPTY;
+	my_poller_purge( poller );
+	XSRETURN_IV( poller->count );
+
+
+#/*****************************************************************************
+# * wait( this [, timeout [, max]] )
+# *****************************************************************************/
+
+void
+wait( this, timeout = NULL, max = 0 )
+	SV *this;
+	SV *timeout;
+	int max;
+PREINIT:
+	sc_poller_t *poller;
+	sc_poll_event_t *ev;
+	double ms;
+	int count, i;
+PPCODE:
+	if( (poller = my_poller_from_class( this )) == NULL )
+		XSRETURN_EMPTY;
+	ms = timeout != NULL && SvOK( timeout ) ? SvNV( timeout ) : -1;
+	if( max <= 0 || max > poller->count )
+		max = poller->count > 0 ? poller->count : 1;
+	if( poller->ready_size < max ) {
+		poller->ready_size = max;
+		Renew( poller->ready, max, sc_poll_event_t );
+	}
+	if( mod_sc_poller_wait( poller, ms, poller->ready, max, &count ) != SC_OK )
+		XSRETURN_UNDEF;
+	/* pairs of socket and events */
+	EXTEND( SP, count * 2 );
+	for( i = 0, ev = poller->ready; i < count; i ++, ev ++ ) {
+		PUSHs( sv_mortalcopy( (SV *) ev->data ) );
+		PUSHs( sv_2mortal( newSViv( ev->events ) ) );
+	}
@@ -17,9 +17,8 @@ while( $c = $s->accept ) {
 	$buf = '';
 	while( ! $c->is_error ) {
 		if( $c->is_readable( 100 ) ) {
-			$got = $c->read( $tmp, 4096 )
+			$got = $c->read( $buf, 4096, length( $buf ) )
 				or last;
-			$buf .= $tmp;
 		}
 	}
 	print "received ", length( $buf ), " bytes\n";
@@ -0,0 +1,100 @@
+#!perl
+
+# SSL accept/read/write stress test with threads sharing one listening
+# socket, run from the distribution directory
+#
+#   perl examples/ssl_threads_bench.pl [max_threads [connections [bytes]]]
+
+BEGIN {
+	unshift @INC, 'blib/lib', 'blib/arch';
+}
+
+use threads;
+use threads::shared;
+
+use Time::HiRes qw(time);
+use Socket::Class::SSL;
+
+our $RUNNING : shared;
+our $BYTES : shared;
+
+$SIG{'PIPE'} = 'IGNORE';
+
+$max_threads = $ARGV[0] || 4;
+$connections = $ARGV[1] || 200;
+$size = $ARGV[2] || 16384;
+
+$server = Socket::Class::SSL->new(
+	'local_addr' => '127.0.0.1',
+	'listen' => 128,
+	'reuseaddr' => 1,
+	'certificate' => 'xs/sc_ssl/cert/server.crt',
+	'private_key' => 'xs/sc_ssl/cert/server.key',
+) or die Socket::Class->error;
+$port = $server->local_port;
+
+printf "%7s %12s %12s %10s\n", 'threads', 'conn/s', 'MB/s', 'speedup';
+for( $threads = 1; $threads <= $max_threads; $threads *= 2 ) {
+	$RUNNING = 1;
+	$BYTES = 0;
+	@servers = map { threads->create( \&server_thread, $server ) }
+		1 .. $threads;
+	$start = time;
+	@clients = map { threads->create( \&client_thread ) } 1 .. $threads;
+	$_->join() foreach @clients;
+	$elapsed = time - $start;
+	# wake up the servers, the plain connections fail the handshake
+	$RUNNING = 0;
+	for( 1 .. $threads ) {
+		Socket::Class->new(
+			'remote_addr' => '127.0.0.1', 'remote_port' => $port )->close();
+	}
+	$_->join() foreach @servers;
+	$rate = $threads * $connections / $elapsed;
+	$base = $rate if $threads == 1;
+	printf "%7d %12.1f %12.2f %9.2fx\n",
+		$threads, $rate, $BYTES / $elapsed / 1048576, $rate / $base;
+}
+
+1;
+
+sub server_thread {
+	my( $sock ) = @_;
+	my( $client, $len, $buf, $got );
+	while( $RUNNING ) {
+		$client = $sock->accept() or next;
+		$client->set_tcp_nodelay( 1 );
+		$len = $client->readline() or next;
+		$buf = '';
+		while( length( $buf ) < $len ) {
+			$client->read( $got, $len - length( $buf ) ) or last;
+			$buf .= $got;
+		}
+		# echo the data
+		$client->write( $buf );
+		$client->close();
+	}
+}
+
+sub client_thread {
+	my( $client, $data, $buf, $got, $i );
+	$data = 'x' x $size;
+	for $i( 1 .. $connections ) {
+		$client = Socket::Class::SSL->new(
+			'remote_addr' => '127.0.0.1',
+			'remote_port' => $port,
+		) or die Socket::Class->error;
+		$client->set_tcp_nodelay( 1 );
+		$client->writeline( $size );
+		$client->write( $data );
+		$buf = '';
+		while( length( $buf ) < $size ) {
+			$client->read( $got, $size - length( $buf ) ) or last;
+			$buf .= $got;
+		}
+		die "short echo" if $buf ne $data;
+		$client->close();
+		lock( $BYTES );
+		$BYTES += 2 * $size;
+	}
+}
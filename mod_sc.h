@@ -99,9 +99,18 @@
 #define SC_STATE_CLOSED			5
 #define SC_STATE_ERROR			99
 
+/* Socket::Class::Poller events */
+#define SC_POLL_READ			0x0001
+#define SC_POLL_WRITE			0x0002
+#define SC_POLL_ERROR			0x0004
+#define SC_POLL_HUP				0x0008
+#define SC_POLL_EDGE			0x0100
+
 /* mod_sc return codes */
 #define SC_OK					0
 #define SC_ERROR				1
+/* end of stream, returned by sc_relay() */
+#define SC_EOF					2
 
 #define SOCKADDR_SIZE_MAX		128
 
@@ -128,6 +137,35 @@ typedef struct st_socket_class		sc_t;
 typedef struct st_sc_sockaddr		sc_addr_t;
 typedef struct st_sc_addrinfo		sc_addrinfo_t;
 typedef struct st_mod_sc			mod_sc_t;
+typedef struct st_sc_poller			sc_poller_t;
+
+struct st_sc_poll_event {
+	sc_t						*sock;
+	void						*data;
+	int							events;
+};
+
+typedef struct st_sc_poll_event		sc_poll_event_t;
+
+/* one datagram of sc_recv_many() and sc_send_many() */
+struct st_sc_msg {
+	char						*buf;
+	int							len;
+	sc_addr_t					peer;
+};
+
+typedef struct st_sc_msg			sc_msg_t;
+
+/* flags of sc_set_output_buffer() */
+#define SC_OUTPUT_CORK			1
+
+/* one chunk of sc_writev() */
+struct st_sc_iovec {
+	const char					*buf;
+	size_t						len;
+};
+
+typedef struct st_sc_iovec			sc_iovec_t;
 
 struct st_mod_sc {
 	const char *sc_version; /* XS_VERSION */
@@ -223,6 +261,39 @@ struct st_mod_sc {
 	int (*sc_read_packet) (
 		sc_t *socket, char *separator, size_t max, char **p_buf, int *p_len
 	);
+	/* since version 2.259 */
+	int (*sc_poller_create) (
+		int size, void (*free_data) (void *data), sc_poller_t **p_poller
+	);
+	void (*sc_poller_destroy) ( sc_poller_t *poller );
+	int (*sc_poller_add) (
+		sc_poller_t *poller, sc_t *sock, int events, void *data );
+	int (*sc_poller_modify) ( sc_poller_t *poller, sc_t *sock, int events );
+	int (*sc_poller_remove) ( sc_poller_t *poller, sc_t *sock );
+	int (*sc_poller_wait) (
+		sc_poller_t *poller, double timeout, sc_poll_event_t *events,
+		int max, int *p_count
+	);
+	int (*sc_recv_many) (
+		sc_t *sock, sc_msg_t *msgs, int count, int flags, int *p_count );
+	int (*sc_send_many) (
+		sc_t *sock, sc_msg_t *msgs, int count, int flags, int *p_count );
+	int (*sc_sendfile) (
+		sc_t *sock, int fd, off_t offset, size_t length, size_t *p_len );
+	int (*sc_relay) ( sc_t *from, sc_t *to, size_t max, size_t *p_len );
+	int (*sc_proxy) (
+		sc_t *sock, sc_t *other, double timeout, size_t *p_out, size_t *p_in );
+	int (*sc_writev) (
+		sc_t *sock, const sc_iovec_t *vec, int count, int *p_len );
+	int (*sc_set_output_buffer) (
+		sc_t *sock, size_t size, int flags, int max_age );
+	int (*sc_flush) ( sc_t *sock, size_t *p_pending );
+	size_t (*sc_get_output_pending) ( sc_t *sock );
+	int (*sc_write_all) (
+		sc_t *sock, const char *buf, size_t len, double timeout,
+		size_t *p_len );
+	int (*sc_read_exact) (
+		sc_t *sock, char *buf, size_t len, double timeout, size_t *p_len );
 };
 
 #endif /* _MOD_SC_H_ */
@@ -1,6 +1,10 @@
 #include "socket_class.h"
 #include "sc_mod_def.h"
 
+#ifdef _WIN32
+#define poll					WSAPoll
+#endif
+
 int mod_sc_create( char **args, int argc, sc_t **p_sc ) {
 	socket_class_t *sc;
 	char *key, *val, **arge;
@@ -309,7 +313,7 @@ int mod_sc_create_class( sc_t *socket, const char *pkg, SV **psv ) {
 		return SC_ERROR;
 	}
 	sv = sv_2mortal( (SV *) newHV() );
-	(void) hv_store( (HV *) sv, "_sc_", 4, newSViv( (IV) socket->id ), 0 );
+	socket_class_bind( socket, sv );
 #ifdef SC_DEBUG
 	_debug( "bless socket %d with %s\n", socket->sock, pkg );
 #endif
@@ -322,19 +326,27 @@ void mod_sc_destroy( sc_t *socket ) {
 }
 
 int mod_sc_refcnt_dec( sc_t *socket ) {
-	socket->refcnt --;
-	if( socket->refcnt <= 0 ) {
+	int r;
+	GLOBAL_LOCK();
+	r = -- socket->refcnt;
+	GLOBAL_UNLOCK();
+	if( r <= 0 ) {
+		/* the buffered data goes out before the connection is shut down */
+		SC_OUTBUF_FINISH( socket );
 		if( socket->state == SC_STATE_CONNECTED )
 			shutdown( socket->sock, 2 );
 		socket_class_rem( socket );
 		return 0;
 	}
-	return socket->refcnt;
+	return r;
 }
 
 int mod_sc_refcnt_inc( sc_t *socket ) {
-	socket->refcnt ++;
-	return socket->refcnt;
+	int r;
+	GLOBAL_LOCK();
+	r = ++ socket->refcnt;
+	GLOBAL_UNLOCK();
+	return r;
 }
 
 sc_t *mod_sc_get_socket( SV *sv ) {
@@ -469,6 +481,12 @@ int mod_sc_connect(
 }
 
 int mod_sc_shutdown( sc_t *sock, int how ) {
+	/* the buffered data goes out before sending is disabled, errors of the
+	 * flush do not keep the socket from shutting down */
+	if( how != 0 ) {
+		SC_OUTBUF_FLUSH( sock );
+		sock->outbuf_pos = sock->outbuf_len = 0;
+	}
 	if( shutdown( sock->sock, how ) == SOCKET_ERROR ) {
 		SOCK_ERRNOLAST( sock );
 		sock->state = SC_STATE_ERROR;
@@ -480,14 +498,21 @@ int mod_sc_shutdown( sc_t *sock, int how ) {
 }
 
 int mod_sc_close( sc_t *sock ) {
+	/* errors of the last flush do not keep the socket open */
+	SC_OUTBUF_FLUSH( sock );
+	sock->outbuf_pos = sock->outbuf_len = 0;
+	my_poller_close( sock );
+	my_relay_free( sock );
 	Socket_close( sock->sock );
 	if( sock->s_domain == AF_UNIX ) {
 		remove( ((struct sockaddr_un *) sock->l_addr.a)->sun_path );
 	}
 	SOCK_ERRNO( sock, 0 );
 	sock->state = SC_STATE_CLOSED;
+	sock->rcvbuf_pos = sock->rcvbuf_len = 0;
+	sock->rcvbuf_skip = '\0';
 	memset( &sock->l_addr, 0, sizeof( sock->l_addr ) );
-	memset( &sock->r_addr, 0, sizeof( sock->r_addr ) );
+	/* the remote address is kept for reconnect() */
 	return SC_OK;
 }
 
@@ -600,6 +625,23 @@ int mod_sc_accept( sc_t *sock, sc_t **client ) {
 
 int mod_sc_recv( sc_t *sock, char *buf, int len, int flags, int *p_len ) {
 	int r;
+	/* a response may wait for the buffered request */
+	if( SC_OUTBUF_FLUSH( sock ) == SOCKET_ERROR )
+		return SC_ERROR;
+	if( ! (flags & MSG_OOB) && sock->rcvbuf_skip != '\0'
+		&& SC_RCVBUF_AVAIL( sock ) == 0
+	) {
+		/* a line break may continue, look at the next byte */
+		if( Socket_read_ahead( sock ) == SOCKET_ERROR )
+			goto error;
+	}
+	if( ! (flags & MSG_OOB) && SC_RCVBUF_AVAIL( sock ) > 0 ) {
+		*p_len = Socket_rcvbuf_read( sock, buf, len, flags & MSG_PEEK );
+		if( *p_len > 0 ) {
+			SOCK_ERRNO( sock, 0 );
+			return SC_OK;
+		}
+	}
 	r = recv( sock->sock, buf, (int) len, flags );
 	if( r == SOCKET_ERROR ) {
 		switch( r = Socket_errno() ) {
@@ -629,6 +671,14 @@ error:
 
 int mod_sc_send( sc_t *sock, const char *buf, int len, int flags, int *p_len ) {
 	int r;
+	if( (r = SC_OUTBUF_FLUSH( sock )) != 0 ) {
+		if( r == SOCKET_ERROR )
+			return SC_ERROR;
+		/* buffered data goes first */
+		*p_len = 0;
+		SOCK_ERRNO( sock, 0 );
+		return SC_OK;
+	}
 	r = send( sock->sock, buf, len, flags );
 	if( r == SOCKET_ERROR ) {
 		switch( r = Socket_errno() ) {
@@ -659,6 +709,8 @@ error:
 int mod_sc_recvfrom( sc_t *sock, char *buf, int len, int flags, int *p_len ) {
 	int r;
 	sc_addr_t peer;
+	if( SC_OUTBUF_FLUSH( sock ) == SOCKET_ERROR )
+		return SC_ERROR;
 	peer.l = SOCKADDR_SIZE_MAX;
 	r = recvfrom(
 		sock->sock, buf, len, flags, (struct sockaddr *) peer.a, &peer.l
@@ -730,8 +782,154 @@ error:
 	return SC_ERROR;
 }
 
+int mod_sc_recv_many(
+	sc_t *sock, sc_msg_t *msgs, int count, int flags, int *p_count
+) {
+	int r, i;
+#ifdef SC_USE_MMSG
+	struct mmsghdr *mm;
+	struct iovec *iov;
+	Newxz( mm, count, struct mmsghdr );
+	Newx( iov, count, struct iovec );
+	for( i = 0; i < count; i ++ ) {
+		iov[i].iov_base = msgs[i].buf;
+		iov[i].iov_len = msgs[i].len;
+		mm[i].msg_hdr.msg_iov = &iov[i];
+		mm[i].msg_hdr.msg_iovlen = 1;
+		mm[i].msg_hdr.msg_name = msgs[i].peer.a;
+		mm[i].msg_hdr.msg_namelen = SOCKADDR_SIZE_MAX;
+	}
+	/* block for the first datagram only */
+	r = recvmmsg( sock->sock, mm, count, flags | MSG_WAITFORONE, NULL );
+	for( i = 0; i < r; i ++ ) {
+		msgs[i].len = (int) mm[i].msg_len;
+		msgs[i].peer.l = mm[i].msg_hdr.msg_namelen;
+	}
+	Safefree( mm );
+	Safefree( iov );
+#else
+	socklen_t sl;
+	int len;
+	for( i = 0; i < count; i ++ ) {
+		sl = SOCKADDR_SIZE_MAX;
+		len = recvfrom(
+			sock->sock, msgs[i].buf, msgs[i].len, flags,
+			(struct sockaddr *) msgs[i].peer.a, &sl
+		);
+		if( len == SOCKET_ERROR )
+			break;
+		msgs[i].peer.l = sl;
+		msgs[i].len = len;
+#ifdef MSG_DONTWAIT
+		flags |= MSG_DONTWAIT;
+#else
+		i ++;
+		break;
+#endif
+	}
+	r = i > 0 ? i : SOCKET_ERROR;
+#endif
+	if( r == SOCKET_ERROR ) {
+		switch( r = Socket_errno() ) {
+		case EWOULDBLOCK:
+			/* threat not as an error */
+			*p_count = 0;
+			SOCK_ERRNO( sock, 0 );
+			return SC_OK;
+		default:
+			SOCK_ERRNO( sock, r );
+			goto error;
+		}
+	}
+	/* remember who we received from */
+	Copy( &msgs[r - 1].peer, &sock->r_addr,
+		SC_ADDR_SIZE( msgs[r - 1].peer ), BYTE );
+	*p_count = r;
+	SOCK_ERRNO( sock, 0 );
+	return SC_OK;
+error:
+#ifdef SC_DEBUG
+	_debug( "recv_many error %u\n", sock->last_errno );
+#endif
+	sock->state = SC_STATE_ERROR;
+	return SC_ERROR;
+}
+
+int mod_sc_send_many(
+	sc_t *sock, sc_msg_t *msgs, int count, int flags, int *p_count
+) {
+	int r, i;
+	sc_addr_t *peer;
+#ifdef SC_USE_MMSG
+	struct mmsghdr *mm;
+	struct iovec *iov;
+	Newxz( mm, count, struct mmsghdr );
+	Newx( iov, count, struct iovec );
+	for( i = 0; i < count; i ++ ) {
+		iov[i].iov_base = msgs[i].buf;
+		iov[i].iov_len = msgs[i].len;
+		mm[i].msg_hdr.msg_iov = &iov[i];
+		mm[i].msg_hdr.msg_iovlen = 1;
+		/* no address sends to the connected or last used peer */
+		peer = msgs[i].peer.l > 0 ? &msgs[i].peer : &sock->r_addr;
+		if( peer->l > 0 ) {
+			mm[i].msg_hdr.msg_name = peer->a;
+			mm[i].msg_hdr.msg_namelen = peer->l;
+		}
+	}
+	r = sendmmsg( sock->sock, mm, count, flags );
+	Safefree( mm );
+	Safefree( iov );
+#else
+	int len;
+	for( i = 0; i < count; i ++ ) {
+		peer = msgs[i].peer.l > 0 ? &msgs[i].peer : &sock->r_addr;
+		len = sendto( sock->sock, msgs[i].buf, msgs[i].len, flags,
+			(struct sockaddr *) peer->a, peer->l );
+		if( len == SOCKET_ERROR )
+			break;
+	}
+	r = i > 0 ? i : SOCKET_ERROR;
+#endif
+	if( r == SOCKET_ERROR ) {
+		switch( r = Socket_errno() ) {
+		case EWOULDBLOCK:
+			/* threat not as an error */
+			*p_count = 0;
+			SOCK_ERRNO( sock, 0 );
+			return SC_OK;
+		default:
+			SOCK_ERRNO( sock, r );
+			goto error;
+		}
+	}
+	*p_count = r;
+	SOCK_ERRNO( sock, 0 );
+	return SC_OK;
+error:
+#ifdef SC_DEBUG
+	_debug( "send_many error %u\n", sock->last_errno );
+#endif
+	sock->state = SC_STATE_ERROR;
+	return SC_ERROR;
+}
+
 int mod_sc_read( sc_t *sock, char *buf, int len, int *p_len ) {
 	int r;
+	if( SC_OUTBUF_FLUSH( sock ) == SOCKET_ERROR )
+		return SC_ERROR;
+	if( sock->rcvbuf_skip != '\0' && SC_RCVBUF_AVAIL( sock ) == 0 ) {
+		/* a line break may continue, look at the next byte */
+		if( Socket_read_ahead( sock ) == SOCKET_ERROR )
+			goto error;
+	}
+	if( SC_RCVBUF_AVAIL( sock ) > 0 ) {
+		*p_len = Socket_rcvbuf_read( sock, buf, len, 0 );
+		if( *p_len > 0 ) {
+			SOCK_ERRNO( sock, 0 );
+			return SC_OK;
+		}
+	}
 	r = recv( sock->sock, buf, len, 0 );
 	if( r == SOCKET_ERROR ) {
 		switch( r = Socket_errno() ) {
@@ -760,7 +958,11 @@ error:
 }
 
 int mod_sc_write( sc_t *sock, const char *buf, int len, int *p_len ) {
-	int r = Socket_write( sock, buf, len );
+	int r;
+	if( sock->outbuf_max > 0 )
+		r = Socket_write_buffered( sock, buf, len );
+	else
+		r = Socket_write( sock, buf, len );
 	if( r == SOCKET_ERROR )
 		return SC_ERROR;
 	*p_len = r;
@@ -768,25 +970,375 @@ int mod_sc_write( sc_t *sock, const char *buf, int len, int *p_len ) {
 	return SC_OK;
 }
 
-int mod_sc_writeln( sc_t *sock, const char *buf, int len, int *p_len ) {
-	char *p;
+int mod_sc_set_output_buffer(
+	sc_t *sock, size_t size, int flags, int max_age
+) {
+	int r;
+	if( sock->s_type != SOCK_STREAM ) {
+		SOCK_ERRNO( sock, EINVAL );
+		return SC_ERROR;
+	}
+	if( SC_OUTBUF_PENDING( sock ) > size ) {
+		if( (r = Socket_flush( sock, 0 )) == SOCKET_ERROR )
+			return SC_ERROR;
+		if( (size_t) r > size ) {
+			SOCK_ERRNO( sock, EWOULDBLOCK );
+			return SC_ERROR;
+		}
+	}
+	sock->outbuf_max = size;
+	sock->outbuf_flags = flags;
+	sock->outbuf_max_age = max_age;
+	if( size == 0 ) {
+		Safefree( sock->outbuf );
+		sock->outbuf = NULL;
+		sock->outbuf_size = sock->outbuf_len = sock->outbuf_pos = 0;
+	}
+	SOCK_ERRNO( sock, 0 );
+	return SC_OK;
+}
+
+int mod_sc_flush( sc_t *sock, size_t *p_pending ) {
+	int r = Socket_flush( sock, 0 );
+	if( r == SOCKET_ERROR )
+		return SC_ERROR;
+	*p_pending = (size_t) r;
+	SOCK_ERRNO( sock, 0 );
+	return SC_OK;
+}
+
+size_t mod_sc_get_output_pending( sc_t *sock ) {
+	return SC_OUTBUF_PENDING( sock );
+}
+
+int mod_sc_sendfile(
+	sc_t *sock, int fd, off_t offset, size_t length, size_t *p_len
+) {
+	struct stat st;
+	size_t sent = 0;
 	int r;
+#ifndef SC_USE_SENDFILE
+	char *buf;
+	int len;
+#endif
+	if( (r = SC_OUTBUF_FLUSH( sock )) != 0 ) {
+		if( r == SOCKET_ERROR )
+			return SC_ERROR;
+		/* buffered data goes first */
+		*p_len = 0;
+		SOCK_ERRNO( sock, 0 );
+		return SC_OK;
+	}
+	if( length == 0 ) {
+		/* send up to the end of the file */
+		if( fstat( fd, &st ) != 0 ) {
+			SOCK_ERRNO( sock, errno );
+			return SC_ERROR;
+		}
+		if( st.st_size > offset )
+			length = (size_t) (st.st_size - offset);
+	}
+#ifdef SC_USE_SENDFILE
+	while( sent < length ) {
+		r = (int) sendfile( sock->sock, fd, &offset, length - sent );
+		if( r == SOCKET_ERROR ) {
+			switch( r = Socket_errno() ) {
+			case EINTR:
+				continue;
+			case EWOULDBLOCK:
+				/* treat not as an error */
+				goto finish;
+			default:
+				SOCK_ERRNO( sock, r );
+				goto error;
+			}
+		}
+		if( r == 0 )
+			break;
+		sent += r;
+	}
+#else
+#ifdef _WIN32
+	/* no pread(), the file offset moves */
+	if( lseek( fd, offset, SEEK_SET ) == (off_t) -1 ) {
+		SOCK_ERRNO( sock, errno );
+		goto error;
+	}
+#endif
+	Newx( buf, SC_RCVBUF_CHUNK * 16, char );
+	while( sent < length ) {
+		len = (int) (length - sent < SC_RCVBUF_CHUNK * 16
+			? length - sent : SC_RCVBUF_CHUNK * 16);
+#ifdef _WIN32
+		len = read( fd, buf, len );
+#else
+		/* the file offset of the caller stays, as with sendfile() */
+		len = (int) pread( fd, buf, len, offset + sent );
+#endif
+		if( len <= 0 ) {
+			if( len == 0 )
+				break;
+			SOCK_ERRNO( sock, errno );
+			Safefree( buf );
+			goto error;
+		}
+		r = Socket_write( sock, buf, len );
+		if( r == SOCKET_ERROR ) {
+			Safefree( buf );
+			goto error;
+		}
+		sent += r;
+		if( r < len )
+			break;
+	}
+	Safefree( buf );
+#endif
+finish:
+	*p_len = sent;
+	SOCK_ERRNO( sock, 0 );
+	return SC_OK;
+error:
+#ifdef SC_DEBUG
+	_debug( "sendfile error %u after %u bytes\n", sock->last_errno, sent );
+#endif
+	sock->state = SC_STATE_ERROR;
+	return SC_ERROR;
+}
+
+int mod_sc_writev(
+	sc_t *sock, const sc_iovec_t *vec, int count, int *p_len
+) {
+#ifdef _WIN32
+	WSABUF tmp[SC_IOV_STATIC], *iov;
+	DWORD len;
+#else
+	struct iovec tmp[SC_IOV_STATIC], *iov;
+	struct msghdr msg;
+#endif
+	int i, n, r, sent = 0;
+	size_t total;
+	if( sock->outbuf_max > 0 ) {
+		for( i = 0, total = 0; i < count; i ++ )
+			total += vec[i].len;
+		if( SC_OUTBUF_PENDING( sock ) + total <= sock->outbuf_max ) {
+			for( i = 0; i < count; i ++ ) {
+				r = Socket_write_buffered( sock, vec[i].buf, (int) vec[i].len );
+				if( r == SOCKET_ERROR )
+					return SC_ERROR;
+			}
+			*p_len = (int) total;
+			SOCK_ERRNO( sock, 0 );
+			return SC_OK;
+		}
+		/* buffered data goes first */
+		if( (r = Socket_flush( sock, SC_FLUSH_MORE )) != 0 ) {
+			if( r == SOCKET_ERROR )
+				return SC_ERROR;
+			*p_len = 0;
+			SOCK_ERRNO( sock, 0 );
+			return SC_OK;
+		}
+	}
+	n = count > SC_IOV_MAX ? SC_IOV_MAX : count;
+	if( n > SC_IOV_STATIC ) {
+#ifdef _WIN32
+		Newx( iov, n, WSABUF );
+#else
+		Newx( iov, n, struct iovec );
+#endif
+	}
+	else
+		iov = tmp;
+	/* more chunks than the system takes at once are sent in rounds */
+	for( ; count > 0; count -= n, vec += n ) {
+		if( n > count )
+			n = count;
+		for( i = 0, total = 0; i < n; i ++ ) {
+#ifdef _WIN32
+			iov[i].buf = (char *) vec[i].buf;
+			iov[i].len = (u_long) vec[i].len;
+#else
+			iov[i].iov_base = (void *) vec[i].buf;
+			iov[i].iov_len = vec[i].len;
+#endif
+			total += vec[i].len;
+		}
+#ifdef _WIN32
+		r = WSASend( sock->sock, iov, n, &len, 0, NULL, NULL ) == 0
+			? (int) len : SOCKET_ERROR;
+#else
+		Zero( &msg, 1, struct msghdr );
+		msg.msg_iov = iov;
+		msg.msg_iovlen = n;
+		r = (int) sendmsg( sock->sock, &msg, 0 );
+#endif
+		if( r == SOCKET_ERROR ) {
+			switch( r = Socket_errno() ) {
+			case EWOULDBLOCK:
+				/* treat not as an error */
+				goto finish;
+			default:
+				SOCK_ERRNO( sock, r );
+				goto error;
+			}
+		}
+		sent += r;
+		if( (size_t) r < total )
+			break;
+	}
+finish:
+	if( iov != tmp )
+		Safefree( iov );
+	*p_len = sent;
+	SOCK_ERRNO( sock, 0 );
+	return SC_OK;
+error:
+	if( iov != tmp )
+		Safefree( iov );
+#ifdef SC_DEBUG
+	_debug( "writev error %u\n", sock->last_errno );
+#endif
+	sock->state = SC_STATE_ERROR;
+	return SC_ERROR;
+}
+
+int mod_sc_writeln( sc_t *sock, const char *buf, int len, int *p_len ) {
+	sc_iovec_t vec[2];
 	if( len <= 0 )
 		len = (int) strlen( buf );
-	if( sock->buffer_len < (size_t) len + 2 ) {
-		sock->buffer_len = (size_t) len + 2;
-		Renew( sock->buffer, len, char );
-	}
-	p = sock->buffer;
-	Copy( buf, p, len, char );
-	p[len ++] = '\r';
-	p[len ++] = '\n';
-	r = Socket_write( sock, p, len );
-	if( r == SOCKET_ERROR )
+	vec[0].buf = buf;
+	vec[0].len = (size_t) len;
+	vec[1].buf = "\r\n";
+	vec[1].len = 2;
+	return mod_sc_writev( sock, vec, 2, p_len );
+}
+
+/* waits up to ms milliseconds for the events of poll() on the socket */
+int my_poll_wait( sc_t *sock, int events, double ms ) {
+	struct pollfd pfd;
+	int r;
+	pfd.fd = sock->sock;
+	pfd.events = (short) events;
+	pfd.revents = 0;
+	/* less than a millisecond would not wait at all */
+	r = poll( &pfd, 1, ms < 1 ? 1 : (int) ms );
+	if( r < 0 && (r = Socket_errno()) != EINTR ) {
+		SOCK_ERRNO( sock, r );
 		return SC_ERROR;
-	*p_len = r;
+	}
+	return SC_OK;
+}
+
+int mod_sc_write_all(
+	sc_t *sock, const char *buf, size_t len, double timeout, size_t *p_len
+) {
+	size_t sent = 0;
+	double deadline, ms;
+	int r;
+	if( timeout < 0 )
+		mod_sc_get_timeout( sock, &timeout );
+	deadline = my_time_ms() + timeout;
+	while( sent < len || SC_OUTBUF_PENDING( sock ) > 0 ) {
+		if( SC_OUTBUF_PENDING( sock ) > 0 ) {
+			/* buffered output goes first */
+			r = Socket_flush( sock, SC_FLUSH_DONTWAIT );
+			if( r == SOCKET_ERROR )
+				goto fail;
+			if( r == 0 )
+				continue;
+		}
+		else {
+			r = send( sock->sock, buf + sent, (int) (len - sent),
+				SC_MSG_DONTWAIT );
+			if( r > 0 ) {
+				sent += r;
+				continue;
+			}
+			if( r == 0 ) {
+				SOCK_ERRNO( sock, ECONNRESET );
+				goto error;
+			}
+			if( (r = Socket_errno()) != EWOULDBLOCK ) {
+				SOCK_ERRNO( sock, r );
+				goto error;
+			}
+		}
+		/* wait until the socket takes more data */
+		if( (ms = deadline - my_time_ms()) <= 0 ) {
+			SOCK_ERRNO( sock, ETIMEDOUT );
+			goto fail;
+		}
+		if( my_poll_wait( sock, POLLOUT, ms ) != SC_OK )
+			goto error;
+	}
+	*p_len = sent;
+	SOCK_ERRNO( sock, 0 );
+	return SC_OK;
+error:
+#ifdef SC_DEBUG
+	_debug( "write_all error %u after %u bytes\n", sock->last_errno, sent );
+#endif
+	sock->state = SC_STATE_ERROR;
+fail:
+	*p_len = sent;
+	return SC_ERROR;
+}
+
+int mod_sc_read_exact(
+	sc_t *sock, char *buf, size_t len, double timeout, size_t *p_len
+) {
+	size_t got = 0;
+	double deadline, ms;
+	int r;
+	if( timeout < 0 )
+		mod_sc_get_timeout( sock, &timeout );
+	deadline = my_time_ms() + timeout;
+	/* the peer may wait for buffered output */
+	if( SC_OUTBUF_FLUSH( sock ) == SOCKET_ERROR )
+		goto fail;
+	while( got < len ) {
+		if( SC_RCVBUF_AVAIL( sock ) > 0 ) {
+			got += Socket_rcvbuf_read( sock, buf + got, (int) (len - got), 0 );
+			continue;
+		}
+		r = recv( sock->sock, buf + got, (int) (len - got), SC_MSG_DONTWAIT );
+		if( r > 0 ) {
+			if( sock->rcvbuf_skip != '\0' ) {
+				/* second char of a line break seen by readline */
+				if( buf[got] == sock->rcvbuf_skip )
+					Move( buf + got + 1, buf + got, -- r, char );
+				sock->rcvbuf_skip = '\0';
+			}
+			got += r;
+			continue;
+		}
+		if( r == 0 ) {
+			SOCK_ERRNO( sock, ECONNRESET );
+			goto error;
+		}
+		if( (r = Socket_errno()) != EWOULDBLOCK ) {
+			SOCK_ERRNO( sock, r );
+			goto error;
+		}
+		/* wait for more data */
+		if( (ms = deadline - my_time_ms()) <= 0 ) {
+			SOCK_ERRNO( sock, ETIMEDOUT );
+			goto fail;
+		}
+		if( my_poll_wait( sock, POLLIN, ms ) != SC_OK )
+			goto error;
+	}
+	*p_len = got;
 	SOCK_ERRNO( sock, 0 );
 	return SC_OK;
+error:
+#ifdef SC_DEBUG
+	_debug( "read_exact error %u after %u bytes\n", sock->last_errno, got );
+#endif
+	sock->state = SC_STATE_ERROR;
+fail:
+	*p_len = got;
+	return SC_ERROR;
 }
 
 int mod_sc_printf( sc_t *sock, const char *fmt, ... ) {
@@ -799,9 +1351,8 @@ int mod_sc_printf( sc_t *sock, const char *fmt, ... ) {
 }
 
 int mod_sc_vprintf( sc_t *sock, const char *fmt, va_list vl ) {
-	const char *s, *s2;
-	char *tmp;
-	int isbig, size = (int) strlen( fmt ) + 64, r;
+	char stmp[1024], *tmp = stmp;
+	int size, r;
 	va_list vlc;
 #if defined (va_copy)
 	va_copy( vlc, vl );
@@ -810,164 +1361,100 @@ int mod_sc_vprintf( sc_t *sock, const char *fmt, va_list vl ) {
 #else
 	vlc = vl;
 #endif
-	for( s = fmt; *s != '\0'; s ++ ) {
-		if( *s != '%' )
-			continue;
-		s ++;
-		if( *s == '%' )
-			continue;
-		for( ; *s < 'a' || *s > 'z'; s ++ ) {
-			if( *s == '\0' )
-				goto finish;
-		}
-		isbig = 0;
-again:
-		switch( *s ) {
-		case 'l':
-			isbig = 1;
-			s ++;
-			goto again;
-		case 'c':
-		case 'C':
-			va_arg( vlc, int );
-			size += 4;
-			break;
-		case 'd':
-		case 'i':
-		case 'u':
-		case 'o':
-		case 'x':
-		case 'X':
-			if( isbig ) {
-				va_arg( vlc, XLONG );
-				size += sizeof( XLONG ) / 2 * 5 + 1;
-			}
-			else {
-				va_arg( vlc, long );
-				size += sizeof( long ) / 2 * 5 + 1;
-			}
-			break;
-		case 'a':
-		case 'A':
-		case 'e':
-		case 'E':
-		case 'f':
-		case 'g':
-		case 'G':
-			if( isbig ) {
-				va_arg( vlc, long double );
-				size += 128;
-			}
-			else {
-				va_arg( vlc, double );
-				size += 64;
-			}
-			break;
-		case 's':
-		case 'S':
-			s2 = va_arg( vlc, const char * );
-			size += (int) strlen( s2 );
-			break;
-		case 'p':
-			s2 = va_arg( vlc, const void * );
-			size += sizeof( void * ) / 2 * 5;
-			break;
-		}
-	}
-finish:
+	/* most messages fit on the stack, format again if not */
+#ifdef _WIN32
+	size = _vsnprintf( tmp, sizeof( stmp ), fmt, vlc );
+	if( size < 0 )
+		size = _vscprintf( fmt, vl );
+#else
+	size = vsnprintf( tmp, sizeof( stmp ), fmt, vlc );
+#endif
 	va_end( vlc );
 #ifdef SC_DEBUG
-	_debug( "vprintf size %u\n", size );
+	_debug( "vprintf size %d\n", size );
 #endif
-	Newx( tmp, size, char );
+	if( size < 0 ) {
+		SOCK_ERRNO( sock, EINVAL );
+		return SC_ERROR;
+	}
+	if( (size_t) size >= sizeof( stmp ) ) {
+		Newx( tmp, size + 1, char );
 #ifdef _WIN32
-	size = _vsnprintf( tmp, size, fmt, vl );
+		size = _vsnprintf( tmp, size + 1, fmt, vl );
 #else
-	size = vsnprintf( tmp, size, fmt, vl );
-#endif
-#ifdef SC_DEBUG
-	_debug( "vprintf size %u\n", size );
+		size = vsnprintf( tmp, size + 1, fmt, vl );
 #endif
+	}
 	r = mod_sc_write( sock, tmp, size, &size );
-	Safefree( tmp );
+	if( tmp != stmp )
+		Safefree( tmp );
 	return r;
 }
 
 int mod_sc_readline( sc_t *sock, char **p_buf, int *p_len ) {
 	int r;
-	size_t i, pos = 0, len = 1024;
-	char *p, ch;
-	p = sock->buffer;
+	size_t scan = 0;
+	char *p, *s, *e, ch;
+	if( SC_OUTBUF_FLUSH( sock ) == SOCKET_ERROR )
+		return SC_ERROR;
 	while( 1 ) {
-		if( sock->buffer_len < pos + len ) {
-			sock->buffer_len = pos + len;
-			Renew( sock->buffer, sock->buffer_len, char );
-			p = sock->buffer + pos;
-		}
-		r = recv( sock->sock, p, (int) len, MSG_PEEK );
-#ifdef SC_DEBUG
-		_debug( "recv MSG_PEEK %d = %d\n", len, r );
-#endif
-		if( r == SOCKET_ERROR ) {
-			if( pos > 0 )
-				break;
-			switch( r = Socket_errno() ) {
-			case EWOULDBLOCK:
-				/* threat not as an error */
-				sock->buffer[0] = '\0';
-				*p_buf = sock->buffer;
-				*p_len = 0;
-				SOCK_ERRNO( sock, 0 );
-				return SC_OK;
+		p = sock->rcvbuf + sock->rcvbuf_pos;
+		e = sock->rcvbuf + sock->rcvbuf_len;
+		if( sock->rcvbuf_skip != '\0' && p < e ) {
+			/* second char of a line break from the previous call */
+			if( *p == sock->rcvbuf_skip ) {
+				sock->rcvbuf_pos ++;
+				p ++;
 			}
-			SOCK_ERRNO( sock, r );
-			goto error;
+			sock->rcvbuf_skip = '\0';
 		}
-		else if( r == 0 ) {
-			if( pos > 0 )
-				break;
-			SOCK_ERRNO( sock, ECONNRESET );
-			goto error;
-		}
-		for( i = 0; i < (size_t) r; i ++, p ++ ) {
-			ch = *p;
+		for( s = p + scan; s < e; s ++ ) {
+			ch = *s;
 			if( ch != '\n' && ch != '\r' && ch != '\0' )
 				continue;
 			/* found newline */
 #ifdef SC_DEBUG
-			_debug( "found newline at %d + %d of %d\n", pos, i, r );
+			_debug( "found newline at %d of %d\n", s - p, e - p );
 #endif
-			*p = '\0';
-			*p_buf = sock->buffer;
-			*p_len = (int) (pos + i);
+			*s ++ = '\0';
+			*p_buf = p;
+			*p_len = (int) (s - p - 1);
 			if( ch == '\r' || ch == '\n' ) {
-				if( i < (size_t) r ) {
-					if( p[1] == (ch == '\r' ? '\n' : '\r') )
-						i ++;
+				if( s < e ) {
+					if( *s == (ch == '\r' ? '\n' : '\r') )
+						s ++;
 				}
-				else if( r == (int) len ) {
-					r = recv( sock->sock, p, 1, MSG_PEEK );
-					if( r == 1 && *p == (ch == '\r' ? '\n' : '\r') )
-						recv( sock->sock, p, 1, 0 );
+				else {
+					sock->rcvbuf_skip = (ch == '\r' ? '\n' : '\r');
 				}
 			}
-			recv( sock->sock, sock->buffer + pos, (int) i + 1, 0 );
+			sock->rcvbuf_pos = s - sock->rcvbuf;
+			SOCK_ERRNO( sock, 0 );
 			return SC_OK;
 		}
-		recv( sock->sock, sock->buffer + pos, (int) i, 0 );
-		pos += i;
-		if( r < (int) len ) {
-			/* line not complete.
-			 * next recv could block infinitely.
-			 * stop here?
-			 */
-			break;
+		scan = e - p;
+		r = Socket_read_ahead( sock );
+		if( r > 0 )
+			continue;
+		if( r == 0 ) {
+			/* would block, keep the partial line for the next call */
+			sock->rcvbuf[sock->rcvbuf_len] = '\0';
+			*p_buf = sock->rcvbuf + sock->rcvbuf_len;
+			*p_len = 0;
+			SOCK_ERRNO( sock, 0 );
+			return SC_OK;
 		}
+		if( scan > 0 ) {
+			/* return the last line, the error appears on the next call */
+			p = sock->rcvbuf + sock->rcvbuf_pos;
+			p[scan] = '\0';
+			*p_buf = p;
+			*p_len = (int) scan;
+			sock->rcvbuf_pos = sock->rcvbuf_len;
+			return SC_OK;
+		}
+		goto error;
 	}
-	sock->buffer[pos] = '\0';
-	*p_buf = sock->buffer;
-	*p_len = (int) pos;
-	return SC_OK;
 error:
 #ifdef SC_DEBUG
 	_debug( "readline error %u\n", sock->last_errno );
@@ -980,95 +1467,86 @@ int mod_sc_read_packet(
 	sc_t *sock, char *separator, size_t max, char **p_buf, int *p_len
 ) {
 	int r;
-	size_t i, pos = 0, len = 1024, seplen;
-	char *p, *sep;
-	p = sock->buffer;
-	for( sep = separator, seplen = 0; *sep != '\0'; sep++, seplen++ );
+	size_t scan = 0, seplen, avail;
+	char *p, *s, *e;
+	if( SC_OUTBUF_FLUSH( sock ) == SOCKET_ERROR )
+		return SC_ERROR;
+	seplen = strlen( separator );
 	if( seplen == 0 ) {
 		mod_sc_set_errno( sock, EINVAL );
 		return SC_ERROR;
 	}
-	sep = separator;
 	if( !max )
 		max = (size_t) -1;
 	while( 1 ) {
-		if( sock->buffer_len < pos + len ) {
-			sock->buffer_len = pos + len;
-			Renew( sock->buffer, sock->buffer_len, char );
-			p = sock->buffer + pos;
-		}
-		r = recv( sock->sock, p, (int) len, MSG_PEEK );
-#ifdef SC_DEBUG
-		_debug( "recv MSG_PEEK %d = %d\n", len, r );
-#endif
-		if( r == SOCKET_ERROR ) {
-			if( pos > 0 )
-				break;
-			switch( r = Socket_errno() ) {
-			case EWOULDBLOCK:
-				/* threat not as an error */
-				sock->buffer[0] = '\0';
-				*p_buf = sock->buffer;
-				*p_len = 0;
-				SOCK_ERRNO( sock, 0 );
-				return SC_OK;
-			}
-			SOCK_ERRNO( sock, r );
-			goto error;
-		}
-		else if( r == 0 ) {
-			if( pos > 0 )
+		if( sock->rcvbuf_skip != '\0' && SC_RCVBUF_AVAIL( sock ) > 0 ) {
+			/* line break from a previous readline */
+			if( sock->rcvbuf[sock->rcvbuf_pos] == sock->rcvbuf_skip )
+				sock->rcvbuf_pos ++;
+			sock->rcvbuf_skip = '\0';
+		}
+		p = sock->rcvbuf + sock->rcvbuf_pos;
+		e = sock->rcvbuf + sock->rcvbuf_len;
+		for( s = p + scan; s + seplen <= e; s ++ ) {
+			if( (size_t) (s - p) >= max )
 				break;
-			SOCK_ERRNO( sock, ECONNRESET );
-			goto error;
-		}
-		for( i = 0; i < (size_t) r; i ++, p ++ ) {
-			if( pos + i == max ) {
-#ifdef SC_DEBUG
-				_debug( "packet max size %u reached\n", max );
-#endif
-				*p = '\0';
-				*p_buf = sock->buffer;
-				*p_len = (int) (pos + i);
-				if( i > 0 )
-					recv( sock->sock, sock->buffer + pos, (int) i, 0 );
-				return SC_OK;
-			}
-			if( *p != *sep ) {
-				sep = separator;
-				continue;
-			}
-			sep++;
-			if( *sep != '\0' )
+			if( *s != *separator || memcmp( s, separator, seplen ) != 0 )
 				continue;
 			/* found packet separator */
 #ifdef SC_DEBUG
-			_debug( "found packet separator at %d + %d of %d\n", pos, i, r );
+			_debug( "found packet separator at %d of %d\n", s - p, e - p );
+#endif
+			*s = '\0';
+			*p_buf = p;
+			*p_len = (int) (s - p);
+			sock->rcvbuf_pos = s + seplen - sock->rcvbuf;
+			SOCK_ERRNO( sock, 0 );
+			return SC_OK;
+		}
+		avail = e - p;
+		if( avail >= max ) {
+#ifdef SC_DEBUG
+			_debug( "packet max size %u reached\n", max );
 #endif
-			i++;
-			*p = '\0';
+			/* the terminating zero would overwrite the next packet */
+			if( sock->buffer_len < max + 1 ) {
+				sock->buffer_len = max + 1;
+				Renew( sock->buffer, sock->buffer_len, char );
+			}
+			Copy( p, sock->buffer, max, char );
+			sock->buffer[max] = '\0';
 			*p_buf = sock->buffer;
-			*p_len = (int) (pos + i - seplen);
-			recv( sock->sock, sock->buffer + pos, (int) i, 0 );
+			*p_len = (int) max;
+			sock->rcvbuf_pos += max;
+			SOCK_ERRNO( sock, 0 );
 			return SC_OK;
 		}
-		recv( sock->sock, sock->buffer + pos, (int) i, 0 );
-		pos += i;
-		if( r < (int) len ) {
-			/* packet not complete.
-			 * next recv could block infinitely.
-			 * stop here?
-			 */
-			break;
+		scan = avail >= seplen ? avail - seplen + 1 : 0;
+		r = Socket_read_ahead( sock );
+		if( r > 0 )
+			continue;
+		if( r == 0 ) {
+			/* would block, keep the partial packet for the next call */
+			sock->rcvbuf[sock->rcvbuf_len] = '\0';
+			*p_buf = sock->rcvbuf + sock->rcvbuf_len;
+			*p_len = 0;
+			SOCK_ERRNO( sock, 0 );
+			return SC_OK;
 		}
+		if( avail > 0 ) {
+			/* return the last packet, the error appears on the next call */
+			p = sock->rcvbuf + sock->rcvbuf_pos;
+			p[avail] = '\0';
+			*p_buf = p;
+			*p_len = (int) avail;
+			sock->rcvbuf_pos = sock->rcvbuf_len;
+			return SC_OK;
+		}
+		goto error;
 	}
-	sock->buffer[pos] = '\0';
-	*p_buf = sock->buffer;
-	*p_len = (int) pos;
-	return SC_OK;
 error:
 #ifdef SC_DEBUG
-	_debug( "readline error %u\n", sock->last_errno );
+	_debug( "read_packet error %u\n", sock->last_errno );
 #endif
 	sock->state = SC_STATE_ERROR;
 	return SC_ERROR;
@@ -1078,6 +1556,12 @@ int mod_sc_available( sc_t *sock, int *p_len ) {
 	socklen_t ol = sizeof(int);
 	int r, len;
 	char *tmp;
+	if( SC_RCVBUF_AVAIL( sock ) > 0 ) {
+		/* data in the read-ahead buffer, don't block */
+		*p_len = (int) SC_RCVBUF_AVAIL( sock );
+		SOCK_ERRNO( sock, 0 );
+		return SC_OK;
+	}
 	r = getsockopt( sock->sock, SOL_SOCKET, SO_RCVBUF, (char *) &len, &ol );
 	if( r != 0 ) {
 		SOCK_ERRNOLAST( sock );
@@ -1845,6 +2329,13 @@ int mod_sc_is_readable( sc_t *sock, double timeout, int *readable ) {
 	fd_set fd_socks;
 	struct timeval t;
 	int r;
+	if( SC_RCVBUF_AVAIL( sock ) > 0 ) {
+		SOCK_ERRNO( sock, 0 );
+		*readable = 1;
+		return SC_OK;
+	}
+	if( SC_OUTBUF_FLUSH( sock ) == SOCKET_ERROR )
+		return SC_ERROR;
 	FD_ZERO( &fd_socks );
 	FD_SET( sock->sock, &fd_socks );
 	if( timeout >= 0 ) {
@@ -1927,7 +2418,15 @@ int mod_sc_select(
 		FD_ZERO( &fde );
 		FD_SET( sock->sock, &fde );
 	}
-	if( timeout >= 0 ) {
+	if( dr && SC_OUTBUF_FLUSH( sock ) == SOCKET_ERROR )
+		return SC_ERROR;
+	if( dr && SC_RCVBUF_AVAIL( sock ) > 0 ) {
+		/* data in the read-ahead buffer, only poll the other events */
+		t.tv_sec = 0;
+		t.tv_usec = 0;
+		pt = &t;
+	}
+	else if( timeout >= 0 ) {
 		t.tv_sec = (long) (timeout / 1000);
 		t.tv_usec = (long) (timeout * 1000) % 1000000;
 		pt = &t;
@@ -1948,8 +2447,8 @@ int mod_sc_select(
 		return SC_ERROR;
 	}
 	SOCK_ERRNO( sock, 0 );
-	if( dr  )
-		*read = FD_ISSET( sock->sock, &fdr );
+	if( dr )
+		*read = SC_RCVBUF_AVAIL( sock ) > 0 || FD_ISSET( sock->sock, &fdr );
 	if( dw )
 		*write = FD_ISSET( sock->sock, &fdw );
 	if( de )
@@ -2257,6 +2756,43 @@ void *mod_sc_get_function( int fnc ) {
 }
 */
 
+/* helpers for the perl interface */
+
+/* prepares a scalar to receive up to 'len' bytes at 'offset' like sysread,
+ * returns the position to write to or NULL if the offset is outside
+ * of the string */
+char *my_sv_recv_start( SV *sv, SV *offset, size_t len, STRLEN *p_pos ) {
+	dTHX;
+	STRLEN cur;
+	IV off = 0;
+	char *p;
+	if( ! SvOK( sv ) )
+		sv_setpvn( sv, "", 0 );
+	SvPVbyte_force( sv, cur );
+	if( offset != NULL && SvOK( offset ) ) {
+		off = SvIV( offset );
+		if( off < 0 ) {
+			if( (STRLEN) -off > cur )
+				return NULL;
+			off += cur;
+		}
+	}
+	p = SvGROW( sv, (STRLEN) off + len + 1 );
+	if( (STRLEN) off > cur )
+		Zero( p + cur, (STRLEN) off - cur, char );
+	*p_pos = (STRLEN) off;
+	return p + off;
+}
+
+/* sets the length of the scalar after 'len' bytes have been received */
+void my_sv_recv_end( SV *sv, STRLEN pos, size_t len ) {
+	dTHX;
+	SvCUR_set( sv, pos + len );
+	*SvEND( sv ) = '\0';
+	SvPOK_only( sv );
+	SvSETMAGIC( sv );
+}
+
 const mod_sc_t mod_sc = {
 	XS_VERSION,
 	mod_sc_create,
@@ -2323,4 +2859,21 @@ const mod_sc_t mod_sc = {
 	mod_sc_refcnt_dec,
 	mod_sc_refcnt_inc,
 	mod_sc_read_packet,
+	mod_sc_poller_create,
+	mod_sc_poller_destroy,
+	mod_sc_poller_add,
+	mod_sc_poller_modify,
+	mod_sc_poller_remove,
+	mod_sc_poller_wait,
+	mod_sc_recv_many,
+	mod_sc_send_many,
+	mod_sc_sendfile,
+	mod_sc_relay,
+	mod_sc_proxy,
+	mod_sc_writev,
+	mod_sc_set_output_buffer,
+	mod_sc_flush,
+	mod_sc_get_output_pending,
+	mod_sc_write_all,
+	mod_sc_read_exact,
 };
@@ -19,9 +19,26 @@ int mod_sc_sendto(
 	sc_t *sock, const char *buf, int len, int flags, sc_addr_t *peer,
 	int *p_len
 );
+int mod_sc_recv_many(
+	sc_t *sock, sc_msg_t *msgs, int count, int flags, int *p_count );
+int mod_sc_send_many(
+	sc_t *sock, sc_msg_t *msgs, int count, int flags, int *p_count );
+int mod_sc_sendfile(
+	sc_t *sock, int fd, off_t offset, size_t length, size_t *p_len );
 int mod_sc_read( sc_t *sock, char *buf, int len, int *p_len );
 int mod_sc_write( sc_t *sock, const char *buf, int len, int *p_len );
 int mod_sc_writeln( sc_t *sock, const char *buf, int len, int *p_len );
+int mod_sc_writev(
+	sc_t *sock, const sc_iovec_t *vec, int count, int *p_len );
+int mod_sc_set_output_buffer(
+	sc_t *sock, size_t size, int flags, int max_age );
+int mod_sc_flush( sc_t *sock, size_t *p_pending );
+size_t mod_sc_get_output_pending( sc_t *sock );
+int mod_sc_write_all(
+	sc_t *sock, const char *buf, size_t len, double timeout, size_t *p_len );
+int mod_sc_read_exact(
+	sc_t *sock, char *buf, size_t len, double timeout, size_t *p_len );
+int my_poll_wait( sc_t *sock, int events, double ms );
 int mod_sc_printf( sc_t *sock, const char *fmt, ... );
 int mod_sc_vprintf( sc_t *sock, const char *fmt, va_list vl );
 int mod_sc_readline( sc_t *sock, char **p_buf, int *p_len );
@@ -45,6 +62,8 @@ int mod_sc_gethostbyname(
 void my_addrinfo_set( const sc_addrinfo_t *src, struct addrinfo **res );
 void my_addrinfo_get( const struct addrinfo *src, sc_addrinfo_t **res );
 void my_addrinfo_free( struct addrinfo *res );
+char *my_sv_recv_start( SV *sv, SV *offset, size_t len, STRLEN *p_pos );
+void my_sv_recv_end( SV *sv, STRLEN pos, size_t len );
 #endif
 int mod_sc_getaddrinfo(
 	sc_t *sock, const char *node, const char *service,
@@ -77,6 +96,8 @@ int mod_sc_setsockopt(
 int mod_sc_getsockopt(
 	sc_t *sock, int level, int optname, void *optval, socklen_t *optlen
 );
+int mod_sc_set_timeout( sc_t *sock, double timeout );
+int mod_sc_get_timeout( sc_t *sock, double *timeout );
 int mod_sc_is_readable( sc_t *sock, double timeout, int *readable );
 int mod_sc_is_writable( sc_t *sock, double timeout, int *writable );
 int mod_sc_select(
@@ -98,4 +119,33 @@ void mod_sc_set_error( sc_t *sock, int code, const char *fmt, ... );
 int mod_sc_refcnt_inc( sc_t *socket );
 int mod_sc_refcnt_dec( sc_t *socket );
 
+int mod_sc_poller_create(
+	int size, void (*free_data) (void *data), sc_poller_t **p_poller
+);
+void mod_sc_poller_destroy( sc_poller_t *poller );
+int mod_sc_poller_add(
+	sc_poller_t *poller, sc_t *sock, int events, void *data
+);
+int mod_sc_poller_modify( sc_poller_t *poller, sc_t *sock, int events );
+int mod_sc_poller_remove( sc_poller_t *poller, sc_t *sock );
+int mod_sc_poller_wait(
+	sc_poller_t *poller, double timeout, sc_poll_event_t *events, int max,
+	int *p_count
+);
+int my_poll_events( int events );
+int my_poll_revents( int revents );
+void my_poller_item_free( sc_poller_t *poller, sc_poller_item_t *item );
+void my_poller_close( sc_t *sock );
+void my_poller_purge( sc_poller_t *poller );
+sc_poller_t *my_poller_from_class( SV *sv );
+void my_poller_free_sv( void *data );
+
+int mod_sc_relay( sc_t *from, sc_t *to, size_t max, size_t *p_len );
+int mod_sc_proxy(
+	sc_t *sock, sc_t *other, double timeout, size_t *p_out, size_t *p_in
+);
+int my_relay_init( sc_t *sock );
+void my_relay_free( sc_t *sock );
+int my_relay_flush( sc_t *from, sc_t *to, size_t *p_len );
+
 extern const mod_sc_t mod_sc;
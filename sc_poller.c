@@ -0,0 +1,408 @@
+#include "socket_class.h"
+#include "sc_mod_def.h"
+
+#ifdef _WIN32
+#define poll					WSAPoll
+#endif
+
+#ifdef SC_USE_EPOLL
+
+int my_poll_events( int events ) {
+	int r = 0;
+	if( events & SC_POLL_READ )
+		r |= EPOLLIN;
+	if( events & SC_POLL_WRITE )
+		r |= EPOLLOUT;
+	if( events & SC_POLL_EDGE )
+		r |= EPOLLET;
+	return r;
+}
+
+int my_poll_revents( int revents ) {
+	int r = 0;
+	if( revents & (EPOLLIN | EPOLLPRI) )
+		r |= SC_POLL_READ;
+	if( revents & EPOLLOUT )
+		r |= SC_POLL_WRITE;
+	if( revents & EPOLLERR )
+		r |= SC_POLL_ERROR;
+	if( revents & EPOLLHUP )
+		r |= SC_POLL_HUP;
+	return r;
+}
+
+#else
+
+int my_poll_events( int events ) {
+	int r = 0;
+	if( events & SC_POLL_READ )
+		r |= POLLIN;
+	if( events & SC_POLL_WRITE )
+		r |= POLLOUT;
+	return r;
+}
+
+int my_poll_revents( int revents ) {
+	int r = 0;
+	if( revents & (POLLIN | POLLPRI) )
+		r |= SC_POLL_READ;
+	if( revents & POLLOUT )
+		r |= SC_POLL_WRITE;
+	if( revents & (POLLERR | POLLNVAL) )
+		r |= SC_POLL_ERROR;
+	if( revents & POLLHUP )
+		r |= SC_POLL_HUP;
+	return r;
+}
+
+#endif
+
+void my_poller_item_free( sc_poller_t *poller, sc_poller_item_t *item ) {
+	sc_poller_item_t **pitem;
+	void *data = item->data;
+	if( item->pending ) {
+		for( pitem = &poller->pending; *pitem != NULL;
+			pitem = &(*pitem)->pnext
+		) {
+			if( *pitem == item ) {
+				*pitem = item->pnext;
+				break;
+			}
+		}
+	}
+	if( item->flush ) {
+		for( pitem = &poller->flush; *pitem != NULL;
+			pitem = &(*pitem)->fnext
+		) {
+			if( *pitem == item ) {
+				*pitem = item->fnext;
+				break;
+			}
+		}
+	}
+	/* move the last item into the gap */
+	poller->count --;
+	if( item->index < poller->count ) {
+		poller->items[item->index] = poller->items[poller->count];
+		poller->items[item->index]->index = item->index;
+#ifndef SC_USE_EPOLL
+		poller->fds[item->index] = poller->fds[poller->count];
+#endif
+	}
+	item->sock->poll_item = NULL;
+	Safefree( item );
+	/* the data may hold the last reference to the socket */
+	if( data != NULL && poller->free_data != NULL )
+		poller->free_data( data );
+}
+
+int mod_sc_poller_create(
+	int size, void (*free_data) (void *data), sc_poller_t **p_poller
+) {
+	sc_poller_t *poller;
+	Newxz( poller, 1, sc_poller_t );
+	if( size < 16 )
+		size = 16;
+#ifdef SC_USE_EPOLL
+	poller->epfd = epoll_create( size );
+	if( poller->epfd < 0 ) {
+		GLOBAL_ERRNOLAST();
+		Safefree( poller );
+		return SC_ERROR;
+	}
+	fcntl( poller->epfd, F_SETFD, FD_CLOEXEC );
+#else
+	Newx( poller->fds, size, struct pollfd );
+#endif
+	Newx( poller->items, size, sc_poller_item_t * );
+	poller->size = size;
+	poller->free_data = free_data;
+#ifdef USE_ITHREADS
+	poller->owner = (void *) PERL_GET_THX;
+#endif
+#ifdef SC_DEBUG
+	_debug( "created poller %p size %d\n", poller, size );
+#endif
+	*p_poller = poller;
+	return SC_OK;
+}
+
+void mod_sc_poller_destroy( sc_poller_t *poller ) {
+#ifdef SC_DEBUG
+	_debug( "destroy poller %p with %d sockets\n", poller, poller->count );
+#endif
+	while( poller->count > 0 )
+		my_poller_item_free( poller, poller->items[poller->count - 1] );
+#ifdef SC_USE_EPOLL
+	close( poller->epfd );
+	Safefree( poller->events );
+#else
+	Safefree( poller->fds );
+#endif
+	Safefree( poller->items );
+	Safefree( poller->ready );
+	Safefree( poller );
+}
+
+int mod_sc_poller_add(
+	sc_poller_t *poller, sc_t *sock, int events, void *data
+) {
+	sc_poller_item_t *item;
+#ifdef SC_USE_EPOLL
+	struct epoll_event ev;
+#endif
+	if( sock->poll_item != NULL ) {
+		/* a socket can be watched by one poller only */
+		SOCK_ERRNO( sock, sock->poll_item->poller == poller ? EEXIST : EBUSY );
+		return SC_ERROR;
+	}
+#ifndef SC_USE_EPOLL
+	if( events & SC_POLL_EDGE ) {
+		/* poll() knows no edge triggered mode */
+		SOCK_ERRNO( sock, EINVAL );
+		return SC_ERROR;
+	}
+#endif
+	Newxz( item, 1, sc_poller_item_t );
+#ifdef SC_USE_EPOLL
+	ev.events = (unsigned int) my_poll_events( events );
+	ev.data.ptr = item;
+	if( epoll_ctl( poller->epfd, EPOLL_CTL_ADD, sock->sock, &ev ) != 0 ) {
+		SOCK_ERRNOLAST( sock );
+		Safefree( item );
+		return SC_ERROR;
+	}
+#endif
+	if( poller->count == poller->size ) {
+		poller->size *= 2;
+		Renew( poller->items, poller->size, sc_poller_item_t * );
+#ifndef SC_USE_EPOLL
+		Renew( poller->fds, poller->size, struct pollfd );
+#endif
+	}
+	item->poller = poller;
+	item->sock = sock;
+	item->fd = sock->sock;
+	item->data = data;
+	item->events = events;
+	item->index = poller->count;
+	poller->items[poller->count] = item;
+#ifndef SC_USE_EPOLL
+	poller->fds[poller->count].fd = item->fd;
+	poller->fds[poller->count].events = (short) my_poll_events( events );
+	poller->fds[poller->count].revents = 0;
+#endif
+	poller->count ++;
+	sock->poll_item = item;
+	if( SC_RCVBUF_AVAIL( sock ) > 0 )
+		SC_POLLER_PENDING( item );
+	if( SC_OUTBUF_PENDING( sock ) > 0 )
+		SC_POLLER_FLUSH( item );
+	SOCK_ERRNO( sock, 0 );
+	return SC_OK;
+}
+
+int mod_sc_poller_modify( sc_poller_t *poller, sc_t *sock, int events ) {
+	sc_poller_item_t *item = sock->poll_item;
+#ifdef SC_USE_EPOLL
+	struct epoll_event ev;
+#endif
+	if( item == NULL || item->poller != poller ) {
+		SOCK_ERRNO( sock, ENOENT );
+		return SC_ERROR;
+	}
+#ifndef SC_USE_EPOLL
+	if( events & SC_POLL_EDGE ) {
+		SOCK_ERRNO( sock, EINVAL );
+		return SC_ERROR;
+	}
+#endif
+#ifdef SC_USE_EPOLL
+	ev.events = (unsigned int) my_poll_events( events );
+	ev.data.ptr = item;
+	if( epoll_ctl( poller->epfd, EPOLL_CTL_MOD, item->fd, &ev ) != 0 ) {
+		SOCK_ERRNOLAST( sock );
+		return SC_ERROR;
+	}
+#else
+	poller->fds[item->index].events = (short) my_poll_events( events );
+#endif
+	item->events = events;
+	if( SC_RCVBUF_AVAIL( sock ) > 0 )
+		SC_POLLER_PENDING( item );
+	SOCK_ERRNO( sock, 0 );
+	return SC_OK;
+}
+
+int mod_sc_poller_remove( sc_poller_t *poller, sc_t *sock ) {
+	sc_poller_item_t *item = sock->poll_item;
+#ifdef SC_USE_EPOLL
+	struct epoll_event ev;
+#endif
+	if( item == NULL || item->poller != poller ) {
+		SOCK_ERRNO( sock, ENOENT );
+		return SC_ERROR;
+	}
+#ifdef SC_USE_EPOLL
+	/* the descriptor is gone already if another thread closed it */
+	if( item->fd != INVALID_SOCKET )
+		epoll_ctl( poller->epfd, EPOLL_CTL_DEL, item->fd, &ev );
+#endif
+	my_poller_item_free( poller, item );
+	SOCK_ERRNO( sock, 0 );
+	return SC_OK;
+}
+
+/* takes the socket out of its poller before the descriptor is closed */
+void my_poller_close( sc_t *sock ) {
+	sc_poller_item_t *item = sock->poll_item;
+#ifdef SC_USE_EPOLL
+	struct epoll_event ev;
+#endif
+	if( item == NULL )
+		return;
+	if( SC_POLLER_OWNED( item->poller ) ) {
+		mod_sc_poller_remove( item->poller, sock );
+		return;
+	}
+	/* the poller of another thread frees the item in its next call, until
+	 * then it must not wait for the descriptor, the number may be reused */
+#ifdef SC_USE_EPOLL
+	if( item->fd != INVALID_SOCKET )
+		epoll_ctl( item->poller->epfd, EPOLL_CTL_DEL, item->fd, &ev );
+#endif
+	item->fd = INVALID_SOCKET;
+	item->poller->closed = TRUE;
+}
+
+/* frees the items of sockets closed by other threads */
+void my_poller_purge( sc_poller_t *poller ) {
+	int i;
+	if( ! poller->closed )
+		return;
+	poller->closed = FALSE;
+	/* the last item moves into the gap, it has been checked already */
+	for( i = poller->count - 1; i >= 0; i -- ) {
+		if( i < poller->count && poller->items[i]->fd == INVALID_SOCKET )
+			my_poller_item_free( poller, poller->items[i] );
+	}
+}
+
+int mod_sc_poller_wait(
+	sc_poller_t *poller, double timeout, sc_poll_event_t *events, int max,
+	int *p_count
+) {
+	sc_poller_item_t *item, **pitem;
+	int r, i, count = 0, ms;
+#ifdef SC_USE_EPOLL
+	struct epoll_event *ev;
+#endif
+	my_poller_purge( poller );
+	/* the peers may wait for buffered output before they answer,
+	 * errors show up as events of the socket */
+	while( (item = poller->flush) != NULL ) {
+		poller->flush = item->fnext;
+		item->flush = FALSE;
+		SC_OUTBUF_FLUSH( item->sock );
+	}
+	/* data in the read-ahead buffer is not seen by the kernel */
+	pitem = &poller->pending;
+	while( (item = *pitem) != NULL ) {
+		if( SC_RCVBUF_AVAIL( item->sock ) == 0 ) {
+			item->pending = FALSE;
+			*pitem = item->pnext;
+			continue;
+		}
+		if( (item->events & SC_POLL_READ) && count < max ) {
+			item->reported = TRUE;
+			item->slot = count;
+			events[count].sock = item->sock;
+			events[count].data = item->data;
+			events[count].events = SC_POLL_READ;
+			count ++;
+		}
+		pitem = &item->pnext;
+	}
+	if( count > 0 )
+		ms = 0;
+	else if( timeout < 0 )
+		ms = -1;
+	else
+		ms = (int) timeout;
+	if( count < max ) {
+#ifdef SC_USE_EPOLL
+		if( poller->events_size < max - count ) {
+			poller->events_size = max - count;
+			Renew( poller->events, poller->events_size, struct epoll_event );
+		}
+		r = epoll_wait( poller->epfd, poller->events, max - count, ms );
+#else
+		/* sockets closed by another thread are skipped */
+		for( i = 0; i < poller->count; i ++ )
+			poller->fds[i].fd = poller->items[i]->fd;
+		r = poll( poller->fds, poller->count, ms );
+#endif
+		if( r < 0 ) {
+			if( (r = Socket_errno()) != EINTR ) {
+				GLOBAL_ERRNO( r );
+				goto error;
+			}
+			r = 0;
+		}
+#ifdef SC_USE_EPOLL
+		for( i = 0, ev = poller->events; i < r; i ++, ev ++ ) {
+			item = (sc_poller_item_t *) ev->data.ptr;
+#else
+		for( i = 0; r > 0 && i < poller->count && count < max; i ++ ) {
+			if( poller->fds[i].revents == 0 )
+				continue;
+			r --;
+			item = poller->items[i];
+#endif
+			if( item->reported ) {
+#ifdef SC_USE_EPOLL
+				events[item->slot].events |= my_poll_revents( (int) ev->events );
+#else
+				events[item->slot].events |=
+					my_poll_revents( poller->fds[i].revents );
+#endif
+				continue;
+			}
+			events[count].sock = item->sock;
+			events[count].data = item->data;
+#ifdef SC_USE_EPOLL
+			events[count].events = my_poll_revents( (int) ev->events );
+#else
+			events[count].events = my_poll_revents( poller->fds[i].revents );
+#endif
+			count ++;
+		}
+	}
+	for( item = poller->pending; item != NULL; item = item->pnext )
+		item->reported = FALSE;
+	*p_count = count;
+	return SC_OK;
+error:
+	for( item = poller->pending; item != NULL; item = item->pnext )
+		item->reported = FALSE;
+#ifdef SC_DEBUG
+	_debug( "poller wait error %d\n", sc_global.last_errno );
+#endif
+	return SC_ERROR;
+}
+
+/* helpers for the perl interface */
+
+sc_poller_t *my_poller_from_class( SV *sv ) {
+	if( ! SvROK( sv ) || ! sv_derived_from( sv, "Socket::Class::Poller" ) )
+		return NULL;
+	sv = SvRV( sv );
+	if( ! SvIOK( sv ) )
+		return NULL;
+	return INT2PTR( sc_poller_t *, SvIV( sv ) );
+}
+
+void my_poller_free_sv( void *data ) {
+	dTHX;
+	SvREFCNT_dec( (SV *) data );
+}
@@ -0,0 +1,248 @@
+#include "socket_class.h"
+#include "sc_mod_def.h"
+
+#ifdef _WIN32
+#define poll					WSAPoll
+#endif
+
+/* data of 'from' waits until 'to' is writable */
+#define SC_RELAY_WAITING(from,to) \
+	((from)->relay->pending > 0 || SC_OUTBUF_PENDING( to ) > 0 \
+		|| SC_RCVBUF_AVAIL( from ) > 0)
+
+int my_relay_init( sc_t *sock ) {
+	sc_relay_t *relay;
+#ifdef SC_USE_SPLICE
+	int i;
+#endif
+	Newxz( relay, 1, sc_relay_t );
+#ifdef SC_USE_SPLICE
+	if( pipe( relay->pipe ) != 0 ) {
+		SOCK_ERRNO( sock, errno );
+		Safefree( relay );
+		return SC_ERROR;
+	}
+	for( i = 0; i < 2; i ++ ) {
+		fcntl( relay->pipe[i], F_SETFD, FD_CLOEXEC );
+		fcntl( relay->pipe[i], F_SETFL, O_NONBLOCK );
+	}
+#endif
+#ifdef SC_DEBUG
+	_debug( "created relay for socket %d\n", sock->sock );
+#endif
+	sock->relay = relay;
+	return SC_OK;
+}
+
+void my_relay_free( sc_t *sock ) {
+	if( sock->relay == NULL )
+		return;
+#ifdef SC_USE_SPLICE
+	close( sock->relay->pipe[0] );
+	close( sock->relay->pipe[1] );
+#endif
+	Safefree( sock->relay );
+	sock->relay = NULL;
+}
+
+/* writes data left in the relay of 'from' to 'to' */
+int my_relay_flush( sc_t *from, sc_t *to, size_t *p_len ) {
+	sc_relay_t *relay = from->relay;
+	int r;
+	while( relay->pending > 0 ) {
+#ifdef SC_USE_SPLICE
+		r = (int) splice( relay->pipe[0], NULL, to->sock, NULL,
+			relay->pending, SPLICE_F_MOVE | SPLICE_F_NONBLOCK );
+		if( r < 0 ) {
+			switch( r = errno ) {
+			case EINTR:
+				continue;
+			case EAGAIN:
+				return SC_OK;
+			default:
+				SOCK_ERRNO( to, r );
+				to->state = SC_STATE_ERROR;
+				return SC_ERROR;
+			}
+		}
+#else
+		r = Socket_write( to, relay->buf + relay->pos, (int) relay->pending );
+		if( r == SOCKET_ERROR )
+			return SC_ERROR;
+		relay->pos += r;
+#endif
+		if( r == 0 )
+			break;
+		relay->pending -= r;
+		*p_len += r;
+	}
+	return SC_OK;
+}
+
+int mod_sc_relay( sc_t *from, sc_t *to, size_t max, size_t *p_len ) {
+	sc_relay_t *relay;
+	size_t moved = 0, len;
+	int r;
+	if( from->relay == NULL && my_relay_init( from ) != SC_OK )
+		return SC_ERROR;
+	relay = from->relay;
+	if( max == 0 )
+		max = SC_RELAY_CHUNK;
+	/* buffered output of the target goes first */
+	if( (r = SC_OUTBUF_FLUSH( to )) != 0 ) {
+		if( r == SOCKET_ERROR )
+			goto error_to;
+		goto finish;
+	}
+	/* data left from an earlier call goes first */
+	if( my_relay_flush( from, to, &moved ) != SC_OK )
+		goto error_to;
+	if( relay->pending > 0 )
+		goto finish;
+	/* data already in the read-ahead buffer */
+	if( from->rcvbuf_skip != '\0' && SC_RCVBUF_AVAIL( from ) > 0 ) {
+		if( from->rcvbuf[from->rcvbuf_pos] == from->rcvbuf_skip )
+			from->rcvbuf_pos ++;
+		from->rcvbuf_skip = '\0';
+	}
+	if( (len = SC_RCVBUF_AVAIL( from )) > 0 ) {
+		if( len > max )
+			len = max;
+		r = Socket_write( to, from->rcvbuf + from->rcvbuf_pos, (int) len );
+		if( r == SOCKET_ERROR )
+			goto error_to;
+		from->rcvbuf_pos += r;
+		moved += r;
+		goto finish;
+	}
+	while( moved < max ) {
+		len = max - moved;
+		if( len > SC_RELAY_CHUNK )
+			len = SC_RELAY_CHUNK;
+#ifdef SC_USE_SPLICE
+		r = (int) splice( from->sock, NULL, relay->pipe[1], NULL, len,
+			SPLICE_F_MOVE | SPLICE_F_NONBLOCK );
+#else
+		r = recv( from->sock, relay->buf, (int) len, 0 );
+#endif
+		if( r == SOCKET_ERROR ) {
+			switch( r = Socket_errno() ) {
+			case EINTR:
+				continue;
+			case EWOULDBLOCK:
+				/* treat not as an error */
+				goto finish;
+			default:
+				SOCK_ERRNO( from, r );
+				goto error;
+			}
+		}
+		else if( r == 0 ) {
+			/* end of stream, report it with the next call */
+			if( moved > 0 )
+				goto finish;
+			*p_len = 0;
+			SOCK_ERRNO( from, 0 );
+			return SC_EOF;
+		}
+#ifndef SC_USE_SPLICE
+		relay->pos = 0;
+#endif
+		relay->pending = r;
+		if( my_relay_flush( from, to, &moved ) != SC_OK )
+			goto error_to;
+		/* a blocking socket would wait for more data */
+		if( relay->pending > 0 || ! from->non_blocking )
+			break;
+	}
+finish:
+	*p_len = moved;
+	SOCK_ERRNO( from, 0 );
+	return SC_OK;
+error_to:
+	/* the caller looks at the source socket */
+	SOCK_ERRNO( from, to->last_errno );
+	return SC_ERROR;
+error:
+#ifdef SC_DEBUG
+	_debug( "relay error %u after %u bytes\n", from->last_errno, moved );
+#endif
+	from->state = SC_STATE_ERROR;
+	return SC_ERROR;
+}
+
+int mod_sc_proxy(
+	sc_t *sock, sc_t *other, double timeout, size_t *p_out, size_t *p_in
+) {
+	sc_t *socks[2];
+	struct pollfd fds[2];
+	size_t moved[2] = { 0, 0 }, len;
+	BYTE done[2] = { FALSE, FALSE };
+	int i, r, ms;
+	socks[0] = sock;
+	socks[1] = other;
+	for( i = 0; i < 2; i ++ ) {
+		if( socks[i]->relay == NULL && my_relay_init( socks[i] ) != SC_OK ) {
+			if( i == 1 )
+				SOCK_ERRNO( sock, other->last_errno );
+			return SC_ERROR;
+		}
+	}
+	ms = timeout < 0 ? -1 : (int) timeout;
+	while( ! done[0] || ! done[1] ) {
+		for( i = 0; i < 2; i ++ )
+			fds[i].events = fds[i].revents = 0;
+		for( i = 0; i < 2; i ++ ) {
+			/* data in the read-ahead buffer is not seen by the kernel,
+			 * like data left in the relay it waits for the target */
+			if( SC_RELAY_WAITING( socks[i], socks[1 - i] ) )
+				fds[1 - i].events |= POLLOUT;
+			else if( ! done[i] )
+				fds[i].events |= POLLIN;
+		}
+		for( i = 0; i < 2; i ++ )
+			fds[i].fd = fds[i].events != 0 ? socks[i]->sock : INVALID_SOCKET;
+		r = poll( fds, 2, ms );
+		if( r < 0 ) {
+			if( (r = Socket_errno()) == EINTR )
+				continue;
+			SOCK_ERRNO( sock, r );
+			return SC_ERROR;
+		}
+		if( r == 0 ) {
+			/* nothing happened within the timeout */
+			*p_out = moved[0];
+			*p_in = moved[1];
+			SOCK_ERRNO( sock, ETIMEDOUT );
+			return SC_OK;
+		}
+		for( i = 0; i < 2; i ++ ) {
+			if( done[i] && socks[i]->relay->pending == 0 )
+				continue;
+			if( SC_RELAY_WAITING( socks[i], socks[1 - i] ) ) {
+				if( fds[1 - i].revents == 0 )
+					continue;
+			}
+			else if( fds[i].revents == 0 )
+				continue;
+			len = 0;
+			r = mod_sc_relay( socks[i], socks[1 - i], 0, &len );
+			if( r == SC_EOF ) {
+				/* end of stream, pass it on to the other side */
+				done[i] = TRUE;
+				shutdown( socks[1 - i]->sock, 1 );
+				continue;
+			}
+			if( r != SC_OK ) {
+				if( i == 1 )
+					SOCK_ERRNO( sock, other->last_errno );
+				return SC_ERROR;
+			}
+			moved[i] += len;
+		}
+	}
+	*p_out = moved[0];
+	*p_in = moved[1];
+	SOCK_ERRNO( sock, 0 );
+	return SC_OK;
+}
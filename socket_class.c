@@ -1,4 +1,5 @@
 #include "socket_class.h"
+#include "sc_mod_def.h"
 
 sc_global_t sc_global;
 
@@ -7,10 +8,6 @@ INLINE void socket_class_add( socket_class_t *sc ) {
 	GLOBAL_LOCK();
 	sc->id = ++sc_global.counter;
 	sc->refcnt = 1;
-#ifdef USE_ITHREADS
-	sc->thread_id = THREAD_ID();
-	sc->do_clone = TRUE;
-#endif
 	i = sc->id & SC_CASCADE;
 #ifdef SC_DEBUG
 	_debug( "add sc %lu cascade %lu\n", sc->id, i );
@@ -20,18 +17,28 @@ INLINE void socket_class_add( socket_class_t *sc ) {
 	GLOBAL_UNLOCK();
 }
 
-INLINE void socket_class_free( socket_class_t *sc ) {
+INLINE void socket_class_cleanup( socket_class_t *sc ) {
 #ifdef SC_DEBUG
 	_debug( "free sc %lu socket %d\n", sc->id, sc->sock );
 #endif
+	my_poller_close( sc );
+	my_relay_free( sc );
 	if( sc->user_data != NULL && sc->free_user_data != NULL )
 		sc->free_user_data( sc->user_data );
+	/* try to send what is left in the output buffer */
+	SC_OUTBUF_FINISH( sc );
 	Socket_close( sc->sock );
 	if( sc->s_domain == AF_UNIX ) {
 		remove( ((struct sockaddr_un *) sc->l_addr.a)->sun_path );
 	}
 	Safefree( sc->buffer );
+	Safefree( sc->rcvbuf );
+	Safefree( sc->outbuf );
 	Safefree( sc->classname );
+}
+
+INLINE void socket_class_free( socket_class_t *sc ) {
+	socket_class_cleanup( sc );
 	Safefree( sc );
 }
 
@@ -55,45 +62,94 @@ INLINE void socket_class_rem( socket_class_t *sc ) {
 		cc = cc->next;
 	}
 	GLOBAL_UNLOCK();
-	socket_class_free( sc );
+	socket_class_cleanup( sc );
+	/* the structure stays alive while perl objects are bound to it */
+	GLOBAL_LOCK();
+	sc->removed = TRUE;
+	if( sc->bound <= 0 )
+		Safefree( sc );
+	GLOBAL_UNLOCK();
+}
+
+static int socket_class_mg_free( pTHX_ SV *sv, MAGIC *mg ) {
+	socket_class_t *sc = (socket_class_t *) mg->mg_ptr;
+	(void) sv; /* avoid compiler warning */
+	if( sc_global.destroyed || sc == NULL )
+		return 0;
+	GLOBAL_LOCK();
+	sc->bound --;
+	if( sc->bound <= 0 && sc->removed )
+		Safefree( sc );
+	GLOBAL_UNLOCK();
+	mg->mg_ptr = NULL;
+	return 0;
+}
+
+#ifdef USE_ITHREADS
+
+static int socket_class_mg_dup( pTHX_ MAGIC *mg, CLONE_PARAMS *param ) {
+	socket_class_t *sc = (socket_class_t *) mg->mg_ptr;
+	(void) param; /* avoid compiler warning */
+	if( sc == NULL )
+		return 0;
+	/* the object in the new thread holds a reference as well */
+	GLOBAL_LOCK();
+	sc->bound ++;
+	sc->refcnt ++;
+	GLOBAL_UNLOCK();
+	return 0;
+}
+
+#endif
+
+static MGVTBL socket_class_mg_vtbl = {
+	NULL, NULL, NULL, NULL,
+	socket_class_mg_free,
+	NULL,
+#ifdef USE_ITHREADS
+	socket_class_mg_dup,
+#else
+	NULL,
+#endif
+	NULL
+};
+
+INLINE void socket_class_bind( socket_class_t *sc, SV *sv ) {
+	MAGIC *mg;
+	GLOBAL_LOCK();
+	sc->bound ++;
+	GLOBAL_UNLOCK();
+	mg = sv_magicext( sv, NULL, PERL_MAGIC_ext, &socket_class_mg_vtbl,
+		(const char *) sc, 0 );
+#ifdef USE_ITHREADS
+	mg->mg_flags |= MGf_DUP;
+#else
+	(void) mg;
+#endif
 }
 
 INLINE socket_class_t *socket_class_find( SV *sv ) {
-	int i;
+	MAGIC *mg;
 	socket_class_t *sc;
-	u_long id;
-	SV **psv;
 	if( sc_global.destroyed )
 		return NULL;
 	if( ! SvROK( sv ) )
 		return NULL;
 	sv = SvRV( sv );
-	if( SvTYPE( sv ) != SVt_PVHV )
+	if( SvTYPE( sv ) < SVt_PVMG )
 		return NULL;
-	psv = hv_fetch( (HV *) sv, "_sc_", 4, 0 );
-	if( psv == NULL )
-		return NULL;
-	sv = *psv;
-	if( !SvIOK( sv ) )
-		return NULL;
-	id = (int) SvIV( sv );
-	i = id & SC_CASCADE;
-	/*
-#ifdef SC_DEBUG
-	_debug( "search sc %d, cascade %d\n", id, cascade );
-#endif
-	*/
-	GLOBAL_LOCK();
-	for( sc = sc_global.socket[i]; sc != NULL; sc = sc->next ) {
-		if( sc->id == id )
-			goto found;
+	/* no lock here, the object holds a reference on the structure */
+	for( mg = SvMAGIC( sv ); mg != NULL; mg = mg->mg_moremagic ) {
+		if( mg->mg_type == PERL_MAGIC_ext
+			&& mg->mg_virtual == &socket_class_mg_vtbl
+		) {
+			sc = (socket_class_t *) mg->mg_ptr;
+			if( sc == NULL || sc->removed )
+				return NULL;
+			return sc;
+		}
 	}
-#ifdef SC_DEBUG
-	_debug( "sc %d NOT found\n", id );
-#endif
-found:
-	GLOBAL_UNLOCK();
-	return sc;
+	return NULL;
 }
 
 #ifdef _WIN32
@@ -445,6 +501,168 @@ error:
 	return SOCKET_ERROR;
 }
 
+/* sends the output buffer, flags is a combination of SC_FLUSH_*
+ * returns the number of bytes left if the operation would block
+ * or SOCKET_ERROR */
+INLINE int Socket_flush( socket_class_t *sc, int flags ) {
+	int r, sf = 0;
+	/* a blocking socket does not wait either */
+	if( flags & SC_FLUSH_DONTWAIT )
+		sf = SC_MSG_DONTWAIT;
+#ifdef MSG_MORE
+	/* let the kernel wait for the following data too */
+	if( (flags & SC_FLUSH_MORE) && (sc->outbuf_flags & SC_OUTPUT_CORK) )
+		sf |= MSG_MORE;
+#endif
+	while( sc->outbuf_pos < sc->outbuf_len ) {
+		r = send( sc->sock, sc->outbuf + sc->outbuf_pos,
+			(int) SC_OUTBUF_PENDING( sc ), sf );
+		if( r == SOCKET_ERROR ) {
+			switch( r = Socket_errno() ) {
+			case EWOULDBLOCK:
+				/* treat not as an error */
+				return (int) SC_OUTBUF_PENDING( sc );
+			default:
+				SOCK_ERRNO( sc, r );
+				sc->state = SC_STATE_ERROR;
+#ifdef SC_DEBUG
+				_debug( "flush error %u\n", sc->last_errno );
+#endif
+				return SOCKET_ERROR;
+			}
+		}
+		sc->outbuf_pos += r;
+	}
+	sc->outbuf_pos = sc->outbuf_len = 0;
+	return 0;
+}
+
+/* appends data to the output buffer, the buffer is sent when it would
+ * run over the high-water mark
+ * returns the number of bytes taken, 0 if the operation would block
+ * or SOCKET_ERROR */
+INLINE int Socket_write_buffered(
+	socket_class_t *sc, const char *buf, int len
+) {
+	size_t size;
+	if( SC_OUTBUF_PENDING( sc ) + len > sc->outbuf_max ) {
+		if( Socket_flush( sc, SC_FLUSH_MORE ) == SOCKET_ERROR )
+			return SOCKET_ERROR;
+		if( SC_OUTBUF_PENDING( sc ) == 0 && (size_t) len >= sc->outbuf_max ) {
+			/* too large to be buffered */
+			return Socket_write( sc, buf, len );
+		}
+		/* take what fits in non-blocking mode */
+		if( SC_OUTBUF_PENDING( sc ) + len > sc->outbuf_max )
+			len = (int) (sc->outbuf_max - SC_OUTBUF_PENDING( sc ));
+		if( len == 0 )
+			return 0;
+	}
+	if( sc->outbuf_len + len > sc->outbuf_size ) {
+		if( sc->outbuf_pos > 0 ) {
+			/* move unsent data to the front */
+			sc->outbuf_len -= sc->outbuf_pos;
+			Move( sc->outbuf + sc->outbuf_pos, sc->outbuf, sc->outbuf_len,
+				char );
+			sc->outbuf_pos = 0;
+		}
+		if( sc->outbuf_len + len > sc->outbuf_size ) {
+			size = sc->outbuf_size * 2;
+			if( size < sc->outbuf_len + len )
+				size = sc->outbuf_len + len;
+			if( size > sc->outbuf_max )
+				size = sc->outbuf_max;
+			sc->outbuf_size = size;
+			Renew( sc->outbuf, size, char );
+		}
+	}
+	if( sc->outbuf_max_age > 0 && SC_OUTBUF_PENDING( sc ) == 0 )
+		sc->outbuf_time = my_time_ms();
+	Copy( buf, sc->outbuf + sc->outbuf_len, len, char );
+	sc->outbuf_len += len;
+	if( sc->poll_item != NULL )
+		SC_POLLER_FLUSH( sc->poll_item );
+	if( sc->outbuf_max_age > 0
+		&& my_time_ms() - sc->outbuf_time >= sc->outbuf_max_age
+	) {
+		/* the oldest data has waited long enough */
+		if( Socket_flush( sc, 0 ) == SOCKET_ERROR )
+			return SOCKET_ERROR;
+	}
+	return len;
+}
+
+/* appends data from the socket to the read-ahead buffer
+ * returns the number of bytes received, 0 if the operation would block
+ * or SOCKET_ERROR */
+INLINE int Socket_read_ahead( socket_class_t *sc ) {
+	int r;
+	size_t size;
+	if( sc->rcvbuf_pos == sc->rcvbuf_len )
+		sc->rcvbuf_pos = sc->rcvbuf_len = 0;
+	if( sc->rcvbuf_size - sc->rcvbuf_len <= SC_RCVBUF_CHUNK ) {
+		if( sc->rcvbuf_pos > 0 ) {
+			/* move unread data to the front */
+			sc->rcvbuf_len -= sc->rcvbuf_pos;
+			Move( sc->rcvbuf + sc->rcvbuf_pos, sc->rcvbuf, sc->rcvbuf_len, char );
+			sc->rcvbuf_pos = 0;
+		}
+		if( sc->rcvbuf_size - sc->rcvbuf_len <= SC_RCVBUF_CHUNK ) {
+			size = sc->rcvbuf_size * 2;
+			if( size < sc->rcvbuf_len + SC_RCVBUF_CHUNK + 1 )
+				size = sc->rcvbuf_len + SC_RCVBUF_CHUNK + 1;
+			sc->rcvbuf_size = size;
+			Renew( sc->rcvbuf, size, char );
+		}
+	}
+	/* keep one byte for the terminating zero */
+	r = recv( sc->sock, sc->rcvbuf + sc->rcvbuf_len,
+		(int) (sc->rcvbuf_size - sc->rcvbuf_len - 1), 0 );
+#ifdef SC_DEBUG
+	_debug( "read ahead %d bytes\n", r );
+#endif
+	if( r == SOCKET_ERROR ) {
+		switch( r = Socket_errno() ) {
+		case EWOULDBLOCK:
+			/* threat not as an error */
+			return 0;
+		default:
+			SOCK_ERRNO( sc, r );
+			return SOCKET_ERROR;
+		}
+	}
+	else if( r == 0 ) {
+		SOCK_ERRNO( sc, ECONNRESET );
+		return SOCKET_ERROR;
+	}
+	sc->rcvbuf_len += r;
+	if( sc->poll_item != NULL )
+		SC_POLLER_PENDING( sc->poll_item );
+	return r;
+}
+
+/* hands out data left in the read-ahead buffer */
+INLINE int Socket_rcvbuf_read(
+	socket_class_t *sc, char *buf, int len, int peek
+) {
+	size_t avail = SC_RCVBUF_AVAIL( sc );
+	if( sc->rcvbuf_skip != '\0' && avail > 0 ) {
+		/* second char of a line break seen by readline */
+		if( sc->rcvbuf[sc->rcvbuf_pos] == sc->rcvbuf_skip ) {
+			sc->rcvbuf_pos ++;
+			avail --;
+		}
+		sc->rcvbuf_skip = '\0';
+	}
+	if( (size_t) len > avail )
+		len = (int) avail;
+	if( len > 0 ) {
+		Copy( sc->rcvbuf + sc->rcvbuf_pos, buf, len, char );
+		if( ! peek )
+			sc->rcvbuf_pos += len;
+	}
+	return len;
+}
 
 INLINE int my_ba2str( const bdaddr_t *ba, char *str ) {
 	register const unsigned char *b = (const unsigned char *) ba;
@@ -469,6 +687,16 @@ INLINE int my_str2ba( const char *str, bdaddr_t *ba ) {
 
 const char *HEXTAB = "0123456789ABCDEF";
 
+INLINE double my_time_ms() {
+#ifdef _WIN32
+	return (double) GetTickCount();
+#else
+	struct timeval tv;
+	gettimeofday( &tv, NULL );
+	return tv.tv_sec * 1000.0 + tv.tv_usec / 1000.0;
+#endif
+}
+
 INLINE char *my_itoa( char *str, long value, int radix ) {
     char tmp[21], *ret = tmp, neg = 0;
 	if( value < 0 ) {
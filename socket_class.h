@@ -28,6 +28,20 @@
 #include <stdlib.h>
 #include <unistd.h>
 
+#ifdef __linux__
+#define SC_USE_EPOLL			1
+#include <sys/epoll.h>
+#if defined MSG_WAITFORONE && defined __USE_GNU
+#define SC_USE_MMSG				1
+#endif
+#define SC_USE_SENDFILE			1
+#include <sys/sendfile.h>
+#ifdef SPLICE_F_MOVE
+#define SC_USE_SPLICE			1
+#endif
+#endif
+#include <poll.h>
+
 #endif
 
 #ifdef SC_USE_BLUEZ
@@ -313,6 +327,9 @@ typedef struct st_sockaddr_l2	SOCKADDR_L2CAP;
 
 typedef struct st_sc_sockaddr	my_sockaddr_t;
 
+typedef struct st_sc_poller_item	sc_poller_item_t;
+typedef struct st_sc_relay			sc_relay_t;
+
 typedef struct st_socket_class {
 	struct st_socket_class		*next;
 	int							id;
@@ -324,23 +341,158 @@ typedef struct st_socket_class {
 	my_sockaddr_t				l_addr, r_addr;
 	char						*buffer;
 	size_t						buffer_len;
+	char						*rcvbuf;
+	size_t						rcvbuf_size;
+	size_t						rcvbuf_len;
+	size_t						rcvbuf_pos;
+	char						rcvbuf_skip;
+	char						*outbuf;
+	size_t						outbuf_size;
+	size_t						outbuf_len;
+	size_t						outbuf_pos;
+	size_t						outbuf_max;
+	int							outbuf_flags;
+	int							outbuf_max_age;
+	double						outbuf_time;
 	int							state;
 	BYTE						non_blocking;
 	struct timeval				timeout;
 	char						*classname;
 	size_t						classname_len;
-#ifdef USE_ITHREADS
-	unsigned long				thread_id;
-	int							do_clone;
-#endif
 	long						last_errno;
 	char						last_error[256];
 	void						*user_data;
 	void						(*free_user_data) ( void *p );
+	int							bound;
+	BYTE						removed;
+	sc_poller_item_t			*poll_item;
+	sc_relay_t					*relay;
 } socket_class_t;
 
 #define SC_CASCADE				31
 
+/* minimum free space in the read-ahead buffer before calling recv() */
+#define SC_RCVBUF_CHUNK			4096
+
+#define SC_RCVBUF_AVAIL(sc)		((sc)->rcvbuf_len - (sc)->rcvbuf_pos)
+
+#define SC_OUTBUF_PENDING(sc)	((sc)->outbuf_len - (sc)->outbuf_pos)
+
+/* sends buffered output, evaluates to the number of bytes left
+ * or SOCKET_ERROR */
+#define SC_OUTBUF_FLUSH(sc) \
+	(SC_OUTBUF_PENDING( sc ) > 0 ? Socket_flush( (sc), 0 ) : 0)
+
+/* flags of Socket_flush() */
+#define SC_FLUSH_MORE			1
+#define SC_FLUSH_DONTWAIT		2
+
+/* last send of buffered output before the socket goes down,
+ * data which cannot be sent at once is dropped */
+#define SC_OUTBUF_FINISH(sc) \
+	if( SC_OUTBUF_PENDING( sc ) > 0 ) { \
+		Socket_flush( (sc), SC_FLUSH_DONTWAIT ); \
+		(sc)->outbuf_pos = (sc)->outbuf_len = 0; \
+	}
+
+/* keeps a blocking socket from waiting inside send() and recv() */
+#ifdef MSG_DONTWAIT
+#define SC_MSG_DONTWAIT			MSG_DONTWAIT
+#else
+#define SC_MSG_DONTWAIT			0
+#endif
+
+/* maximum number of chunks passed to one writev() */
+#ifdef IOV_MAX
+#define SC_IOV_MAX				IOV_MAX
+#else
+#define SC_IOV_MAX				1024
+#endif
+
+/* chunks of writev() kept on the stack */
+#define SC_IOV_STATIC			16
+
+/* maximum number of bytes moved by one relay step */
+#define SC_RELAY_CHUNK			65536
+
+/* data on the way from a socket to another one */
+struct st_sc_relay {
+#ifdef SC_USE_SPLICE
+	int							pipe[2];
+#else
+	char						buf[SC_RELAY_CHUNK];
+	size_t						pos;
+#endif
+	size_t						pending;
+};
+
+struct st_sc_poller_item {
+	sc_poller_t					*poller;
+	socket_class_t				*sock;
+	/* the descriptor as added, INVALID_SOCKET after close() */
+	SOCKET						fd;
+	void						*data;
+	int							events;
+	int							index;
+	BYTE						pending;
+	BYTE						reported;
+	int							slot;
+	sc_poller_item_t			*pnext;
+	BYTE						flush;
+	sc_poller_item_t			*fnext;
+};
+
+struct st_sc_poller {
+	sc_poller_item_t			**items;
+	int							count;
+	int							size;
+	/* sockets with data in the read-ahead buffer */
+	sc_poller_item_t			*pending;
+	/* sockets with data in the output buffer */
+	sc_poller_item_t			*flush;
+	/* set when another thread closed a socket of the poller */
+	BYTE						closed;
+	void						(*free_data) ( void *data );
+#ifdef SC_USE_EPOLL
+	int							epfd;
+	struct epoll_event			*events;
+	int							events_size;
+#else
+	struct pollfd				*fds;
+#endif
+	/* result buffer of the perl interface */
+	sc_poll_event_t				*ready;
+	int							ready_size;
+#ifdef USE_ITHREADS
+	/* the interpreter owning the poller and the data of its items */
+	void						*owner;
+#endif
+};
+
+#ifdef USE_ITHREADS
+#define SC_POLLER_OWNED(poller)	((poller)->owner == (void *) PERL_GET_THX)
+#else
+#define SC_POLLER_OWNED(poller)	1
+#endif
+
+#define SC_POLLER_PENDING(item) \
+	do { \
+		if( ! (item)->pending && SC_POLLER_OWNED( (item)->poller ) ) { \
+			(item)->pending = TRUE; \
+			(item)->pnext = (item)->poller->pending; \
+			(item)->poller->pending = (item); \
+		} \
+	} while( 0 )
+
+#define SC_POLLER_FLUSH(item) \
+	do { \
+		if( ! (item)->flush && SC_POLLER_OWNED( (item)->poller ) ) { \
+			(item)->flush = TRUE; \
+			(item)->fnext = (item)->poller->flush; \
+			(item)->poller->flush = (item); \
+		} \
+	} while( 0 )
+
 typedef struct st_sc_global {
 	socket_class_t				*socket[SC_CASCADE + 1];
 	long						last_errno;
@@ -431,10 +583,13 @@ extern sc_global_t sc_global;
 EXTERN void socket_class_add( socket_class_t *sc );
 EXTERN void socket_class_rem( socket_class_t *sc );
 EXTERN void socket_class_free( socket_class_t *sc );
+EXTERN void socket_class_cleanup( socket_class_t *sc );
 EXTERN socket_class_t *socket_class_find( SV *sv );
+EXTERN void socket_class_bind( socket_class_t *sc, SV *sv );
 
 EXTERN char *my_itoa( char *str, long value, int radix );
 EXTERN char *my_strncpy( char *dst, const char *src, size_t len );
+EXTERN double my_time_ms();
 EXTERN char *my_strcpy( char *dst, const char *src );
 EXTERN int my_stricmp( const char *cs, const char *ct );
 EXTERN int my_snprintf_( char *str, size_t size, const char *format, ... );
@@ -471,6 +626,12 @@ EXTERN int Socket_domainbyname( const char *name );
 EXTERN int Socket_typebyname( const char *name );
 EXTERN int Socket_protobyname( const char *name );
 EXTERN int Socket_write( socket_class_t *sc, const char *buf, int len );
+EXTERN int Socket_read_ahead( socket_class_t *sc );
+EXTERN int Socket_flush( socket_class_t *sc, int flags );
+EXTERN int Socket_write_buffered(
+	socket_class_t *sc, const char *buf, int len );
+EXTERN int Socket_rcvbuf_read(
+	socket_class_t *sc, char *buf, int len, int peek );
 EXTERN void Socket_error( char *str, DWORD len, long num );
 
 #define IPPORT4(ip,port) \
@@ -0,0 +1,307 @@
+print "1..$_tests\n";
+
+require Socket::Class;
+import Socket::Class qw(:all);
+
+$server = Socket::Class->new(
+	'local_addr' => '127.0.0.1',
+	'listen' => 1,
+) or warn Socket::Class->error;
+if( ! $server ) {
+	_fail_all();
+	goto _end;
+}
+$client = Socket::Class->new(
+	'remote_addr' => '127.0.0.1',
+	'remote_port' => $server->local_port,
+) or warn Socket::Class->error;
+$conn = $client ? $server->accept() : undef;
+if( ! $conn ) {
+	_fail_all();
+	goto _end;
+}
+_check( 1 );
+
+# lines and packets are carved out of one read-ahead buffer
+$client->write( "line1\r\nline2\nPACK1||PACK2||rest" );
+$client->wait( 100 );
+_check( $conn->readline() eq 'line1' );
+_check( $conn->readline() eq 'line2' );
+_check( $conn->read_packet( '||' ) eq 'PACK1' );
+_check( $conn->read_packet( '||' ) eq 'PACK2' );
+_check( $conn->available() == 4 );
+$r = $conn->read( $buf, 2 );
+_check( $r == 2 && $buf eq 're' );
+
+# partial lines are kept in non-blocking mode
+$conn->set_blocking( 0 );
+$r = $conn->readline();
+_check( defined $r && $r eq '' );
+$client->write( "-line3\r" );
+$client->wait( 100 );
+_check( $conn->readline() eq 'st-line3' );
+$client->write( "\nline4\n" );
+$client->wait( 100 );
+_check( $conn->readline() eq 'line4' );
+$client->write( "line5\r" );
+$client->wait( 100 );
+_check( $conn->readline() eq 'line5' );
+$client->write( "\nabc" );
+$client->wait( 100 );
+$conn->recv( $buf, 100 );
+_check( $buf eq 'abc' );
+
+# batched datagrams
+$udp1 = Socket::Class->new(
+	'local_addr' => '127.0.0.1',
+	'proto' => 'udp',
+) or warn Socket::Class->error;
+$udp2 = Socket::Class->new(
+	'local_addr' => '127.0.0.1',
+	'proto' => 'udp',
+) or warn Socket::Class->error;
+$r = $udp1 && $udp2 ? $udp1->send_many( [ 'one', 'two', 'three' ],
+	[ ($udp1->pack_addr( '127.0.0.1', $udp2->local_port )) x 3 ] ) : undef;
+if( ! defined $r && _unsupported( $udp1 ) ) {
+	_skip( 4, 'batched datagrams not supported' );
+}
+else {
+	_check( $r == 3 );
+	$udp2->wait( 100 );
+	( $bufs, $peers ) = $udp2->recv_many( 10, 100 );
+	_check( $bufs && "@$bufs" eq 'one two three' );
+	_check( $peers && @$peers == 3
+		&& ( $udp2->unpack_addr( $peers->[0] ) )[1] == $udp1->local_port );
+	$udp2->set_blocking( 0 );
+	( $bufs, $peers ) = $udp2->recv_many( 10, 100 );
+	_check( $bufs && @$bufs == 0 );
+}
+
+# file transmission
+$file = "t/_sendfile.tmp";
+if( open( FH, '>', $file ) ) {
+	binmode( FH );
+	print FH join( '', map { chr( $_ % 256 ) } 0 .. 9999 );
+	close( FH );
+}
+$conn->set_blocking( 1 );
+$r = $client->sendfile( $file );
+if( ! defined $r && _unsupported( $client ) ) {
+	_skip( 2, 'sendfile not supported' );
+}
+else {
+	$buf = '';
+	while( $r && length( $buf ) < 10000 ) {
+		$conn->read( $tmp, 10000 ) or last;
+		$buf .= $tmp;
+	}
+	_check( $r == 10000
+		&& $buf eq join( '', map { chr( $_ % 256 ) } 0 .. 9999 ) );
+	open( FH, '<', $file );
+	$r = $client->sendfile( \*FH, 9990, 5 );
+	# the offset of the handle does not move
+	$pos = sysseek( FH, 0, 1 );
+	close( FH );
+	$conn->wait( 100 );
+	$conn->read( $buf, 100 );
+	_check( $r == 5 && $pos == 0
+		&& $buf eq join( '', map { chr( $_ % 256 ) } 9990 .. 9994 ) );
+}
+unlink( $file );
+
+# gathered writes
+$r = $client->writev( [ 'ab', undef, 'cd', '' ] );
+_check( $r == 4 );
+$client->print( 'e', 'f', 1 );
+$client->writeline( 'x' x 2000 );
+$buf = '';
+while( length( $buf ) < 2009 ) {
+	$conn->wait( 100 );
+	$conn->read( $buf, 4096, length( $buf ) ) or last;
+}
+_check( $buf eq "abcdef1" . ( 'x' x 2000 ) . "\r\n" );
+
+# output buffer
+_check( $client->set_output_buffer( 64, 1 ) );
+$client->write( "buf" );
+$client->writeline( "fered" );
+_check( $client->output_pending() == 10 && ! $conn->is_readable( 50 ) );
+_check( $client->flush() && $client->output_pending() == 0 );
+$client->write( "x" x 70 );
+$conn->wait( 100 );
+$buf = '';
+while( length( $buf ) < 80 && $conn->is_readable( 100 ) ) {
+	$conn->read( $buf, 4096, length( $buf ) ) or last;
+}
+_check( $buf eq "buffered\r\n" . ( 'x' x 70 ) );
+$client->write( "ask" );
+$client->is_readable( 10 );
+$conn->wait( 100 );
+$conn->read( $buf, 100 );
+_check( $buf eq 'ask' && $client->set_output_buffer( 0 ) );
+# the next write sends data older than max_age
+_check( $client->set_output_buffer( 1024, 0, 20 ) );
+$client->write( "old" );
+select( undef, undef, undef, 0.05 );
+$client->write( "new" );
+$r = $client->output_pending();
+$conn->wait( 100 );
+$conn->read( $buf, 100 );
+_check( $r == 0 && $buf eq 'oldnew' && $client->set_output_buffer( 0 ) );
+
+# complete transfers with deadlines
+$conn->set_blocking( 0 );
+$r = $client->write_all( 'z' x 40000, 5000 );
+$buf = $conn->read_exact( 40000, 5000 );
+_check( $r == 40000 && length( $buf ) == 40000 );
+$client->write( "abc" );
+$buf = $conn->read_exact( 5, 200 );
+_check( $buf eq 'abc' && $conn->errno == ETIMEDOUT() );
+$conn->set_blocking( 1 );
+# buffered output does not hold a blocking socket beyond the deadline
+$near = Socket::Class->new(
+	'remote_addr' => '127.0.0.1',
+	'remote_port' => $server->local_port,
+) or warn Socket::Class->error;
+$far = $near ? $server->accept() : undef;
+$near->set_sndbuf_size( 4096 );
+$far->set_rcvbuf_size( 4096 );
+$near->set_output_buffer( 1 << 20 );
+$near->write( 'z' x 65536 ) for 1 .. 16;
+$r = $near->write_all( 'x', 300 );
+_check( ! defined $r && $near->errno == ETIMEDOUT()
+	&& $near->output_pending() > 0 );
+
+# receive into the scalar at an offset
+$buf = 'abc';
+$client->write( "def" );
+$conn->wait( 100 );
+$r = $conn->read( $buf, 100, length( $buf ) );
+_check( $r == 3 && $buf eq 'abcdef' );
+$client->write( "XY" );
+$conn->wait( 100 );
+$r = $conn->recv( $buf, 100, 0, -2 );
+$client->write( "Z" );
+$conn->wait( 100 );
+$conn->read( $buf, 100, 7 );
+_check( $r == 2 && $buf eq "abcdXY\0Z" );
+_check( ! defined $conn->read( $buf, 100, -20 ) );
+
+# relay between two connections
+$near = Socket::Class->new(
+	'remote_addr' => '127.0.0.1',
+	'remote_port' => $server->local_port,
+) or warn Socket::Class->error;
+$far = $near ? $server->accept() : undef;
+$client->write( "relay me" );
+$conn->wait( 100 );
+$r = $conn->relay( $near );
+$far->wait( 100 );
+$far->read( $buf, 100 );
+_check( $r == 8 && $buf eq 'relay me' );
+$client->write( "ping" );
+$far->write( "pong" );
+$client->shutdown( 1 );
+$far->shutdown( 1 );
+@r = $conn->proxy( $near, 1000 );
+$client->read( $buf, 100 );
+$far->read( $tmp, 100 );
+_check( "@r" eq '4 4' && $buf eq 'pong' && $tmp eq 'ping' );
+# the end of stream is no error, the socket can still be written
+$near = Socket::Class->new(
+	'remote_addr' => '127.0.0.1',
+	'remote_port' => $server->local_port,
+) or warn Socket::Class->error;
+$far = $near ? $server->accept() : undef;
+$near->shutdown( 1 );
+$far->wait( 100 );
+$r = $far->relay( $conn );
+$far->write( "bye" );
+$near->read( $buf, 100 );
+_check( defined $r && $r eq '0' && $far->errno == 0 && $buf eq 'bye' );
+
+# buffered data is sent on shutdown and destruction
+for $how ( 'shutdown', 'destroy' ) {
+	$near = Socket::Class->new(
+		'remote_addr' => '127.0.0.1',
+		'remote_port' => $server->local_port,
+	) or warn Socket::Class->error;
+	$far = $near ? $server->accept() : undef;
+	$near->set_output_buffer( 1024 );
+	$near->write( "hello" );
+	if( $how eq 'shutdown' ) {
+		$near->shutdown( 1 );
+	}
+	else {
+		undef $near;
+	}
+	$far->wait( 100 );
+	$buf = '';
+	$far->read( $buf, 100 );
+	_check( $buf eq 'hello' );
+}
+# a peer which does not read does not hold the destruction
+$near = Socket::Class->new(
+	'remote_addr' => '127.0.0.1',
+	'remote_port' => $server->local_port,
+) or warn Socket::Class->error;
+$far = $near ? $server->accept() : undef;
+$near->set_sndbuf_size( 4096 );
+$far->set_rcvbuf_size( 4096 );
+$near->set_output_buffer( 1 << 20 );
+$near->write( 'z' x 65536 ) for 1 .. 16;
+undef $near;
+$far->wait( 100 );
+$far->read( $buf, 100 );
+_check( $buf eq 'z' x 100 );
+
+# the remote address outlives close() for reconnect()
+$near = Socket::Class->new(
+	'remote_addr' => '127.0.0.1',
+	'remote_port' => $server->local_port,
+) or warn Socket::Class->error;
+$far = $near ? $server->accept() : undef;
+$near->close();
+_check( $near->remote_port() == $server->local_port
+	&& $near->reconnect() && $server->accept() );
+
+BEGIN {
+	$_tests = 40;
+	$_pos = 1;
+	unshift @INC, 'blib/lib', 'blib/arch';
+}
+
+_end:
+
+1;
+
+sub _check {
+	my( $val ) = @_;
+	print "" . ($val ? "ok" : "not ok") . " $_pos\n";
+	$_pos ++;
+}
+
+# the system lacks the calls behind the feature
+sub _unsupported {
+	my( $sock ) = @_;
+	my( $e );
+	return 1 if ! $sock;
+	require POSIX;
+	$e = $sock->errno;
+	return $e == POSIX::ENOSYS() || $e == POSIX::EINVAL()
+		|| $e == eval { POSIX::EOPNOTSUPP() };
+}
+
+sub _skip {
+	my( $count, $why ) = @_;
+	for( 1 .. $count ) {
+		print "ok $_pos # skip $why\n";
+		$_pos ++;
+	}
+}
+
+sub _fail_all {
+	for( ; $_pos <= $_tests; $_pos ++ ) {
+		print "not ok $_pos\n";
+	}
+}
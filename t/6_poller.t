@@ -0,0 +1,83 @@
+print "1..$_tests\n";
+
+require Socket::Class;
+import Socket::Class qw(:all);
+
+$server = Socket::Class->new(
+	'local_addr' => '127.0.0.1',
+	'listen' => 5,
+	'blocking' => 0,
+) or warn Socket::Class->error;
+$poller = Socket::Class::Poller->new();
+if( ! $server || ! $poller ) {
+	_fail_all();
+	goto _end;
+}
+_check( $poller->add( $server, SC_POLL_READ() ) );
+_check( ! $poller->add( $server, SC_POLL_READ() ) );
+
+$client = Socket::Class->new(
+	'remote_addr' => '127.0.0.1',
+	'remote_port' => $server->local_port,
+) or warn Socket::Class->error;
+@ready = $poller->wait( 1000 );
+_check( @ready == 2 && $ready[0] == $server && $ready[1] & SC_POLL_READ() );
+$conn = $server->accept();
+_check( $conn && $poller->add( $conn ) );
+_check( $poller->count() == 2 );
+
+# buffered lines are reported as readable
+$client->write( "line1\nline2\n" );
+@ready = $poller->wait( 1000 );
+_check( @ready == 2 && $ready[0] == $conn );
+_check( $conn->readline() eq 'line1' );
+@ready = $poller->wait( 0 );
+_check( @ready == 2 && $ready[0] == $conn );
+_check( $conn->readline() eq 'line2' );
+@ready = $poller->wait( 0 );
+_check( @ready == 0 );
+
+_check( $poller->modify( $conn, SC_POLL_WRITE() ) );
+@ready = $poller->wait( 1000 );
+_check( @ready == 2 && $ready[1] & SC_POLL_WRITE() );
+_check( $poller->remove( $conn ) && $poller->count() == 1 );
+$server->close();
+_check( $poller->count() == 0 );
+
+# sockets closed by another thread leave the poller on its next call
+require Config;
+if( $Config::Config{'useithreads'} && eval { require threads; 1 } ) {
+	$udp = Socket::Class->new(
+		'local_addr' => '127.0.0.1',
+		'proto' => 'udp',
+	) or warn Socket::Class->error;
+	$poller->add( $udp );
+	threads->create( sub { $udp->close(); 1 } )->join();
+	_check( $poller->wait( 0 ) == 0 );
+	_check( $poller->count() == 0 && ! $poller->remove( $udp ) );
+}
+else {
+	_check( 1 ) for 1 .. 2;
+}
+
+BEGIN {
+	$_tests = 16;
+	$_pos = 1;
+	unshift @INC, 'blib/lib', 'blib/arch';
+}
+
+_end:
+
+1;
+
+sub _check {
+	my( $val ) = @_;
+	print "" . ($val ? "ok" : "not ok") . " $_pos\n";
+	$_pos ++;
+}
+
+sub _fail_all {
+	for( ; $_pos <= $_tests; $_pos ++ ) {
+		print "not ok $_pos\n";
+	}
+}
@@ -171,6 +171,11 @@ const export_item_t export_items[] = {
 	{ "SC_STATE_SHUTDOWN", ITEM_LONG, (const char *) SC_STATE_SHUTDOWN },
 	{ "SC_STATE_CLOSED", ITEM_LONG, (const char *) SC_STATE_CLOSED },
 	{ "SC_STATE_ERROR", ITEM_LONG, (const char *) SC_STATE_ERROR },
+	{ "SC_POLL_READ", ITEM_LONG, (const char *) SC_POLL_READ },
+	{ "SC_POLL_WRITE", ITEM_LONG, (const char *) SC_POLL_WRITE },
+	{ "SC_POLL_ERROR", ITEM_LONG, (const char *) SC_POLL_ERROR },
+	{ "SC_POLL_HUP", ITEM_LONG, (const char *) SC_POLL_HUP },
+	{ "SC_POLL_EDGE", ITEM_LONG, (const char *) SC_POLL_EDGE },
 	{ "SD_RECEIVE", ITEM_LONG, (const char *) 0 },
 	{ "SD_SEND", ITEM_LONG, (const char *) 1 },
 	{ "SD_BOTH", ITEM_LONG, (const char *) 2 },
@@ -40,6 +40,12 @@ BOOT:
 	mod_sc_ssl.sc_printf = mod_sc_ssl_printf;
 	mod_sc_ssl.sc_vprintf = mod_sc_ssl_vprintf;
 	mod_sc_ssl.sc_available = mod_sc_ssl_available;
+	mod_sc_ssl.sc_sendfile = mod_sc_ssl_sendfile;
+	mod_sc_ssl.sc_set_output_buffer = mod_sc_ssl_set_output_buffer;
+	mod_sc_ssl.sc_flush = mod_sc_ssl_flush;
+	mod_sc_ssl.sc_get_output_pending = mod_sc_ssl_get_output_pending;
+	mod_sc_ssl.sc_is_readable = mod_sc_ssl_is_readable;
+	mod_sc_ssl.sc_close = mod_sc_ssl_close;
 	mod_sc_ssl.sc_set_userdata = mod_sc_ssl_set_userdata;
 	mod_sc_ssl.sc_get_userdata = mod_sc_ssl_get_userdata;
 	/* set additional functions */
@@ -71,6 +77,44 @@ BOOT:
 	mod_sc_ssl.sc_ssl_ctx_set_cipher_list = mod_sc_ssl_ctx_set_cipher_list;
 	mod_sc_ssl.sc_ssl_ctx_check_private_key = mod_sc_ssl_ctx_check_private_key;
 	mod_sc_ssl.sc_ssl_ctx_enable_compatibility = mod_sc_ssl_ctx_enable_compatibility;
+	mod_sc_ssl.sc_ssl_ctx_set_session_cache = mod_sc_ssl_ctx_set_session_cache;
+	mod_sc_ssl.sc_ssl_ctx_set_session_id_context = mod_sc_ssl_ctx_set_session_id_context;
+	mod_sc_ssl.sc_ssl_ctx_set_ticket_key = mod_sc_ssl_ctx_set_ticket_key;
+	mod_sc_ssl.sc_ssl_ctx_get_stats = mod_sc_ssl_ctx_get_stats;
+	mod_sc_ssl.sc_ssl_ctx_set_session_store = mod_sc_ssl_ctx_set_session_store;
+	mod_sc_ssl.sc_ssl_session_reused = mod_sc_ssl_session_reused;
+	mod_sc_ssl.sc_ssl_handshake = mod_sc_ssl_handshake;
+	mod_sc_ssl.sc_ssl_ctx_set_ktls = mod_sc_ssl_ctx_set_ktls;
+	mod_sc_ssl.sc_ssl_ktls_active = mod_sc_ssl_ktls_active;
+	mod_sc_ssl.sc_ssl_sendfile = mod_sc_ssl_sendfile;
+	mod_sc_ssl.sc_ssl_ctx_set_read_ahead = mod_sc_ssl_ctx_set_read_ahead;
+	mod_sc_ssl.sc_ssl_ctx_set_dynamic_records =
+		mod_sc_ssl_ctx_set_dynamic_records;
+	mod_sc_ssl.sc_ssl_bio_write = mod_sc_ssl_bio_write;
+	mod_sc_ssl.sc_ssl_bio_read = mod_sc_ssl_bio_read;
+	mod_sc_ssl.sc_ssl_bio_pending = mod_sc_ssl_bio_pending;
+	mod_sc_ssl.sc_ssl_ctx_set_release_buffers =
+		mod_sc_ssl_ctx_set_release_buffers;
+	mod_sc_ssl.sc_ssl_memory_usage = mod_sc_ssl_memory_usage;
+	mod_sc_ssl.sc_ssl_ctx_memory_usage = mod_sc_ssl_ctx_memory_usage;
+	mod_sc_ssl.sc_ssl_set_handshake_threads = mod_sc_ssl_set_handshake_threads;
+	mod_sc_ssl.sc_ssl_handshake_pending = mod_sc_ssl_handshake_pending;
+	mod_sc_ssl.sc_ssl_add_server_name = mod_sc_ssl_add_server_name;
+	mod_sc_ssl.sc_ssl_remove_server_name = mod_sc_ssl_remove_server_name;
+	mod_sc_ssl.sc_ssl_get_server_name = mod_sc_ssl_get_server_name;
+	mod_sc_ssl.sc_ssl_get_peer_certificate = mod_sc_ssl_get_peer_certificate;
+	mod_sc_ssl.sc_ssl_ctx_add_server_name = mod_sc_ssl_ctx_add_server_name;
+	mod_sc_ssl.sc_ssl_ctx_remove_server_name =
+		mod_sc_ssl_ctx_remove_server_name;
+	mod_sc_ssl.sc_ssl_get_ocsp_response = mod_sc_ssl_get_ocsp_response;
+	mod_sc_ssl.sc_ssl_ctx_set_ocsp_response = mod_sc_ssl_ctx_set_ocsp_response;
+	mod_sc_ssl.sc_ssl_ctx_load_ocsp_response =
+		mod_sc_ssl_ctx_load_ocsp_response;
+	mod_sc_ssl.sc_ssl_ctx_get_ocsp_status = mod_sc_ssl_ctx_get_ocsp_status;
+	mod_sc_ssl.sc_ssl_ctx_set_verify_peer = mod_sc_ssl_ctx_set_verify_peer;
+	mod_sc_ssl.sc_ssl_ctx_set_verify_cache = mod_sc_ssl_ctx_set_verify_cache;
+	mod_sc_ssl.sc_ssl_ctx_set_shared_session_cache =
+		mod_sc_ssl_ctx_set_shared_session_cache;
 	/* store the c module interface in the modglobal hash */
 	(void) hv_store( PL_modglobal,
 		"Socket::Class::SSL", 18, newSViv( PTR2IV( &mod_sc_ssl ) ), 0 );
@@ -80,9 +124,8 @@ BOOT:
 	OpenSSL_add_all_algorithms();
 	Zero( &sc_ssl_global, 1, sc_ssl_global_t );
 	sc_ssl_global.process_id = PROCESS_ID();
-#ifdef USE_ITHREADS
-	MUTEX_INIT( &sc_ssl_global.thread_lock );
-#endif
+	SC_SSL_MUTEX_INIT( &sc_ssl_global.thread_lock );
+	my_locks_init();
 }
 
 #/*****************************************************************************
@@ -131,9 +174,9 @@ CODE:
 	MUTEX_UNLOCK( &sc_ssl_global.thread_lock );
 #endif
 	*/
-#ifdef USE_ITHREADS
-	MUTEX_DESTROY( &sc_ssl_global.thread_lock );
-#endif
+	my_pool_free();
+	my_locks_free();
+	SC_SSL_MUTEX_DESTROY( &sc_ssl_global.thread_lock );
 #if SC_DEBUG > 1
 	debug_free();
 #endif
@@ -152,17 +195,17 @@ PREINIT:
 	int i;
 PPCODE:
 	(void) items; /* avoid compiler warning */
-	MUTEX_LOCK( &sc_ssl_global.thread_lock );
+	SC_SSL_MUTEX_LOCK( &sc_ssl_global.thread_lock );
 	for( i = 0; i <= SC_SSL_CTX_CASCADE; i ++ ) {
 		for( ctx = sc_ssl_global.ctx[i]; ctx != NULL; ctx = ctx->next ) {
 			/*if( !ctx->dont_clone )*/
-				ctx->refcnt ++;
+				SC_SSL_REF_INC( &ctx->refcnt );
 #ifdef SC_DEBUG
 			_debug( "CLONE called for ctx %d, refcnt: %d\n", ctx->id, ctx->refcnt );
 #endif
 		}
 	}
-	MUTEX_UNLOCK( &sc_ssl_global.thread_lock );
+	SC_SSL_MUTEX_UNLOCK( &sc_ssl_global.thread_lock );
 
 #endif
 
@@ -235,6 +278,9 @@ PPCODE:
 	case AF_INET6:
 	default:
 		switch( items ) {
+		case 1:
+			/* reconnect to the last address */
+			break;
 		case 4:
 		default:
 			if( SvNOK( ST(3) ) || SvIOK( ST(3) ) )
@@ -250,6 +296,8 @@ PPCODE:
 		break;
 	case AF_UNIX:
 		switch( items ) {
+		case 1:
+			break;
 		case 3:
 		default:
 			if( SvNOK( ST(2) ) || SvIOK( ST(2) ) )
@@ -324,20 +372,24 @@ SSL_recv( this, buf, len, flags = 0 )
 PREINIT:
 	sc_t *socket;
 	userdata_t *ud;
-	int rlen;
+	int r, rlen;
+	char *tmp;
+	size_t size;
 PPCODE:
 	if( (socket = mod_sc->sc_get_socket( this )) == NULL )
 		XSRETURN_EMPTY;
 	ud = (userdata_t *) mod_sc->sc_get_userdata( socket );
-	if( ud->buffer_len < (int) len ) {
-		ud->buffer_len = (int) len;
-		Renew( ud->buffer, len, char );
-	}
-	if( mod_sc_ssl_recv( socket, ud->buffer, len, flags, &rlen ) != SC_OK )
+	/* scratch buffer from the pool, the socket keeps no buffer of the
+	 * largest read */
+	tmp = my_buf_get( ud, len, &size );
+	r = mod_sc_ssl_recv( socket, tmp, len, flags, &rlen );
+	if( r == SC_OK && rlen > 0 )
+		sv_setpvn_mg( buf, tmp, rlen );
+	my_buf_put( ud, tmp, size );
+	if( r != SC_OK )
 		XSRETURN_EMPTY;
 	if( rlen == 0 )
 		XSRETURN_NO;
-	sv_setpvn_mg( buf, ud->buffer, rlen );
 	XSRETURN_IV( rlen );
 
 
@@ -381,20 +433,21 @@ PREINIT:
 	userdata_t *ud;
 	sc_addr_t addr;
 	int r, rlen;
+	char *tmp;
+	size_t size;
 PPCODE:
 	if( (socket = mod_sc->sc_get_socket( this )) == NULL )
 		XSRETURN_EMPTY;
 	ud = mod_sc->sc_get_userdata( socket );
-	if( ud->buffer_len < (int) len ) {
-		ud->buffer_len = (int) len;
-		Renew( ud->buffer, len, char );
-	}
-	r = mod_sc_ssl_recvfrom( socket, ud->buffer, (int) len, flags, &rlen );
+	tmp = my_buf_get( ud, len, &size );
+	r = mod_sc_ssl_recvfrom( socket, tmp, (int) len, flags, &rlen );
+	if( r == SC_OK && rlen > 0 )
+		sv_setpvn_mg( buf, tmp, rlen );
+	my_buf_put( ud, tmp, size );
 	if( r != SC_OK )
 		XSRETURN_EMPTY;
 	if( rlen == 0 )
 		XSRETURN_NO;
-	sv_setpvn_mg( buf, ud->buffer, rlen );
 	mod_sc->sc_remote_addr( socket, &addr );
 	ST(0) = sv_2mortal( newSVpvn( (char *) &addr, SC_ADDR_SIZE( addr ) ) );
 	XSRETURN(1);
@@ -447,21 +500,23 @@ SSL_read( this, buf, len )
 PREINIT:
 	sc_t *socket;
 	userdata_t *ud;
-	int rlen;
+	int r, rlen;
+	char *tmp;
+	size_t size;
 PPCODE:
-	if( (socket = mod_sc->sc_get_socket( this )) == NULL )
+	if( (socket = mod_sc->sc_get_socket( this )) == NULL || len < 0 )
 		XSRETURN_EMPTY;
 	ud = (userdata_t *) mod_sc->sc_get_userdata( socket );
-	if( ud->buffer_len < len ) {
-		ud->buffer_len = len;
-		Renew( ud->buffer, len, char );
-	}
-	if( mod_sc_ssl_read( socket, ud->buffer, len, &rlen ) != SC_OK )
+	tmp = my_buf_get( ud, len, &size );
+	r = mod_sc_ssl_read( socket, tmp, len, &rlen );
+	if( r == SC_OK && rlen > 0 )
+		sv_setpvn_mg( buf, tmp, rlen );
+	my_buf_put( ud, tmp, size );
+	if( r != SC_OK )
 		XSRETURN_EMPTY;
 	if( rlen == 0 )
 		XSRETURN_NO;
-	sv_setpvn_mg( buf, ud->buffer, rlen );
-	XSRETURN_IV( len );
+	XSRETURN_IV( rlen );
 
 
 #/*****************************************************************************
@@ -860,292 +915,1150 @@ PPCODE:
 
 
 #/*****************************************************************************
-# * SSL_starttls( pkg, this )
+# * SSL_session_reused( this )
 # *****************************************************************************/
 
 void
-SSL_starttls( pkg, this, ... )
-	SV *pkg;
+SSL_session_reused( this )
 	SV *this;
 PREINIT:
 	sc_t *socket;
-	SV *sv;
-	char **args, *key, *val;
-	int argc = 0, i, r;
 PPCODE:
 	if( (socket = mod_sc->sc_get_socket( this )) == NULL )
 		XSRETURN_EMPTY;
-	Newx( args, items - 1, char * );
-	/* read options */
-	for( i = 2; i < items - 1; ) {
-		key = SvPV_nolen( ST(i) );
-		i++;
-		switch( *key ) {
-		case 'u':
-		case 'U':
-			if( my_stricmp( key, "use_ctx" ) == 0 ) {
-				val = (char *) mod_sc_ssl_ctx_from_class( ST(i) );
-				goto got_val;
-			}
-			break;
-		}
-		val = SvPV_nolen( ST(i) );
-got_val:
-		i++;
-		args[argc++] = key;
-		args[argc++] = val;
-	}
-	r = mod_sc_ssl_starttls( socket, args, argc );
-	Safefree( args );
-	if( r != SC_OK )
-		XSRETURN_EMPTY;
-	/* create a new class */
-	if( mod_sc->sc_create_class( socket, SvPV_nolen( pkg ), &sv ) != SC_OK )
-		XSRETURN_EMPTY;
-	ST(0) = sv_2mortal( sv );
-	XSRETURN(1);
+	if( mod_sc_ssl_session_reused( socket ) )
+		XSRETURN_YES;
+	XSRETURN_NO;
 
 
 #/*****************************************************************************
-# * SSL_set_ssl_method( this, name )
+# * SSL_handshake( this )
 # *****************************************************************************/
 
 void
-SSL_set_ssl_method( this, name )
+SSL_handshake( this )
 	SV *this;
-	char *name;
 PREINIT:
 	sc_t *socket;
+	int want;
 PPCODE:
 	if( (socket = mod_sc->sc_get_socket( this )) == NULL )
 		XSRETURN_EMPTY;
-	if( mod_sc_ssl_set_ssl_method( socket, name ) != SC_OK )
+	if( mod_sc_ssl_handshake( socket, &want ) != SC_OK )
 		XSRETURN_EMPTY;
-	XSRETURN_YES;
+	if( want == 0 )
+		XSRETURN_YES;
+	XSRETURN_NO;
 
 
 #/*****************************************************************************
-# * SSL_set_cipher_list( this, str )
+# * SSL_handshake_wants( this )
 # *****************************************************************************/
 
 void
-SSL_set_cipher_list( this, str )
+SSL_handshake_wants( this )
 	SV *this;
-	char *str;
 PREINIT:
 	sc_t *socket;
+	userdata_t *ud;
 PPCODE:
 	if( (socket = mod_sc->sc_get_socket( this )) == NULL )
 		XSRETURN_EMPTY;
-	if( mod_sc_ssl_set_cipher_list( socket, str ) != SC_OK )
-		XSRETURN_EMPTY;
-	XSRETURN_YES;
-
+	ud = (userdata_t *) mod_sc->sc_get_userdata( socket );
+	ST(0) = sv_2mortal( newSViv( ud != NULL ? ud->handshake : 0 ) );
+	XSRETURN(1);
 
-#/*############################### SSL CONTEXT ###############################*/
 
+#/*****************************************************************************
+# * SSL_ktls_active( this )
+# *****************************************************************************/
 
-MODULE = Socket::Class::SSL	PACKAGE = Socket::Class::SSL::CTX	PREFIX = CTX_
+void
+SSL_ktls_active( this )
+	SV *this;
+PREINIT:
+	sc_t *socket;
+PPCODE:
+	if( (socket = mod_sc->sc_get_socket( this )) == NULL )
+		XSRETURN_EMPTY;
+	XSRETURN_IV( mod_sc_ssl_ktls_active( socket ) );
 
 
 #/*****************************************************************************
-# * CTX_new( pkg, ... )
+# * SSL_sendfile( this, file [, offset [, length]] )
 # *****************************************************************************/
 
 void
-CTX_new( pkg, ... )
-	char *pkg;
+SSL_sendfile( this, file, offset = 0, length = 0 )
+	SV *this;
+	SV *file;
+	IV offset;
+	IV length;
 PREINIT:
-	sc_ssl_ctx_t *ctx;
-	int r, i, argc = 0;
-	SV *sv;
-	char **args;
+	sc_t *socket;
+	IO *io;
+	int fd, r;
+	size_t len;
 PPCODE:
-	(void) pkg; /* unused */
-	Newx( args, items - 1, char * );
-	/* read options */
-	for( i = 1; i < items - 1; ) {
-		args[argc ++] = SvPV_nolen( ST(i) );
-		i ++;
-		args[argc ++] = SvPV_nolen( ST(i) );
-		i ++;
-	}
-	r = mod_sc_ssl_ctx_create( args, argc, &ctx );
-	Safefree( args );
-	if( r != SC_OK )
+	if( (socket = mod_sc->sc_get_socket( this )) == NULL )
 		XSRETURN_EMPTY;
-	r = mod_sc_ssl_ctx_create_class( ctx, &sv );
+	if( offset < 0 || length < 0 ) {
+		mod_sc->sc_set_errno( socket, EINVAL );
+		XSRETURN_EMPTY;
+	}
+	if( SvROK( file ) || isGV( file ) ) {
+		/* file handle */
+		io = sv_2io( file );
+		if( io == NULL || IoIFP( io ) == NULL
+			|| (fd = PerlIO_fileno( IoIFP( io ) )) < 0
+		) {
+			mod_sc->sc_set_errno( socket, EBADF );
+			XSRETURN_EMPTY;
+		}
+		r = mod_sc_ssl_sendfile(
+			socket, fd, (off_t) offset, (size_t) length, &len );
+	}
+	else {
+		/* file name */
+#ifdef O_BINARY
+		fd = open( SvPV_nolen( file ), O_RDONLY | O_BINARY );
+#else
+		fd = open( SvPV_nolen( file ), O_RDONLY );
+#endif
+		if( fd < 0 ) {
+			mod_sc->sc_set_errno( socket, errno );
+			XSRETURN_EMPTY;
+		}
+		r = mod_sc_ssl_sendfile(
+			socket, fd, (off_t) offset, (size_t) length, &len );
+		close( fd );
+	}
 	if( r != SC_OK )
 		XSRETURN_EMPTY;
-	ST(0) = sv_2mortal( sv );
-	XSRETURN(1);
+	if( len == 0 )
+		XSRETURN_NO;
+	XSRETURN_IV( (IV) len );
 
 
 #/*****************************************************************************
-# * CTX_DESTROY( this, ... )
+# * SSL_set_output_buffer( this, size [, cork [, max_age]] )
 # *****************************************************************************/
 
 void
-CTX_DESTROY( this, ... )
+SSL_set_output_buffer( this, size, cork = 0, max_age = 0 )
 	SV *this;
+	IV size;
+	int cork;
+	int max_age;
 PREINIT:
-	sc_ssl_ctx_t *ctx;
+	sc_t *socket;
 PPCODE:
-	if( (ctx = mod_sc_ssl_ctx_from_class( this )) == NULL )
+	if( (socket = mod_sc->sc_get_socket( this )) == NULL )
+		XSRETURN_EMPTY;
+	if( size < 0 || max_age < 0 ) {
+		mod_sc->sc_set_errno( socket, EINVAL );
 		XSRETURN_EMPTY;
-	/*
-#ifdef USE_ITHREADS
-	if( !ctx->dont_clone && ctx->thread_id == THREAD_ID() ) {
-		ctx->dont_clone = TRUE;
-#ifdef SC_DEBUG
-		_debug( "disable futher CLONE for ctx %d\n", ctx->id );
-#endif
 	}
-#endif
-	*/
-	mod_sc_ssl_ctx_destroy( ctx );
+	if( mod_sc_ssl_set_output_buffer(
+		socket, (size_t) size, cork ? SC_OUTPUT_CORK : 0, max_age ) != SC_OK
+	)
+		XSRETURN_EMPTY;
+	XSRETURN_YES;
 
 
 #/*****************************************************************************
-# * CTX_set_ssl_method( this, name )
+# * SSL_flush( this )
 # *****************************************************************************/
 
 void
-CTX_set_ssl_method( this, name )
+SSL_flush( this )
 	SV *this;
-	char *name;
 PREINIT:
-	sc_ssl_ctx_t *ctx;
+	sc_t *socket;
+	size_t pending;
 PPCODE:
-	if( (ctx = mod_sc_ssl_ctx_from_class( this )) == NULL )
+	if( (socket = mod_sc->sc_get_socket( this )) == NULL )
 		XSRETURN_EMPTY;
-	if( mod_sc_ssl_ctx_set_ssl_method( ctx, name ) != SC_OK )
+	if( mod_sc_ssl_flush( socket, &pending ) != SC_OK )
 		XSRETURN_EMPTY;
+	if( pending > 0 )
+		XSRETURN_NO;
 	XSRETURN_YES;
 
 
 #/*****************************************************************************
-# * CTX_set_private_key( this, pk )
+# * SSL_output_pending( this )
 # *****************************************************************************/
 
 void
-CTX_set_private_key( this, pk )
+SSL_output_pending( this )
 	SV *this;
-	char *pk;
 PREINIT:
-	sc_ssl_ctx_t *ctx;
+	sc_t *socket;
 PPCODE:
-	if( (ctx = mod_sc_ssl_ctx_from_class( this )) == NULL )
-		XSRETURN_EMPTY;
-	if( mod_sc_ssl_ctx_set_private_key( ctx, pk ) != SC_OK )
+	if( (socket = mod_sc->sc_get_socket( this )) == NULL )
 		XSRETURN_EMPTY;
-	XSRETURN_YES;
+	XSRETURN_IV( (IV) mod_sc_ssl_get_output_pending( socket ) );
 
 
 #/*****************************************************************************
-# * CTX_set_certificate( this, crt )
+# * SSL_is_readable( this [, timeout] )
 # *****************************************************************************/
 
 void
-CTX_set_certificate( this, crt )
+SSL_is_readable( this, timeout = NULL )
 	SV *this;
-	char *crt;
+	SV *timeout;
 PREINIT:
-	sc_ssl_ctx_t *ctx;
+	sc_t *socket;
+	double ms;
+	int readable;
 PPCODE:
-	if( (ctx = mod_sc_ssl_ctx_from_class( this )) == NULL )
+	if( (socket = mod_sc->sc_get_socket( this )) == NULL )
 		XSRETURN_EMPTY;
-	if( mod_sc_ssl_ctx_set_certificate( ctx, crt ) != SC_OK )
+	ms = timeout != NULL ? SvNV( timeout ) : -1;
+	if( mod_sc_ssl_is_readable( socket, ms, &readable ) != SC_OK )
 		XSRETURN_EMPTY;
-	XSRETURN_YES;
+	ST(0) = readable ? &PL_sv_yes : &PL_sv_no;
+	XSRETURN(1);
 
 
 #/*****************************************************************************
-# * CTX_set_client_ca( this, client_ca )
+# * SSL_close( this )
 # *****************************************************************************/
 
 void
-CTX_set_client_ca( this, client_ca )
+SSL_close( this )
 	SV *this;
-	char *client_ca;
 PREINIT:
-	sc_ssl_ctx_t *ctx;
+	sc_t *socket;
 PPCODE:
-	if( (ctx = mod_sc_ssl_ctx_from_class( this )) == NULL )
+	if( (socket = mod_sc->sc_get_socket( this )) == NULL )
 		XSRETURN_EMPTY;
-	if( mod_sc_ssl_ctx_set_client_ca( ctx, client_ca ) != SC_OK )
+	if( mod_sc_ssl_close( socket ) != SC_OK )
 		XSRETURN_EMPTY;
 	XSRETURN_YES;
 
 
 #/*****************************************************************************
-# * CTX_set_verify_locations( this, ca_file )
+# * SSL_bio_write( this, buf )
 # *****************************************************************************/
 
 void
-CTX_set_verify_locations( this, ca_file, ca_path = NULL )
+SSL_bio_write( this, buf )
 	SV *this;
-	char *ca_file;
-	char *ca_path;
+	SV *buf;
 PREINIT:
-	sc_ssl_ctx_t *ctx;
+	sc_t *socket;
+	const char *msg;
+	STRLEN len;
+	int rlen;
 PPCODE:
-	if( (ctx = mod_sc_ssl_ctx_from_class( this )) == NULL )
+	if( (socket = mod_sc->sc_get_socket( this )) == NULL )
 		XSRETURN_EMPTY;
-	if( mod_sc_ssl_ctx_set_verify_locations( ctx, ca_file, ca_path ) != SC_OK )
+	msg = SvPV( buf, len );
+	if( mod_sc_ssl_bio_write( socket, msg, (int) len, &rlen ) != SC_OK )
 		XSRETURN_EMPTY;
-	XSRETURN_YES;
+	if( rlen == 0 )
+		XSRETURN_NO;
+	XSRETURN_IV( rlen );
 
 
 #/*****************************************************************************
-# * CTX_set_cipher_list( this, str )
+# * SSL_bio_read( this, buf, len )
 # *****************************************************************************/
 
 void
-CTX_set_cipher_list( this, str )
+SSL_bio_read( this, buf, len )
 	SV *this;
-	char *str;
+	SV *buf;
+	int len;
 PREINIT:
-	sc_ssl_ctx_t *ctx;
+	sc_t *socket;
+	userdata_t *ud;
+	int r, rlen;
+	char *tmp;
+	size_t size;
 PPCODE:
-	if( (ctx = mod_sc_ssl_ctx_from_class( this )) == NULL )
+	if( (socket = mod_sc->sc_get_socket( this )) == NULL || len < 0 )
 		XSRETURN_EMPTY;
-	if( mod_sc_ssl_ctx_set_cipher_list( ctx, str ) != SC_OK )
+	ud = (userdata_t *) mod_sc->sc_get_userdata( socket );
+	tmp = my_buf_get( ud, len, &size );
+	r = mod_sc_ssl_bio_read( socket, tmp, len, &rlen );
+	if( r == SC_OK && rlen > 0 )
+		sv_setpvn_mg( buf, tmp, rlen );
+	my_buf_put( ud, tmp, size );
+	if( r != SC_OK )
 		XSRETURN_EMPTY;
-	XSRETURN_YES;
+	if( rlen == 0 )
+		XSRETURN_NO;
+	XSRETURN_IV( rlen );
 
 
 #/*****************************************************************************
-# * CTX_check_private_key( this )
+# * SSL_bio_pending( this )
 # *****************************************************************************/
 
 void
-CTX_check_private_key( this )
+SSL_bio_pending( this )
 	SV *this;
 PREINIT:
-	sc_ssl_ctx_t *ctx;
+	sc_t *socket;
 PPCODE:
-	if( (ctx = mod_sc_ssl_ctx_from_class( this )) == NULL )
+	if( (socket = mod_sc->sc_get_socket( this )) == NULL )
 		XSRETURN_EMPTY;
-	if( mod_sc_ssl_ctx_check_private_key( ctx ) != SC_OK )
+	XSRETURN_IV( (IV) mod_sc_ssl_bio_pending( socket ) );
+
+
+#/*****************************************************************************
+# * SSL_memory_usage( this )
+# *****************************************************************************/
+
+void
+SSL_memory_usage( this )
+	SV *this;
+PREINIT:
+	sc_t *socket;
+	sc_ssl_memory_t mem;
+	HV *hv;
+PPCODE:
+	if( (socket = mod_sc->sc_get_socket( this )) == NULL )
 		XSRETURN_EMPTY;
-	XSRETURN_YES;
+	if( mod_sc_ssl_memory_usage( socket, &mem ) != SC_OK )
+		XSRETURN_EMPTY;
+	hv = (HV *) sv_2mortal( (SV *) newHV() );
+	(void) hv_store( hv, "sockets", 7, newSViv( mem.sockets ), 0 );
+	(void) hv_store( hv, "buffers", 7, newSViv( mem.buffers ), 0 );
+	(void) hv_store( hv, "ssl_buffers", 11, newSViv( mem.ssl_buffers ), 0 );
+	(void) hv_store( hv, "pool", 4, newSViv( mem.pool ), 0 );
+	(void) hv_store( hv, "total", 5, newSViv( mem.total ), 0 );
+	ST(0) = sv_2mortal( newRV( (SV *) hv ) );
+	XSRETURN(1);
 
 
 #/*****************************************************************************
-# * CTX_enable_compatibility( this )
+# * SSL_set_handshake_threads( this, threads [, timeout] )
 # *****************************************************************************/
 
 void
-CTX_enable_compatibility( this )
+SSL_set_handshake_threads( this, threads, timeout = 0 )
 	SV *this;
+	int threads;
+	int timeout;
 PREINIT:
-	sc_ssl_ctx_t *ctx;
+	sc_t *socket;
 PPCODE:
-	if( (ctx = mod_sc_ssl_ctx_from_class( this )) == NULL )
+	if( (socket = mod_sc->sc_get_socket( this )) == NULL )
 		XSRETURN_EMPTY;
-	if( mod_sc_ssl_ctx_enable_compatibility( ctx ) != SC_OK )
+	if( mod_sc_ssl_set_handshake_threads( socket, threads, timeout ) != SC_OK )
 		XSRETURN_EMPTY;
 	XSRETURN_YES;
 
 
+#/*****************************************************************************
+# * SSL_handshake_pending( this )
+# *****************************************************************************/
+
+void
+SSL_handshake_pending( this )
+	SV *this;
+PREINIT:
+	sc_t *socket;
+PPCODE:
+	if( (socket = mod_sc->sc_get_socket( this )) == NULL )
+		XSRETURN_EMPTY;
+	XSRETURN_IV( mod_sc_ssl_handshake_pending( socket ) );
+
+
+#/*****************************************************************************
+# * SSL_add_server_name( this, name, ctx )
+# *****************************************************************************/
+
+void
+SSL_add_server_name( this, name, ctx )
+	SV *this;
+	char *name;
+	SV *ctx;
+PREINIT:
+	sc_t *socket;
+PPCODE:
+	if( (socket = mod_sc->sc_get_socket( this )) == NULL )
+		XSRETURN_EMPTY;
+	if( mod_sc_ssl_add_server_name(
+		socket, name, mod_sc_ssl_ctx_from_class( ctx ) ) != SC_OK
+	)
+		XSRETURN_EMPTY;
+	XSRETURN_YES;
+
+
+#/*****************************************************************************
+# * SSL_remove_server_name( this, name )
+# *****************************************************************************/
+
+void
+SSL_remove_server_name( this, name )
+	SV *this;
+	char *name;
+PREINIT:
+	sc_t *socket;
+PPCODE:
+	if( (socket = mod_sc->sc_get_socket( this )) == NULL )
+		XSRETURN_EMPTY;
+	if( mod_sc_ssl_remove_server_name( socket, name ) != SC_OK )
+		XSRETURN_EMPTY;
+	XSRETURN_YES;
+
+
+#/*****************************************************************************
+# * SSL_get_server_name( this )
+# *****************************************************************************/
+
+void
+SSL_get_server_name( this )
+	SV *this;
+PREINIT:
+	sc_t *socket;
+	const char *s;
+PPCODE:
+	if( (socket = mod_sc->sc_get_socket( this )) == NULL )
+		XSRETURN_EMPTY;
+	s = mod_sc_ssl_get_server_name( socket );
+	if( s == NULL )
+		XSRETURN_EMPTY;
+	ST(0) = sv_2mortal( newSVpvn( s, strlen( s ) ) );
+	XSRETURN(1);
+
+
+#/*****************************************************************************
+# * SSL_get_peer_certificate( this )
+# *****************************************************************************/
+
+void
+SSL_get_peer_certificate( this )
+	SV *this;
+PREINIT:
+	sc_t *socket;
+	char *buf;
+	int len;
+PPCODE:
+	if( (socket = mod_sc->sc_get_socket( this )) == NULL )
+		XSRETURN_EMPTY;
+	if( mod_sc_ssl_get_peer_certificate( socket, &buf, &len ) != SC_OK )
+		XSRETURN_EMPTY;
+	if( buf == NULL )
+		XSRETURN_NO;
+	ST(0) = sv_2mortal( newSVpvn( buf, len ) );
+	XSRETURN(1);
+
+
+#/*****************************************************************************
+# * SSL_get_ocsp_response( this )
+# *****************************************************************************/
+
+void
+SSL_get_ocsp_response( this )
+	SV *this;
+PREINIT:
+	sc_t *socket;
+	char *buf;
+	int len;
+PPCODE:
+	if( (socket = mod_sc->sc_get_socket( this )) == NULL )
+		XSRETURN_EMPTY;
+	if( mod_sc_ssl_get_ocsp_response( socket, &buf, &len ) != SC_OK )
+		XSRETURN_EMPTY;
+	if( buf == NULL )
+		XSRETURN_NO;
+	ST(0) = sv_2mortal( newSVpvn( buf, len ) );
+	XSRETURN(1);
+
+
+#/*****************************************************************************
+# * SSL_starttls( pkg, this )
+# *****************************************************************************/
+
+void
+SSL_starttls( pkg, this, ... )
+	SV *pkg;
+	SV *this;
+PREINIT:
+	sc_t *socket;
+	SV *sv;
+	char **args, *key, *val;
+	int argc = 0, i, r;
+PPCODE:
+	if( (socket = mod_sc->sc_get_socket( this )) == NULL )
+		XSRETURN_EMPTY;
+	Newx( args, items - 1, char * );
+	/* read options */
+	for( i = 2; i < items - 1; ) {
+		key = SvPV_nolen( ST(i) );
+		i++;
+		switch( *key ) {
+		case 'u':
+		case 'U':
+			if( my_stricmp( key, "use_ctx" ) == 0 ) {
+				val = (char *) mod_sc_ssl_ctx_from_class( ST(i) );
+				goto got_val;
+			}
+			break;
+		}
+		val = SvPV_nolen( ST(i) );
+got_val:
+		i++;
+		args[argc++] = key;
+		args[argc++] = val;
+	}
+	r = mod_sc_ssl_starttls( socket, args, argc );
+	Safefree( args );
+	if( r != SC_OK )
+		XSRETURN_EMPTY;
+	/* create a new class */
+	if( mod_sc->sc_create_class( socket, SvPV_nolen( pkg ), &sv ) != SC_OK )
+		XSRETURN_EMPTY;
+	ST(0) = sv_2mortal( sv );
+	XSRETURN(1);
+
+
+#/*****************************************************************************
+# * SSL_set_ssl_method( this, name )
+# *****************************************************************************/
+
+void
+SSL_set_ssl_method( this, name )
+	SV *this;
+	char *name;
+PREINIT:
+	sc_t *socket;
+PPCODE:
+	if( (socket = mod_sc->sc_get_socket( this )) == NULL )
+		XSRETURN_EMPTY;
+	if( mod_sc_ssl_set_ssl_method( socket, name ) != SC_OK )
+		XSRETURN_EMPTY;
+	XSRETURN_YES;
+
+
+#/*****************************************************************************
+# * SSL_set_cipher_list( this, str )
+# *****************************************************************************/
+
+void
+SSL_set_cipher_list( this, str )
+	SV *this;
+	char *str;
+PREINIT:
+	sc_t *socket;
+PPCODE:
+	if( (socket = mod_sc->sc_get_socket( this )) == NULL )
+		XSRETURN_EMPTY;
+	if( mod_sc_ssl_set_cipher_list( socket, str ) != SC_OK )
+		XSRETURN_EMPTY;
+	XSRETURN_YES;
+
+
+#/*############################### SSL CONTEXT ###############################*/
+
+
+MODULE = Socket::Class::SSL	PACKAGE = Socket::Class::SSL::CTX	PREFIX = CTX_
+
+
+#/*****************************************************************************
+# * CTX_new( pkg, ... )
+# *****************************************************************************/
+
+void
+CTX_new( pkg, ... )
+	char *pkg;
+PREINIT:
+	sc_ssl_ctx_t *ctx;
+	int r, i, argc = 0;
+	SV *sv;
+	char **args;
+PPCODE:
+	(void) pkg; /* unused */
+	Newx( args, items - 1, char * );
+	/* read options */
+	for( i = 1; i < items - 1; ) {
+		args[argc ++] = SvPV_nolen( ST(i) );
+		i ++;
+		args[argc ++] = SvPV_nolen( ST(i) );
+		i ++;
+	}
+	r = mod_sc_ssl_ctx_create( args, argc, &ctx );
+	Safefree( args );
+	if( r != SC_OK )
+		XSRETURN_EMPTY;
+	r = mod_sc_ssl_ctx_create_class( ctx, &sv );
+	if( r != SC_OK )
+		XSRETURN_EMPTY;
+	ST(0) = sv_2mortal( sv );
+	XSRETURN(1);
+
+
+#/*****************************************************************************
+# * CTX_DESTROY( this, ... )
+# *****************************************************************************/
+
+void
+CTX_DESTROY( this, ... )
+	SV *this;
+PREINIT:
+	sc_ssl_ctx_t *ctx;
+PPCODE:
+	if( (ctx = mod_sc_ssl_ctx_from_class( this )) == NULL )
+		XSRETURN_EMPTY;
+	/*
+#ifdef USE_ITHREADS
+	if( !ctx->dont_clone && ctx->thread_id == THREAD_ID() ) {
+		ctx->dont_clone = TRUE;
+#ifdef SC_DEBUG
+		_debug( "disable futher CLONE for ctx %d\n", ctx->id );
+#endif
+	}
+#endif
+	*/
+	mod_sc_ssl_ctx_destroy( ctx );
+
+
+#/*****************************************************************************
+# * CTX_set_ssl_method( this, name )
+# *****************************************************************************/
+
+void
+CTX_set_ssl_method( this, name )
+	SV *this;
+	char *name;
+PREINIT:
+	sc_ssl_ctx_t *ctx;
+PPCODE:
+	if( (ctx = mod_sc_ssl_ctx_from_class( this )) == NULL )
+		XSRETURN_EMPTY;
+	if( mod_sc_ssl_ctx_set_ssl_method( ctx, name ) != SC_OK )
+		XSRETURN_EMPTY;
+	XSRETURN_YES;
+
+
+#/*****************************************************************************
+# * CTX_set_private_key( this, pk )
+# *****************************************************************************/
+
+void
+CTX_set_private_key( this, pk )
+	SV *this;
+	char *pk;
+PREINIT:
+	sc_ssl_ctx_t *ctx;
+PPCODE:
+	if( (ctx = mod_sc_ssl_ctx_from_class( this )) == NULL )
+		XSRETURN_EMPTY;
+	if( mod_sc_ssl_ctx_set_private_key( ctx, pk ) != SC_OK )
+		XSRETURN_EMPTY;
+	XSRETURN_YES;
+
+
+#/*****************************************************************************
+# * CTX_set_certificate( this, crt )
+# *****************************************************************************/
+
+void
+CTX_set_certificate( this, crt )
+	SV *this;
+	char *crt;
+PREINIT:
+	sc_ssl_ctx_t *ctx;
+PPCODE:
+	if( (ctx = mod_sc_ssl_ctx_from_class( this )) == NULL )
+		XSRETURN_EMPTY;
+	if( mod_sc_ssl_ctx_set_certificate( ctx, crt ) != SC_OK )
+		XSRETURN_EMPTY;
+	XSRETURN_YES;
+
+
+#/*****************************************************************************
+# * CTX_set_client_ca( this, client_ca )
+# *****************************************************************************/
+
+void
+CTX_set_client_ca( this, client_ca )
+	SV *this;
+	char *client_ca;
+PREINIT:
+	sc_ssl_ctx_t *ctx;
+PPCODE:
+	if( (ctx = mod_sc_ssl_ctx_from_class( this )) == NULL )
+		XSRETURN_EMPTY;
+	if( mod_sc_ssl_ctx_set_client_ca( ctx, client_ca ) != SC_OK )
+		XSRETURN_EMPTY;
+	XSRETURN_YES;
+
+
+#/*****************************************************************************
+# * CTX_set_verify_locations( this, ca_file )
+# *****************************************************************************/
+
+void
+CTX_set_verify_locations( this, ca_file, ca_path = NULL )
+	SV *this;
+	char *ca_file;
+	char *ca_path;
+PREINIT:
+	sc_ssl_ctx_t *ctx;
+PPCODE:
+	if( (ctx = mod_sc_ssl_ctx_from_class( this )) == NULL )
+		XSRETURN_EMPTY;
+	if( mod_sc_ssl_ctx_set_verify_locations( ctx, ca_file, ca_path ) != SC_OK )
+		XSRETURN_EMPTY;
+	XSRETURN_YES;
+
+
+#/*****************************************************************************
+# * CTX_set_cipher_list( this, str )
+# *****************************************************************************/
+
+void
+CTX_set_cipher_list( this, str )
+	SV *this;
+	char *str;
+PREINIT:
+	sc_ssl_ctx_t *ctx;
+PPCODE:
+	if( (ctx = mod_sc_ssl_ctx_from_class( this )) == NULL )
+		XSRETURN_EMPTY;
+	if( mod_sc_ssl_ctx_set_cipher_list( ctx, str ) != SC_OK )
+		XSRETURN_EMPTY;
+	XSRETURN_YES;
+
+
+#/*****************************************************************************
+# * CTX_check_private_key( this )
+# *****************************************************************************/
+
+void
+CTX_check_private_key( this )
+	SV *this;
+PREINIT:
+	sc_ssl_ctx_t *ctx;
+PPCODE:
+	if( (ctx = mod_sc_ssl_ctx_from_class( this )) == NULL )
+		XSRETURN_EMPTY;
+	if( mod_sc_ssl_ctx_check_private_key( ctx ) != SC_OK )
+		XSRETURN_EMPTY;
+	XSRETURN_YES;
+
+
+#/*****************************************************************************
+# * CTX_enable_compatibility( this )
+# *****************************************************************************/
+
+void
+CTX_enable_compatibility( this )
+	SV *this;
+PREINIT:
+	sc_ssl_ctx_t *ctx;
+PPCODE:
+	if( (ctx = mod_sc_ssl_ctx_from_class( this )) == NULL )
+		XSRETURN_EMPTY;
+	if( mod_sc_ssl_ctx_enable_compatibility( ctx ) != SC_OK )
+		XSRETURN_EMPTY;
+	XSRETURN_YES;
+
+
+#/*****************************************************************************
+# * CTX_set_session_cache( this, mode [, size [, timeout]] )
+# *****************************************************************************/
+
+void
+CTX_set_session_cache( this, mode, size = -1, timeout = -1 )
+	SV *this;
+	SV *mode;
+	long size;
+	long timeout;
+PREINIT:
+	sc_ssl_ctx_t *ctx;
+	int m = SC_SSL_SESS_DEFAULT;
+PPCODE:
+	if( (ctx = mod_sc_ssl_ctx_from_class( this )) == NULL )
+		XSRETURN_EMPTY;
+	if( SvOK( mode ) )
+		m = my_session_cache_mode( SvPV_nolen( mode ) );
+	if( mod_sc_ssl_ctx_set_session_cache( ctx, m, size, timeout ) != SC_OK )
+		XSRETURN_EMPTY;
+	XSRETURN_YES;
+
+
+#/*****************************************************************************
+# * CTX_set_session_id_context( this, str )
+# *****************************************************************************/
+
+void
+CTX_set_session_id_context( this, str )
+	SV *this;
+	char *str;
+PREINIT:
+	sc_ssl_ctx_t *ctx;
+PPCODE:
+	if( (ctx = mod_sc_ssl_ctx_from_class( this )) == NULL )
+		XSRETURN_EMPTY;
+	if( mod_sc_ssl_ctx_set_session_id_context( ctx, str ) != SC_OK )
+		XSRETURN_EMPTY;
+	XSRETURN_YES;
+
+
+#/*****************************************************************************
+# * CTX_rotate_ticket_key( this [, key] )
+# *****************************************************************************/
+
+void
+CTX_rotate_ticket_key( this, key = NULL )
+	SV *this;
+	char *key;
+PREINIT:
+	sc_ssl_ctx_t *ctx;
+PPCODE:
+	if( (ctx = mod_sc_ssl_ctx_from_class( this )) == NULL )
+		XSRETURN_EMPTY;
+	if( mod_sc_ssl_ctx_set_ticket_key( ctx, key ) != SC_OK )
+		XSRETURN_EMPTY;
+	XSRETURN_YES;
+
+
+#/*****************************************************************************
+# * CTX_set_session_store( this, max )
+# *****************************************************************************/
+
+void
+CTX_set_session_store( this, max )
+	SV *this;
+	int max;
+PREINIT:
+	sc_ssl_ctx_t *ctx;
+PPCODE:
+	if( (ctx = mod_sc_ssl_ctx_from_class( this )) == NULL )
+		XSRETURN_EMPTY;
+	if( mod_sc_ssl_ctx_set_session_store( ctx, max ) != SC_OK )
+		XSRETURN_EMPTY;
+	XSRETURN_YES;
+
+
+#/*****************************************************************************
+# * CTX_set_ktls( this, enable )
+# *****************************************************************************/
+
+void
+CTX_set_ktls( this, enable )
+	SV *this;
+	int enable;
+PREINIT:
+	sc_ssl_ctx_t *ctx;
+PPCODE:
+	if( (ctx = mod_sc_ssl_ctx_from_class( this )) == NULL )
+		XSRETURN_EMPTY;
+	if( mod_sc_ssl_ctx_set_ktls( ctx, enable ) != SC_OK )
+		XSRETURN_EMPTY;
+	XSRETURN_YES;
+
+
+#/*****************************************************************************
+# * CTX_set_read_ahead( this, enable )
+# *****************************************************************************/
+
+void
+CTX_set_read_ahead( this, enable )
+	SV *this;
+	int enable;
+PREINIT:
+	sc_ssl_ctx_t *ctx;
+PPCODE:
+	if( (ctx = mod_sc_ssl_ctx_from_class( this )) == NULL )
+		XSRETURN_EMPTY;
+	if( mod_sc_ssl_ctx_set_read_ahead( ctx, enable ) != SC_OK )
+		XSRETURN_EMPTY;
+	XSRETURN_YES;
+
+
+#/*****************************************************************************
+# * CTX_set_dynamic_records( this, enable )
+# *****************************************************************************/
+
+void
+CTX_set_dynamic_records( this, enable )
+	SV *this;
+	int enable;
+PREINIT:
+	sc_ssl_ctx_t *ctx;
+PPCODE:
+	if( (ctx = mod_sc_ssl_ctx_from_class( this )) == NULL )
+		XSRETURN_EMPTY;
+	if( mod_sc_ssl_ctx_set_dynamic_records( ctx, enable ) != SC_OK )
+		XSRETURN_EMPTY;
+	XSRETURN_YES;
+
+
+#/*****************************************************************************
+# * CTX_set_release_buffers( this, enable )
+# *****************************************************************************/
+
+void
+CTX_set_release_buffers( this, enable )
+	SV *this;
+	int enable;
+PREINIT:
+	sc_ssl_ctx_t *ctx;
+PPCODE:
+	if( (ctx = mod_sc_ssl_ctx_from_class( this )) == NULL )
+		XSRETURN_EMPTY;
+	if( mod_sc_ssl_ctx_set_release_buffers( ctx, enable ) != SC_OK )
+		XSRETURN_EMPTY;
+	XSRETURN_YES;
+
+
+#/*****************************************************************************
+# * CTX_set_verify_peer( this, enable )
+# *****************************************************************************/
+
+void
+CTX_set_verify_peer( this, enable )
+	SV *this;
+	int enable;
+PREINIT:
+	sc_ssl_ctx_t *ctx;
+PPCODE:
+	if( (ctx = mod_sc_ssl_ctx_from_class( this )) == NULL )
+		XSRETURN_EMPTY;
+	if( mod_sc_ssl_ctx_set_verify_peer( ctx, enable ) != SC_OK )
+		XSRETURN_EMPTY;
+	XSRETURN_YES;
+
+
+#/*****************************************************************************
+# * CTX_set_verify_cache( this, size [, timeout] )
+# *****************************************************************************/
+
+void
+CTX_set_verify_cache( this, size, timeout = -1 )
+	SV *this;
+	int size;
+	long timeout;
+PREINIT:
+	sc_ssl_ctx_t *ctx;
+PPCODE:
+	if( (ctx = mod_sc_ssl_ctx_from_class( this )) == NULL )
+		XSRETURN_EMPTY;
+	if( mod_sc_ssl_ctx_set_verify_cache( ctx, size, timeout ) != SC_OK )
+		XSRETURN_EMPTY;
+	XSRETURN_YES;
+
+
+#/*****************************************************************************
+# * CTX_set_shared_session_cache( this, size )
+# *****************************************************************************/
+
+void
+CTX_set_shared_session_cache( this, size )
+	SV *this;
+	int size;
+PREINIT:
+	sc_ssl_ctx_t *ctx;
+PPCODE:
+	if( (ctx = mod_sc_ssl_ctx_from_class( this )) == NULL )
+		XSRETURN_EMPTY;
+	if( mod_sc_ssl_ctx_set_shared_session_cache( ctx, size ) != SC_OK )
+		XSRETURN_EMPTY;
+	XSRETURN_YES;
+
+
+#/*****************************************************************************
+# * CTX_memory_usage( this )
+# *****************************************************************************/
+
+void
+CTX_memory_usage( this )
+	SV *this;
+PREINIT:
+	sc_ssl_ctx_t *ctx;
+	sc_ssl_memory_t mem;
+	HV *hv;
+PPCODE:
+	if( (ctx = mod_sc_ssl_ctx_from_class( this )) == NULL )
+		XSRETURN_EMPTY;
+	if( mod_sc_ssl_ctx_memory_usage( ctx, &mem ) != SC_OK )
+		XSRETURN_EMPTY;
+	hv = (HV *) sv_2mortal( (SV *) newHV() );
+	(void) hv_store( hv, "sockets", 7, newSViv( mem.sockets ), 0 );
+	(void) hv_store( hv, "buffers", 7, newSViv( mem.buffers ), 0 );
+	(void) hv_store( hv, "ssl_buffers", 11, newSViv( mem.ssl_buffers ), 0 );
+	(void) hv_store( hv, "pool", 4, newSViv( mem.pool ), 0 );
+	(void) hv_store( hv, "total", 5, newSViv( mem.total ), 0 );
+	ST(0) = sv_2mortal( newRV( (SV *) hv ) );
+	XSRETURN(1);
+
+
+#/*****************************************************************************
+# * CTX_session_stats( this )
+# *****************************************************************************/
+
+void
+CTX_session_stats( this )
+	SV *this;
+PREINIT:
+	sc_ssl_ctx_t *ctx;
+	sc_ssl_ctx_stats_t stats;
+	HV *hv;
+PPCODE:
+	if( (ctx = mod_sc_ssl_ctx_from_class( this )) == NULL )
+		XSRETURN_EMPTY;
+	if( mod_sc_ssl_ctx_get_stats( ctx, &stats ) != SC_OK )
+		XSRETURN_EMPTY;
+	hv = (HV *) sv_2mortal( (SV *) newHV() );
+	(void) hv_store( hv, "sessions", 8, newSViv( stats.sessions ), 0 );
+	(void) hv_store( hv, "accept", 6, newSViv( stats.accept ), 0 );
+	(void) hv_store( hv, "accept_good", 11, newSViv( stats.accept_good ), 0 );
+	(void) hv_store( hv, "connect", 7, newSViv( stats.connect ), 0 );
+	(void) hv_store( hv, "connect_good", 12,
+		newSViv( stats.connect_good ), 0 );
+	(void) hv_store( hv, "hits", 4, newSViv( stats.hits ), 0 );
+	(void) hv_store( hv, "misses", 6, newSViv( stats.misses ), 0 );
+	(void) hv_store( hv, "timeouts", 8, newSViv( stats.timeouts ), 0 );
+	(void) hv_store( hv, "cache_full", 10, newSViv( stats.cache_full ), 0 );
+	(void) hv_store( hv, "tickets_issued", 14,
+		newSViv( stats.tickets_issued ), 0 );
+	(void) hv_store( hv, "tickets_accepted", 16,
+		newSViv( stats.tickets_accepted ), 0 );
+	(void) hv_store( hv, "tickets_renewed", 15,
+		newSViv( stats.tickets_renewed ), 0 );
+	(void) hv_store( hv, "tickets_failed", 14,
+		newSViv( stats.tickets_failed ), 0 );
+	(void) hv_store( hv, "store_sessions", 14,
+		newSViv( stats.store_sessions ), 0 );
+	(void) hv_store( hv, "store_offered", 13,
+		newSViv( stats.store_offered ), 0 );
+	(void) hv_store( hv, "store_resumed", 13,
+		newSViv( stats.store_resumed ), 0 );
+	(void) hv_store( hv, "verify_cached", 13,
+		newSViv( stats.verify_cached ), 0 );
+	(void) hv_store( hv, "verify_hits", 11, newSViv( stats.verify_hits ), 0 );
+	(void) hv_store( hv, "verify_misses", 13,
+		newSViv( stats.verify_misses ), 0 );
+	(void) hv_store( hv, "shared_stored", 13,
+		newSViv( stats.shared_stored ), 0 );
+	(void) hv_store( hv, "shared_hits", 11, newSViv( stats.shared_hits ), 0 );
+	(void) hv_store( hv, "shared_misses", 13,
+		newSViv( stats.shared_misses ), 0 );
+	(void) hv_store( hv, "shared_evicted", 14,
+		newSViv( stats.shared_evicted ), 0 );
+	ST(0) = sv_2mortal( newRV( (SV *) hv ) );
+	XSRETURN(1);
+
+
+#/*****************************************************************************
+# * CTX_add_server_name( this, name, ctx )
+# *****************************************************************************/
+
+void
+CTX_add_server_name( this, name, ctx )
+	SV *this;
+	char *name;
+	SV *ctx;
+PREINIT:
+	sc_ssl_ctx_t *sctx;
+PPCODE:
+	if( (sctx = mod_sc_ssl_ctx_from_class( this )) == NULL )
+		XSRETURN_EMPTY;
+	if( mod_sc_ssl_ctx_add_server_name(
+		sctx, name, mod_sc_ssl_ctx_from_class( ctx ) ) != SC_OK
+	)
+		XSRETURN_EMPTY;
+	XSRETURN_YES;
+
+
+#/*****************************************************************************
+# * CTX_remove_server_name( this, name )
+# *****************************************************************************/
+
+void
+CTX_remove_server_name( this, name )
+	SV *this;
+	char *name;
+PREINIT:
+	sc_ssl_ctx_t *ctx;
+PPCODE:
+	if( (ctx = mod_sc_ssl_ctx_from_class( this )) == NULL )
+		XSRETURN_EMPTY;
+	if( mod_sc_ssl_ctx_remove_server_name( ctx, name ) != SC_OK )
+		XSRETURN_EMPTY;
+	XSRETURN_YES;
+
+
+#/*****************************************************************************
+# * CTX_set_ocsp_response( this, data )
+# *****************************************************************************/
+
+void
+CTX_set_ocsp_response( this, data )
+	SV *this;
+	SV *data;
+PREINIT:
+	sc_ssl_ctx_t *ctx;
+	const char *buf;
+	STRLEN len;
+PPCODE:
+	if( (ctx = mod_sc_ssl_ctx_from_class( this )) == NULL )
+		XSRETURN_EMPTY;
+	if( SvOK( data ) ) {
+		buf = SvPVbyte( data, len );
+	}
+	else {
+		buf = NULL;
+		len = 0;
+	}
+	if( mod_sc_ssl_ctx_set_ocsp_response( ctx, buf, (int) len ) != SC_OK )
+		XSRETURN_EMPTY;
+	XSRETURN_YES;
+
+
+#/*****************************************************************************
+# * CTX_load_ocsp_response( this, file )
+# *****************************************************************************/
+
+void
+CTX_load_ocsp_response( this, file )
+	SV *this;
+	char *file;
+PREINIT:
+	sc_ssl_ctx_t *ctx;
+PPCODE:
+	if( (ctx = mod_sc_ssl_ctx_from_class( this )) == NULL )
+		XSRETURN_EMPTY;
+	if( mod_sc_ssl_ctx_load_ocsp_response( ctx, file ) != SC_OK )
+		XSRETURN_EMPTY;
+	XSRETURN_YES;
+
+
+#/*****************************************************************************
+# * CTX_get_ocsp_status( this )
+# *****************************************************************************/
+
+void
+CTX_get_ocsp_status( this )
+	SV *this;
+PREINIT:
+	sc_ssl_ctx_t *ctx;
+	sc_ssl_ocsp_status_t status;
+	const char *str = "unknown";
+	HV *hv;
+PPCODE:
+	if( (ctx = mod_sc_ssl_ctx_from_class( this )) == NULL )
+		XSRETURN_EMPTY;
+	if( mod_sc_ssl_ctx_get_ocsp_status( ctx, &status ) != SC_OK )
+		XSRETURN_EMPTY;
+#ifdef SC_SSL_USE_OCSP
+	str = OCSP_cert_status_str( status.status );
+#endif
+	hv = (HV *) sv_2mortal( (SV *) newHV() );
+	(void) hv_store( hv, "status", 6, newSVpv( str, 0 ), 0 );
+	(void) hv_store( hv, "this_update", 11, newSViv( status.this_update ), 0 );
+	(void) hv_store( hv, "next_update", 11, newSViv( status.next_update ), 0 );
+	(void) hv_store( hv, "stapled", 7, newSViv( status.stapled ), 0 );
+	(void) hv_store( hv, "missed", 6, newSViv( status.missed ), 0 );
+	ST(0) = sv_2mortal( newRV( (SV *) hv ) );
+	XSRETURN(1);
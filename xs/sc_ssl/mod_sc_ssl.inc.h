@@ -10,8 +10,69 @@
 /* !include default_pk */
 /* !include default_crt */
 
+/* pending handshake, see sc_ssl_handshake */
+#define SC_SSL_WANT_READ		1
+#define SC_SSL_WANT_WRITE		2
+
+/* memory bio modes, the records are moved through the socket functions
+ * of Socket::Class, or by the caller with sc_ssl_bio_read/sc_ssl_bio_write */
+#define SC_SSL_BIO_SOCKET		1
+#define SC_SSL_BIO_MANUAL		2
+
+/* kernel tls offload, see sc_ssl_ktls_active */
+#define SC_SSL_KTLS_TX			1
+#define SC_SSL_KTLS_RX			2
+
 typedef struct st_mod_sc_ssl		mod_sc_ssl_t;
 typedef struct st_sc_ssl_ctx		sc_ssl_ctx_t;
+typedef struct st_sc_ssl_ctx_stats	sc_ssl_ctx_stats_t;
+typedef struct st_sc_ssl_memory		sc_ssl_memory_t;
+typedef struct st_sc_ssl_ocsp_status	sc_ssl_ocsp_status_t;
+
+/* session counters of a context */
+struct st_sc_ssl_ctx_stats {
+	long sessions; /* sessions in the internal cache */
+	long accept;
+	long accept_good;
+	long connect;
+	long connect_good;
+	long hits; /* resumed sessions */
+	long misses;
+	long timeouts;
+	long cache_full;
+	long tickets_issued;
+	long tickets_accepted; /* decrypted with the current key */
+	long tickets_renewed; /* decrypted with the previous key */
+	long tickets_failed; /* unknown ticket key */
+	long store_sessions; /* sessions in the client session store */
+	long store_offered; /* stored sessions offered to servers */
+	long store_resumed; /* stored sessions accepted by servers */
+	long verify_cached; /* verified peer chains in the cache */
+	long verify_hits; /* peer chains found in the cache */
+	long verify_misses; /* peer chains verified by OpenSSL */
+	long shared_stored; /* sessions put into the shared cache */
+	long shared_hits; /* sessions found in the shared cache */
+	long shared_misses;
+	long shared_evicted; /* valid sessions replaced in the shared cache */
+};
+
+/* memory held by connections in bytes */
+struct st_sc_ssl_memory {
+	long sockets; /* sockets counted */
+	long buffers; /* plaintext and record buffers of the module */
+	long ssl_buffers; /* record buffers of OpenSSL, estimated */
+	long pool; /* free buffers in the shared pool */
+	long total; /* buffers and ssl_buffers */
+};
+
+/* ocsp response of a server context */
+struct st_sc_ssl_ocsp_status {
+	int status; /* V_OCSP_CERTSTATUS_GOOD, _REVOKED or _UNKNOWN */
+	long this_update; /* unix time */
+	long next_update; /* unix time, 0 if not given */
+	long stapled; /* handshakes with the response */
+	long missed; /* requests without a valid response */
+};
 
 struct st_mod_sc_ssl {
 /* st_mod_sc included by Makefile.PL */
@@ -58,6 +119,70 @@ struct st_mod_sc_ssl {
 	int (*sc_ssl_ctx_set_cipher_list) ( sc_ssl_ctx_t *ctx, const char *str );
 	int (*sc_ssl_ctx_check_private_key) ( sc_ssl_ctx_t *ctx );
 	int (*sc_ssl_ctx_enable_compatibility) ( sc_ssl_ctx_t *ctx );
+	/* since version 1.41 */
+	int (*sc_ssl_ctx_set_session_cache) (
+		sc_ssl_ctx_t *ctx, int mode, long size, long timeout
+	);
+	int (*sc_ssl_ctx_set_session_id_context) (
+		sc_ssl_ctx_t *ctx, const char *str
+	);
+	int (*sc_ssl_ctx_set_ticket_key) ( sc_ssl_ctx_t *ctx, const char *key );
+	int (*sc_ssl_ctx_get_stats) (
+		sc_ssl_ctx_t *ctx, sc_ssl_ctx_stats_t *stats
+	);
+	int (*sc_ssl_ctx_set_session_store) ( sc_ssl_ctx_t *ctx, int max );
+	int (*sc_ssl_session_reused) ( sc_t *socket );
+	int (*sc_ssl_handshake) ( sc_t *socket, int *p_want );
+	int (*sc_ssl_ctx_set_ktls) ( sc_ssl_ctx_t *ctx, int enable );
+	int (*sc_ssl_ktls_active) ( sc_t *socket );
+	int (*sc_ssl_sendfile) (
+		sc_t *socket, int fd, off_t offset, size_t length, size_t *p_len
+	);
+	int (*sc_ssl_ctx_set_read_ahead) ( sc_ssl_ctx_t *ctx, int enable );
+	int (*sc_ssl_ctx_set_dynamic_records) ( sc_ssl_ctx_t *ctx, int enable );
+	int (*sc_ssl_bio_write) (
+		sc_t *socket, const char *buf, int len, int *p_len
+	);
+	int (*sc_ssl_bio_read) ( sc_t *socket, char *buf, int len, int *p_len );
+	size_t (*sc_ssl_bio_pending) ( sc_t *socket );
+	int (*sc_ssl_ctx_set_release_buffers) ( sc_ssl_ctx_t *ctx, int enable );
+	int (*sc_ssl_memory_usage) ( sc_t *socket, sc_ssl_memory_t *mem );
+	int (*sc_ssl_ctx_memory_usage) (
+		sc_ssl_ctx_t *ctx, sc_ssl_memory_t *mem
+	);
+	int (*sc_ssl_set_handshake_threads) (
+		sc_t *socket, int threads, int timeout
+	);
+	int (*sc_ssl_handshake_pending) ( sc_t *socket );
+	int (*sc_ssl_add_server_name) (
+		sc_t *socket, const char *name, sc_ssl_ctx_t *ctx
+	);
+	int (*sc_ssl_remove_server_name) ( sc_t *socket, const char *name );
+	const char *(*sc_ssl_get_server_name) ( sc_t *socket );
+	int (*sc_ssl_get_peer_certificate) (
+		sc_t *socket, char **p_buf, int *p_len
+	);
+	int (*sc_ssl_ctx_add_server_name) (
+		sc_ssl_ctx_t *ctx, const char *name, sc_ssl_ctx_t *target
+	);
+	int (*sc_ssl_ctx_remove_server_name) (
+		sc_ssl_ctx_t *ctx, const char *name
+	);
+	int (*sc_ssl_get_ocsp_response) ( sc_t *socket, char **p_buf, int *p_len );
+	int (*sc_ssl_ctx_set_ocsp_response) (
+		sc_ssl_ctx_t *ctx, const char *buf, int len
+	);
+	int (*sc_ssl_ctx_load_ocsp_response) (
+		sc_ssl_ctx_t *ctx, const char *file
+	);
+	int (*sc_ssl_ctx_get_ocsp_status) (
+		sc_ssl_ctx_t *ctx, sc_ssl_ocsp_status_t *status
+	);
+	int (*sc_ssl_ctx_set_verify_peer) ( sc_ssl_ctx_t *ctx, int enable );
+	int (*sc_ssl_ctx_set_verify_cache) (
+		sc_ssl_ctx_t *ctx, int max, long timeout
+	);
+	int (*sc_ssl_ctx_set_shared_session_cache) ( sc_ssl_ctx_t *ctx, int size );
 };
 
 #endif /* _MOD_SC_SSL_H_ */
@@ -4,9 +4,10 @@ sc_ssl_global_t sc_ssl_global;
 
 int mod_sc_ssl_create( char **args, int argc, sc_t **p_socket ) {
 	sc_t *socket;
-	int r, i, argc2 = 0, listen = 0, is_client = -1;
+	int r, i, argc2 = 0, listen = 0, is_client = -1, defer = FALSE;
+	int membio = 0, threads = 0;
 	char *key, *val, **args2, *ra = NULL, *rp = NULL, *la = NULL, *lp = NULL;
-	char *domain = NULL, *type = NULL, *proto = NULL;
+	char *domain = NULL, *type = NULL, *proto = NULL, *sn = NULL;
 	userdata_t *ud;
 	sc_ssl_ctx_t *ctx, *use_ctx = NULL;
 	if( argc % 2 ) {
@@ -24,6 +25,9 @@ int mod_sc_ssl_create( char **args, int argc, sc_t **p_socket ) {
 			if( my_stricmp( key, "domain" ) == 0 ) {
 				domain = val;
 			}
+			else if( my_stricmp( key, "defer_handshake" ) == 0 ) {
+				defer = *val != '\0' && *val != '0';
+			}
 			else {
 				break;
 			}
@@ -37,6 +41,15 @@ int mod_sc_ssl_create( char **args, int argc, sc_t **p_socket ) {
 				break;
 			}
 			continue;
+		case 'h':
+		case 'H':
+			if( my_stricmp( key, "handshake_threads" ) == 0 ) {
+				threads = atoi( val );
+			}
+			else {
+				break;
+			}
+			continue;
 		case 'l':
 		case 'L':
 			if( my_stricmp( key, "local_addr" ) == 0 ) {
@@ -58,6 +71,15 @@ int mod_sc_ssl_create( char **args, int argc, sc_t **p_socket ) {
 				break;
 			}
 			continue;
+		case 'm':
+		case 'M':
+			if( my_stricmp( key, "memory_bio" ) == 0 ) {
+				membio = my_bio_mode( val );
+			}
+			else {
+				break;
+			}
+			continue;
 		case 'p':
 		case 'P':
 			if( my_stricmp( key, "proto" ) == 0 ) {
@@ -87,6 +109,15 @@ int mod_sc_ssl_create( char **args, int argc, sc_t **p_socket ) {
 				break;
 			}
 			continue;
+		case 's':
+		case 'S':
+			if( my_stricmp( key, "server_name" ) == 0 ) {
+				sn = val;
+			}
+			else {
+				break;
+			}
+			continue;
 		case 't':
 		case 'T':
 			if( my_stricmp( key, "type" ) == 0 ) {
@@ -117,15 +148,18 @@ int mod_sc_ssl_create( char **args, int argc, sc_t **p_socket ) {
 	if( r != SC_OK )
 		return r;
 	Newxz( ud, 1, userdata_t );
+	ud->defer_handshake = defer;
+	ud->mem_bio = membio;
+	if( sn != NULL )
+		ud->server_name = my_strdup( sn );
 	mod_sc->sc_set_userdata( socket, ud, free_userdata );
 	mod_sc_ssl_ctx_create( NULL, 0, &ctx );
 	r = mod_sc_ssl_ctx_set_arg( ctx, args, argc, is_client, &use_ctx );
 	if( use_ctx != NULL ) {
 		mod_sc_ssl_ctx_destroy( ctx );
-		use_ctx->refcnt++;
 		ctx = use_ctx;
 	}
-	ud->sc_ssl_ctx = ctx;
+	my_ctx_attach( ud, ctx );
 	if( la != NULL || lp != NULL || listen ) {
 		r = mod_sc->sc_bind( socket, la, lp );
 		if( r != SC_OK )
@@ -135,6 +169,11 @@ int mod_sc_ssl_create( char **args, int argc, sc_t **p_socket ) {
 		r = mod_sc_ssl_listen( socket, listen );
 		if( r != SC_OK )
 			goto error;
+		if( threads > 0 ) {
+			r = mod_sc_ssl_set_handshake_threads( socket, threads, 0 );
+			if( r != SC_OK )
+				goto error;
+		}
 	}
 	else if( ra != NULL || rp != NULL ) {
 		r = mod_sc_ssl_connect( socket, ra, rp, 0 );
@@ -155,8 +194,12 @@ int mod_sc_ssl_connect(
 	sc_t *socket, const char *host, const char *serv, double timeout
 ) {
 	userdata_t *ud;
-	int r, err;
+	int r;
 	ud = (userdata_t *) mod_sc->sc_get_userdata( socket );
+	if( ud->ssl != NULL ) {
+		/* state of the previous connection, see reconnect() */
+		my_ssl_free( ud );
+	}
 	r = mod_sc->sc_connect( socket, host, serv, timeout );
 	if( r != SC_OK )
 		return r;
@@ -173,20 +216,16 @@ int mod_sc_ssl_connect(
 	/* get new SSL state with context */
 	ud->ssl = SSL_new( ud->sc_ssl_ctx->ctx );
 	/* set connection to SSL state */
-	SSL_set_fd( ud->ssl, (int) mod_sc->sc_get_handle( socket ) );
-	/* start the handshaking */
-	r = SSL_connect( ud->ssl );
-	if( r <= 0 ) {
-		r = SSL_get_error( ud->ssl, r );
-		err = ERR_get_error();
-		if( err == 0 )
-			mod_sc->sc_set_error( socket, r, my_ssl_error( r ) );
-		else
-			mod_sc->sc_set_error( socket, err, ERR_reason_error_string( err ) );
-		return SC_ERROR;
-	}
+	my_ssl_attach( socket, ud );
+	my_set_server_name( ud, host );
+	my_ocsp_request( ud );
+	/* offer a session of an earlier connection */
+	my_session_offer( socket, ud, host, serv );
 	ud->sc_ssl_ctx->is_client = TRUE;
-	return SC_OK;
+	/* start the handshaking, non-blocking sockets continue with
+	 * mod_sc_ssl_handshake() */
+	r = SSL_connect( ud->ssl );
+	return my_handshake_result( socket, ud, r );
 }
 
 int mod_sc_ssl_listen( sc_t *socket, int queue ) {
@@ -216,7 +255,10 @@ int mod_sc_ssl_listen( sc_t *socket, int queue ) {
 int mod_sc_ssl_accept( sc_t *socket, sc_t **r_client ) {
 	sc_t *client;
 	userdata_t *ud, *udc;
-	int r, err;
+	int r;
+	ud = (userdata_t *) mod_sc->sc_get_userdata( socket );
+	if( ud->workers != NULL && ! ud->defer_handshake )
+		return my_workers_accept( socket, ud, r_client );
 	r = mod_sc->sc_accept( socket, &client );
 	if( r != SC_OK )
 		return SC_ERROR;
@@ -224,25 +266,19 @@ int mod_sc_ssl_accept( sc_t *socket, sc_t **r_client ) {
 		*r_client = NULL;
 		return SC_OK;
 	}
-	ud = (userdata_t *) mod_sc->sc_get_userdata( socket );
-	Newxz( udc, 1, userdata_t );
-	mod_sc->sc_set_userdata( client, udc, free_userdata );
-	/* use context of listen socket */
-	udc->sc_ssl_ctx = ud->sc_ssl_ctx;
-	udc->sc_ssl_ctx->refcnt++;
-	/* get new SSL state with context */
-	udc->ssl = SSL_new( udc->sc_ssl_ctx->ctx );
-	/* set connection to SSL state */
-	SSL_set_fd( udc->ssl, (int) mod_sc->sc_get_handle( client ) );
+	udc = my_accept_setup( ud, client );
+	if( ud->defer_handshake ) {
+		/* the caller drives the handshake with mod_sc_ssl_handshake() */
+		SSL_set_accept_state( udc->ssl );
+		udc->handshake = SC_SSL_WANT_READ;
+		*r_client = client;
+		return SC_OK;
+	}
 	/* start the handshaking */
 	r = SSL_accept( udc->ssl );
-	if( r < 0 ) {
-		r = SSL_get_error( ud->ssl, r );
-		err = ERR_get_error();
-		if( err == 0 )
-			mod_sc->sc_set_error( socket, r, my_ssl_error( r ) );
-		else
-			mod_sc->sc_set_error( socket, err, ERR_reason_error_string( err ) );
+	if( my_handshake_result( client, udc, r ) != SC_OK ) {
+		mod_sc->sc_set_error( socket,
+			mod_sc->sc_get_errno( client ), mod_sc->sc_get_error( client ) );
 		mod_sc->sc_destroy( client );
 		return SC_ERROR;
 	}
@@ -256,45 +292,47 @@ int mod_sc_ssl_accept( sc_t *socket, sc_t **r_client ) {
 
 int mod_sc_ssl_recv( sc_t *socket, char *buf, int len, int flags, int *p_len ) {
 	userdata_t *ud;
-	int r, err, len2 = 0;
+	int r, err, len2;
 	ud = (userdata_t *) mod_sc->sc_get_userdata( socket );
 	if( ud->ssl == NULL ) {
 		mod_sc->sc_set_errno( socket, ENOTCONN );
 		return SC_ERROR;
 	}
-	if( ud->rcvbuf_pos > 0 ) {
-		/* read from rcvbuf */
-		len2 = ud->rcvbuf_pos < len ? ud->rcvbuf_pos : len;
+	/* a response may wait for the buffered request */
+	if( SC_SSL_OUTBUF_PENDING( ud ) > 0 && my_ssl_flush( socket, ud ) < 0 )
+		return SC_ERROR;
+	if( flags & MSG_PEEK ) {
+		/* peeked data stays in the plaintext buffer */
+		if( SC_SSL_RCVBUF_AVAIL( ud ) == 0 ) {
+			r = my_ssl_read_ahead( socket, ud );
+			if( r < 0 ) {
+				mod_sc->sc_set_state( socket, SC_STATE_ERROR );
+				return SC_ERROR;
+			}
+		}
+		*p_len = my_ssl_rcvbuf_read( ud, buf, len, TRUE );
+		return SC_OK;
+	}
+	/* data left by readline() or a peek goes first */
+	len2 = my_ssl_rcvbuf_read( ud, buf, len, FALSE );
+	if( len2 > 0 ) {
 #ifdef SC_DEBUG
 		_debug( "read %d bytes from internal buffer\n", len2 );
 #endif
-		Copy( ud->rcvbuf, buf, len2, char );
-		if( (flags & MSG_PEEK) == 0 ) {
-			ud->rcvbuf_pos -= len2;
-			if( ud->rcvbuf_pos > 0 )
-				Move( ud->rcvbuf + len2, ud->rcvbuf, ud->rcvbuf_pos, char );
-		}
 		len -= len2;
 		if( len == 0 || !SSL_pending( ud->ssl ) ) {
 			*p_len = len2;
 			return SC_OK;
 		}
 	}
-	if( flags & MSG_PEEK ) {
-		if( ud->rcvbuf_len < len + ud->rcvbuf_pos ) {
-			ud->rcvbuf_len = len + ud->rcvbuf_pos;
-			Renew( ud->rcvbuf, ud->rcvbuf_len, char );
-		}
-#ifdef SC_DEBUG
-		_debug( "read %d bytes into internal buffer\n", len );
-#endif
-		r = SSL_read( ud->ssl, ud->rcvbuf + ud->rcvbuf_pos, len );
-	}
-	else {
 #ifdef SC_DEBUG
-		_debug( "read %d bytes\n", len );
+	_debug( "read %d bytes\n", len );
 #endif
-		r = SSL_read( ud->ssl, buf + len2, len );
+	while( (r = SSL_read( ud->ssl, buf + len2, len )) <= 0 ) {
+		if( (err = my_bio_pump( socket, ud, r )) == 0 )
+			break;
+		if( err < 0 )
+			return SC_ERROR;
 	}
 #ifdef SC_DEBUG
 	_debug( "got %d bytes from SSL_read\n", r );
@@ -302,6 +340,9 @@ int mod_sc_ssl_recv( sc_t *socket, char *buf, int len, int flags, int *p_len ) {
 	if( r <= 0 ) {
 		r = SSL_get_error( ud->ssl, r );
 		if( r == SSL_ERROR_WANT_READ ) {
+			/* idle connection, the buffers go back to the pool */
+			if( len2 == 0 )
+				my_ssl_release( ud );
 			*p_len = len2;
 			return SC_OK;
 		}
@@ -313,10 +354,8 @@ int mod_sc_ssl_recv( sc_t *socket, char *buf, int len, int flags, int *p_len ) {
 		mod_sc->sc_set_state( socket, SC_STATE_ERROR );
 		return SC_ERROR;
 	}
-	if( flags & MSG_PEEK ) {
-		Copy( ud->rcvbuf + ud->rcvbuf_pos, buf + len2, r, char );
-		ud->rcvbuf_pos += r;
-	}
+	if( SC_SSL_BIO_FLUSH( socket, ud ) < 0 )
+		return SC_ERROR;
 	*p_len = len2 + r;
 	return SC_OK;
 }
@@ -325,33 +364,66 @@ int mod_sc_ssl_send(
 	sc_t *socket, const char *buf, int len, int flags, int *p_len
 ) {
 	userdata_t *ud;
-	int r, err;
+	int r;
+	size_t size;
 	ud = (userdata_t *) mod_sc->sc_get_userdata( socket );
 	if( ud->ssl == NULL ) {
 		mod_sc->sc_set_errno( socket, ENOTCONN );
 		return SC_ERROR;
 	}
-#ifdef SC_DEBUG
-	_debug( "write %d bytes\n", len );
-#endif
-	r = SSL_write( ud->ssl, buf, len );
-#ifdef SC_DEBUG
-	_debug( "wrote %d bytes\n", r );
-#endif
-	if( r <= 0 ) {
-		r = SSL_get_error( ud->ssl, r );
-		if( r == SSL_ERROR_WANT_WRITE ) {
+	if( ud->outbuf_max == 0 )
+		goto write;
+	/* small writes are packed into full records */
+	if( SC_SSL_OUTBUF_PENDING( ud ) + len > ud->outbuf_max ) {
+		if( (r = my_ssl_flush( socket, ud )) < 0 )
+			return SC_ERROR;
+		if( r == 0 && (size_t) len >= ud->outbuf_max ) {
+			/* too large to be buffered */
+			goto write;
+		}
+		/* take what fits in non-blocking mode */
+		if( SC_SSL_OUTBUF_PENDING( ud ) + len > ud->outbuf_max )
+			len = (int) (ud->outbuf_max - SC_SSL_OUTBUF_PENDING( ud ));
+		if( len == 0 ) {
 			*p_len = 0;
 			return SC_OK;
 		}
-		err = ERR_get_error();
-		if( err == 0 )
-			mod_sc->sc_set_error( socket, r, my_ssl_error( r ) );
-		else
-			mod_sc->sc_set_error( socket, err, ERR_reason_error_string( err ) );
-		mod_sc->sc_set_state( socket, SC_STATE_ERROR );
-		return SC_ERROR;
 	}
+	if( ud->outbuf_len + len > ud->outbuf_size ) {
+		if( ud->outbuf_pos > 0 ) {
+			/* move unsent data to the front */
+			ud->outbuf_len -= ud->outbuf_pos;
+			Move( ud->outbuf + ud->outbuf_pos, ud->outbuf, ud->outbuf_len,
+				char );
+			ud->outbuf_pos = 0;
+		}
+		if( ud->outbuf_len + len > ud->outbuf_size ) {
+			size = ud->outbuf_size * 2;
+			if( size < ud->outbuf_len + len )
+				size = ud->outbuf_len + len;
+			if( size > ud->outbuf_max )
+				size = ud->outbuf_max;
+			ud->outbuf = my_buf_resize(
+				ud, ud->outbuf, &ud->outbuf_size, size, ud->outbuf_len );
+		}
+	}
+	if( ud->outbuf_max_age > 0 && SC_SSL_OUTBUF_PENDING( ud ) == 0 )
+		ud->outbuf_time = my_time_ms();
+	Copy( buf, ud->outbuf + ud->outbuf_len, len, char );
+	ud->outbuf_len += len;
+	if( ud->outbuf_max_age > 0
+		&& my_time_ms() - ud->outbuf_time >= ud->outbuf_max_age
+	) {
+		/* the oldest data has waited long enough */
+		if( my_ssl_flush( socket, ud ) < 0 )
+			return SC_ERROR;
+	}
+	*p_len = len;
+	return SC_OK;
+write:
+	r = my_ssl_write( socket, ud, buf, len );
+	if( r < 0 )
+		return SC_ERROR;
 	*p_len = r;
 	return SC_OK;
 }
@@ -383,151 +455,173 @@ int mod_sc_ssl_write( sc_t *socket, const char *buf, int len, int *p_len ) {
 
 int mod_sc_ssl_readline( sc_t *socket, char **p_buf, int *p_len ) {
 	userdata_t *ud;
-	int r, l, i, pos = 0, len = 1024;
-	char *p, ch;
+	int r;
+	size_t scan = 0;
+	char *p, *s, *e, ch;
 	ud = (userdata_t *) mod_sc->sc_get_userdata( socket );
-	p = ud->buffer;
-	while( TRUE ) {
-		if( ud->buffer_len < (pos + len) ) {
-			ud->buffer_len = (pos + len);
-			Renew( ud->buffer, ud->buffer_len, char );
-			p = ud->buffer + pos;
-		}
-		r = mod_sc_ssl_recv( socket, p, len, MSG_PEEK, &l );
-		if( r != SC_OK ) {
-			if( pos > 0 )
-				break;
-			return SC_ERROR;
-		}
-		if( l == 0 ) {
-			/* line not complete */
-			*p_buf = ud->buffer;
-			*p_len = pos;
-			return SC_OK;
+	if( ud->ssl == NULL ) {
+		mod_sc->sc_set_errno( socket, ENOTCONN );
+		return SC_ERROR;
+	}
+	if( SC_SSL_OUTBUF_PENDING( ud ) > 0 && my_ssl_flush( socket, ud ) < 0 )
+		return SC_ERROR;
+	while( 1 ) {
+		p = ud->rcvbuf + ud->rcvbuf_pos;
+		e = ud->rcvbuf + ud->rcvbuf_len;
+		if( ud->rcvbuf_skip != '\0' && p < e ) {
+			/* second char of a line break from the previous call */
+			if( *p == ud->rcvbuf_skip ) {
+				ud->rcvbuf_pos ++;
+				p ++;
+			}
+			ud->rcvbuf_skip = '\0';
 		}
-		for( i = 0; i < l; i ++, p ++ ) {
-			if( *p != '\n' && *p != '\r' && *p != '\0' )
+		for( s = p + scan; s < e; s ++ ) {
+			ch = *s;
+			if( ch != '\n' && ch != '\r' && ch != '\0' )
 				continue;
 			/* found newline */
 #ifdef SC_DEBUG
-			_debug( "found newline at %d + %d of %d\n", pos, i, l );
+			_debug( "found newline at %d of %d\n", s - p, e - p );
 #endif
-			ch = *p;
-			*p = '\0';
-			*p_buf = ud->buffer;
-			*p_len = pos + i;
+			*s ++ = '\0';
+			*p_buf = p;
+			*p_len = (int) (s - p - 1);
 			if( ch == '\r' || ch == '\n' ) {
-				if( i < (size_t) l ) {
-					if( p[1] == (ch == '\r' ? '\n' : '\r') )
-						i ++;
+				if( s < e ) {
+					if( *s == (ch == '\r' ? '\n' : '\r') )
+						s ++;
 				}
-				else if( l == len ) {
-					r = mod_sc_ssl_recv( socket, p, 1, MSG_PEEK, &l );
-					if( r == SC_OK && l == 1 &&
-						*p == (ch == '\r' ? '\n' : '\r')
-					) {
-						mod_sc_ssl_recv( socket, p, 1, 0, &l );
-					}
+				else {
+					ud->rcvbuf_skip = (ch == '\r' ? '\n' : '\r');
 				}
 			}
-			mod_sc_ssl_recv( socket, ud->buffer + pos, i + 1, 0, &l );
+			ud->rcvbuf_pos = s - ud->rcvbuf;
 			return SC_OK;
 		}
-		mod_sc_ssl_recv( socket, ud->buffer + pos, i, 0, &l );
-		pos += i;
-		if( i < len ) {
-			/* line not complete.
-			 * next recv could block infinitely.
-			 * stop here?
-			 */
-			break;
+		scan = e - p;
+		r = my_ssl_read_ahead( socket, ud );
+		if( r > 0 )
+			continue;
+		if( r == 0 ) {
+			*p_len = 0;
+			if( SC_SSL_RCVBUF_AVAIL( ud ) == 0 ) {
+				/* idle connection, the buffers go back to the pool */
+				my_ssl_release( ud );
+				*p_buf = (char *) "";
+				return SC_OK;
+			}
+			/* would block, keep the partial line for the next call */
+			ud->rcvbuf[ud->rcvbuf_len] = '\0';
+			*p_buf = ud->rcvbuf + ud->rcvbuf_len;
+			return SC_OK;
+		}
+		if( scan > 0 ) {
+			/* return the last line, the error appears on the next call */
+			p = ud->rcvbuf + ud->rcvbuf_pos;
+			p[scan] = '\0';
+			*p_buf = p;
+			*p_len = (int) scan;
+			ud->rcvbuf_pos = ud->rcvbuf_len;
+			return SC_OK;
 		}
+		break;
 	}
-	ud->buffer[pos] = '\0';
-	(*p_buf) = ud->buffer;
-	(*p_len) = pos;
-	return SC_OK;
+	mod_sc->sc_set_state( socket, SC_STATE_ERROR );
+	return SC_ERROR;
 }
 
 int mod_sc_ssl_read_packet(
 	sc_t *socket, char *separator, size_t max, char **p_buf, int *p_len
 ) {
 	userdata_t *ud;
-	int r, l;
-	size_t i, pos = 0, len = 1024, seplen;
-	char *p, *sep;
-	for( sep = separator, seplen = 0; *sep != '\0'; sep++, seplen++ );
+	int r;
+	size_t scan = 0, seplen, avail;
+	char *p, *s, *e;
+	seplen = strlen( separator );
 	if( seplen == 0 ) {
 		mod_sc->sc_set_errno( socket, EINVAL );
 		return SC_ERROR;
 	}
-	sep = separator;
 	if( !max )
 		max = (size_t) -1;
 	ud = (userdata_t *) mod_sc->sc_get_userdata( socket );
-	p = ud->buffer;
-	while( TRUE ) {
-		if( ud->buffer_len < (int) (pos + len) ) {
-			ud->buffer_len = (int) (pos + len);
-			Renew( ud->buffer, ud->buffer_len, char );
-			p = ud->buffer + pos;
+	if( ud->ssl == NULL ) {
+		mod_sc->sc_set_errno( socket, ENOTCONN );
+		return SC_ERROR;
+	}
+	if( SC_SSL_OUTBUF_PENDING( ud ) > 0 && my_ssl_flush( socket, ud ) < 0 )
+		return SC_ERROR;
+	while( 1 ) {
+		if( ud->rcvbuf_skip != '\0' && SC_SSL_RCVBUF_AVAIL( ud ) > 0 ) {
+			/* line break from a previous readline */
+			if( ud->rcvbuf[ud->rcvbuf_pos] == ud->rcvbuf_skip )
+				ud->rcvbuf_pos ++;
+			ud->rcvbuf_skip = '\0';
 		}
-		r = mod_sc_ssl_recv( socket, p, (int) len, MSG_PEEK, &l );
-		if( r != SC_OK ) {
-			if( pos > 0 )
+		p = ud->rcvbuf + ud->rcvbuf_pos;
+		e = ud->rcvbuf + ud->rcvbuf_len;
+		for( s = p + scan; s + seplen <= e; s ++ ) {
+			if( (size_t) (s - p) >= max )
 				break;
-			return SC_ERROR;
-		}
-		if( l == 0 ) {
-			/* packet not complete */
-			*p_buf = ud->buffer;
-			*p_len = (int) pos;
+			if( *s != *separator || memcmp( s, separator, seplen ) != 0 )
+				continue;
+			/* found packet separator */
+#ifdef SC_DEBUG
+			_debug( "found packet separator at %d of %d\n", s - p, e - p );
+#endif
+			*s = '\0';
+			*p_buf = p;
+			*p_len = (int) (s - p);
+			ud->rcvbuf_pos = s + seplen - ud->rcvbuf;
 			return SC_OK;
 		}
-		for( i = 0; i < (size_t) l; i ++, p ++ ) {
-			if( pos + i == max ) {
+		avail = e - p;
+		if( avail >= max ) {
 #ifdef SC_DEBUG
-				_debug( "packet max size %u reached\n", max );
+			_debug( "packet max size %u reached\n", max );
 #endif
-				*p = '\0';
-				*p_buf = ud->buffer;
-				*p_len = (int) (pos + i);
-				if( i > 0 )
-					mod_sc_ssl_recv( socket, ud->buffer + pos, (int) i, 0, &l );
-				return SC_OK;
+			/* the terminating zero would overwrite the next packet */
+			if( ud->buffer_len < max + 1 ) {
+				ud->buffer = my_buf_resize(
+					ud, ud->buffer, &ud->buffer_len, max + 1, 0 );
 			}
-			if( *p != *sep ) {
-				sep = separator;
-				continue;
-			}
-			sep++;
-			if( *sep != '\0' )
-				continue;
-			/* found packet separator */
-#ifdef SC_DEBUG
-			_debug( "found packet separator at %d + %d of %d\n", pos, i, l );
-#endif
-			i++;
-			*p = '\0';
+			Copy( p, ud->buffer, max, char );
+			ud->buffer[max] = '\0';
 			*p_buf = ud->buffer;
-			*p_len = (int) (pos + i - seplen);
-			mod_sc_ssl_recv( socket, ud->buffer + pos, (int) i, 0, &l );
+			*p_len = (int) max;
+			ud->rcvbuf_pos += max;
 			return SC_OK;
 		}
-		mod_sc_ssl_recv( socket, ud->buffer + pos, (int) i, 0, &l );
-		pos += i;
-		if( i < len ) {
-			/* packet not complete.
-			 * next recv could block infinitely.
-			 * stop here?
-			 */
-			break;
+		scan = avail >= seplen ? avail - seplen + 1 : 0;
+		r = my_ssl_read_ahead( socket, ud );
+		if( r > 0 )
+			continue;
+		if( r == 0 ) {
+			*p_len = 0;
+			if( SC_SSL_RCVBUF_AVAIL( ud ) == 0 ) {
+				my_ssl_release( ud );
+				*p_buf = (char *) "";
+				return SC_OK;
+			}
+			/* would block, keep the partial packet for the next call */
+			ud->rcvbuf[ud->rcvbuf_len] = '\0';
+			*p_buf = ud->rcvbuf + ud->rcvbuf_len;
+			return SC_OK;
 		}
+		if( avail > 0 ) {
+			/* return the last packet, the error appears on the next call */
+			p = ud->rcvbuf + ud->rcvbuf_pos;
+			p[avail] = '\0';
+			*p_buf = p;
+			*p_len = (int) avail;
+			ud->rcvbuf_pos = ud->rcvbuf_len;
+			return SC_OK;
+		}
+		break;
 	}
-	ud->buffer[pos] = '\0';
-	*p_buf = ud->buffer;
-	*p_len = (int) pos;
-	return SC_OK;
+	mod_sc->sc_set_state( socket, SC_STATE_ERROR );
+	return SC_ERROR;
 }
 
 int mod_sc_ssl_writeln( sc_t *socket, const char *buf, int len, int *p_len ) {
@@ -536,9 +630,9 @@ int mod_sc_ssl_writeln( sc_t *socket, const char *buf, int len, int *p_len ) {
 	ud = (userdata_t *) mod_sc->sc_get_userdata( socket );
 	if( len <= 0 )
 		len = (int) strlen( buf );
-	if( ud->buffer_len < len + 2 ) {
-		ud->buffer_len = len + 2;
-		Renew( ud->buffer, len, char );
+	if( ud->buffer_len < (size_t) len + 2 ) {
+		ud->buffer = my_buf_resize(
+			ud, ud->buffer, &ud->buffer_len, (size_t) len + 2, 0 );
 	}
 	p = ud->buffer;
 	Copy( buf, p, len, char );
@@ -657,7 +751,7 @@ int mod_sc_ssl_available( sc_t *socket, int *p_len ) {
 		mod_sc->sc_set_errno( socket, ENOTCONN );
 		return SC_ERROR;
 	}
-	*p_len = SSL_pending( ud->ssl );
+	*p_len = (int) SC_SSL_RCVBUF_AVAIL( ud ) + SSL_pending( ud->ssl );
 	return SC_OK;
 }
 
@@ -674,21 +768,30 @@ void *mod_sc_ssl_get_userdata( sc_t *socket ) {
 
 int mod_sc_ssl_set_private_key( sc_t *socket, const char *pk ) {
 	userdata_t *ud = (userdata_t *) mod_sc->sc_get_userdata( socket );
-	sc_ssl_ctx_t *ctx = ud->sc_ssl_ctx;
+	sc_ssl_ctx_t *ctx;
+	if( my_ctx_private( ud ) != SC_OK )
+		return SC_ERROR;
+	ctx = ud->sc_ssl_ctx;
 	ctx->socket = socket;
 	return mod_sc_ssl_ctx_set_private_key( ctx, pk );
 }
 
 int mod_sc_ssl_set_certificate( sc_t *socket, const char *crt ) {
 	userdata_t *ud = (userdata_t *) mod_sc->sc_get_userdata( socket );
-	sc_ssl_ctx_t *ctx = ud->sc_ssl_ctx;
+	sc_ssl_ctx_t *ctx;
+	if( my_ctx_private( ud ) != SC_OK )
+		return SC_ERROR;
+	ctx = ud->sc_ssl_ctx;
 	ctx->socket = socket;
 	return mod_sc_ssl_ctx_set_certificate( ctx, crt );
 }
 
 int mod_sc_ssl_set_client_ca( sc_t *socket, const char *str ) {
 	userdata_t *ud = (userdata_t *) mod_sc->sc_get_userdata( socket );
-	sc_ssl_ctx_t *ctx = ud->sc_ssl_ctx;
+	sc_ssl_ctx_t *ctx;
+	if( my_ctx_private( ud ) != SC_OK )
+		return SC_ERROR;
+	ctx = ud->sc_ssl_ctx;
 	ctx->socket = socket;
 	return mod_sc_ssl_ctx_set_client_ca( ctx, str );
 }
@@ -697,7 +800,10 @@ int mod_sc_ssl_set_verify_locations(
 	sc_t *socket, const char *cafile, const char *capath
 ) {
 	userdata_t *ud = (userdata_t *) mod_sc->sc_get_userdata( socket );
-	sc_ssl_ctx_t *ctx = ud->sc_ssl_ctx;
+	sc_ssl_ctx_t *ctx;
+	if( my_ctx_private( ud ) != SC_OK )
+		return SC_ERROR;
+	ctx = ud->sc_ssl_ctx;
 	ctx->socket = socket;
 	return mod_sc_ssl_ctx_set_verify_locations( ctx, cafile, capath );
 }
@@ -724,10 +830,15 @@ int mod_sc_ssl_shutdown( sc_t *socket ) {
 int mod_sc_ssl_create_client_context( sc_t *socket ) {
 	userdata_t *ud = (userdata_t *) mod_sc->sc_get_userdata( socket );
 	sc_ssl_ctx_t *ctx = ud->sc_ssl_ctx;
+	if( ctx->config_key != NULL && ctx->is_client != TRUE ) {
+		/* do not turn a shared context around */
+		if( my_ctx_private( ud ) != SC_OK )
+			return SC_ERROR;
+		ctx = ud->sc_ssl_ctx;
+	}
 	if( ud->ssl != NULL ) {
 		mod_sc->sc_close( socket );
-		SSL_free( ud->ssl );
-		ud->ssl = NULL;
+		my_ssl_free( ud );
 	}
 	ctx->socket = socket;
 	return mod_sc_ssl_ctx_init_client( ctx );
@@ -736,10 +847,15 @@ int mod_sc_ssl_create_client_context( sc_t *socket ) {
 int mod_sc_ssl_create_server_context( sc_t *socket ) {
 	userdata_t *ud = (userdata_t *) mod_sc->sc_get_userdata( socket );
 	sc_ssl_ctx_t *ctx = ud->sc_ssl_ctx;
+	if( ctx->config_key != NULL && ctx->is_client != FALSE ) {
+		/* do not turn a shared context around */
+		if( my_ctx_private( ud ) != SC_OK )
+			return SC_ERROR;
+		ctx = ud->sc_ssl_ctx;
+	}
 	if( ud->ssl != NULL ) {
 		mod_sc->sc_close( socket );
-		SSL_free( ud->ssl );
-		ud->ssl = NULL;
+		my_ssl_free( ud );
 	}
 	ctx->socket = socket;
 	return mod_sc_ssl_ctx_init_server( ctx );
@@ -755,7 +871,10 @@ int mod_sc_ssl_check_private_key( sc_t *socket ) {
 
 int mod_sc_ssl_enable_compatibility( sc_t *socket ) {
 	userdata_t *ud = (userdata_t *) mod_sc->sc_get_userdata( socket );
-	sc_ssl_ctx_t *ctx = ud->sc_ssl_ctx;
+	sc_ssl_ctx_t *ctx;
+	if( my_ctx_private( ud ) != SC_OK )
+		return SC_ERROR;
+	ctx = ud->sc_ssl_ctx;
 	ctx->socket = socket;
 	return mod_sc_ssl_ctx_enable_compatibility( ctx );
 }
@@ -785,109 +904,542 @@ const char *mod_sc_ssl_get_version( sc_t *socket ) {
 }
 
 int mod_sc_ssl_starttls( sc_t *socket, char **args, int argc ) {
-	int r, err, blocking;
+	int r, i, membio = -1;
 	userdata_t *ud = (userdata_t *) mod_sc->sc_get_userdata( socket );
 	sc_ssl_ctx_t *ctx, *use_ctx = NULL;
+	const char *sn = NULL;
+	for( i = 0; i < argc - 1; i += 2 ) {
+		if( my_stricmp( args[i], "memory_bio" ) == 0 )
+			membio = my_bio_mode( args[i + 1] );
+		else if( my_stricmp( args[i], "server_name" ) == 0 )
+			sn = args[i + 1];
+	}
 	if( ud == NULL ) {
 		Newxz( ud, 1, userdata_t );
 		mod_sc->sc_set_userdata( socket, ud, free_userdata );
-		mod_sc_ssl_ctx_create( NULL, 0, &ud->sc_ssl_ctx );
+		mod_sc_ssl_ctx_create( NULL, 0, &ctx );
+		my_ctx_attach( ud, ctx );
+	}
+	else if( argc > 0 && my_ctx_private( ud ) != SC_OK ) {
+		return SC_ERROR;
 	}
-	mod_sc->sc_get_blocking( socket, &blocking );
-	if( !blocking )
-		mod_sc->sc_set_blocking( socket, 1 );
 	ctx = ud->sc_ssl_ctx;
 	r = mod_sc_ssl_ctx_set_arg( ctx, args, argc, TRUE, &use_ctx );
 	if( r != SC_OK )
-		goto exit;
+		return r;
 	if( use_ctx != NULL ) {
+		my_ctx_attach( ud, use_ctx );
 		mod_sc_ssl_ctx_destroy( ctx );
-		use_ctx->refcnt++;
-		ud->sc_ssl_ctx = ctx = use_ctx;
+		ctx = use_ctx;
+	}
+	if( ud->ssl != NULL )
+		my_ssl_free( ud );
+	if( membio >= 0 )
+		ud->mem_bio = membio;
+	if( sn != NULL ) {
+		Safefree( ud->server_name );
+		ud->server_name = my_strdup( sn );
 	}
 	ud->ssl = SSL_new( ctx->ctx );
-	SSL_set_fd( ud->ssl, (int) mod_sc->sc_get_handle( socket ) );
+	my_ssl_attach( socket, ud );
 	if( ctx->is_client ) {
+		my_set_server_name( ud, NULL );
+		my_ocsp_request( ud );
+		my_session_offer( socket, ud, NULL, NULL );
 		SSL_set_connect_state( ud->ssl );
+		return SC_OK;
 	}
-	else {
-		/* start the handshaking */
-		r = SSL_accept( ud->ssl );
-		if( r < 0 ) {
-			r = SSL_get_error( ud->ssl, r );
-			if( (err = ERR_get_error()) == 0 ) {
-				mod_sc->sc_set_error( socket, r, my_ssl_error( r ) );
-			}
-			else {
-				mod_sc->sc_set_error(
-					socket, err, ERR_reason_error_string( err ) );
-			}
-			r = SC_ERROR;
-			goto exit;
-		}
-	}
-	r = SC_OK;
-exit:
-	if( !blocking )
-		mod_sc->sc_set_blocking( socket, 0 );
-	return r;
+	/* start the handshaking, non-blocking sockets continue with
+	 * mod_sc_ssl_handshake() */
+	r = SSL_accept( ud->ssl );
+	return my_handshake_result( socket, ud, r );
 }
 
 int mod_sc_ssl_set_ssl_method( sc_t *socket, const char *name ) {
 	userdata_t *ud = (userdata_t *) mod_sc->sc_get_userdata( socket );
-	sc_ssl_ctx_t *ctx = ud->sc_ssl_ctx;
+	sc_ssl_ctx_t *ctx;
+	if( my_ctx_private( ud ) != SC_OK )
+		return SC_ERROR;
+	ctx = ud->sc_ssl_ctx;
 	ctx->socket = socket;
 	return mod_sc_ssl_ctx_set_ssl_method( ctx, name );
 }
 
 int mod_sc_ssl_set_cipher_list( sc_t *socket, const char *str ) {
 	userdata_t *ud = (userdata_t *) mod_sc->sc_get_userdata( socket );
-	sc_ssl_ctx_t *ctx = ud->sc_ssl_ctx;
+	sc_ssl_ctx_t *ctx;
+	if( my_ctx_private( ud ) != SC_OK )
+		return SC_ERROR;
+	ctx = ud->sc_ssl_ctx;
 	ctx->socket = socket;
 	return mod_sc_ssl_ctx_set_cipher_list( ctx, str );
 }
 
-/* ssl context */
+int mod_sc_ssl_session_reused( sc_t *socket ) {
+	userdata_t *ud;
+	ud = (userdata_t *) mod_sc->sc_get_userdata( socket );
+	if( ud == NULL || ud->ssl == NULL )
+		return FALSE;
+	return SSL_session_reused( ud->ssl ) ? TRUE : FALSE;
+}
 
-int mod_sc_ssl_ctx_create( char **args, int argc, sc_ssl_ctx_t **p_ctx ) {
+int mod_sc_ssl_handshake( sc_t *socket, int *p_want ) {
+	userdata_t *ud;
 	int r;
-	sc_ssl_ctx_t *ctx;
-	Newxz( ctx, 1, sc_ssl_ctx_t );
-	if( argc > 0 ) {
-		r = mod_sc_ssl_ctx_set_arg( ctx, args, argc, TRUE, NULL );
-		if( r != SC_OK ) {
-			Safefree( ctx );
-			return r;
-		}
+	ud = (userdata_t *) mod_sc->sc_get_userdata( socket );
+	if( ud == NULL || ud->ssl == NULL ) {
+		mod_sc->sc_set_errno( socket, ENOTCONN );
+		return SC_ERROR;
 	}
-	ctx->refcnt = 1;
-#ifdef USE_ITHREADS
-	MUTEX_LOCK( &sc_ssl_global.thread_lock );
-#endif
-	ctx->id = ++sc_ssl_global.counter;
-	r = ctx->id & SC_SSL_CTX_CASCADE;
-	ctx->next = sc_ssl_global.ctx[r];
-	sc_ssl_global.ctx[r] = ctx;
-#ifdef USE_ITHREADS
-	MUTEX_UNLOCK( &sc_ssl_global.thread_lock );
-#endif
-#ifdef SC_DEBUG
-	_debug( "created ctx %d, refcnt %d\n", ctx->id, ctx->refcnt );
-#endif
-	(*p_ctx) = ctx;
+	if( ! SSL_is_init_finished( ud->ssl ) ) {
+		r = SSL_do_handshake( ud->ssl );
+		if( my_handshake_result( socket, ud, r ) != SC_OK )
+			return SC_ERROR;
+	}
+	else {
+		/* finished by read or write */
+		ud->handshake = 0;
+	}
+	*p_want = ud->handshake;
 	return SC_OK;
 }
 
-int mod_sc_ssl_ctx_destroy( sc_ssl_ctx_t *ctx ) {
-#ifdef SC_DEBUG
-	_debug( "destroy ctx %d, refcnt %d\n", ctx->id, ctx->refcnt );
+int mod_sc_ssl_ktls_active( sc_t *socket ) {
+	userdata_t *ud;
+	int r = 0;
+	ud = (userdata_t *) mod_sc->sc_get_userdata( socket );
+	if( ud == NULL || ud->ssl == NULL )
+		return 0;
+#ifdef SC_SSL_USE_KTLS
+	if( BIO_get_ktls_send( SSL_get_wbio( ud->ssl ) ) )
+		r |= SC_SSL_KTLS_TX;
+	if( BIO_get_ktls_recv( SSL_get_rbio( ud->ssl ) ) )
+		r |= SC_SSL_KTLS_RX;
 #endif
-	if( --ctx->refcnt > 0 )
-		return SC_OK;
-	if( remove_context( ctx ) == SC_OK ) {
-		free_context( ctx );
-		return SC_OK;
-	}
+	return r;
+}
+
+int mod_sc_ssl_sendfile(
+	sc_t *socket, int fd, off_t offset, size_t length, size_t *p_len
+) {
+	userdata_t *ud;
+	struct stat st;
+	size_t sent = 0, size;
+	int r, len;
+	char *buf;
+#ifdef SC_SSL_USE_KTLS
+	ossl_ssize_t n;
+	int err;
+#endif
+	ud = (userdata_t *) mod_sc->sc_get_userdata( socket );
+	if( ud->ssl == NULL ) {
+		mod_sc->sc_set_errno( socket, ENOTCONN );
+		return SC_ERROR;
+	}
+	if( SC_SSL_OUTBUF_PENDING( ud ) > 0 ) {
+		if( (r = my_ssl_flush( socket, ud )) != 0 ) {
+			if( r < 0 )
+				return SC_ERROR;
+			/* buffered data goes first */
+			*p_len = 0;
+			return SC_OK;
+		}
+	}
+	if( length == 0 ) {
+		/* send up to the end of the file */
+		if( fstat( fd, &st ) != 0 ) {
+			mod_sc->sc_set_errno( socket, errno );
+			return SC_ERROR;
+		}
+		if( st.st_size > offset )
+			length = (size_t) (st.st_size - offset);
+	}
+#ifdef SC_SSL_USE_KTLS
+	if( BIO_get_ktls_send( SSL_get_wbio( ud->ssl ) ) ) {
+		/* the kernel encrypts, file data is not copied to user space */
+		while( sent < length ) {
+			/* the result is kept wide, files may be larger than 2 GB */
+			n = SSL_sendfile( ud->ssl, fd, offset + sent, length - sent, 0 );
+			if( n <= 0 ) {
+				r = SSL_get_error( ud->ssl, (int) n );
+				if( r == SSL_ERROR_WANT_WRITE )
+					break;
+				err = ERR_get_error();
+				if( err == 0 )
+					mod_sc->sc_set_error( socket, r, my_ssl_error( r ) );
+				else
+					mod_sc->sc_set_error(
+						socket, err, ERR_reason_error_string( err ) );
+				mod_sc->sc_set_state( socket, SC_STATE_ERROR );
+				return SC_ERROR;
+			}
+			sent += (size_t) n;
+		}
+		*p_len = sent;
+		return SC_OK;
+	}
+#endif
+#ifdef _WIN32
+	/* no pread(), the file offset moves */
+	if( lseek( fd, offset, SEEK_SET ) == (off_t) -1 ) {
+		mod_sc->sc_set_errno( socket, errno );
+		return SC_ERROR;
+	}
+#endif
+	buf = my_buf_get( ud, SC_SSL_RECORD_MAX, &size );
+	while( sent < length ) {
+		len = (int) (length - sent < SC_SSL_RECORD_MAX
+			? length - sent : SC_SSL_RECORD_MAX);
+#ifdef _WIN32
+		len = read( fd, buf, len );
+#else
+		/* the file offset of the caller stays, as with sendfile() */
+		len = (int) pread( fd, buf, len, offset + sent );
+#endif
+		if( len <= 0 ) {
+			if( len == 0 )
+				break;
+			mod_sc->sc_set_errno( socket, errno );
+			my_buf_put( ud, buf, size );
+			return SC_ERROR;
+		}
+		r = my_ssl_write( socket, ud, buf, len );
+		if( r < 0 ) {
+			my_buf_put( ud, buf, size );
+			return SC_ERROR;
+		}
+		sent += r;
+		if( r < len )
+			break;
+	}
+	my_buf_put( ud, buf, size );
+	*p_len = sent;
+	return SC_OK;
+}
+
+int mod_sc_ssl_set_output_buffer(
+	sc_t *socket, size_t size, int flags, int max_age
+) {
+	userdata_t *ud;
+	int r;
+	ud = (userdata_t *) mod_sc->sc_get_userdata( socket );
+	if( SC_SSL_OUTBUF_PENDING( ud ) > size ) {
+		if( (r = my_ssl_flush( socket, ud )) < 0 )
+			return SC_ERROR;
+		if( (size_t) r > size ) {
+			mod_sc->sc_set_errno( socket, EWOULDBLOCK );
+			return SC_ERROR;
+		}
+	}
+	/* records are never sent partially, flags are not used */
+	ud->outbuf_max = size;
+	ud->outbuf_max_age = max_age;
+	if( size == 0 ) {
+		my_buf_put( ud, ud->outbuf, ud->outbuf_size );
+		ud->outbuf = NULL;
+		ud->outbuf_size = ud->outbuf_len = ud->outbuf_pos = 0;
+	}
+	return SC_OK;
+}
+
+int mod_sc_ssl_flush( sc_t *socket, size_t *p_pending ) {
+	userdata_t *ud;
+	int r = 0;
+	ud = (userdata_t *) mod_sc->sc_get_userdata( socket );
+	if( SC_SSL_OUTBUF_PENDING( ud ) > 0 ) {
+		if( ud->ssl == NULL ) {
+			mod_sc->sc_set_errno( socket, ENOTCONN );
+			return SC_ERROR;
+		}
+		if( (r = my_ssl_flush( socket, ud )) < 0 )
+			return SC_ERROR;
+	}
+	if( ud->ssl != NULL && SC_SSL_BIO_FLUSH( socket, ud ) < 0 )
+		return SC_ERROR;
+	*p_pending = (size_t) r + SC_SSL_NETBUF_PENDING( ud );
+	return SC_OK;
+}
+
+size_t mod_sc_ssl_get_output_pending( sc_t *socket ) {
+	userdata_t *ud;
+	ud = (userdata_t *) mod_sc->sc_get_userdata( socket );
+	return SC_SSL_OUTBUF_PENDING( ud ) + SC_SSL_NETBUF_PENDING( ud );
+}
+
+int mod_sc_ssl_is_readable( sc_t *socket, double timeout, int *readable ) {
+	userdata_t *ud;
+	int r;
+	ud = (userdata_t *) mod_sc->sc_get_userdata( socket );
+	if( ud != NULL && ud->workers != NULL && ! ud->defer_handshake ) {
+		/* a listener is readable when a handshake is done */
+		r = my_workers_poll( socket, ud, timeout < 0 ? -1 : (int) timeout );
+		if( r < 0 )
+			return SC_ERROR;
+		*readable = r;
+		return SC_OK;
+	}
+	if( ud != NULL && ud->ssl != NULL ) {
+		/* a response may wait for the buffered request */
+		if( SC_SSL_OUTBUF_PENDING( ud ) > 0 && my_ssl_flush( socket, ud ) < 0 )
+			return SC_ERROR;
+		/* data buffered in user space is not seen by the kernel */
+		if( SC_SSL_RCVBUF_AVAIL( ud ) > 0 || SSL_pending( ud->ssl ) > 0 ) {
+			*readable = TRUE;
+			return SC_OK;
+		}
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+		if( ud->sc_ssl_ctx->read_ahead && SSL_has_pending( ud->ssl ) ) {
+			*readable = TRUE;
+			return SC_OK;
+		}
+#endif
+		if( ud->mem_bio && BIO_ctrl_pending( SSL_get_rbio( ud->ssl ) ) > 0 ) {
+			*readable = TRUE;
+			return SC_OK;
+		}
+		if( ud->mem_bio == SC_SSL_BIO_MANUAL ) {
+			/* records are fed by the caller */
+			*readable = FALSE;
+			return SC_OK;
+		}
+		/* the connection waits, its buffers are not needed meanwhile */
+		my_ssl_release( ud );
+	}
+	return mod_sc->sc_is_readable( socket, timeout, readable );
+}
+
+int mod_sc_ssl_close( sc_t *socket ) {
+	userdata_t *ud;
+	ud = (userdata_t *) mod_sc->sc_get_userdata( socket );
+	if( ud != NULL ) {
+		/* errors of the last flush do not keep the socket open */
+		if( ud->ssl != NULL && SC_SSL_OUTBUF_PENDING( ud ) > 0 )
+			my_ssl_flush( socket, ud );
+		if( ud->ssl != NULL )
+			SC_SSL_BIO_FLUSH( socket, ud );
+		ud->outbuf_pos = ud->outbuf_len = 0;
+		ud->netbuf_pos = ud->netbuf_len = 0;
+	}
+	return mod_sc->sc_close( socket );
+}
+
+int mod_sc_ssl_bio_write( sc_t *socket, const char *buf, int len, int *p_len ) {
+	userdata_t *ud;
+	int r;
+	ud = (userdata_t *) mod_sc->sc_get_userdata( socket );
+	if( ud->ssl == NULL || ! ud->mem_bio ) {
+		mod_sc->sc_set_errno( socket, ud->ssl == NULL ? ENOTCONN : EINVAL );
+		return SC_ERROR;
+	}
+	/* memory bios take everything */
+	r = len > 0 ? BIO_write( SSL_get_rbio( ud->ssl ), buf, len ) : 0;
+	*p_len = r > 0 ? r : 0;
+	return SC_OK;
+}
+
+int mod_sc_ssl_bio_read( sc_t *socket, char *buf, int len, int *p_len ) {
+	userdata_t *ud;
+	int r;
+	ud = (userdata_t *) mod_sc->sc_get_userdata( socket );
+	if( ud->ssl == NULL || ! ud->mem_bio ) {
+		mod_sc->sc_set_errno( socket, ud->ssl == NULL ? ENOTCONN : EINVAL );
+		return SC_ERROR;
+	}
+	r = BIO_read( SSL_get_wbio( ud->ssl ), buf, len );
+	*p_len = r > 0 ? r : 0;
+	return SC_OK;
+}
+
+size_t mod_sc_ssl_bio_pending( sc_t *socket ) {
+	userdata_t *ud;
+	ud = (userdata_t *) mod_sc->sc_get_userdata( socket );
+	if( ud->ssl == NULL || ! ud->mem_bio )
+		return 0;
+	return BIO_ctrl_pending( SSL_get_wbio( ud->ssl ) );
+}
+
+int mod_sc_ssl_memory_usage( sc_t *socket, sc_ssl_memory_t *mem ) {
+	userdata_t *ud;
+	ud = (userdata_t *) mod_sc->sc_get_userdata( socket );
+	my_mem_update( ud );
+	mem->sockets = 1;
+	mem->buffers = (long) ud->mem_buffers;
+	mem->ssl_buffers = (long) ud->mem_ssl;
+	SC_SSL_MUTEX_LOCK( &sc_ssl_global.thread_lock );
+	mem->pool = (long) sc_ssl_global.pool_bytes;
+	SC_SSL_MUTEX_UNLOCK( &sc_ssl_global.thread_lock );
+	mem->total = mem->buffers + mem->ssl_buffers;
+	return SC_OK;
+}
+int mod_sc_ssl_set_handshake_threads( sc_t *socket, int threads, int timeout ) {
+	userdata_t *ud;
+	ud = (userdata_t *) mod_sc->sc_get_userdata( socket );
+	if( threads < 0 || threads > SC_SSL_WORKER_MAX || ud->mem_bio ) {
+		mod_sc->sc_set_errno( socket, EINVAL );
+		return SC_ERROR;
+	}
+	/* a running pool is replaced, handshakes in progress are aborted */
+	if( ud->workers != NULL )
+		my_workers_stop( ud );
+	if( threads == 0 )
+		return SC_OK;
+	if( timeout <= 0 )
+		timeout = SC_SSL_WORKER_TIMEOUT;
+	return my_workers_start( socket, ud, threads, timeout );
+}
+
+int mod_sc_ssl_handshake_pending( sc_t *socket ) {
+	userdata_t *ud;
+	int r;
+	ud = (userdata_t *) mod_sc->sc_get_userdata( socket );
+	if( ud->workers == NULL )
+		return 0;
+	SC_SSL_MUTEX_LOCK( &ud->workers->lock );
+	r = ud->workers->pending;
+	SC_SSL_MUTEX_UNLOCK( &ud->workers->lock );
+	return r;
+}
+
+
+int mod_sc_ssl_add_server_name(
+	sc_t *socket, const char *name, sc_ssl_ctx_t *target
+) {
+	userdata_t *ud = (userdata_t *) mod_sc->sc_get_userdata( socket );
+	sc_ssl_ctx_t *ctx;
+	if( my_ctx_private( ud ) != SC_OK )
+		return SC_ERROR;
+	ctx = ud->sc_ssl_ctx;
+	ctx->socket = socket;
+	return mod_sc_ssl_ctx_add_server_name( ctx, name, target );
+}
+
+int mod_sc_ssl_remove_server_name( sc_t *socket, const char *name ) {
+	userdata_t *ud = (userdata_t *) mod_sc->sc_get_userdata( socket );
+	sc_ssl_ctx_t *ctx;
+	if( my_ctx_private( ud ) != SC_OK )
+		return SC_ERROR;
+	ctx = ud->sc_ssl_ctx;
+	ctx->socket = socket;
+	return mod_sc_ssl_ctx_remove_server_name( ctx, name );
+}
+
+const char *mod_sc_ssl_get_server_name( sc_t *socket ) {
+	userdata_t *ud;
+	ud = (userdata_t *) mod_sc->sc_get_userdata( socket );
+	if( ud->ssl == NULL )
+		return NULL;
+#ifdef SC_SSL_USE_SNI
+	return SSL_get_servername( ud->ssl, TLSEXT_NAMETYPE_host_name );
+#else
+	return NULL;
+#endif
+}
+
+int mod_sc_ssl_get_peer_certificate( sc_t *socket, char **p_buf, int *p_len ) {
+	userdata_t *ud;
+	X509 *cert;
+	BIO *bio;
+	char *data;
+	long len;
+	ud = (userdata_t *) mod_sc->sc_get_userdata( socket );
+	if( ud->ssl == NULL ) {
+		mod_sc->sc_set_errno( socket, ENOTCONN );
+		return SC_ERROR;
+	}
+	cert = SSL_get_peer_certificate( ud->ssl );
+	if( cert == NULL ) {
+		/* anonymous peer, or a client without certificate */
+		*p_buf = NULL;
+		*p_len = 0;
+		return SC_OK;
+	}
+	bio = BIO_new( BIO_s_mem() );
+	PEM_write_bio_X509( bio, cert );
+	X509_free( cert );
+	len = BIO_get_mem_data( bio, &data );
+	if( ud->buffer_len < (size_t) len + 1 ) {
+		ud->buffer = my_buf_resize(
+			ud, ud->buffer, &ud->buffer_len, (size_t) len + 1, 0 );
+	}
+	Copy( data, ud->buffer, len, char );
+	ud->buffer[len] = '\0';
+	BIO_free( bio );
+	*p_buf = ud->buffer;
+	*p_len = (int) len;
+	return SC_OK;
+}
+
+int mod_sc_ssl_get_ocsp_response( sc_t *socket, char **p_buf, int *p_len ) {
+	userdata_t *ud;
+	unsigned char *resp = NULL;
+	long len = -1;
+	ud = (userdata_t *) mod_sc->sc_get_userdata( socket );
+	if( ud->ssl == NULL ) {
+		mod_sc->sc_set_errno( socket, ENOTCONN );
+		return SC_ERROR;
+	}
+#ifdef SC_SSL_USE_OCSP
+	len = SSL_get_tlsext_status_ocsp_resp( ud->ssl, &resp );
+#endif
+	if( len <= 0 || resp == NULL ) {
+		/* not requested or not sent by the server */
+		*p_buf = NULL;
+		*p_len = 0;
+		return SC_OK;
+	}
+	if( ud->buffer_len < (size_t) len ) {
+		ud->buffer = my_buf_resize(
+			ud, ud->buffer, &ud->buffer_len, (size_t) len, 0 );
+	}
+	Copy( resp, ud->buffer, len, char );
+	*p_buf = ud->buffer;
+	*p_len = (int) len;
+	return SC_OK;
+}
+
+
+/* ssl context */
+
+int mod_sc_ssl_ctx_create( char **args, int argc, sc_ssl_ctx_t **p_ctx ) {
+	int r;
+	sc_ssl_ctx_t *ctx;
+	Newxz( ctx, 1, sc_ssl_ctx_t );
+	ctx->session_cache = SC_SSL_SESS_DEFAULT;
+	ctx->session_cache_size = -1;
+	ctx->session_timeout = -1;
+	ctx->sessions_max = SC_SSL_SESS_STORE_MAX;
+	ctx->verify_timeout = SC_SSL_VERIFY_TIMEOUT;
+	if( argc > 0 ) {
+		r = mod_sc_ssl_ctx_set_arg( ctx, args, argc, TRUE, NULL );
+		if( r != SC_OK ) {
+			free_context( ctx );
+			return r;
+		}
+	}
+	ctx->refcnt = 1;
+	SC_SSL_MUTEX_LOCK( &sc_ssl_global.thread_lock );
+	ctx->id = ++sc_ssl_global.counter;
+	r = ctx->id & SC_SSL_CTX_CASCADE;
+	ctx->next = sc_ssl_global.ctx[r];
+	sc_ssl_global.ctx[r] = ctx;
+	SC_SSL_MUTEX_UNLOCK( &sc_ssl_global.thread_lock );
+#ifdef SC_DEBUG
+	_debug( "created ctx %d, refcnt %d\n", ctx->id, ctx->refcnt );
+#endif
+	(*p_ctx) = ctx;
+	return SC_OK;
+}
+
+int mod_sc_ssl_ctx_destroy( sc_ssl_ctx_t *ctx ) {
+#ifdef SC_DEBUG
+	_debug( "destroy ctx %d, refcnt %d\n", ctx->id, ctx->refcnt );
+#endif
+	if( SC_SSL_REF_DEC( &ctx->refcnt ) > 0 )
+		return SC_OK;
+	if( remove_context( ctx ) == SC_OK ) {
+		free_context( ctx );
+		return SC_OK;
+	}
 	mod_sc->sc_set_error( NULL, -9999, "Invalid context" );
 	return SC_ERROR;
 }
@@ -923,10 +1475,8 @@ sc_ssl_ctx_t *mod_sc_ssl_ctx_from_class( SV *sv ) {
 		return NULL;
 	id = (int) SvIV( sv );
 	i = id & SC_SSL_CTX_CASCADE;
-#ifdef USE_ITHREADS
 	if( !sc_ssl_global.destroyed )
-		MUTEX_LOCK( &sc_ssl_global.thread_lock );
-#endif
+		SC_SSL_MUTEX_LOCK( &sc_ssl_global.thread_lock );
 	for( ctx = sc_ssl_global.ctx[i]; ctx != NULL; ctx = ctx->next ) {
 		if( ctx->id == id )
 			goto found;
@@ -935,10 +1485,8 @@ sc_ssl_ctx_t *mod_sc_ssl_ctx_from_class( SV *sv ) {
 	_debug( "ctx %d NOT found\n", id );
 #endif
 found:
-#ifdef USE_ITHREADS
 	if( !sc_ssl_global.destroyed )
-		MUTEX_UNLOCK( &sc_ssl_global.thread_lock );
-#endif
+		SC_SSL_MUTEX_UNLOCK( &sc_ssl_global.thread_lock );
 	return ctx;
 }
 
@@ -948,7 +1496,12 @@ int mod_sc_ssl_ctx_set_arg(
 ) {
 	int r, i;
 	char *key, *val, *pk = NULL, *crt = NULL, *cca = NULL, *caf = NULL;
-	char *cap = NULL, *ciphlist = NULL, *sslmethod = NULL;
+	char *cap = NULL, *ciphlist = NULL, *sslmethod = NULL, *sidctx = NULL;
+	char *tkey = NULL, *ocspfile = NULL;
+	int sessmode = SC_SSL_SESS_DEFAULT, notickets = -1, storemax = -1;
+	int ktls = -1, readahead = -1, dynrec = -1, relbuf = -1, stapling = -1;
+	int files, verifypeer = -1, verifymax = -1, shared = -1;
+	long sesssize = -1, sesstimeout = -1, verifytimeout = -1;
 	sc_ssl_ctx_t *usectx = NULL;
 	if( argc % 2 ) {
 		mod_sc->sc_set_errno( ctx->socket, EINVAL );
@@ -976,12 +1529,42 @@ int mod_sc_ssl_ctx_set_arg(
 				cap = val;
 			}
 			break;
+		case 'd':
+		case 'D':
+			if( my_stricmp( key, "dynamic_records" ) == 0 ) {
+				dynrec = *val != '\0' && *val != '0';
+			}
+			break;
+		case 'k':
+		case 'K':
+			if( my_stricmp( key, "ktls" ) == 0 ) {
+				ktls = *val != '\0' && *val != '0';
+			}
+			break;
+		case 'o':
+		case 'O':
+			if( my_stricmp( key, "ocsp_response" ) == 0 ) {
+				ocspfile = val;
+			}
+			else if( my_stricmp( key, "ocsp_stapling" ) == 0 ) {
+				stapling = *val != '\0' && *val != '0';
+			}
+			break;
 		case 'p':
 		case 'P':
 			if( my_stricmp( key, "private_key" ) == 0 ) {
 				pk = val;
 			}
 			break;
+		case 'r':
+		case 'R':
+			if( my_stricmp( key, "read_ahead" ) == 0 ) {
+				readahead = *val != '\0' && *val != '0';
+			}
+			else if( my_stricmp( key, "release_buffers" ) == 0 ) {
+				relbuf = *val != '\0' && *val != '0';
+			}
+			break;
 		case 's':
 		case 'S':
 			if( my_stricmp( key, "server" ) == 0 ) {
@@ -990,6 +1573,33 @@ int mod_sc_ssl_ctx_set_arg(
 			else if( my_stricmp( key, "ssl_method" ) == 0 ) {
 				sslmethod = val;
 			}
+			else if( my_stricmp( key, "session_cache" ) == 0 ) {
+				sessmode = my_session_cache_mode( val );
+			}
+			else if( my_stricmp( key, "session_cache_size" ) == 0 ) {
+				sesssize = atol( val );
+			}
+			else if( my_stricmp( key, "session_timeout" ) == 0 ) {
+				sesstimeout = atol( val );
+			}
+			else if( my_stricmp( key, "session_id_context" ) == 0 ) {
+				sidctx = val;
+			}
+			else if( my_stricmp( key, "session_tickets" ) == 0 ) {
+				notickets = *val == '\0' || *val == '0';
+			}
+			else if( my_stricmp( key, "session_store" ) == 0 ) {
+				storemax = atoi( val );
+			}
+			else if( my_stricmp( key, "shared_session_cache" ) == 0 ) {
+				shared = atoi( val );
+			}
+			break;
+		case 't':
+		case 'T':
+			if( my_stricmp( key, "ticket_key" ) == 0 ) {
+				tkey = val;
+			}
 			break;
 		case 'u':
 		case 'U':
@@ -997,53 +1607,128 @@ int mod_sc_ssl_ctx_set_arg(
 				usectx = (sc_ssl_ctx_t *) val;
 			}
 			break;
+		case 'v':
+		case 'V':
+			if( my_stricmp( key, "verify_peer" ) == 0 ) {
+				verifypeer = *val != '\0' && *val != '0';
+			}
+			else if( my_stricmp( key, "verify_cache" ) == 0 ) {
+				verifymax = atoi( val );
+			}
+			else if( my_stricmp( key, "verify_timeout" ) == 0 ) {
+				verifytimeout = atol( val );
+			}
+			break;
 		}
 	}
 	if( usectx != NULL && usectx->ctx != NULL && p_ctx != NULL ) {
 #ifdef SC_DEBUG
 		_debug( "use ctx %d\n", usectx->id );
 #endif
+		SC_SSL_REF_INC( &usectx->refcnt );
 		(*p_ctx) = usectx;
 		return SC_OK;
 	}
+	usectx = NULL;
 	ctx->is_client = is_client;
 	r = mod_sc_ssl_ctx_set_ssl_method( ctx, sslmethod );
 	if( r != SC_OK )
 		return SC_ERROR;
-	if( is_client >= 0 ) {
-		if( is_client )
-			r = mod_sc_ssl_ctx_init_client( ctx );
-		else
-			r = mod_sc_ssl_ctx_init_server( ctx );
+	/* session settings are picked up by the context initialization */
+	if( notickets >= 0 )
+		ctx->no_tickets = notickets;
+	if( tkey != NULL ) {
+		r = mod_sc_ssl_ctx_set_ticket_key( ctx, tkey );
 		if( r != SC_OK )
 			return r;
 	}
-	if( crt != NULL ) {
-		r = mod_sc_ssl_ctx_set_certificate( ctx, crt );
+	if( sidctx != NULL ) {
+		r = mod_sc_ssl_ctx_set_session_id_context( ctx, sidctx );
 		if( r != SC_OK )
 			return r;
 	}
-	if( pk != NULL ) {
-		r = mod_sc_ssl_ctx_set_private_key( ctx, pk );
-		if( r != SC_OK )
-			return r;
-	}
-	if( cca != NULL ) {
-		r = mod_sc_ssl_ctx_set_client_ca( ctx, cca );
-		if( r != SC_OK )
-			return r;
+	if( storemax >= 0 )
+		ctx->sessions_max = storemax;
+	if( ktls >= 0 )
+		mod_sc_ssl_ctx_set_ktls( ctx, ktls );
+	if( readahead >= 0 )
+		mod_sc_ssl_ctx_set_read_ahead( ctx, readahead );
+	if( dynrec >= 0 )
+		mod_sc_ssl_ctx_set_dynamic_records( ctx, dynrec );
+	if( relbuf >= 0 )
+		mod_sc_ssl_ctx_set_release_buffers( ctx, relbuf );
+	if( stapling >= 0 )
+		ctx->ocsp_stapling = stapling;
+	if( verifypeer >= 0 )
+		mod_sc_ssl_ctx_set_verify_peer( ctx, verifypeer );
+	if( verifymax >= 0 || verifytimeout > 0 )
+		mod_sc_ssl_ctx_set_verify_cache( ctx, verifymax, verifytimeout );
+	r = mod_sc_ssl_ctx_set_session_cache(
+		ctx, sessmode, sesssize, sesstimeout );
+	if( r != SC_OK )
+		return r;
+	if( shared >= 0 ) {
+		if( is_client >= 0 && ctx->ctx == NULL && p_ctx != NULL ) {
+			/* not mapped when an identical context is found below */
+			ctx->shared_size = shared;
+		}
+		else {
+			r = mod_sc_ssl_ctx_set_shared_session_cache( ctx, shared );
+			if( r != SC_OK )
+				return r;
+		}
 	}
-	if( caf != NULL || cap != NULL ) {
-		r = mod_sc_ssl_ctx_set_verify_locations( ctx, caf, cap );
+	files = ctx->ctx == NULL;
+	if( files ) {
+		/* files are loaded by the initialization below */
+		r = my_ctx_set_files( ctx, crt, pk, cca, caf, cap, ciphlist );
 		if( r != SC_OK )
 			return r;
+		/* the response is checked against the certificate loaded above */
+		if( ocspfile != NULL ) {
+			r = mod_sc_ssl_ctx_load_ocsp_response( ctx, ocspfile );
+			if( r != SC_OK )
+				return r;
+		}
 	}
-	if( ciphlist != NULL ) {
-		r = mod_sc_ssl_ctx_set_cipher_list( ctx, ciphlist );
+	if( is_client >= 0 ) {
+		if( ctx->ctx == NULL && p_ctx != NULL ) {
+			/* identical configurations share one context */
+			usectx = my_ctx_config_lookup( ctx );
+			if( usectx != NULL ) {
+#ifdef SC_DEBUG
+				_debug( "share ctx %d\n", usectx->id );
+#endif
+				(*p_ctx) = usectx;
+				return SC_OK;
+			}
+			if( ctx->shared_size > 0 ) {
+				r = mod_sc_ssl_ctx_set_shared_session_cache(
+					ctx, ctx->shared_size );
+				if( r != SC_OK )
+					return r;
+			}
+			r = is_client
+				? mod_sc_ssl_ctx_init_client( ctx )
+				: mod_sc_ssl_ctx_init_server( ctx );
+			if( r != SC_OK )
+				return r;
+			my_ctx_config_register( ctx );
+			return SC_OK;
+		}
+		if( is_client )
+			r = mod_sc_ssl_ctx_init_client( ctx );
+		else
+			r = mod_sc_ssl_ctx_init_server( ctx );
 		if( r != SC_OK )
 			return r;
 	}
-	return SC_OK;
+	if( files )
+		return SC_OK;
+	r = my_ctx_set_files( ctx, crt, pk, cca, caf, cap, ciphlist );
+	if( r != SC_OK || ocspfile == NULL )
+		return r;
+	return mod_sc_ssl_ctx_load_ocsp_response( ctx, ocspfile );
 }
 
 int mod_sc_ssl_ctx_set_ssl_method( sc_ssl_ctx_t *ctx, const char *name ) {
@@ -1076,13 +1761,12 @@ int mod_sc_ssl_ctx_set_private_key( sc_ssl_ctx_t *ctx, const char *pk ) {
 	int r, l = (int) strlen( pk );
 	Renew( ctx->private_key, l + 1, char );
 	Copy( pk, ctx->private_key, l + 1, char );
+	/* the key is parsed once and used by every (re)initialization */
+	r = my_ctx_load_private_key( ctx, ctx->private_key );
+	if( r != SC_OK )
+		return r;
 	if( ctx->ctx != NULL ) {
-		/* set the private key from KeyFile */
-#ifdef SC_DEBUG
-		_debug( "use private key from '%s'\n", ctx->private_key );
-#endif
-		r = SSL_CTX_use_PrivateKey_file(
-			ctx->ctx, ctx->private_key, SSL_FILETYPE_PEM );
+		r = SSL_CTX_use_PrivateKey( ctx->ctx, ctx->pkey );
 		if( ! r ) {
 			r = ERR_get_error();
 			mod_sc->sc_set_error(
@@ -1097,13 +1781,13 @@ int mod_sc_ssl_ctx_set_certificate( sc_ssl_ctx_t *ctx, const char *crt ) {
 	int r, l = (int) strlen( crt );
 	Renew( ctx->certificate, l + 1, char );
 	Copy( crt, ctx->certificate, l + 1, char );
+	r = my_ctx_load_certificate( ctx, ctx->certificate );
+	if( r != SC_OK )
+		return r;
+	/* a stapled response belongs to the old certificate */
+	my_ocsp_clear( ctx );
 	if( ctx->ctx != NULL ) {
-		/* set the local certificate from CertFile */
-#ifdef SC_DEBUG
-		_debug( "use certificate from '%s'\n", ctx->certificate );
-#endif
-		r = SSL_CTX_use_certificate_chain_file(
-			ctx->ctx, ctx->certificate );
+		r = my_ctx_use_certificate( ctx );
 		if( ! r ) {
 			r = ERR_get_error();
 			mod_sc->sc_set_error(
@@ -1140,13 +1824,15 @@ int mod_sc_ssl_ctx_set_verify_locations(
 	}
 	if( capath != NULL ) {
 		r = (int) strlen( capath );
-		Newx( ctx->ca_path, r + 1, char );
+		Renew( ctx->ca_path, r + 1, char );
 		Copy( capath, ctx->ca_path, r + 1, char );
 	}
 	else if( ctx->ca_path != NULL ) {
 		Safefree( ctx->ca_path );
 		ctx->ca_path = NULL;
 	}
+	/* chains were verified against the old locations */
+	my_verify_trim( ctx, 0 );
 	if( ctx->ctx != NULL ) {
 		r = SSL_CTX_load_verify_locations( ctx->ctx, cafile, capath );
 		if( ! r ) {
@@ -1202,6 +1888,406 @@ int mod_sc_ssl_ctx_enable_compatibility( sc_ssl_ctx_t *ctx ) {
 	return SC_OK;
 }
 
+int mod_sc_ssl_ctx_set_session_cache(
+	sc_ssl_ctx_t *ctx, int mode, long size, long timeout
+) {
+	if( mode != SC_SSL_SESS_DEFAULT )
+		ctx->session_cache = mode;
+	if( size >= 0 )
+		ctx->session_cache_size = size;
+	if( timeout >= 0 )
+		ctx->session_timeout = timeout;
+	if( ctx->ctx != NULL )
+		my_ctx_init_sessions( ctx, ! ctx->is_client );
+	return SC_OK;
+}
+
+int mod_sc_ssl_ctx_set_session_id_context(
+	sc_ssl_ctx_t *ctx, const char *str
+) {
+	int l = (int) strlen( str );
+	if( l > SSL_MAX_SID_CTX_LENGTH ) {
+		mod_sc->sc_set_error( ctx->socket, -9999,
+			"Session id context is longer than %d bytes",
+			SSL_MAX_SID_CTX_LENGTH );
+		return SC_ERROR;
+	}
+	Renew( ctx->session_id_context, l + 1, char );
+	Copy( str, ctx->session_id_context, l + 1, char );
+	if( ctx->ctx != NULL && ! ctx->is_client ) {
+		SSL_CTX_set_session_id_context(
+			ctx->ctx, (unsigned char *) ctx->session_id_context, l );
+	}
+	return SC_OK;
+}
+
+int mod_sc_ssl_ctx_set_ticket_key( sc_ssl_ctx_t *ctx, const char *key ) {
+	sc_ssl_ticket_key_t tk;
+	unsigned char *p = (unsigned char *) &tk;
+	int i, r;
+	char ch;
+	if( key == NULL || *key == '\0' ) {
+		if( RAND_bytes( p, sizeof( tk ) ) <= 0 ) {
+			r = ERR_get_error();
+			mod_sc->sc_set_error(
+				ctx->socket, r, ERR_reason_error_string( r ) );
+			return SC_ERROR;
+		}
+	}
+	else {
+		/* the key comes hex encoded: name, hmac key, aes key */
+		if( strlen( key ) != sizeof( tk ) * 2 )
+			goto invalid;
+		for( i = 0; i < (int) sizeof( tk ) * 2; i ++ ) {
+			ch = (char) toupper( key[i] );
+			if( ch >= '0' && ch <= '9' )
+				r = ch - '0';
+			else if( ch >= 'A' && ch <= 'F' )
+				r = ch - 'A' + 10;
+			else
+				goto invalid;
+			if( i % 2 )
+				p[i / 2] |= (unsigned char) r;
+			else
+				p[i / 2] = (unsigned char) (r << 4);
+		}
+	}
+	SC_SSL_MUTEX_LOCK( &sc_ssl_global.thread_lock );
+	my_shared_keys_lock( ctx );
+	/* the previous key stays valid for tickets issued with it */
+	Move( ctx->ticket_keys, ctx->ticket_keys + 1,
+		SC_SSL_TICKET_KEYS - 1, sc_ssl_ticket_key_t );
+	Copy( &tk, ctx->ticket_keys, 1, sc_ssl_ticket_key_t );
+	if( ctx->ticket_key_count < SC_SSL_TICKET_KEYS )
+		ctx->ticket_key_count ++;
+	my_shared_keys_unlock( ctx, TRUE );
+	SC_SSL_MUTEX_UNLOCK( &sc_ssl_global.thread_lock );
+	OPENSSL_cleanse( &tk, sizeof( tk ) );
+	return SC_OK;
+invalid:
+	mod_sc->sc_set_error( ctx->socket, -9999,
+		"Invalid ticket key, expected %d hex digits", (int) sizeof( tk ) * 2 );
+	return SC_ERROR;
+}
+
+int mod_sc_ssl_ctx_get_stats( sc_ssl_ctx_t *ctx, sc_ssl_ctx_stats_t *stats ) {
+	if( ctx->ctx == NULL ) {
+		mod_sc->sc_set_error( ctx->socket, -9999, "Invalid context" );
+		return SC_ERROR;
+	}
+	stats->sessions = SSL_CTX_sess_number( ctx->ctx );
+	stats->accept = SSL_CTX_sess_accept( ctx->ctx );
+	stats->accept_good = SSL_CTX_sess_accept_good( ctx->ctx );
+	stats->connect = SSL_CTX_sess_connect( ctx->ctx );
+	stats->connect_good = SSL_CTX_sess_connect_good( ctx->ctx );
+	stats->hits = SSL_CTX_sess_hits( ctx->ctx );
+	stats->misses = SSL_CTX_sess_misses( ctx->ctx );
+	stats->timeouts = SSL_CTX_sess_timeouts( ctx->ctx );
+	stats->cache_full = SSL_CTX_sess_cache_full( ctx->ctx );
+	SC_SSL_MUTEX_LOCK( &sc_ssl_global.thread_lock );
+	stats->tickets_issued = ctx->tickets_issued;
+	stats->tickets_accepted = ctx->tickets_accepted;
+	stats->tickets_renewed = ctx->tickets_renewed;
+	stats->tickets_failed = ctx->tickets_failed;
+	stats->store_sessions = ctx->sessions_count;
+	stats->store_offered = ctx->sessions_offered;
+	stats->store_resumed = ctx->sessions_resumed;
+	stats->verify_cached = ctx->verified_count;
+	stats->verify_hits = ctx->verify_hits;
+	stats->verify_misses = ctx->verify_misses;
+	SC_SSL_MUTEX_UNLOCK( &sc_ssl_global.thread_lock );
+#ifdef SC_SSL_USE_SHM
+	if( ctx->shared != NULL ) {
+		/* counters of all processes */
+		stats->shared_stored = ctx->shared->shm->stored;
+		stats->shared_hits = ctx->shared->shm->hits;
+		stats->shared_misses = ctx->shared->shm->misses;
+		stats->shared_evicted = ctx->shared->shm->evicted;
+		return SC_OK;
+	}
+#endif
+	stats->shared_stored = stats->shared_hits = 0;
+	stats->shared_misses = stats->shared_evicted = 0;
+	return SC_OK;
+}
+
+int mod_sc_ssl_ctx_set_session_store( sc_ssl_ctx_t *ctx, int max ) {
+	if( max < 0 )
+		max = 0;
+	ctx->sessions_max = max;
+	my_session_store_trim( ctx, max );
+	if( ctx->ctx != NULL )
+		my_ctx_init_sessions( ctx, ! ctx->is_client );
+	return SC_OK;
+}
+
+int mod_sc_ssl_ctx_set_verify_peer( sc_ssl_ctx_t *ctx, int enable ) {
+	ctx->verify_peer = enable;
+	/* applies to connections created afterwards */
+	if( ctx->ctx != NULL )
+		my_ctx_init_verify( ctx, ! ctx->is_client );
+	return SC_OK;
+}
+
+int mod_sc_ssl_ctx_set_verify_cache(
+	sc_ssl_ctx_t *ctx, int max, long timeout
+) {
+	if( max >= 0 )
+		ctx->verify_max = max;
+	if( timeout > 0 )
+		ctx->verify_timeout = timeout;
+	my_verify_trim( ctx, ctx->verify_max );
+	if( ctx->ctx != NULL )
+		my_ctx_init_verify( ctx, ! ctx->is_client );
+	return SC_OK;
+}
+
+int mod_sc_ssl_ctx_set_shared_session_cache( sc_ssl_ctx_t *ctx, int size ) {
+#ifdef SC_SSL_USE_SHM
+	sc_ssl_shared_t *shared = NULL;
+	sc_ssl_shm_t *shm;
+	size_t len;
+	int sets, r, i;
+	if( size > 0 ) {
+		sets = (size + SC_SSL_SHM_WAYS - 1) / SC_SSL_SHM_WAYS;
+		len = sizeof( sc_ssl_shm_t ) + (sets - 1) * sizeof( sc_ssl_shm_set_t );
+		shm = (sc_ssl_shm_t *) mmap( NULL, len, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_ANONYMOUS, -1, 0 );
+		if( shm == (sc_ssl_shm_t *) MAP_FAILED ) {
+			r = errno;
+			mod_sc->sc_set_errno( ctx->socket, r );
+			return SC_ERROR;
+		}
+#ifdef SC_DEBUG
+		_debug( "mapped %u bytes for %d shared sessions\n", len, size );
+#endif
+		shm->set_count = sets;
+		r = my_shm_lock_init( &shm->lock );
+		for( i = 0; r == 0 && i < sets; i ++ )
+			r = my_shm_lock_init( &shm->set[i].lock );
+		if( r != 0 ) {
+			munmap( (void *) shm, len );
+			mod_sc->sc_set_errno( ctx->socket, r );
+			return SC_ERROR;
+		}
+		SC_SSL_MUTEX_LOCK( &sc_ssl_global.thread_lock );
+		Copy( ctx->ticket_keys, shm->ticket_keys,
+			SC_SSL_TICKET_KEYS, sc_ssl_ticket_key_t );
+		shm->ticket_key_count = ctx->ticket_key_count;
+		SC_SSL_MUTEX_UNLOCK( &sc_ssl_global.thread_lock );
+		Newx( shared, 1, sc_ssl_shared_t );
+		shared->shm = shm;
+		shared->size = len;
+		shared->slots = sets * SC_SSL_SHM_WAYS;
+		shared->refcnt = 1;
+	}
+	my_shared_free( ctx );
+	ctx->shared = shared;
+	if( ctx->ctx != NULL && ! ctx->is_client )
+		my_ctx_init_sessions( ctx, TRUE );
+	return SC_OK;
+#else
+	if( size <= 0 )
+		return SC_OK;
+	mod_sc->sc_set_error(
+		ctx->socket, -9999, "Shared session cache is not supported" );
+	return SC_ERROR;
+#endif
+}
+
+int mod_sc_ssl_ctx_set_ktls( sc_ssl_ctx_t *ctx, int enable ) {
+	ctx->ktls = enable;
+#ifdef SC_SSL_USE_KTLS
+	/* applies to connections created afterwards */
+	if( ctx->ctx != NULL ) {
+		if( enable )
+			SSL_CTX_set_options( ctx->ctx, SSL_OP_ENABLE_KTLS );
+		else
+			SSL_CTX_clear_options( ctx->ctx, SSL_OP_ENABLE_KTLS );
+	}
+#endif
+	return SC_OK;
+}
+
+int mod_sc_ssl_ctx_set_read_ahead( sc_ssl_ctx_t *ctx, int enable ) {
+	ctx->read_ahead = enable;
+	if( ctx->ctx != NULL )
+		SSL_CTX_set_read_ahead( ctx->ctx, enable ? 1 : 0 );
+	return SC_OK;
+}
+
+int mod_sc_ssl_ctx_set_dynamic_records( sc_ssl_ctx_t *ctx, int enable ) {
+	ctx->dynamic_records = enable;
+	return SC_OK;
+}
+
+int mod_sc_ssl_ctx_set_release_buffers( sc_ssl_ctx_t *ctx, int enable ) {
+	ctx->release_buffers = enable;
+	/* applies to connections created afterwards */
+	if( ctx->ctx != NULL ) {
+		if( enable )
+			SSL_CTX_set_mode( ctx->ctx, SSL_MODE_RELEASE_BUFFERS );
+		else
+			SSL_CTX_clear_mode( ctx->ctx, SSL_MODE_RELEASE_BUFFERS );
+	}
+	return SC_OK;
+}
+
+int mod_sc_ssl_ctx_memory_usage( sc_ssl_ctx_t *ctx, sc_ssl_memory_t *mem ) {
+	SC_SSL_MUTEX_LOCK( &sc_ssl_global.thread_lock );
+	mem->sockets = ctx->mem_sockets;
+	mem->buffers = ctx->mem_buffers;
+	mem->ssl_buffers = ctx->mem_ssl;
+	mem->pool = (long) sc_ssl_global.pool_bytes;
+	SC_SSL_MUTEX_UNLOCK( &sc_ssl_global.thread_lock );
+	mem->total = mem->buffers + mem->ssl_buffers;
+	return SC_OK;
+}
+
+int mod_sc_ssl_ctx_add_server_name(
+	sc_ssl_ctx_t *ctx, const char *name, sc_ssl_ctx_t *target
+) {
+	char buf[SC_SSL_SNI_NAME_MAX + 1];
+	sc_ssl_ctx_t *old;
+	if( my_sni_name( buf, name ) != SC_OK ) {
+		mod_sc->sc_set_errno( ctx->socket, EINVAL );
+		return SC_ERROR;
+	}
+	/* an initialized server context of its own */
+	if( target == NULL || target == ctx || target->ctx == NULL
+		|| target->is_client
+	) {
+		mod_sc->sc_set_error( ctx->socket, -9999, "Invalid context" );
+		return SC_ERROR;
+	}
+#ifdef SC_DEBUG
+	_debug( "add server name %s to ctx %d, use ctx %d\n",
+		buf, ctx->id, target->id );
+#endif
+	SC_SSL_REF_INC( &target->refcnt );
+	SC_SSL_MUTEX_LOCK( &sc_ssl_global.thread_lock );
+	old = my_sni_insert( ctx, buf, target );
+	SC_SSL_MUTEX_UNLOCK( &sc_ssl_global.thread_lock );
+	/* handshakes in progress keep the replaced context */
+	if( old != NULL )
+		mod_sc_ssl_ctx_destroy( old );
+	return SC_OK;
+}
+
+int mod_sc_ssl_ctx_remove_server_name( sc_ssl_ctx_t *ctx, const char *name ) {
+	char buf[SC_SSL_SNI_NAME_MAX + 1];
+	sc_ssl_sni_t **ps, *sni = NULL;
+	if( my_sni_name( buf, name ) != SC_OK ) {
+		mod_sc->sc_set_errno( ctx->socket, EINVAL );
+		return SC_ERROR;
+	}
+	SC_SSL_MUTEX_LOCK( &sc_ssl_global.thread_lock );
+	if( ctx->sni != NULL ) {
+		ps = my_sni_slot( ctx, buf, my_strhash( buf ) );
+		if( (sni = *ps) != NULL ) {
+			*ps = sni->next;
+			ctx->sni_count --;
+		}
+	}
+	SC_SSL_MUTEX_UNLOCK( &sc_ssl_global.thread_lock );
+	if( sni == NULL ) {
+		mod_sc->sc_set_errno( ctx->socket, ENOENT );
+		return SC_ERROR;
+	}
+	mod_sc_ssl_ctx_destroy( sni->ctx );
+	Safefree( sni->name );
+	Safefree( sni );
+	return SC_OK;
+}
+
+int mod_sc_ssl_ctx_set_ocsp_response(
+	sc_ssl_ctx_t *ctx, const char *buf, int len
+) {
+#ifdef SC_SSL_USE_OCSP
+	const unsigned char *p = (const unsigned char *) buf;
+	OCSP_RESPONSE *resp;
+	int r;
+	if( len <= 0 ) {
+		my_ocsp_clear( ctx );
+		return SC_OK;
+	}
+	resp = d2i_OCSP_RESPONSE( NULL, &p, len );
+	if( resp == NULL ) {
+		ERR_clear_error();
+		mod_sc->sc_set_error( ctx->socket, -9999, "Invalid OCSP response" );
+		return SC_ERROR;
+	}
+	r = my_ocsp_store( ctx, resp );
+	OCSP_RESPONSE_free( resp );
+	if( r != SC_OK )
+		return r;
+	Safefree( ctx->ocsp_file );
+	ctx->ocsp_file = NULL;
+	return SC_OK;
+#else
+	(void) buf; /* unused */
+	(void) len; /* unused */
+	mod_sc->sc_set_error( ctx->socket, -9999, "OCSP is not supported" );
+	return SC_ERROR;
+#endif
+}
+
+int mod_sc_ssl_ctx_load_ocsp_response( sc_ssl_ctx_t *ctx, const char *file ) {
+#ifdef SC_SSL_USE_OCSP
+	BIO *bio;
+	OCSP_RESPONSE *resp;
+	int r;
+#ifdef SC_DEBUG
+	_debug( "load ocsp response from '%s'\n", file );
+#endif
+	bio = BIO_new_file( file, "rb" );
+	if( bio == NULL ) {
+		r = errno;
+		ERR_clear_error();
+		mod_sc->sc_set_errno( ctx->socket, r != 0 ? r : ENOENT );
+		return SC_ERROR;
+	}
+	resp = d2i_OCSP_RESPONSE_bio( bio, NULL );
+	BIO_free( bio );
+	if( resp == NULL ) {
+		ERR_clear_error();
+		mod_sc->sc_set_error( ctx->socket, -9999, "Invalid OCSP response" );
+		return SC_ERROR;
+	}
+	r = my_ocsp_store( ctx, resp );
+	OCSP_RESPONSE_free( resp );
+	if( r != SC_OK )
+		return r;
+	if( ctx->ocsp_file == NULL || strcmp( ctx->ocsp_file, file ) != 0 ) {
+		Safefree( ctx->ocsp_file );
+		ctx->ocsp_file = my_strdup( file );
+	}
+	return SC_OK;
+#else
+	(void) file; /* unused */
+	mod_sc->sc_set_error( ctx->socket, -9999, "OCSP is not supported" );
+	return SC_ERROR;
+#endif
+}
+
+int mod_sc_ssl_ctx_get_ocsp_status(
+	sc_ssl_ctx_t *ctx, sc_ssl_ocsp_status_t *status
+) {
+	SC_SSL_MUTEX_LOCK( &sc_ssl_global.thread_lock );
+	if( ctx->ocsp_response == NULL ) {
+		SC_SSL_MUTEX_UNLOCK( &sc_ssl_global.thread_lock );
+		mod_sc->sc_set_error( ctx->socket, -9999, "No OCSP response" );
+		return SC_ERROR;
+	}
+	status->status = ctx->ocsp_status;
+	status->this_update = ctx->ocsp_this_update;
+	status->next_update = ctx->ocsp_next_update;
+	status->stapled = ctx->ocsp_stapled;
+	status->missed = ctx->ocsp_missed;
+	SC_SSL_MUTEX_UNLOCK( &sc_ssl_global.thread_lock );
+	return SC_OK;
+}
+
 int mod_sc_ssl_ctx_init_client( sc_ssl_ctx_t *ctx ) {
 	int r;
 	SSL_METHOD *method;
@@ -1234,23 +2320,14 @@ int mod_sc_ssl_ctx_init_client( sc_ssl_ctx_t *ctx ) {
 			if( ! r )
 				goto error;
 		}
-		if( ctx->certificate != NULL ) {
-			/* set the local certificate from CertFile */
-#ifdef SC_DEBUG
-			_debug( "use certificate from '%s'\n", ctx->certificate );
-#endif
-			r = SSL_CTX_use_certificate_file(
-				ctx->ctx, ctx->certificate, SSL_FILETYPE_PEM );
+		if( ctx->cert != NULL ) {
+			/* set the local certificate parsed by set_certificate() */
+			r = my_ctx_use_certificate( ctx );
 			if( ! r )
 				goto error;
 		}
-		if( ctx->private_key != NULL ) {
-			/* set the private key from KeyFile */
-#ifdef SC_DEBUG
-			_debug( "use private key from '%s'\n", ctx->private_key );
-#endif
-			r = SSL_CTX_use_PrivateKey_file(
-				ctx->ctx, ctx->private_key, SSL_FILETYPE_PEM );
+		if( ctx->pkey != NULL ) {
+			r = SSL_CTX_use_PrivateKey( ctx->ctx, ctx->pkey );
 			if( ! r )
 				goto error;
 		}
@@ -1262,8 +2339,20 @@ int mod_sc_ssl_ctx_init_client( sc_ssl_ctx_t *ctx ) {
 			if( !SSL_CTX_set_cipher_list( ctx->ctx, ctx->cipher_list ) )
 				goto error;
 		}
-		/* set auto retry */
-		SSL_CTX_set_mode( ctx->ctx, SSL_MODE_AUTO_RETRY );
+		/* set auto retry, buffered writes are retried from a moved
+		 * output buffer */
+		SSL_CTX_set_mode( ctx->ctx,
+			SSL_MODE_AUTO_RETRY | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER );
+		if( ctx->read_ahead )
+			SSL_CTX_set_read_ahead( ctx->ctx, 1 );
+		if( ctx->release_buffers )
+			SSL_CTX_set_mode( ctx->ctx, SSL_MODE_RELEASE_BUFFERS );
+#ifdef SC_SSL_USE_KTLS
+		if( ctx->ktls )
+			SSL_CTX_set_options( ctx->ctx, SSL_OP_ENABLE_KTLS );
+#endif
+		my_ctx_init_sessions( ctx, FALSE );
+		my_ctx_init_verify( ctx, FALSE );
 	}
 	return SC_OK;
 error:
@@ -1312,23 +2401,14 @@ int mod_sc_ssl_ctx_init_server( sc_ssl_ctx_t *ctx ) {
 			SSL_CTX_set_client_CA_list(
 				ctx->ctx, SSL_load_client_CA_file( ctx->client_ca ) );
 		}
-		if( ctx->certificate != NULL ) {
-			/* set the local certificate from CertFile */
-#ifdef SC_DEBUG
-			_debug( "use certificate from '%s'\n", ctx->certificate );
-#endif
-			r = SSL_CTX_use_certificate_file(
-				ctx->ctx, ctx->certificate, SSL_FILETYPE_PEM );
+		if( ctx->cert != NULL ) {
+			/* set the local certificate parsed by set_certificate() */
+			r = my_ctx_use_certificate( ctx );
 			if( ! r )
 				goto error;
 		}
-		if( ctx->private_key != NULL ) {
-			/* set the private key from KeyFile */
-#ifdef SC_DEBUG
-			_debug( "use private key from '%s'\n", ctx->private_key );
-#endif
-			r = SSL_CTX_use_PrivateKey_file(
-				ctx->ctx, ctx->private_key, SSL_FILETYPE_PEM );
+		if( ctx->pkey != NULL ) {
+			r = SSL_CTX_use_PrivateKey( ctx->ctx, ctx->pkey );
 			if( ! r )
 				goto error;
 		}
@@ -1340,8 +2420,30 @@ int mod_sc_ssl_ctx_init_server( sc_ssl_ctx_t *ctx ) {
 			if( !SSL_CTX_set_cipher_list( ctx->ctx, ctx->cipher_list ) )
 				goto error;
 		}
-		/* set auto retry */
-		SSL_CTX_set_mode( ctx->ctx, SSL_MODE_AUTO_RETRY );
+		/* set auto retry, buffered writes are retried from a moved
+		 * output buffer */
+		SSL_CTX_set_mode( ctx->ctx,
+			SSL_MODE_AUTO_RETRY | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER );
+		if( ctx->read_ahead )
+			SSL_CTX_set_read_ahead( ctx->ctx, 1 );
+		if( ctx->release_buffers )
+			SSL_CTX_set_mode( ctx->ctx, SSL_MODE_RELEASE_BUFFERS );
+#ifdef SC_SSL_USE_KTLS
+		if( ctx->ktls )
+			SSL_CTX_set_options( ctx->ctx, SSL_OP_ENABLE_KTLS );
+#endif
+		my_ctx_init_sessions( ctx, TRUE );
+		my_ctx_init_verify( ctx, TRUE );
+#ifdef SC_SSL_USE_SNI
+		/* contexts added by add_server_name() take over the handshake */
+		SSL_CTX_set_tlsext_servername_callback( ctx->ctx, my_servername_cb );
+		SSL_CTX_set_tlsext_servername_arg( ctx->ctx, ctx );
+#endif
+#ifdef SC_SSL_USE_OCSP
+		/* responses set by set_ocsp_response() are stapled */
+		SSL_CTX_set_tlsext_status_cb( ctx->ctx, my_ocsp_status_cb );
+		SSL_CTX_set_tlsext_status_arg( ctx->ctx, ctx );
+#endif
 	}
 	return SC_OK;
 error:
@@ -1352,67 +2454,2423 @@ error:
 
 /* internal functions */
 
-void free_context( sc_ssl_ctx_t *ctx ) {
-	/*
-#ifdef SC_DEBUG
-	_debug( "free ctx %u\n", ctx );
+void my_ctx_init_sessions( sc_ssl_ctx_t *ctx, int is_server ) {
+	const char *sid;
+	SSL_CTX_set_app_data( ctx->ctx, ctx );
+	if( ctx->session_cache != SC_SSL_SESS_DEFAULT )
+		SSL_CTX_set_session_cache_mode( ctx->ctx, ctx->session_cache );
+	if( ctx->session_cache_size >= 0 )
+		SSL_CTX_sess_set_cache_size( ctx->ctx, ctx->session_cache_size );
+	if( ctx->session_timeout >= 0 )
+		SSL_CTX_set_timeout( ctx->ctx, ctx->session_timeout );
+	if( ! is_server ) {
+		/* sessions are kept in the store of the context */
+		if( ctx->sessions_max > 0 ) {
+			if( ctx->session_cache == SC_SSL_SESS_DEFAULT ) {
+				SSL_CTX_set_session_cache_mode( ctx->ctx,
+					SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE );
+			}
+			SSL_CTX_sess_set_new_cb( ctx->ctx, my_session_new_cb );
+		}
+		else {
+			SSL_CTX_sess_set_new_cb( ctx->ctx, NULL );
+		}
+		return;
+	}
+	/* sessions are not resumed without an id context */
+	sid = ctx->session_id_context != NULL
+		? ctx->session_id_context : SC_SSL_SID_CTX;
+	SSL_CTX_set_session_id_context(
+		ctx->ctx, (const unsigned char *) sid, (unsigned int) strlen( sid ) );
+#ifdef SC_SSL_USE_SHM
+	if( ctx->shared != NULL && ctx->session_cache != SSL_SESS_CACHE_OFF ) {
+		/* the shared cache replaces the one of the process */
+		SSL_CTX_set_session_cache_mode( ctx->ctx,
+			SSL_SESS_CACHE_SERVER | SSL_SESS_CACHE_NO_INTERNAL_STORE );
+		SSL_CTX_sess_set_new_cb( ctx->ctx, my_shared_new_cb );
+		SSL_CTX_sess_set_get_cb( ctx->ctx, my_shared_get_cb );
+	}
+	else if( SSL_CTX_sess_get_get_cb( ctx->ctx ) != NULL ) {
+		if( ctx->session_cache == SC_SSL_SESS_DEFAULT )
+			SSL_CTX_set_session_cache_mode( ctx->ctx, SSL_SESS_CACHE_SERVER );
+		SSL_CTX_sess_set_new_cb( ctx->ctx, NULL );
+		SSL_CTX_sess_set_get_cb( ctx->ctx, NULL );
+	}
+#endif
+#ifdef SC_SSL_USE_TICKETS
+	if( ctx->no_tickets ) {
+		SSL_CTX_set_options( ctx->ctx, SSL_OP_NO_TICKET );
+		return;
+	}
+	if( ctx->ticket_key_count == 0 )
+		mod_sc_ssl_ctx_set_ticket_key( ctx, NULL );
+#ifdef SC_SSL_TICKET_EVP
+	SSL_CTX_set_tlsext_ticket_key_evp_cb( ctx->ctx, my_ticket_key_cb );
+#else
+	SSL_CTX_set_tlsext_ticket_key_cb( ctx->ctx, my_ticket_key_cb );
+#endif
 #endif
-	*/
-	if( ctx->ctx != NULL )
-		SSL_CTX_free( ctx->ctx );
-	Safefree( ctx->private_key );
-	Safefree( ctx->certificate );
-	Safefree( ctx->client_ca );
-	Safefree( ctx->ca_file );
-	Safefree( ctx->ca_path );
-	Safefree( ctx );
 }
 
-int remove_context( sc_ssl_ctx_t *ctx ) {
-	sc_ssl_ctx_t *cp = NULL, *cc;
-	int i;
-#ifdef USE_ITHREADS
-	if( !sc_ssl_global.destroyed )
-		MUTEX_LOCK( &sc_ssl_global.thread_lock );
-#endif
-	i = ctx->id & SC_SSL_CTX_CASCADE;
-	cc = sc_ssl_global.ctx[i];
-	while( cc != NULL ) {
-		if( cc == ctx ) {
-			if( cp == NULL )
-				sc_ssl_global.ctx[i] = cc->next;
-			else
-				cp->next = cc->next;
-			ctx = NULL;
+#ifdef SC_SSL_USE_TICKETS
+
+/* picks the key of a ticket and sets up the cipher, returns the value of
+ * the ticket key callback and leaves the key in tk for the mac */
+int my_ticket_key_init(
+	SSL *ssl, unsigned char *name, unsigned char *iv,
+	EVP_CIPHER_CTX *ectx, int enc, sc_ssl_ticket_key_t *tk
+) {
+	sc_ssl_ctx_t *ctx;
+	userdata_t *ud;
+	int i, r = 0;
+	/* the keys of the listening context, the server name callback may
+	 * have switched the connection to another one */
+	ud = (userdata_t *) SSL_get_app_data( ssl );
+	if( ud != NULL )
+		ctx = ud->sc_ssl_ctx;
+	else
+		ctx = (sc_ssl_ctx_t *) SSL_CTX_get_app_data( SSL_get_SSL_CTX( ssl ) );
+	if( ctx == NULL )
+		return -1;
+	SC_SSL_MUTEX_LOCK( &sc_ssl_global.thread_lock );
+	my_shared_keys_lock( ctx );
+	if( enc ) {
+		Copy( ctx->ticket_keys, tk, 1, sc_ssl_ticket_key_t );
+		ctx->tickets_issued ++;
+		r = 1;
+	}
+	else {
+		for( i = 0; i < ctx->ticket_key_count; i ++ ) {
+			if( memcmp( name, ctx->ticket_keys[i].name, 16 ) != 0 )
+				continue;
+			Copy( ctx->ticket_keys + i, tk, 1, sc_ssl_ticket_key_t );
+			if( i == 0 ) {
+				ctx->tickets_accepted ++;
+				r = 1;
+			}
+			else {
+				/* issue a new ticket with the current key */
+				ctx->tickets_renewed ++;
+				r = 2;
+			}
 			break;
 		}
-		cp = cc;
-		cc = cc->next;
+		if( r == 0 )
+			ctx->tickets_failed ++;
 	}
-#ifdef USE_ITHREADS
-	if( !sc_ssl_global.destroyed )
-		MUTEX_UNLOCK( &sc_ssl_global.thread_lock );
-#endif
-	if( ctx == NULL )
-		return SC_OK;
-	return SC_ERROR;
+	my_shared_keys_unlock( ctx, FALSE );
+	SC_SSL_MUTEX_UNLOCK( &sc_ssl_global.thread_lock );
+	if( r == 0 )
+		return 0;
+	if( enc ) {
+		Copy( tk->name, name, 16, unsigned char );
+		if( RAND_bytes( iv, 16 ) <= 0
+			|| ! EVP_EncryptInit_ex(
+				ectx, EVP_aes_128_cbc(), NULL, tk->aes_key, iv )
+		)
+			r = -1;
+	}
+	else if( ! EVP_DecryptInit_ex(
+		ectx, EVP_aes_128_cbc(), NULL, tk->aes_key, iv )
+	) {
+		r = -1;
+	}
+	return r;
 }
 
-void free_userdata( void *p ) {
+#ifdef SC_SSL_TICKET_EVP
+
+int my_ticket_key_cb(
+	SSL *ssl, unsigned char *name, unsigned char *iv,
+	EVP_CIPHER_CTX *ectx, EVP_MAC_CTX *mctx, int enc
+) {
+	sc_ssl_ticket_key_t tk;
+	OSSL_PARAM params[2];
+	int r = my_ticket_key_init( ssl, name, iv, ectx, enc, &tk );
+	if( r > 0 ) {
+		params[0] = OSSL_PARAM_construct_utf8_string(
+			OSSL_MAC_PARAM_DIGEST, (char *) "SHA256", 0 );
+		params[1] = OSSL_PARAM_construct_end();
+		if( ! EVP_MAC_init( mctx, tk.hmac_key, sizeof( tk.hmac_key ), params ) )
+			r = -1;
+	}
+	OPENSSL_cleanse( &tk, sizeof( tk ) );
+	return r;
+}
+
+#else
+
+int my_ticket_key_cb(
+	SSL *ssl, unsigned char *name, unsigned char *iv,
+	EVP_CIPHER_CTX *ectx, HMAC_CTX *hctx, int enc
+) {
+	sc_ssl_ticket_key_t tk;
+	int r = my_ticket_key_init( ssl, name, iv, ectx, enc, &tk );
+	if( r > 0 ) {
+		HMAC_Init_ex(
+			hctx, tk.hmac_key, sizeof( tk.hmac_key ), EVP_sha256(), NULL );
+	}
+	OPENSSL_cleanse( &tk, sizeof( tk ) );
+	return r;
+}
+
+#endif /* SC_SSL_TICKET_EVP */
+
+#endif /* SC_SSL_USE_TICKETS */
+
+int my_session_cache_mode( const char *str ) {
+	if( my_stricmp( str, "off" ) == 0 )
+		return SSL_SESS_CACHE_OFF;
+	if( my_stricmp( str, "server" ) == 0 )
+		return SSL_SESS_CACHE_SERVER;
+	if( my_stricmp( str, "client" ) == 0 )
+		return SSL_SESS_CACHE_CLIENT;
+	if( my_stricmp( str, "both" ) == 0 )
+		return SSL_SESS_CACHE_BOTH;
+	return atoi( str );
+}
+
+int my_ctx_set_files(
+	sc_ssl_ctx_t *ctx, const char *crt, const char *pk, const char *cca,
+	const char *caf, const char *cap, const char *ciphlist
+) {
+	int r;
+	if( crt != NULL ) {
+		r = mod_sc_ssl_ctx_set_certificate( ctx, crt );
+		if( r != SC_OK )
+			return r;
+	}
+	if( pk != NULL ) {
+		r = mod_sc_ssl_ctx_set_private_key( ctx, pk );
+		if( r != SC_OK )
+			return r;
+	}
+	if( cca != NULL ) {
+		r = mod_sc_ssl_ctx_set_client_ca( ctx, cca );
+		if( r != SC_OK )
+			return r;
+	}
+	if( caf != NULL || cap != NULL ) {
+		r = mod_sc_ssl_ctx_set_verify_locations( ctx, caf, cap );
+		if( r != SC_OK )
+			return r;
+	}
+	if( ciphlist != NULL ) {
+		r = mod_sc_ssl_ctx_set_cipher_list( ctx, ciphlist );
+		if( r != SC_OK )
+			return r;
+	}
+	return SC_OK;
+}
+
+/* shared contexts of identical configuration, locked by the global lock */
+
+void my_ctx_config_key( sc_ssl_ctx_t *ctx ) {
+	const char *str[9];
+	/* 16 numbers of at most 20 digits and a sign, separated by blanks */
+	char head[16 * 22];
+	char *p;
+	size_t l, hl;
+	int i;
+	str[0] = ctx->certificate;
+	str[1] = ctx->private_key;
+	str[2] = ctx->client_ca;
+	str[3] = ctx->ca_file;
+	str[4] = ctx->ca_path;
+	str[5] = ctx->cipher_list;
+	str[6] = ctx->session_id_context;
+	str[7] = ctx->ocsp_file;
+	str[8] = NULL;
+	hl = sprintf( head,
+		"%d %d %d %ld %ld %d %d %d %d %d %d %d %d %d %ld %d",
+		ctx->is_client, (int) ctx->method_id, ctx->session_cache,
+		ctx->session_cache_size, ctx->session_timeout, ctx->no_tickets,
+		ctx->sessions_max, ctx->ktls, ctx->read_ahead, ctx->dynamic_records,
+		ctx->release_buffers, ctx->ocsp_stapling, ctx->verify_peer,
+		ctx->verify_max, ctx->verify_timeout,
+		ctx->shared != NULL ? ctx->shared->slots : ctx->shared_size
+	);
+	/* a line break in front of each string */
+	l = hl;
+	for( i = 0; i < 8; i ++ ) {
+		l ++;
+		if( str[i] != NULL )
+			l += strlen( str[i] );
+	}
+	/* a line break and two hex digits per byte of the ticket key */
+	if( ctx->ticket_key_count > 0 )
+		l += 1 + sizeof( ctx->ticket_keys[0] ) * 2;
+	Renew( ctx->config_key, l + 1, char );
+	p = ctx->config_key;
+	Copy( head, p, hl, char );
+	p += hl;
+	for( i = 0; i < 8; i ++ ) {
+		*p ++ = '\n';
+		if( str[i] != NULL )
+			p = my_strcpy( p, str[i] );
+	}
+	if( ctx->ticket_key_count > 0 ) {
+		*p ++ = '\n';
+		for( i = 0; i < (int) sizeof( ctx->ticket_keys[0] ); i ++ )
+			p += sprintf( p, "%02x", ((unsigned char *) ctx->ticket_keys)[i] );
+	}
+	*p = '\0';
+	ctx->config_hash = my_strhash( ctx->config_key );
+}
+
+sc_ssl_ctx_t *my_ctx_config_lookup( sc_ssl_ctx_t *ctx ) {
+	sc_ssl_ctx_t *cc;
+	my_ctx_config_key( ctx );
+	SC_SSL_MUTEX_LOCK( &sc_ssl_global.thread_lock );
+	cc = sc_ssl_global.config[ctx->config_hash & SC_SSL_CTX_CASCADE];
+	for( ; cc != NULL; cc = cc->config_next ) {
+		if( cc->config_hash == ctx->config_hash
+			&& strcmp( cc->config_key, ctx->config_key ) == 0
+			&& my_ctx_ref( cc )
+		)
+			break;
+	}
+	SC_SSL_MUTEX_UNLOCK( &sc_ssl_global.thread_lock );
+	return cc;
+}
+
+void my_ctx_config_register( sc_ssl_ctx_t *ctx ) {
+	int i = ctx->config_hash & SC_SSL_CTX_CASCADE;
+	SC_SSL_MUTEX_LOCK( &sc_ssl_global.thread_lock );
+	ctx->config_next = sc_ssl_global.config[i];
+	sc_ssl_global.config[i] = ctx;
+	SC_SSL_MUTEX_UNLOCK( &sc_ssl_global.thread_lock );
+}
+
+/* must be called with the global lock */
+void my_ctx_config_remove( sc_ssl_ctx_t *ctx ) {
+	sc_ssl_ctx_t **pcc;
+	if( ctx->config_key == NULL )
+		return;
+	pcc = &sc_ssl_global.config[ctx->config_hash & SC_SSL_CTX_CASCADE];
+	for( ; *pcc != NULL; pcc = &(*pcc)->config_next ) {
+		if( *pcc == ctx ) {
+			*pcc = ctx->config_next;
+			break;
+		}
+	}
+	Safefree( ctx->config_key );
+	ctx->config_key = NULL;
+}
+
+/* gives the socket a context of its own before the context is changed */
+int my_ctx_private( userdata_t *ud ) {
+	sc_ssl_ctx_t *ctx = ud->sc_ssl_ctx, *nctx;
+	int r;
+	if( ctx->config_key == NULL )
+		return SC_OK;
+	SC_SSL_MUTEX_LOCK( &sc_ssl_global.thread_lock );
+	my_ctx_config_remove( ctx );
+	r = ctx->refcnt;
+	SC_SSL_MUTEX_UNLOCK( &sc_ssl_global.thread_lock );
+	if( r == 1 )
+		return SC_OK;
+	mod_sc_ssl_ctx_create( NULL, 0, &nctx );
+	nctx->socket = ctx->socket;
+	nctx->is_client = ctx->is_client;
+	nctx->method_id = ctx->method_id;
+	nctx->private_key = my_strdup( ctx->private_key );
+	nctx->certificate = my_strdup( ctx->certificate );
+	nctx->client_ca = my_strdup( ctx->client_ca );
+	nctx->ca_file = my_strdup( ctx->ca_file );
+	nctx->ca_path = my_strdup( ctx->ca_path );
+	nctx->cipher_list = my_strdup( ctx->cipher_list );
+	nctx->session_id_context = my_strdup( ctx->session_id_context );
+	my_ctx_copy_keys( nctx, ctx );
+	my_sni_copy( nctx, ctx );
+	nctx->ocsp_stapling = ctx->ocsp_stapling;
+	nctx->session_cache = ctx->session_cache;
+	nctx->session_cache_size = ctx->session_cache_size;
+	nctx->session_timeout = ctx->session_timeout;
+	nctx->no_tickets = ctx->no_tickets;
+	nctx->sessions_max = ctx->sessions_max;
+	nctx->ktls = ctx->ktls;
+	nctx->read_ahead = ctx->read_ahead;
+	nctx->dynamic_records = ctx->dynamic_records;
+	nctx->release_buffers = ctx->release_buffers;
+	nctx->verify_peer = ctx->verify_peer;
+	nctx->verify_max = ctx->verify_max;
+	nctx->verify_timeout = ctx->verify_timeout;
+	if( ctx->shared != NULL ) {
+		SC_SSL_REF_INC( &ctx->shared->refcnt );
+		nctx->shared = ctx->shared;
+	}
+	SC_SSL_MUTEX_LOCK( &sc_ssl_global.thread_lock );
+	Copy( ctx->ticket_keys, nctx->ticket_keys,
+		SC_SSL_TICKET_KEYS, sc_ssl_ticket_key_t );
+	nctx->ticket_key_count = ctx->ticket_key_count;
+	if( ctx->ocsp_response != NULL ) {
+		Newx( nctx->ocsp_response, ctx->ocsp_response_len, unsigned char );
+		Copy( ctx->ocsp_response, nctx->ocsp_response,
+			ctx->ocsp_response_len, unsigned char );
+		nctx->ocsp_response_len = ctx->ocsp_response_len;
+		nctx->ocsp_file = my_strdup( ctx->ocsp_file );
+		nctx->ocsp_status = ctx->ocsp_status;
+		nctx->ocsp_this_update = ctx->ocsp_this_update;
+		nctx->ocsp_next_update = ctx->ocsp_next_update;
+	}
+	SC_SSL_MUTEX_UNLOCK( &sc_ssl_global.thread_lock );
+	if( ctx->ctx != NULL ) {
+		r = nctx->is_client
+			? mod_sc_ssl_ctx_init_client( nctx )
+			: mod_sc_ssl_ctx_init_server( nctx );
+		if( r != SC_OK ) {
+			mod_sc_ssl_ctx_destroy( nctx );
+			return r;
+		}
+	}
+	my_ctx_attach( ud, nctx );
+	mod_sc_ssl_ctx_destroy( ctx );
+	return SC_OK;
+}
+
+/* certificates and keys are read from a file or from PEM data */
+BIO *my_pem_open( const char *str ) {
+	if( SC_SSL_IS_PEM( str ) )
+		return BIO_new_mem_buf( (void *) str, -1 );
+	return BIO_new_file( str, "r" );
+}
+
+int my_ctx_load_certificate( sc_ssl_ctx_t *ctx, const char *crt ) {
+	BIO *bio;
+	X509 *cert, *ca;
+	STACK_OF(X509) *chain;
+	unsigned long err;
+#ifdef SC_DEBUG
+	_debug( "load certificate from '%s'\n",
+		SC_SSL_IS_PEM( crt ) ? "memory" : crt );
+#endif
+	if( (bio = my_pem_open( crt )) == NULL )
+		goto error;
+	/* the certificate followed by the chain */
+	cert = PEM_read_bio_X509_AUX( bio, NULL, NULL, NULL );
+	if( cert == NULL ) {
+		BIO_free( bio );
+		goto error;
+	}
+	chain = sk_X509_new_null();
+	while( (ca = PEM_read_bio_X509( bio, NULL, NULL, NULL )) != NULL )
+		sk_X509_push( chain, ca );
+	BIO_free( bio );
+	err = ERR_peek_last_error();
+	if( ERR_GET_LIB( err ) != ERR_LIB_PEM
+		|| ERR_GET_REASON( err ) != PEM_R_NO_START_LINE
+	) {
+		X509_free( cert );
+		sk_X509_pop_free( chain, X509_free );
+		goto error;
+	}
+	/* the end of the data */
+	ERR_clear_error();
+	if( ctx->cert != NULL )
+		X509_free( ctx->cert );
+	if( ctx->chain != NULL )
+		sk_X509_pop_free( ctx->chain, X509_free );
+	ctx->cert = cert;
+	ctx->chain = chain;
+	return SC_OK;
+error:
+	err = ERR_get_error();
+	mod_sc->sc_set_error( ctx->socket, (int) err, "%s",
+		err != 0 ? ERR_reason_error_string( err ) : "Invalid certificate" );
+	return SC_ERROR;
+}
+
+int my_ctx_load_private_key( sc_ssl_ctx_t *ctx, const char *pk ) {
+	BIO *bio;
+	EVP_PKEY *pkey;
+	unsigned long err;
+#ifdef SC_DEBUG
+	_debug( "load private key from '%s'\n",
+		SC_SSL_IS_PEM( pk ) ? "memory" : pk );
+#endif
+	if( (bio = my_pem_open( pk )) == NULL )
+		goto error;
+	pkey = PEM_read_bio_PrivateKey( bio, NULL, NULL, NULL );
+	BIO_free( bio );
+	if( pkey == NULL )
+		goto error;
+	if( ctx->pkey != NULL )
+		EVP_PKEY_free( ctx->pkey );
+	ctx->pkey = pkey;
+	return SC_OK;
+error:
+	err = ERR_get_error();
+	mod_sc->sc_set_error( ctx->socket, (int) err, "%s",
+		err != 0 ? ERR_reason_error_string( err ) : "Invalid private key" );
+	return SC_ERROR;
+}
+
+/* sets the parsed certificate and chain, returns 0 on error like the
+ * OpenSSL functions */
+int my_ctx_use_certificate( sc_ssl_ctx_t *ctx ) {
+#ifndef SSL_CTX_set1_chain
+	X509 *ca;
+	int i;
+#endif
+	if( ! SSL_CTX_use_certificate( ctx->ctx, ctx->cert ) )
+		return 0;
+#ifdef SSL_CTX_set1_chain
+	return (int) SSL_CTX_set1_chain( ctx->ctx, ctx->chain );
+#else
+	SSL_CTX_clear_extra_chain_certs( ctx->ctx );
+	for( i = 0; i < sk_X509_num( ctx->chain ); i ++ ) {
+		ca = sk_X509_value( ctx->chain, i );
+		X509_up_ref( ca );
+		if( ! SSL_CTX_add_extra_chain_cert( ctx->ctx, ca ) ) {
+			X509_free( ca );
+			return 0;
+		}
+	}
+	return 1;
+#endif
+}
+
+void my_ctx_copy_keys( sc_ssl_ctx_t *dst, sc_ssl_ctx_t *src ) {
+	if( src->cert != NULL ) {
+		X509_up_ref( src->cert );
+		dst->cert = src->cert;
+	}
+	if( src->chain != NULL )
+		dst->chain = X509_chain_up_ref( src->chain );
+	if( src->pkey != NULL ) {
+		EVP_PKEY_up_ref( src->pkey );
+		dst->pkey = src->pkey;
+	}
+}
+
+/* server names are compared in lower case */
+int my_sni_name( char *dst, const char *src ) {
+	size_t i, l = strlen( src );
+	if( l == 0 || l > SC_SSL_SNI_NAME_MAX )
+		return SC_ERROR;
+	for( i = 0; i <= l; i ++ )
+		dst[i] = (char) tolower( (unsigned char) src[i] );
+	return SC_OK;
+}
+
+/* returns the link to the entry of the name, or the end of its chain,
+ * called with the global lock */
+sc_ssl_sni_t **my_sni_slot(
+	sc_ssl_ctx_t *ctx, const char *name, unsigned long hash
+) {
+	sc_ssl_sni_t **ps = ctx->sni + (hash & (ctx->sni_size - 1));
+	while( *ps != NULL ) {
+		if( (*ps)->hash == hash && strcmp( (*ps)->name, name ) == 0 )
+			break;
+		ps = &(*ps)->next;
+	}
+	return ps;
+}
+
+/* looks up the exact name first, then the wildcard matching its first
+ * label, called with the global lock */
+sc_ssl_ctx_t *my_sni_find( sc_ssl_ctx_t *ctx, const char *name ) {
+	sc_ssl_sni_t *sni;
+	char wc[SC_SSL_SNI_NAME_MAX + 2];
+	const char *p;
+	if( ctx->sni_count == 0 )
+		return NULL;
+	sni = *my_sni_slot( ctx, name, my_strhash( name ) );
+	if( sni != NULL )
+		return sni->ctx;
+	p = strchr( name, '.' );
+	if( p == NULL || p[1] == '\0' )
+		return NULL;
+	wc[0] = '*';
+	my_strcpy( wc + 1, p );
+	sni = *my_sni_slot( ctx, wc, my_strhash( wc ) );
+	return sni != NULL ? sni->ctx : NULL;
+}
+
+/* adds or replaces the context of a name, returns the replaced one,
+ * called with the global lock */
+sc_ssl_ctx_t *my_sni_insert(
+	sc_ssl_ctx_t *ctx, const char *name, sc_ssl_ctx_t *target
+) {
+	sc_ssl_sni_t **ps, *sni, **table;
+	sc_ssl_ctx_t *old;
+	unsigned long hash = my_strhash( name );
+	int i, size;
+	if( ctx->sni == NULL ) {
+		ctx->sni_size = SC_SSL_SNI_SIZE;
+		Newxz( ctx->sni, ctx->sni_size, sc_ssl_sni_t * );
+	}
+	ps = my_sni_slot( ctx, name, hash );
+	if( *ps != NULL ) {
+		old = (*ps)->ctx;
+		(*ps)->ctx = target;
+		return old;
+	}
+	Newx( sni, 1, sc_ssl_sni_t );
+	sni->next = NULL;
+	sni->hash = hash;
+	sni->name = my_strdup( name );
+	sni->ctx = target;
+	*ps = sni;
+	if( ++ ctx->sni_count <= ctx->sni_size )
+		return NULL;
+	/* move the entries into a table of twice the size */
+	size = ctx->sni_size * 2;
+	Newxz( table, size, sc_ssl_sni_t * );
+	for( i = 0; i < ctx->sni_size; i ++ ) {
+		while( (sni = ctx->sni[i]) != NULL ) {
+			ctx->sni[i] = sni->next;
+			ps = table + (sni->hash & (size - 1));
+			sni->next = *ps;
+			*ps = sni;
+		}
+	}
+	Safefree( ctx->sni );
+	ctx->sni = table;
+	ctx->sni_size = size;
+	return NULL;
+}
+
+void my_sni_copy( sc_ssl_ctx_t *dst, sc_ssl_ctx_t *src ) {
+	sc_ssl_sni_t *sni;
+	int i;
+	SC_SSL_MUTEX_LOCK( &sc_ssl_global.thread_lock );
+	for( i = 0; i < src->sni_size; i ++ ) {
+		for( sni = src->sni[i]; sni != NULL; sni = sni->next ) {
+			SC_SSL_REF_INC( &sni->ctx->refcnt );
+			my_sni_insert( dst, sni->name, sni->ctx );
+		}
+	}
+	SC_SSL_MUTEX_UNLOCK( &sc_ssl_global.thread_lock );
+}
+
+void my_sni_free( sc_ssl_ctx_t *ctx ) {
+	sc_ssl_sni_t *sni;
+	int i;
+	if( ctx->sni == NULL )
+		return;
+	for( i = 0; i < ctx->sni_size; i ++ ) {
+		while( (sni = ctx->sni[i]) != NULL ) {
+			ctx->sni[i] = sni->next;
+			mod_sc_ssl_ctx_destroy( sni->ctx );
+			Safefree( sni->name );
+			Safefree( sni );
+		}
+	}
+	Safefree( ctx->sni );
+	ctx->sni_size = ctx->sni_count = 0;
+}
+
+#ifdef SC_SSL_USE_SNI
+
+/* selects the context of the server name sent by the client, 'arg' is the
+ * listening context */
+int my_servername_cb( SSL *ssl, int *ad, void *arg ) {
+	sc_ssl_ctx_t *ctx = (sc_ssl_ctx_t *) arg, *sctx;
+	userdata_t *ud;
+	const char *name;
+	char buf[SC_SSL_SNI_NAME_MAX + 1];
+	(void) ad; /* unused */
+	if( ctx->sni_count == 0 )
+		return SSL_TLSEXT_ERR_NOACK;
+	name = SSL_get_servername( ssl, TLSEXT_NAMETYPE_host_name );
+	if( name == NULL || my_sni_name( buf, name ) != SC_OK )
+		return SSL_TLSEXT_ERR_NOACK;
+	SC_SSL_MUTEX_LOCK( &sc_ssl_global.thread_lock );
+	sctx = my_sni_find( ctx, buf );
+	/* the context may be replaced or removed meanwhile */
+	if( sctx != NULL )
+		SC_SSL_REF_INC( &sctx->refcnt );
+	SC_SSL_MUTEX_UNLOCK( &sc_ssl_global.thread_lock );
+	if( sctx == NULL )
+		return SSL_TLSEXT_ERR_NOACK;
+#ifdef SC_DEBUG
+	_debug( "server name %s uses ctx %d\n", buf, sctx->id );
+#endif
+	/* the connection holds a reference to the SSL_CTX */
+	if( sctx->ctx != SSL_get_SSL_CTX( ssl ) )
+		SSL_set_SSL_CTX( ssl, sctx->ctx );
+	/* the context stays alive for its callbacks until the connection is
+	 * freed, see my_ssl_free() */
+	ud = (userdata_t *) SSL_get_app_data( ssl );
+	if( ud == NULL ) {
+		mod_sc_ssl_ctx_destroy( sctx );
+		return SSL_TLSEXT_ERR_OK;
+	}
+	if( ud->sni_ctx == sctx ) {
+		/* the client hello after a retry request, the connection holds
+		 * a reference already and the context is not freed here */
+		SC_SSL_REF_DEC( &sctx->refcnt );
+		return SSL_TLSEXT_ERR_OK;
+	}
+	if( ud->sni_ctx != NULL )
+		mod_sc_ssl_ctx_destroy( ud->sni_ctx );
+	ud->sni_ctx = sctx;
+	return SSL_TLSEXT_ERR_OK;
+}
+
+#endif /* SC_SSL_USE_SNI */
+
+/* sends the server name, or the host name if not given as address */
+void my_set_server_name( userdata_t *ud, const char *host ) {
+#ifdef SC_SSL_USE_SNI
+	const char *name = ud->server_name, *p;
+	if( name == NULL ) {
+		if( host == NULL || strchr( host, ':' ) != NULL )
+			return;
+		for( p = host; *p != '\0'; p ++ ) {
+			if( ! isdigit( (unsigned char) *p ) && *p != '.' )
+				break;
+		}
+		if( *p == '\0' )
+			return;
+		name = host;
+	}
+	SSL_set_tlsext_host_name( ud->ssl, name );
+#else
+	(void) ud; /* unused */
+	(void) host; /* unused */
+#endif
+}
+
+/* asks the server for a stapled ocsp response */
+void my_ocsp_request( userdata_t *ud ) {
+#ifdef SC_SSL_USE_OCSP
+	if( ud->sc_ssl_ctx->ocsp_stapling )
+		SSL_set_tlsext_status_type( ud->ssl, TLSEXT_STATUSTYPE_ocsp );
+#else
+	(void) ud; /* unused */
+#endif
+}
+
+/* stapled ocsp responses, locked by the global lock */
+
+void my_ocsp_clear( sc_ssl_ctx_t *ctx ) {
+	unsigned char *old;
+	SC_SSL_MUTEX_LOCK( &sc_ssl_global.thread_lock );
+	old = ctx->ocsp_response;
+	ctx->ocsp_response = NULL;
+	ctx->ocsp_response_len = 0;
+	ctx->ocsp_status = 0;
+	ctx->ocsp_this_update = ctx->ocsp_next_update = 0;
+	SC_SSL_MUTEX_UNLOCK( &sc_ssl_global.thread_lock );
+	Safefree( old );
+	Safefree( ctx->ocsp_file );
+	ctx->ocsp_file = NULL;
+}
+
+/* converts to unix time, 0 if not given */
+long my_asn1_time( const ASN1_TIME *t ) {
+	int days, secs;
+	if( t == NULL || ! ASN1_TIME_diff( &days, &secs, NULL, t ) )
+		return 0;
+	return (long) time( NULL ) + days * 86400L + secs;
+}
+
+#ifdef SC_SSL_USE_OCSP
+
+/* checks the response against the certificate of the context and keeps it
+ * in DER format */
+int my_ocsp_store( sc_ssl_ctx_t *ctx, OCSP_RESPONSE *resp ) {
+	OCSP_BASICRESP *basic = NULL;
+	OCSP_CERTID *id;
+	ASN1_GENERALIZEDTIME *thisupd, *nextupd;
+	X509 *issuer = NULL, *ca;
+	const EVP_MD *md[2];
+	unsigned char *buf, *p, *old;
+	const char *msg;
+	int i, len, status = -1, reason;
+	long tu, nu;
+	if( ctx->cert == NULL ) {
+		msg = "No certificate";
+		goto error;
+	}
+	if( OCSP_response_status( resp ) != OCSP_RESPONSE_STATUS_SUCCESSFUL
+		|| (basic = OCSP_response_get1_basic( resp )) == NULL
+	) {
+		msg = "Invalid OCSP response";
+		goto error;
+	}
+	/* the issuer is needed for the certificate id */
+	if( X509_check_issued( ctx->cert, ctx->cert ) == X509_V_OK ) {
+		issuer = ctx->cert;
+	}
+	else if( ctx->chain != NULL ) {
+		for( i = 0; i < sk_X509_num( ctx->chain ); i ++ ) {
+			ca = sk_X509_value( ctx->chain, i );
+			if( X509_check_issued( ca, ctx->cert ) == X509_V_OK ) {
+				issuer = ca;
+				break;
+			}
+		}
+	}
+	if( issuer == NULL ) {
+		msg = "Issuer of the certificate not found";
+		goto error;
+	}
+	/* responders identify certificates by sha1 mostly */
+	md[0] = EVP_sha1();
+	md[1] = EVP_sha256();
+	for( i = 0; i < 2 && status < 0; i ++ ) {
+		id = OCSP_cert_to_id( md[i], ctx->cert, issuer );
+		if( id == NULL )
+			continue;
+		if( ! OCSP_resp_find_status(
+			basic, id, &status, &reason, NULL, &thisupd, &nextupd )
+		)
+			status = -1;
+		OCSP_CERTID_free( id );
+	}
+	if( status < 0 ) {
+		msg = "Certificate not found in OCSP response";
+		goto error;
+	}
+	tu = my_asn1_time( thisupd );
+	nu = my_asn1_time( nextupd );
+	OCSP_BASICRESP_free( basic );
+	len = i2d_OCSP_RESPONSE( resp, NULL );
+	Newx( buf, len, unsigned char );
+	p = buf;
+	i2d_OCSP_RESPONSE( resp, &p );
+#ifdef SC_DEBUG
+	_debug( "ocsp response %d bytes, status %d\n", len, status );
+#endif
+	SC_SSL_MUTEX_LOCK( &sc_ssl_global.thread_lock );
+	old = ctx->ocsp_response;
+	ctx->ocsp_response = buf;
+	ctx->ocsp_response_len = len;
+	ctx->ocsp_status = status;
+	ctx->ocsp_this_update = tu;
+	ctx->ocsp_next_update = nu;
+	SC_SSL_MUTEX_UNLOCK( &sc_ssl_global.thread_lock );
+	Safefree( old );
+	return SC_OK;
+error:
+	if( basic != NULL )
+		OCSP_BASICRESP_free( basic );
+	ERR_clear_error();
+	mod_sc->sc_set_error( ctx->socket, -9999, "%s", msg );
+	return SC_ERROR;
+}
+
+/* staples the response of the context, 'arg' is the context selected for
+ * the handshake */
+int my_ocsp_status_cb( SSL *ssl, void *arg ) {
+	sc_ssl_ctx_t *ctx = (sc_ssl_ctx_t *) arg;
+	unsigned char *buf = NULL;
+	int len = 0;
+	SC_SSL_MUTEX_LOCK( &sc_ssl_global.thread_lock );
+	if( ctx->ocsp_response != NULL && (ctx->ocsp_next_update == 0
+		|| ctx->ocsp_next_update > (long) time( NULL ))
+	) {
+		len = ctx->ocsp_response_len;
+		buf = (unsigned char *) OPENSSL_malloc( len );
+		if( buf != NULL )
+			Copy( ctx->ocsp_response, buf, len, unsigned char );
+	}
+	if( buf != NULL )
+		ctx->ocsp_stapled ++;
+	else
+		ctx->ocsp_missed ++;
+	SC_SSL_MUTEX_UNLOCK( &sc_ssl_global.thread_lock );
+	if( buf == NULL )
+		return SSL_TLSEXT_ERR_NOACK;
+	/* OpenSSL frees the buffer */
+	SSL_set_tlsext_status_ocsp_resp( ssl, buf, len );
+	return SSL_TLSEXT_ERR_OK;
+}
+
+#endif /* SC_SSL_USE_OCSP */
+
+/* client session store, locked by the global lock */
+
+unsigned long my_strhash( const char *str ) {
+	unsigned long h = 5381;
+	for( ; *str != '\0'; str ++ )
+		h = ((h << 5) + h) ^ (unsigned char) *str;
+	return h;
+}
+
+sc_ssl_session_t *my_session_find(
+	sc_ssl_ctx_t *ctx, const char *key, unsigned long hash
+) {
+	sc_ssl_session_t *ss;
+	ss = ctx->sessions[hash & SC_SSL_SESS_CASCADE];
+	for( ; ss != NULL; ss = ss->next ) {
+		if( ss->hash == hash && strcmp( ss->key, key ) == 0 )
+			break;
+	}
+	return ss;
+}
+
+void my_session_lru_unlink( sc_ssl_ctx_t *ctx, sc_ssl_session_t *ss ) {
+	if( ss->lru_prev != NULL )
+		ss->lru_prev->lru_next = ss->lru_next;
+	else
+		ctx->sessions_lru = ss->lru_next;
+	if( ss->lru_next != NULL )
+		ss->lru_next->lru_prev = ss->lru_prev;
+	else
+		ctx->sessions_lru_last = ss->lru_prev;
+	ss->lru_prev = ss->lru_next = NULL;
+}
+
+void my_session_lru_push( sc_ssl_ctx_t *ctx, sc_ssl_session_t *ss ) {
+	ss->lru_prev = NULL;
+	ss->lru_next = ctx->sessions_lru;
+	if( ctx->sessions_lru != NULL )
+		ctx->sessions_lru->lru_prev = ss;
+	else
+		ctx->sessions_lru_last = ss;
+	ctx->sessions_lru = ss;
+}
+
+void my_session_remove( sc_ssl_ctx_t *ctx, sc_ssl_session_t *ss ) {
+	sc_ssl_session_t **pss;
+	pss = &ctx->sessions[ss->hash & SC_SSL_SESS_CASCADE];
+	for( ; *pss != NULL; pss = &(*pss)->next ) {
+		if( *pss == ss ) {
+			*pss = ss->next;
+			break;
+		}
+	}
+	my_session_lru_unlink( ctx, ss );
+	ctx->sessions_count --;
+	SSL_SESSION_free( ss->session );
+	Safefree( ss->key );
+	Safefree( ss );
+}
+
+void my_session_store_trim( sc_ssl_ctx_t *ctx, int max ) {
+	if( !sc_ssl_global.destroyed )
+		SC_SSL_MUTEX_LOCK( &sc_ssl_global.thread_lock );
+	/* drop the least recently used sessions */
+	while( ctx->sessions_count > max )
+		my_session_remove( ctx, ctx->sessions_lru_last );
+	if( !sc_ssl_global.destroyed )
+		SC_SSL_MUTEX_UNLOCK( &sc_ssl_global.thread_lock );
+}
+
+/* session cache and ticket keys shared with forked processes */
+
+void my_shared_free( sc_ssl_ctx_t *ctx ) {
+	sc_ssl_shared_t *shared = ctx->shared;
+	if( shared == NULL )
+		return;
+	ctx->shared = NULL;
+	if( SC_SSL_REF_DEC( &shared->refcnt ) > 0 )
+		return;
+#ifdef SC_SSL_USE_SHM
+	/* the memory is released with the mapping of the last process */
+	munmap( (void *) shared->shm, shared->size );
+#endif
+	Safefree( shared );
+}
+
+/* takes over the ticket keys rotated by other processes, the global lock
+ * is held */
+void my_shared_keys_lock( sc_ssl_ctx_t *ctx ) {
+#ifdef SC_SSL_USE_SHM
+	sc_ssl_shm_t *shm;
+	if( ctx->shared == NULL )
+		return;
+	shm = ctx->shared->shm;
+	if( my_shm_lock( &shm->lock ) ) {
+		/* the keys may be half written */
+		shm->ticket_key_count = 0;
+	}
+	if( shm->ticket_key_count > 0 ) {
+		Copy( shm->ticket_keys, ctx->ticket_keys,
+			SC_SSL_TICKET_KEYS, sc_ssl_ticket_key_t );
+		ctx->ticket_key_count = shm->ticket_key_count;
+	}
+#else
+	(void) ctx; /* unused */
+#endif
+}
+
+void my_shared_keys_unlock( sc_ssl_ctx_t *ctx, int store ) {
+#ifdef SC_SSL_USE_SHM
+	sc_ssl_shm_t *shm;
+	if( ctx->shared == NULL )
+		return;
+	shm = ctx->shared->shm;
+	if( store ) {
+		Copy( ctx->ticket_keys, shm->ticket_keys,
+			SC_SSL_TICKET_KEYS, sc_ssl_ticket_key_t );
+		shm->ticket_key_count = ctx->ticket_key_count;
+	}
+	SC_SSL_SHM_UNLOCK( &shm->lock );
+#else
+	(void) ctx; /* unused */
+	(void) store; /* unused */
+#endif
+}
+
+#ifdef SC_SSL_USE_SHM
+
+int my_shm_lock_init( sc_ssl_shm_lock_t *m ) {
+	pthread_mutexattr_t attr;
+	int r;
+	if( (r = pthread_mutexattr_init( &attr )) != 0 )
+		return r;
+	r = pthread_mutexattr_setpshared( &attr, PTHREAD_PROCESS_SHARED );
+	if( r == 0 )
+		r = pthread_mutexattr_setrobust( &attr, PTHREAD_MUTEX_ROBUST );
+	if( r == 0 )
+		r = pthread_mutex_init( m, &attr );
+	pthread_mutexattr_destroy( &attr );
+	return r;
+}
+
+/* returns TRUE if the owner died with the lock and the data it guards may
+ * be half written, the lock is taken over in any case */
+int my_shm_lock( sc_ssl_shm_lock_t *m ) {
+	if( pthread_mutex_lock( m ) != EOWNERDEAD )
+		return FALSE;
+	pthread_mutex_consistent( m );
+	return TRUE;
+}
+
+/* forgets the sessions of a set after its lock was recovered */
+void my_shm_set_reset( sc_ssl_shm_set_t *set ) {
+	int i;
+	for( i = 0; i < SC_SSL_SHM_WAYS; i ++ )
+		set->slot[i].id_len = 0;
+}
+
+unsigned long my_memhash( const unsigned char *p, size_t len ) {
+	unsigned long h = 5381;
+	for( ; len > 0; len --, p ++ )
+		h = ((h << 5) + h) ^ *p;
+	return h;
+}
+
+/* the listening context, as in my_ticket_key_cb() */
+sc_ssl_ctx_t *my_shared_ctx( SSL *ssl ) {
+	userdata_t *ud = (userdata_t *) SSL_get_app_data( ssl );
+	if( ud != NULL )
+		return ud->sc_ssl_ctx;
+	return (sc_ssl_ctx_t *) SSL_CTX_get_app_data( SSL_get_SSL_CTX( ssl ) );
+}
+
+int my_shared_new_cb( SSL *ssl, SSL_SESSION *session ) {
+	sc_ssl_ctx_t *ctx = my_shared_ctx( ssl );
+	sc_ssl_shm_t *shm;
+	sc_ssl_shm_set_t *set;
+	sc_ssl_shm_slot_t *slot, *cs;
+	unsigned char buf[SC_SSL_SHM_DATA], *p;
+	const unsigned char *id;
+	unsigned int id_len;
+	unsigned long hash;
+	long now, expires;
+	int i, len;
+	if( ctx == NULL || ctx->shared == NULL )
+		return 0;
+	shm = ctx->shared->shm;
+	id = SSL_SESSION_get_id( session, &id_len );
+	len = i2d_SSL_SESSION( session, NULL );
+	if( id_len == 0 || id_len > SSL_MAX_SSL_SESSION_ID_LENGTH
+		|| len <= 0 || len > SC_SSL_SHM_DATA
+	)
+		return 0;
+	p = buf;
+	i2d_SSL_SESSION( session, &p );
+	hash = my_memhash( id, id_len );
+	now = (long) time( NULL );
+	expires = (long) SSL_SESSION_get_time( session )
+		+ (long) SSL_SESSION_get_timeout( session );
+	set = &shm->set[hash % shm->set_count];
+	if( my_shm_lock( &set->lock ) )
+		my_shm_set_reset( set );
+	/* the same session, a free slot or the least recently used one */
+	slot = NULL;
+	for( i = 0; i < SC_SSL_SHM_WAYS; i ++ ) {
+		cs = &set->slot[i];
+		if( cs->id_len == id_len && cs->hash == hash
+			&& memcmp( cs->id, id, id_len ) == 0
+		) {
+			slot = cs;
+			break;
+		}
+		if( slot == NULL || (slot->id_len != 0 && slot->expires > now
+			&& (cs->id_len == 0 || cs->expires <= now || cs->used < slot->used))
+		)
+			slot = cs;
+	}
+	if( slot->id_len != 0 && slot->expires > now && slot->hash != hash )
+		SC_SSL_REF_INC( &shm->evicted );
+	slot->hash = hash;
+	slot->expires = expires;
+	slot->used = ++ set->clock;
+	slot->id_len = id_len;
+	Copy( id, slot->id, id_len, unsigned char );
+	slot->data_len = (unsigned int) len;
+	Copy( buf, slot->data, len, unsigned char );
+	SC_SSL_SHM_UNLOCK( &set->lock );
+	SC_SSL_REF_INC( &shm->stored );
+	/* the session is not kept */
+	return 0;
+}
+
+SSL_SESSION *my_shared_get_cb(
+	SSL *ssl, SC_SSL_SESSION_ID *id, int id_len, int *copy
+) {
+	sc_ssl_ctx_t *ctx = my_shared_ctx( ssl );
+	sc_ssl_shm_t *shm;
+	sc_ssl_shm_set_t *set;
+	sc_ssl_shm_slot_t *cs;
+	SSL_SESSION *session = NULL;
+	unsigned char buf[SC_SSL_SHM_DATA];
+	const unsigned char *p = buf;
+	unsigned long hash;
+	long now;
+	int i, len = 0;
+	/* the caller gets the reference */
+	*copy = 0;
+	if( ctx == NULL || ctx->shared == NULL || id_len <= 0 )
+		return NULL;
+	shm = ctx->shared->shm;
+	hash = my_memhash( id, (size_t) id_len );
+	now = (long) time( NULL );
+	set = &shm->set[hash % shm->set_count];
+	if( my_shm_lock( &set->lock ) )
+		my_shm_set_reset( set );
+	for( i = 0; i < SC_SSL_SHM_WAYS; i ++ ) {
+		cs = &set->slot[i];
+		if( cs->id_len != (unsigned int) id_len || cs->hash != hash
+			|| memcmp( cs->id, id, id_len ) != 0
+		)
+			continue;
+		if( cs->expires > now ) {
+			len = (int) cs->data_len;
+			Copy( cs->data, buf, len, unsigned char );
+			cs->used = ++ set->clock;
+		}
+		break;
+	}
+	SC_SSL_SHM_UNLOCK( &set->lock );
+	if( len > 0 )
+		session = d2i_SSL_SESSION( NULL, &p, len );
+	if( session == NULL ) {
+		SC_SSL_REF_INC( &shm->misses );
+		return NULL;
+	}
+	SC_SSL_REF_INC( &shm->hits );
+	return session;
+}
+
+#endif /* SC_SSL_USE_SHM */
+
+/* peer verification, the cache is locked by the global lock */
+
+void my_ctx_init_verify( sc_ssl_ctx_t *ctx, int is_server ) {
+	int mode = SSL_VERIFY_NONE;
+	if( ctx->verify_peer ) {
+		mode = SSL_VERIFY_PEER;
+		/* servers ask for a client certificate and insist on it */
+		if( is_server )
+			mode |= SSL_VERIFY_FAIL_IF_NO_PEER_CERT | SSL_VERIFY_CLIENT_ONCE;
+	}
+	SSL_CTX_set_verify( ctx->ctx, mode, NULL );
+	if( ctx->verify_max > 0 )
+		SSL_CTX_set_cert_verify_callback( ctx->ctx, my_verify_cb, ctx );
+	else
+		SSL_CTX_set_cert_verify_callback( ctx->ctx, NULL, NULL );
+}
+
+/* verifies the chain of the peer unless it was verified before */
+int my_verify_cb( X509_STORE_CTX *store, void *arg ) {
+	sc_ssl_ctx_t *ctx = (sc_ssl_ctx_t *) arg;
+	sc_ssl_verified_t *vf;
+	STACK_OF(X509) *chain;
+	unsigned char md[SC_SSL_VERIFY_MD_SIZE];
+	unsigned long hash = 0;
+	long now, expires, t;
+	int i, r;
+	if( my_verify_digest( store, md ) != SC_OK ) {
+		ERR_clear_error();
+		return X509_verify_cert( store );
+	}
+	for( i = 0; i < (int) sizeof( hash ); i ++ )
+		hash = (hash << 8) | md[i];
+	now = (long) time( NULL );
+	SC_SSL_MUTEX_LOCK( &sc_ssl_global.thread_lock );
+	vf = my_verify_find( ctx, md, hash );
+	if( vf != NULL && vf->expires <= now ) {
+		/* verified again, revoked or expired certificates fail now */
+		my_verify_remove( ctx, vf );
+		vf = NULL;
+	}
+	if( vf != NULL )
+		ctx->verify_hits ++;
+	else
+		ctx->verify_misses ++;
+	SC_SSL_MUTEX_UNLOCK( &sc_ssl_global.thread_lock );
+	if( vf != NULL ) {
+#ifdef SC_DEBUG
+		_debug( "peer chain verified before\n" );
+#endif
+		X509_STORE_CTX_set_error( store, X509_V_OK );
+		return 1;
+	}
+	r = X509_verify_cert( store );
+	if( r <= 0 || X509_STORE_CTX_get_error( store ) != X509_V_OK )
+		return r;
+	/* the entry does not outlive a certificate of the chain */
+	expires = now + ctx->verify_timeout;
+	chain = X509_STORE_CTX_get0_chain( store );
+	for( i = 0; chain != NULL && i < sk_X509_num( chain ); i ++ ) {
+		t = my_asn1_time( X509_get0_notAfter( sk_X509_value( chain, i ) ) );
+		if( t > 0 && t < expires )
+			expires = t;
+	}
+	SC_SSL_MUTEX_LOCK( &sc_ssl_global.thread_lock );
+	if( ctx->verify_max > 0 && my_verify_find( ctx, md, hash ) == NULL )
+		my_verify_add( ctx, md, hash, expires );
+	SC_SSL_MUTEX_UNLOCK( &sc_ssl_global.thread_lock );
+	return r;
+}
+
+/* sha256 over the fingerprints of the leaf and the chain sent by the peer */
+int my_verify_digest( X509_STORE_CTX *store, unsigned char *md ) {
+	STACK_OF(X509) *sk = X509_STORE_CTX_get0_untrusted( store );
+	X509 *x = X509_STORE_CTX_get0_cert( store );
+	EVP_MD_CTX *mdctx;
+	unsigned char buf[EVP_MAX_MD_SIZE];
+	unsigned int len;
+	int i, n = sk != NULL ? sk_X509_num( sk ) : 0, r;
+	if( x == NULL )
+		return SC_ERROR;
+	mdctx = EVP_MD_CTX_create();
+	r = EVP_DigestInit_ex( mdctx, EVP_sha256(), NULL );
+	for( i = -1; r && i < n; i ++ ) {
+		if( i >= 0 )
+			x = sk_X509_value( sk, i );
+		r = X509_digest( x, EVP_sha256(), buf, &len )
+			&& EVP_DigestUpdate( mdctx, buf, len );
+	}
+	if( r )
+		r = EVP_DigestFinal_ex( mdctx, md, &len );
+	EVP_MD_CTX_destroy( mdctx );
+	return r ? SC_OK : SC_ERROR;
+}
+
+sc_ssl_verified_t *my_verify_find(
+	sc_ssl_ctx_t *ctx, const unsigned char *md, unsigned long hash
+) {
+	sc_ssl_verified_t *vf;
+	vf = ctx->verified[hash & SC_SSL_VERIFY_CASCADE];
+	for( ; vf != NULL; vf = vf->next ) {
+		if( vf->hash == hash && memcmp( vf->md, md, sizeof( vf->md ) ) == 0 )
+			break;
+	}
+	return vf;
+}
+
+void my_verify_add(
+	sc_ssl_ctx_t *ctx, const unsigned char *md, unsigned long hash,
+	long expires
+) {
+	sc_ssl_verified_t *vf;
+	/* the oldest entries expire first */
+	while( ctx->verified_count > 0
+		&& ctx->verified_count >= ctx->verify_max
+	)
+		my_verify_remove( ctx, ctx->verified_oldest );
+	/* called by the handshake workers, which have no perl interpreter */
+	vf = (sc_ssl_verified_t *) malloc( sizeof( sc_ssl_verified_t ) );
+	if( vf == NULL )
+		return;
+	Copy( md, vf->md, sizeof( vf->md ), unsigned char );
+	vf->hash = hash;
+	vf->expires = expires;
+	vf->next = ctx->verified[hash & SC_SSL_VERIFY_CASCADE];
+	ctx->verified[hash & SC_SSL_VERIFY_CASCADE] = vf;
+	vf->newer = NULL;
+	vf->older = ctx->verified_newest;
+	if( ctx->verified_newest != NULL )
+		ctx->verified_newest->newer = vf;
+	else
+		ctx->verified_oldest = vf;
+	ctx->verified_newest = vf;
+	ctx->verified_count ++;
+}
+
+void my_verify_remove( sc_ssl_ctx_t *ctx, sc_ssl_verified_t *vf ) {
+	sc_ssl_verified_t **pvf;
+	pvf = &ctx->verified[vf->hash & SC_SSL_VERIFY_CASCADE];
+	for( ; *pvf != NULL; pvf = &(*pvf)->next ) {
+		if( *pvf == vf ) {
+			*pvf = vf->next;
+			break;
+		}
+	}
+	if( vf->newer != NULL )
+		vf->newer->older = vf->older;
+	else
+		ctx->verified_newest = vf->older;
+	if( vf->older != NULL )
+		vf->older->newer = vf->newer;
+	else
+		ctx->verified_oldest = vf->newer;
+	ctx->verified_count --;
+	free( vf );
+}
+
+void my_verify_trim( sc_ssl_ctx_t *ctx, int max ) {
+	if( !sc_ssl_global.destroyed )
+		SC_SSL_MUTEX_LOCK( &sc_ssl_global.thread_lock );
+	while( ctx->verified_count > max )
+		my_verify_remove( ctx, ctx->verified_oldest );
+	if( !sc_ssl_global.destroyed )
+		SC_SSL_MUTEX_UNLOCK( &sc_ssl_global.thread_lock );
+}
+
+void my_session_offer(
+	sc_t *socket, userdata_t *ud, const char *host, const char *serv
+) {
+	sc_ssl_ctx_t *ctx = ud->sc_ssl_ctx;
+	sc_ssl_session_t *ss;
+	sc_addr_t addr;
+	char h[256], sv[32];
+	int hl = sizeof( h ), sl = sizeof( sv );
+	unsigned long hash;
+	/* sessions of one address differ by the server name */
+	const char *sn = ud->server_name != NULL ? ud->server_name : "";
+	if( ctx->sessions_max <= 0 )
+		return;
+	if( host != NULL || serv != NULL ) {
+		if( host == NULL )
+			host = "";
+		if( serv == NULL )
+			serv = "";
+		Renew( ud->session_key,
+			strlen( host ) + strlen( serv ) + strlen( sn ) + 3, char );
+		sprintf( ud->session_key, "%s:%s/%s", host, serv, sn );
+	}
+	else if( ud->session_key == NULL ) {
+		/* starttls or reconnect without address, take the peer */
+		if( mod_sc->sc_remote_addr( socket, &addr ) != SC_OK
+			|| mod_sc->sc_unpack_addr( socket, &addr, h, &hl, sv, &sl ) != SC_OK
+		) {
+			return;
+		}
+		Newx( ud->session_key, hl + sl + strlen( sn ) + 3, char );
+		sprintf( ud->session_key, "%s:%s/%s", h, sv, sn );
+	}
+	hash = my_strhash( ud->session_key );
+	SC_SSL_MUTEX_LOCK( &sc_ssl_global.thread_lock );
+	ss = my_session_find( ctx, ud->session_key, hash );
+	if( ss != NULL ) {
+#ifdef SC_DEBUG
+		_debug( "offer stored session for %s\n", ud->session_key );
+#endif
+		SSL_set_session( ud->ssl, ss->session );
+		ctx->sessions_offered ++;
+		my_session_lru_unlink( ctx, ss );
+		my_session_lru_push( ctx, ss );
+	}
+	SC_SSL_MUTEX_UNLOCK( &sc_ssl_global.thread_lock );
+}
+
+int my_session_new_cb( SSL *ssl, SSL_SESSION *session ) {
+	userdata_t *ud;
+	sc_ssl_ctx_t *ctx;
+	sc_ssl_session_t *ss;
+	unsigned long hash;
+	int l;
+	ud = (userdata_t *) SSL_get_app_data( ssl );
+	if( ud == NULL || ud->session_key == NULL )
+		return 0;
+	ctx = ud->sc_ssl_ctx;
+	hash = my_strhash( ud->session_key );
+	SC_SSL_MUTEX_LOCK( &sc_ssl_global.thread_lock );
+	ss = my_session_find( ctx, ud->session_key, hash );
+	if( ss != NULL ) {
+		/* the latest session of the peer replaces the old one */
+		SSL_SESSION_free( ss->session );
+		my_session_lru_unlink( ctx, ss );
+	}
+	else {
+		Newxz( ss, 1, sc_ssl_session_t );
+		l = (int) strlen( ud->session_key );
+		Newx( ss->key, l + 1, char );
+		Copy( ud->session_key, ss->key, l + 1, char );
+		ss->hash = hash;
+		ss->next = ctx->sessions[hash & SC_SSL_SESS_CASCADE];
+		ctx->sessions[hash & SC_SSL_SESS_CASCADE] = ss;
+		ctx->sessions_count ++;
+	}
+	ss->session = session;
+	my_session_lru_push( ctx, ss );
+	while( ctx->sessions_count > ctx->sessions_max )
+		my_session_remove( ctx, ctx->sessions_lru_last );
+	SC_SSL_MUTEX_UNLOCK( &sc_ssl_global.thread_lock );
+#ifdef SC_DEBUG
+	_debug( "stored session for %s\n", ud->session_key );
+#endif
+	/* we keep the reference */
+	return 1;
+}
+
+void free_context( sc_ssl_ctx_t *ctx ) {
+	/*
+#ifdef SC_DEBUG
+	_debug( "free ctx %u\n", ctx );
+#endif
+	*/
+	my_session_store_trim( ctx, 0 );
+	my_verify_trim( ctx, 0 );
+	my_shared_free( ctx );
+	my_sni_free( ctx );
+	if( ctx->ctx != NULL )
+		SSL_CTX_free( ctx->ctx );
+	if( ctx->cert != NULL )
+		X509_free( ctx->cert );
+	if( ctx->chain != NULL )
+		sk_X509_pop_free( ctx->chain, X509_free );
+	if( ctx->pkey != NULL )
+		EVP_PKEY_free( ctx->pkey );
+	my_ocsp_clear( ctx );
+	Safefree( ctx->private_key );
+	Safefree( ctx->certificate );
+	Safefree( ctx->client_ca );
+	Safefree( ctx->ca_file );
+	Safefree( ctx->ca_path );
+	Safefree( ctx->session_id_context );
+	OPENSSL_cleanse( ctx->ticket_keys, sizeof( ctx->ticket_keys ) );
+	Safefree( ctx );
+}
+
+int remove_context( sc_ssl_ctx_t *ctx ) {
+	sc_ssl_ctx_t *cp = NULL, *cc;
+	int i;
+	if( !sc_ssl_global.destroyed )
+		SC_SSL_MUTEX_LOCK( &sc_ssl_global.thread_lock );
+	my_ctx_config_remove( ctx );
+	i = ctx->id & SC_SSL_CTX_CASCADE;
+	cc = sc_ssl_global.ctx[i];
+	while( cc != NULL ) {
+		if( cc == ctx ) {
+			if( cp == NULL )
+				sc_ssl_global.ctx[i] = cc->next;
+			else
+				cp->next = cc->next;
+			ctx = NULL;
+			break;
+		}
+		cp = cc;
+		cc = cc->next;
+	}
+	if( !sc_ssl_global.destroyed )
+		SC_SSL_MUTEX_UNLOCK( &sc_ssl_global.thread_lock );
+	if( ctx == NULL )
+		return SC_OK;
+	return SC_ERROR;
+}
+
+void free_userdata( void *p ) {
 	userdata_t *ud = (userdata_t *) p;
 	sc_ssl_ctx_t *ctx = ud->sc_ssl_ctx;
 	if( ud->user_data != NULL && ud->free_user_data != NULL )
 		ud->free_user_data( ud->user_data );
 #ifdef SC_DEBUG
-	_debug( "free userdata\n" );
+	_debug( "free userdata\n" );
+#endif
+	if( ud->workers != NULL )
+		my_workers_stop( ud );
+	if( ud->ssl != NULL )
+		my_ssl_free( ud );
+	my_buf_put( ud, ud->rcvbuf, ud->rcvbuf_size );
+	my_buf_put( ud, ud->outbuf, ud->outbuf_size );
+	my_buf_put( ud, ud->netbuf, ud->netbuf_size );
+	my_buf_put( ud, ud->buffer, ud->buffer_len );
+	Safefree( ud->session_key );
+	Safefree( ud->server_name );
+	my_ctx_attach( ud, NULL );
+	//if( !sc_ssl_global.destroyed )
+		mod_sc_ssl_ctx_destroy( ctx );
+	Safefree( ud );
+}
+
+int my_handshake_result( sc_t *socket, userdata_t *ud, int r ) {
+	int err;
+	while( r <= 0 && (err = my_bio_pump( socket, ud, r )) != 0 ) {
+		if( err < 0 ) {
+			ud->handshake = 0;
+			return SC_ERROR;
+		}
+		r = SSL_do_handshake( ud->ssl );
+	}
+	if( r == 1 ) {
+		ud->handshake = 0;
+		if( ud->sc_ssl_ctx->is_client == TRUE && SSL_session_reused( ud->ssl ) )
+			ud->sc_ssl_ctx->sessions_resumed ++;
+		/* the last flight of the handshake */
+		if( SC_SSL_BIO_FLUSH( socket, ud ) < 0 )
+			return SC_ERROR;
+		return SC_OK;
+	}
+	r = SSL_get_error( ud->ssl, r );
+	switch( r ) {
+	case SSL_ERROR_WANT_READ:
+		/* records of the memory bio may wait for the socket */
+		ud->handshake = SC_SSL_NETBUF_PENDING( ud ) > 0
+			? SC_SSL_WANT_WRITE : SC_SSL_WANT_READ;
+		mod_sc->sc_set_errno( socket, EWOULDBLOCK );
+		return SC_OK;
+	case SSL_ERROR_WANT_WRITE:
+		ud->handshake = SC_SSL_WANT_WRITE;
+		mod_sc->sc_set_errno( socket, EWOULDBLOCK );
+		return SC_OK;
+	}
+	ud->handshake = 0;
+	err = ERR_get_error();
+	if( err == 0 )
+		mod_sc->sc_set_error( socket, r, my_ssl_error( r ) );
+	else
+		mod_sc->sc_set_error( socket, err, ERR_reason_error_string( err ) );
+	return SC_ERROR;
+}
+
+void my_ssl_free( userdata_t *ud ) {
+	/* OpenSSL drops the session of connections closed without
+	 * close_notify, fatal errors invalidate it anyway */
+	SSL_set_shutdown( ud->ssl, SSL_get_shutdown( ud->ssl ) | SSL_SENT_SHUTDOWN );
+	SSL_free( ud->ssl );
+	ud->ssl = NULL;
+	if( ud->sni_ctx != NULL ) {
+		mod_sc_ssl_ctx_destroy( ud->sni_ctx );
+		ud->sni_ctx = NULL;
+	}
+	/* data of the old connection */
+	ud->rcvbuf_pos = ud->rcvbuf_len = 0;
+	ud->rcvbuf_skip = '\0';
+	ud->outbuf_pos = ud->outbuf_len = 0;
+	ud->write_retry = 0;
+	ud->record_bytes = 0;
+	ud->netbuf_pos = ud->netbuf_len = 0;
+	my_mem_update( ud );
+}
+
+/* reads decrypted data into the plaintext buffer, returns the number of
+ * bytes read, 0 if the call would block, or -1 on error */
+int my_ssl_read_ahead( sc_t *socket, userdata_t *ud ) {
+	int r, err;
+	size_t size;
+	if( ud->rcvbuf_pos == ud->rcvbuf_len )
+		ud->rcvbuf_pos = ud->rcvbuf_len = 0;
+	if( ud->rcvbuf_size - ud->rcvbuf_len <= SC_SSL_RCVBUF_CHUNK ) {
+		if( ud->rcvbuf_pos > 0 ) {
+			/* move unread data to the front */
+			ud->rcvbuf_len -= ud->rcvbuf_pos;
+			Move( ud->rcvbuf + ud->rcvbuf_pos, ud->rcvbuf, ud->rcvbuf_len, char );
+			ud->rcvbuf_pos = 0;
+		}
+		if( ud->rcvbuf_size - ud->rcvbuf_len <= SC_SSL_RCVBUF_CHUNK ) {
+			size = ud->rcvbuf_size * 2;
+			if( size < ud->rcvbuf_len + SC_SSL_RCVBUF_CHUNK + 1 )
+				size = ud->rcvbuf_len + SC_SSL_RCVBUF_CHUNK + 1;
+			ud->rcvbuf = my_buf_resize(
+				ud, ud->rcvbuf, &ud->rcvbuf_size, size, ud->rcvbuf_len );
+		}
+	}
+	/* keep one byte for the terminating zero */
+	while( (r = SSL_read( ud->ssl, ud->rcvbuf + ud->rcvbuf_len,
+		(int) (ud->rcvbuf_size - ud->rcvbuf_len - 1) )) <= 0
+	) {
+		if( (err = my_bio_pump( socket, ud, r )) == 0 )
+			break;
+		if( err < 0 )
+			return -1;
+	}
+#ifdef SC_DEBUG
+	_debug( "read ahead %d bytes\n", r );
+#endif
+	if( r <= 0 ) {
+		r = SSL_get_error( ud->ssl, r );
+		switch( r ) {
+		case SSL_ERROR_WANT_READ:
+		case SSL_ERROR_WANT_WRITE:
+			/* threat not as an error */
+			return 0;
+		}
+		err = ERR_get_error();
+		if( err == 0 )
+			mod_sc->sc_set_error( socket, r, my_ssl_error( r ) );
+		else
+			mod_sc->sc_set_error( socket, err, ERR_reason_error_string( err ) );
+		return -1;
+	}
+	ud->rcvbuf_len += r;
+	if( SC_SSL_BIO_FLUSH( socket, ud ) < 0 )
+		return -1;
+	return r;
+}
+
+/* writes in records of my_ssl_record_size() with dynamic record sizing,
+ * returns the number of bytes written, 0 if the call would block,
+ * or -1 on error */
+int my_ssl_write( sc_t *socket, userdata_t *ud, const char *buf, int len ) {
+	int r, n, err, sent = 0;
+	while( sent < len ) {
+		if( ud->write_retry > 0 ) {
+			/* OpenSSL wants the same length again */
+			n = ud->write_retry;
+		}
+		else if( ud->sc_ssl_ctx->dynamic_records ) {
+			n = my_ssl_record_size( ud );
+		}
+		else {
+			n = len - sent;
+		}
+		if( n > len - sent )
+			n = len - sent;
+		while( (r = SSL_write( ud->ssl, buf + sent, n )) <= 0 ) {
+			if( (err = my_bio_pump( socket, ud, r )) == 0 )
+				break;
+			if( err < 0 )
+				return -1;
+		}
+#ifdef SC_DEBUG
+		_debug( "wrote %d of %d bytes\n", r, n );
+#endif
+		if( r <= 0 ) {
+			r = SSL_get_error( ud->ssl, r );
+			if( r == SSL_ERROR_WANT_WRITE || r == SSL_ERROR_WANT_READ ) {
+				ud->write_retry = n;
+				break;
+			}
+			ud->write_retry = 0;
+			err = ERR_get_error();
+			if( err == 0 )
+				mod_sc->sc_set_error( socket, r, my_ssl_error( r ) );
+			else
+				mod_sc->sc_set_error(
+					socket, err, ERR_reason_error_string( err ) );
+			mod_sc->sc_set_state( socket, SC_STATE_ERROR );
+			return -1;
+		}
+		ud->write_retry = 0;
+		ud->record_bytes += r;
+		sent += r;
+	}
+	if( SC_SSL_BIO_FLUSH( socket, ud ) < 0 )
+		return -1;
+	return sent;
+}
+
+/* sends the output buffer, returns the number of bytes left or -1 */
+int my_ssl_flush( sc_t *socket, userdata_t *ud ) {
+	int r;
+	r = my_ssl_write( socket, ud, ud->outbuf + ud->outbuf_pos,
+		(int) SC_SSL_OUTBUF_PENDING( ud ) );
+	if( r < 0 )
+		return -1;
+	ud->outbuf_pos += r;
+	if( ud->outbuf_pos < ud->outbuf_len )
+		return (int) SC_SSL_OUTBUF_PENDING( ud );
+	ud->outbuf_pos = ud->outbuf_len = 0;
+	return 0;
+}
+
+/* small records at the start of a transfer let the peer process the
+ * first bytes early, bulk data goes in full records */
+int my_ssl_record_size( userdata_t *ud ) {
+	double now = my_time_ms();
+	if( now - ud->record_time >= SC_SSL_RECORD_IDLE )
+		ud->record_bytes = 0;
+	ud->record_time = now;
+	return ud->record_bytes < SC_SSL_RECORD_BOOST
+		? SC_SSL_RECORD_SMALL : SC_SSL_RECORD_MAX;
+}
+
+double my_time_ms() {
+#ifdef _WIN32
+	return (double) GetTickCount();
+#else
+	struct timeval tv;
+	gettimeofday( &tv, NULL );
+	return tv.tv_sec * 1000.0 + tv.tv_usec / 1000.0;
+#endif
+}
+
+void my_ssl_attach( sc_t *socket, userdata_t *ud ) {
+	if( ud->mem_bio ) {
+		/* records go through memory, see my_bio_pump() */
+		SSL_set_bio( ud->ssl, BIO_new( BIO_s_mem() ), BIO_new( BIO_s_mem() ) );
+	}
+	else {
+		SSL_set_fd( ud->ssl, (int) mod_sc->sc_get_handle( socket ) );
+	}
+	/* the session and server name callbacks look for the socket data */
+	SSL_set_app_data( ud->ssl, ud );
+	my_mem_update( ud );
+}
+
+int my_bio_mode( const char *val ) {
+	if( my_stricmp( val, "socket" ) == 0 )
+		return SC_SSL_BIO_SOCKET;
+	if( my_stricmp( val, "manual" ) == 0 )
+		return SC_SSL_BIO_MANUAL;
+	return atoi( val );
+}
+
+/* moves records between the memory bios and the socket after an SSL
+ * operation returned 'r', returns 1 if the operation should be called
+ * again, 0 if not, or -1 on a socket error */
+int my_bio_pump( sc_t *socket, userdata_t *ud, int r ) {
+	char buf[SC_SSL_RECORD_MAX];
+	int len;
+	if( ud->mem_bio != SC_SSL_BIO_SOCKET )
+		return 0;
+	r = SSL_get_error( ud->ssl, r );
+	/* the peer may wait for our records first */
+	if( my_bio_flush( socket, ud ) < 0 )
+		return -1;
+	if( r != SSL_ERROR_WANT_READ )
+		return 0;
+	if( mod_sc->sc_recv( socket, buf, sizeof( buf ), 0, &len ) != SC_OK ) {
+		if( mod_sc->sc_get_errno( socket ) != ECONNRESET )
+			return -1;
+		/* end of stream, let OpenSSL tell about it */
+		BIO_set_mem_eof_return( SSL_get_rbio( ud->ssl ), 0 );
+		return 1;
+	}
+	if( len == 0 )
+		return 0;
+	BIO_write( SSL_get_rbio( ud->ssl ), buf, len );
+	return 1;
+}
+
+/* sends the records in the write bio, returns the number of bytes left
+ * in non-blocking mode, or -1 on error */
+int my_bio_flush( sc_t *socket, userdata_t *ud ) {
+	BIO *bio = SSL_get_wbio( ud->ssl );
+	size_t size;
+	int r;
+	while( 1 ) {
+		if( ud->netbuf_pos == ud->netbuf_len ) {
+			ud->netbuf_pos = ud->netbuf_len = 0;
+			if( (size = BIO_ctrl_pending( bio )) == 0 )
+				return 0;
+			if( ud->netbuf_size < size ) {
+				ud->netbuf = my_buf_resize(
+					ud, ud->netbuf, &ud->netbuf_size, size, 0 );
+			}
+			r = BIO_read( bio, ud->netbuf, (int) size );
+			ud->netbuf_len = r > 0 ? r : 0;
+			continue;
+		}
+		if( mod_sc->sc_send( socket, ud->netbuf + ud->netbuf_pos,
+			(int) SC_SSL_NETBUF_PENDING( ud ), 0, &r ) != SC_OK
+		)
+			return -1;
+		if( r == 0 )
+			return (int) SC_SSL_NETBUF_PENDING( ud );
+		ud->netbuf_pos += r;
+	}
+}
+
+/* hands out data left in the plaintext buffer */
+int my_ssl_rcvbuf_read( userdata_t *ud, char *buf, int len, int peek ) {
+	size_t avail = SC_SSL_RCVBUF_AVAIL( ud );
+	if( ud->rcvbuf_skip != '\0' && avail > 0 ) {
+		/* second char of a line break seen by readline */
+		if( ud->rcvbuf[ud->rcvbuf_pos] == ud->rcvbuf_skip ) {
+			ud->rcvbuf_pos ++;
+			avail --;
+		}
+		ud->rcvbuf_skip = '\0';
+	}
+	if( (size_t) len > avail )
+		len = (int) avail;
+	if( len > 0 ) {
+		Copy( ud->rcvbuf + ud->rcvbuf_pos, buf, len, char );
+		if( ! peek )
+			ud->rcvbuf_pos += len;
+	}
+	return len;
+}
+
+/* size class of a pooled buffer, returns -1 for buffers too large for the
+ * pool */
+int my_pool_class( size_t size, size_t *p_size ) {
+	size_t cs = SC_SSL_POOL_BASE;
+	int i;
+	for( i = 0; i < SC_SSL_POOL_CLASSES; i ++ ) {
+		if( size <= cs ) {
+			*p_size = cs;
+			return i;
+		}
+		cs <<= 1;
+	}
+	*p_size = size;
+	return -1;
+}
+
+/* takes a buffer of at least 'size' bytes from the shared pool,
+ * the real size is returned in 'p_size' */
+char *my_buf_get( userdata_t *ud, size_t size, size_t *p_size ) {
+	char *buf = NULL;
+	int i = my_pool_class( size, &size );
+	if( !sc_ssl_global.destroyed )
+		SC_SSL_MUTEX_LOCK( &sc_ssl_global.thread_lock );
+	if( i >= 0 && (buf = sc_ssl_global.pool[i]) != NULL ) {
+		sc_ssl_global.pool[i] = *((char **) buf);
+		sc_ssl_global.pool_bytes -= size;
+	}
+	ud->mem_buffers += size;
+	if( ud->sc_ssl_ctx != NULL )
+		ud->sc_ssl_ctx->mem_buffers += size;
+	if( !sc_ssl_global.destroyed )
+		SC_SSL_MUTEX_UNLOCK( &sc_ssl_global.thread_lock );
+	if( buf == NULL )
+		Newx( buf, size, char );
+	*p_size = size;
+	return buf;
+}
+
+/* returns a buffer to the shared pool */
+void my_buf_put( userdata_t *ud, char *buf, size_t size ) {
+	size_t cs;
+	int i;
+	if( buf == NULL )
+		return;
+	i = my_pool_class( size, &cs );
+	if( !sc_ssl_global.destroyed )
+		SC_SSL_MUTEX_LOCK( &sc_ssl_global.thread_lock );
+	ud->mem_buffers -= size;
+	if( ud->sc_ssl_ctx != NULL )
+		ud->sc_ssl_ctx->mem_buffers -= size;
+	if( i >= 0 && cs == size && ! sc_ssl_global.destroyed
+		&& sc_ssl_global.pool_bytes + size <= SC_SSL_POOL_MAX
+	) {
+		*((char **) buf) = sc_ssl_global.pool[i];
+		sc_ssl_global.pool[i] = buf;
+		sc_ssl_global.pool_bytes += size;
+		buf = NULL;
+	}
+	if( !sc_ssl_global.destroyed )
+		SC_SSL_MUTEX_UNLOCK( &sc_ssl_global.thread_lock );
+	if( buf != NULL )
+		Safefree( buf );
+}
+
+/* replaces a buffer by a larger one, 'keep' bytes are copied */
+char *my_buf_resize(
+	userdata_t *ud, char *buf, size_t *p_size, size_t need, size_t keep
+) {
+	size_t size;
+	char *nbuf = my_buf_get( ud, need, &size );
+	if( keep > 0 )
+		Copy( buf, nbuf, keep, char );
+	my_buf_put( ud, buf, *p_size );
+	*p_size = size;
+	return nbuf;
+}
+
+/* returns empty buffers of an idle connection to the pool */
+void my_ssl_release( userdata_t *ud ) {
+	if( ud->rcvbuf != NULL && SC_SSL_RCVBUF_AVAIL( ud ) == 0 ) {
+		my_buf_put( ud, ud->rcvbuf, ud->rcvbuf_size );
+		ud->rcvbuf = NULL;
+		ud->rcvbuf_size = ud->rcvbuf_len = ud->rcvbuf_pos = 0;
+	}
+	if( ud->outbuf != NULL && SC_SSL_OUTBUF_PENDING( ud ) == 0 ) {
+		my_buf_put( ud, ud->outbuf, ud->outbuf_size );
+		ud->outbuf = NULL;
+		ud->outbuf_size = ud->outbuf_len = ud->outbuf_pos = 0;
+	}
+	if( ud->netbuf != NULL && SC_SSL_NETBUF_PENDING( ud ) == 0 ) {
+		my_buf_put( ud, ud->netbuf, ud->netbuf_size );
+		ud->netbuf = NULL;
+		ud->netbuf_size = ud->netbuf_len = ud->netbuf_pos = 0;
+	}
+	if( ud->buffer != NULL ) {
+		my_buf_put( ud, ud->buffer, ud->buffer_len );
+		ud->buffer = NULL;
+		ud->buffer_len = 0;
+	}
+	my_mem_update( ud );
+}
+
+/* estimates the record buffers held by OpenSSL */
+void my_mem_update( userdata_t *ud ) {
+	size_t size = 0;
+	if( ud->ssl != NULL ) {
+		size = SC_SSL_RECORD_BUFFER * 2;
+		if( SSL_is_init_finished( ud->ssl )
+			&& (SSL_get_mode( ud->ssl ) & SSL_MODE_RELEASE_BUFFERS)
+		) {
+			/* the buffers are freed when they are empty */
+			size = 0;
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+			if( SSL_has_pending( ud->ssl ) )
+#else
+			if( SSL_pending( ud->ssl ) > 0 )
+#endif
+				size += SC_SSL_RECORD_BUFFER;
+			if( ud->write_retry > 0 )
+				size += SC_SSL_RECORD_BUFFER;
+		}
+	}
+	if( size == ud->mem_ssl )
+		return;
+	if( !sc_ssl_global.destroyed )
+		SC_SSL_MUTEX_LOCK( &sc_ssl_global.thread_lock );
+	if( ud->sc_ssl_ctx != NULL )
+		ud->sc_ssl_ctx->mem_ssl += (long) size - (long) ud->mem_ssl;
+	ud->mem_ssl = size;
+	if( !sc_ssl_global.destroyed )
+		SC_SSL_MUTEX_UNLOCK( &sc_ssl_global.thread_lock );
+}
+
+/* binds the connection to a context, the memory counters move along */
+void my_ctx_attach( userdata_t *ud, sc_ssl_ctx_t *ctx ) {
+	if( !sc_ssl_global.destroyed )
+		SC_SSL_MUTEX_LOCK( &sc_ssl_global.thread_lock );
+	if( ud->sc_ssl_ctx != NULL ) {
+		ud->sc_ssl_ctx->mem_sockets --;
+		ud->sc_ssl_ctx->mem_buffers -= ud->mem_buffers;
+		ud->sc_ssl_ctx->mem_ssl -= ud->mem_ssl;
+	}
+	if( ctx != NULL ) {
+		ctx->mem_sockets ++;
+		ctx->mem_buffers += ud->mem_buffers;
+		ctx->mem_ssl += ud->mem_ssl;
+	}
+	ud->sc_ssl_ctx = ctx;
+	if( !sc_ssl_global.destroyed )
+		SC_SSL_MUTEX_UNLOCK( &sc_ssl_global.thread_lock );
+}
+
+/* frees the buffers in the pool, called at the end of the program */
+void my_pool_free() {
+	char *buf;
+	int i;
+	for( i = 0; i < SC_SSL_POOL_CLASSES; i ++ ) {
+		while( (buf = sc_ssl_global.pool[i]) != NULL ) {
+			sc_ssl_global.pool[i] = *((char **) buf);
+			Safefree( buf );
+		}
+	}
+	sc_ssl_global.pool_bytes = 0;
+}
+
+/* takes a reference on a context, unless the last one is already gone */
+int my_ctx_ref( sc_ssl_ctx_t *ctx ) {
+	int r;
+	do {
+		if( (r = ctx->refcnt) <= 0 )
+			return FALSE;
+	} while( ! SC_SSL_REF_CAS( &ctx->refcnt, r, r + 1 ) );
+	return TRUE;
+}
+
+/* installs the locking callbacks of OpenSSL before 1.1.0, unless another
+ * module did so before */
+void my_locks_init() {
+#ifdef SC_SSL_LOCK_CALLBACKS
+	int i;
+	if( CRYPTO_get_locking_callback() != NULL )
+		return;
+	sc_ssl_global.lock_count = CRYPTO_num_locks();
+	/* the callbacks run in threads without perl interpreter */
+	sc_ssl_global.locks = (sc_ssl_rwlock_t *) OPENSSL_malloc(
+		sc_ssl_global.lock_count * sizeof( sc_ssl_rwlock_t ) );
+	for( i = 0; i < sc_ssl_global.lock_count; i ++ )
+		SC_SSL_RWLOCK_INIT( sc_ssl_global.locks + i );
+#if OPENSSL_VERSION_NUMBER >= 0x10000000L
+	CRYPTO_THREADID_set_callback( my_threadid_cb );
+#else
+	CRYPTO_set_id_callback( my_threadid_cb );
+#endif
+	CRYPTO_set_locking_callback( my_locking_cb );
+	CRYPTO_set_dynlock_create_callback( my_dynlock_create_cb );
+	CRYPTO_set_dynlock_lock_callback( my_dynlock_lock_cb );
+	CRYPTO_set_dynlock_destroy_callback( my_dynlock_destroy_cb );
+#ifdef SC_DEBUG
+	_debug( "installed %d openssl locks\n", sc_ssl_global.lock_count );
+#endif
+#endif
+}
+
+void my_locks_free() {
+#ifdef SC_SSL_LOCK_CALLBACKS
+	int i;
+	if( sc_ssl_global.locks == NULL )
+		return;
+	CRYPTO_set_locking_callback( NULL );
+	CRYPTO_set_dynlock_create_callback( NULL );
+	CRYPTO_set_dynlock_lock_callback( NULL );
+	CRYPTO_set_dynlock_destroy_callback( NULL );
+	for( i = 0; i < sc_ssl_global.lock_count; i ++ )
+		SC_SSL_RWLOCK_DESTROY( sc_ssl_global.locks + i );
+	OPENSSL_free( sc_ssl_global.locks );
+	sc_ssl_global.locks = NULL;
+#endif
+}
+
+#ifdef SC_SSL_LOCK_CALLBACKS
+
+void my_locking_cb( int mode, int n, const char *file, int line ) {
+	sc_ssl_rwlock_t *l = sc_ssl_global.locks + n;
+	if( mode & CRYPTO_LOCK ) {
+		if( mode & CRYPTO_READ )
+			SC_SSL_RWLOCK_RDLOCK( l );
+		else
+			SC_SSL_RWLOCK_WRLOCK( l );
+	}
+	else {
+		if( mode & CRYPTO_READ )
+			SC_SSL_RWLOCK_RDUNLOCK( l );
+		else
+			SC_SSL_RWLOCK_WRUNLOCK( l );
+	}
+	(void) file, (void) line;
+}
+
+#if OPENSSL_VERSION_NUMBER >= 0x10000000L
+void my_threadid_cb( CRYPTO_THREADID *id ) {
+#ifdef _WIN32
+	CRYPTO_THREADID_set_numeric( id, (unsigned long) GetCurrentThreadId() );
+#else
+	CRYPTO_THREADID_set_numeric( id, (unsigned long) pthread_self() );
+#endif
+}
+#else
+unsigned long my_threadid_cb() {
+#ifdef _WIN32
+	return (unsigned long) GetCurrentThreadId();
+#else
+	return (unsigned long) pthread_self();
+#endif
+}
+#endif
+
+struct CRYPTO_dynlock_value *my_dynlock_create_cb( const char *file, int line ) {
+	struct CRYPTO_dynlock_value *l;
+	l = (struct CRYPTO_dynlock_value *) OPENSSL_malloc( sizeof( *l ) );
+	if( l != NULL )
+		SC_SSL_RWLOCK_INIT( &l->lock );
+	(void) file, (void) line;
+	return l;
+}
+
+void my_dynlock_lock_cb(
+	int mode, struct CRYPTO_dynlock_value *l, const char *file, int line
+) {
+	if( mode & CRYPTO_LOCK ) {
+		if( mode & CRYPTO_READ )
+			SC_SSL_RWLOCK_RDLOCK( &l->lock );
+		else
+			SC_SSL_RWLOCK_WRLOCK( &l->lock );
+	}
+	else {
+		if( mode & CRYPTO_READ )
+			SC_SSL_RWLOCK_RDUNLOCK( &l->lock );
+		else
+			SC_SSL_RWLOCK_WRUNLOCK( &l->lock );
+	}
+	(void) file, (void) line;
+}
+
+void my_dynlock_destroy_cb(
+	struct CRYPTO_dynlock_value *l, const char *file, int line
+) {
+	SC_SSL_RWLOCK_DESTROY( &l->lock );
+	OPENSSL_free( l );
+	(void) file, (void) line;
+}
+
+#endif /* SC_SSL_LOCK_CALLBACKS */
+
+/* creates the SSL state of an accepted connection */
+userdata_t *my_accept_setup( userdata_t *ud, sc_t *client ) {
+	userdata_t *udc;
+	Newxz( udc, 1, userdata_t );
+	mod_sc->sc_set_userdata( client, udc, free_userdata );
+	/* use context of listen socket */
+	my_ctx_attach( udc, ud->sc_ssl_ctx );
+	SC_SSL_REF_INC( &udc->sc_ssl_ctx->refcnt );
+	/* get new SSL state with context */
+	udc->ssl = SSL_new( udc->sc_ssl_ctx->ctx );
+	/* set connection to SSL state */
+	udc->mem_bio = ud->mem_bio;
+	my_ssl_attach( client, udc );
+	return udc;
+}
+
+int my_workers_start( sc_t *socket, userdata_t *ud, int threads, int timeout ) {
+	sc_ssl_workers_t *wk;
+	int i, r = 0;
+#ifndef _WIN32
+	sigset_t set, oldset;
+#endif
+	Newxz( wk, 1, sc_ssl_workers_t );
+	Newxz( wk->threads, threads, sc_ssl_thread_t );
+	wk->timeout = timeout;
+#ifndef _WIN32
+	wk->pid = getpid();
+#endif
+	SC_SSL_MUTEX_INIT( &wk->lock );
+	SC_SSL_COND_INIT( &wk->cond );
+	ud->workers = wk;
+#ifndef _WIN32
+	if( pipe( wk->wakeup ) != 0 ) {
+		wk->wakeup[0] = wk->wakeup[1] = -1;
+		r = errno;
+		goto error;
+	}
+	for( i = 0; i < 2; i ++ ) {
+		fcntl( wk->wakeup[i], F_SETFD, FD_CLOEXEC );
+		fcntl( wk->wakeup[i], F_SETFL, O_NONBLOCK );
+	}
+	/* signals are handled by the perl thread, the workers inherit
+	 * a mask with all signals blocked */
+	sigfillset( &set );
+	pthread_sigmask( SIG_BLOCK, &set, &oldset );
+#endif
+	for( i = 0; i < threads; i ++ ) {
+#ifdef _WIN32
+		wk->threads[i] = CreateThread( NULL, 0, my_workers_thread, wk, 0, NULL );
+		if( wk->threads[i] == NULL ) {
+			r = (int) GetLastError();
+			break;
+		}
+#else
+		r = pthread_create( wk->threads + i, NULL, my_workers_thread, wk );
+		if( r != 0 )
+			break;
+#endif
+		wk->thread_count ++;
+	}
+#ifndef _WIN32
+	pthread_sigmask( SIG_SETMASK, &oldset, NULL );
+#endif
+	if( r == 0 ) {
+#ifdef SC_DEBUG
+		_debug( "started %d handshake workers\n", threads );
+#endif
+		return SC_OK;
+	}
+error:
+	my_workers_stop( ud );
+	mod_sc->sc_set_errno( socket, r );
+	return SC_ERROR;
+}
+
+void my_workers_stop( userdata_t *ud ) {
+	sc_ssl_workers_t *wk = ud->workers;
+	sc_ssl_job_t *job;
+	int i;
+#ifndef _WIN32
+	if( wk->pid != getpid() ) {
+		/* forked child, the copy of the lock may be held by a worker */
+		wk->thread_count = 0;
+		goto cleanup;
+	}
+#endif
+	SC_SSL_MUTEX_LOCK( &wk->lock );
+	wk->shutdown = TRUE;
+	SC_SSL_COND_BROADCAST( &wk->cond );
+	SC_SSL_MUTEX_UNLOCK( &wk->lock );
+	for( i = 0; i < wk->thread_count; i ++ ) {
+#ifdef _WIN32
+		WaitForSingleObject( wk->threads[i], INFINITE );
+		CloseHandle( wk->threads[i] );
+#else
+		pthread_join( wk->threads[i], NULL );
+#endif
+	}
+#ifndef _WIN32
+cleanup:
+#endif
+	/* connections not handed out by accept() */
+	while( (job = wk->queue) != NULL ) {
+		wk->queue = job->next;
+		mod_sc->sc_destroy( job->socket );
+		Safefree( job );
+	}
+	while( (job = wk->done) != NULL ) {
+		wk->done = job->next;
+		mod_sc->sc_destroy( job->socket );
+		Safefree( job );
+	}
+#ifndef _WIN32
+	if( wk->wakeup[0] >= 0 ) {
+		close( wk->wakeup[0] );
+		close( wk->wakeup[1] );
+	}
+	if( wk->pid == getpid() )
+#endif
+	{
+		SC_SSL_COND_DESTROY( &wk->cond );
+		SC_SSL_MUTEX_DESTROY( &wk->lock );
+	}
+	Safefree( wk->threads );
+	Safefree( wk );
+	ud->workers = NULL;
+}
+
+/* accepts connections and hands them to the workers until a handshake is
+ * done or 'ms' milliseconds are over, returns 1 if a handshake is done */
+int my_workers_poll( sc_t *socket, userdata_t *ud, int ms ) {
+	sc_ssl_workers_t *wk = ud->workers;
+	sc_t *client;
+	double start = my_time_ms();
+	int r, wait;
+#ifndef _WIN32
+	if( wk->pid != getpid() ) {
+		/* forked child, start own workers */
+		r = wk->thread_count;
+		wait = wk->timeout;
+		my_workers_stop( ud );
+		if( my_workers_start( socket, ud, r, wait ) != SC_OK )
+			return -1;
+		wk = ud->workers;
+	}
+#endif
+	while( 1 ) {
+		SC_SSL_MUTEX_LOCK( &wk->lock );
+		r = wk->done != NULL;
+		SC_SSL_MUTEX_UNLOCK( &wk->lock );
+		if( r )
+			return 1;
+		if( ms < 0 )
+			wait = -1;
+		else if( (wait = ms - (int) (my_time_ms() - start)) < 0 )
+			wait = 0;
+		r = my_workers_wait( socket, wk, wait );
+		if( r < 0 )
+			return -1;
+		if( r > 0 ) {
+			if( mod_sc->sc_accept( socket, &client ) != SC_OK )
+				return -1;
+			if( client != NULL )
+				my_workers_submit( ud, client );
+			continue;
+		}
+		if( wait == 0 )
+			return 0;
+	}
+}
+
+/* returns a connection after its handshake is done */
+int my_workers_accept( sc_t *socket, userdata_t *ud, sc_t **r_client ) {
+	sc_ssl_workers_t *wk = ud->workers;
+	sc_ssl_job_t *job;
+	int r, blocking;
+	mod_sc->sc_get_blocking( socket, &blocking );
+	r = my_workers_poll( socket, ud, blocking ? -1 : 0 );
+	if( r < 0 )
+		return SC_ERROR;
+	if( r == 0 ) {
+		/* nothing done yet */
+		*r_client = NULL;
+		mod_sc->sc_set_errno( socket, EWOULDBLOCK );
+		return SC_OK;
+	}
+	SC_SSL_MUTEX_LOCK( &wk->lock );
+	job = wk->done;
+	if( (wk->done = job->next) == NULL )
+		wk->done_last = NULL;
+	wk->pending --;
+	SC_SSL_MUTEX_UNLOCK( &wk->lock );
+	return my_workers_finish( socket, job, r_client );
+}
+
+void my_workers_submit( userdata_t *ud, sc_t *client ) {
+	sc_ssl_workers_t *wk = ud->workers;
+	sc_ssl_job_t *job;
+	userdata_t *udc;
+	udc = my_accept_setup( ud, client );
+	SSL_set_accept_state( udc->ssl );
+	udc->handshake = SC_SSL_WANT_READ;
+	Newxz( job, 1, sc_ssl_job_t );
+	job->socket = client;
+	job->ssl = udc->ssl;
+	job->sock = mod_sc->sc_get_handle( client );
+	mod_sc->sc_get_blocking( client, &job->blocking );
+	SC_SSL_MUTEX_LOCK( &wk->lock );
+	if( wk->queue_last != NULL )
+		wk->queue_last->next = job;
+	else
+		wk->queue = job;
+	wk->queue_last = job;
+	wk->pending ++;
+	SC_SSL_COND_BROADCAST( &wk->cond );
+	SC_SSL_MUTEX_UNLOCK( &wk->lock );
+}
+
+/* waits up to 'ms' milliseconds for a new connection or a finished
+ * handshake, returns 1 if a connection waits to be accepted */
+int my_workers_wait( sc_t *socket, sc_ssl_workers_t *wk, int ms ) {
+	struct pollfd fds[2];
+	int r, nfds = 1;
+#ifndef _WIN32
+	char buf[64];
+#endif
+	fds[0].fd = mod_sc->sc_get_handle( socket );
+	fds[0].events = POLLIN;
+	fds[0].revents = 0;
+#ifdef _WIN32
+	/* no wakeup descriptor, finished handshakes are seen with a delay */
+	if( ms < 0 || ms > SC_SSL_WORKER_SLICE )
+		ms = SC_SSL_WORKER_SLICE;
+#else
+	fds[1].fd = wk->wakeup[0];
+	fds[1].events = POLLIN;
+	fds[1].revents = 0;
+	nfds = 2;
+#endif
+	r = poll( fds, nfds, ms );
+	if( r < 0 ) {
+		if( (r = SOCKET_ERRNO()) == EINTR )
+			return 0;
+		mod_sc->sc_set_errno( socket, r );
+		return -1;
+	}
+#ifndef _WIN32
+	if( fds[1].revents != 0 ) {
+		while( read( wk->wakeup[0], buf, sizeof( buf ) ) > 0 )
+			;
+	}
+#else
+	(void) wk;
+#endif
+	return fds[0].revents != 0 ? 1 : 0;
+}
+
+/* hands a connection of the workers out, in the thread of the caller */
+int my_workers_finish( sc_t *socket, sc_ssl_job_t *job, sc_t **r_client ) {
+	sc_t *client = job->socket;
+	userdata_t *udc;
+	udc = (userdata_t *) mod_sc->sc_get_userdata( client );
+	udc->handshake = 0;
+	if( job->result == SC_OK ) {
+		Safefree( job );
+		my_mem_update( udc );
+		*r_client = client;
+		return SC_OK;
+	}
+	if( job->error != 0 ) {
+		mod_sc->sc_set_error( socket,
+			(int) job->error, ERR_reason_error_string( job->error ) );
+	}
+	else if( job->sys_error != 0 ) {
+		mod_sc->sc_set_errno( socket, job->sys_error );
+	}
+	else {
+		mod_sc->sc_set_error( socket,
+			job->ssl_error, my_ssl_error( job->ssl_error ) );
+	}
+	Safefree( job );
+	mod_sc->sc_destroy( client );
+	return SC_ERROR;
+}
+
+/* worker thread, runs without a perl interpreter */
+SC_SSL_THREAD_RETURN my_workers_thread( void *arg ) {
+	sc_ssl_workers_t *wk = (sc_ssl_workers_t *) arg;
+	sc_ssl_job_t *job;
+#ifndef _WIN32
+	char ch = 1;
+#endif
+	SC_SSL_MUTEX_LOCK( &wk->lock );
+	while( 1 ) {
+		while( wk->queue == NULL && ! wk->shutdown )
+			SC_SSL_COND_WAIT( &wk->cond, &wk->lock );
+		if( wk->shutdown )
+			break;
+		job = wk->queue;
+		if( (wk->queue = job->next) == NULL )
+			wk->queue_last = NULL;
+		job->next = NULL;
+		SC_SSL_MUTEX_UNLOCK( &wk->lock );
+		my_workers_handshake( wk, job );
+		SC_SSL_MUTEX_LOCK( &wk->lock );
+		if( wk->done_last != NULL )
+			wk->done_last->next = job;
+		else
+			wk->done = job;
+		wk->done_last = job;
+#ifndef _WIN32
+		if( write( wk->wakeup[1], &ch, 1 ) < 0 ) {
+			/* the pipe is full, accept() wakes up anyway */
+		}
+#endif
+	}
+	SC_SSL_MUTEX_UNLOCK( &wk->lock );
+	return 0;
+}
+
+/* runs the handshake on a non-blocking socket, in a worker thread */
+void my_workers_handshake( sc_ssl_workers_t *wk, sc_ssl_job_t *job ) {
+	struct pollfd pfd;
+	double start = my_time_ms();
+	int r, ms, stop;
+#ifdef _WIN32
+	u_long mode = 1;
+	ioctlsocket( job->sock, FIONBIO, &mode );
+#else
+	int flags = fcntl( job->sock, F_GETFL );
+	fcntl( job->sock, F_SETFL, flags | O_NONBLOCK );
+#endif
+	ERR_clear_error();
+	pfd.fd = job->sock;
+	job->result = SC_ERROR;
+	while( 1 ) {
+		r = SSL_do_handshake( job->ssl );
+		if( r == 1 ) {
+			job->result = SC_OK;
+			break;
+		}
+		r = SSL_get_error( job->ssl, r );
+		if( r == SSL_ERROR_WANT_READ )
+			pfd.events = POLLIN;
+		else if( r == SSL_ERROR_WANT_WRITE )
+			pfd.events = POLLOUT;
+		else {
+			job->ssl_error = r;
+			job->error = ERR_get_error();
+			if( r == SSL_ERROR_SYSCALL && job->error == 0 )
+				job->sys_error = SOCKET_ERRNO() != 0
+					? SOCKET_ERRNO() : ECONNRESET;
+			break;
+		}
+		do {
+			/* the flag is set by my_workers_stop() under the lock */
+			SC_SSL_MUTEX_LOCK( &wk->lock );
+			stop = wk->shutdown;
+			SC_SSL_MUTEX_UNLOCK( &wk->lock );
+			if( stop ) {
+				job->sys_error = ECONNABORTED;
+				goto finish;
+			}
+			ms = wk->timeout - (int) (my_time_ms() - start);
+			if( ms <= 0 ) {
+				job->sys_error = ETIMEDOUT;
+				goto finish;
+			}
+			pfd.revents = 0;
+			r = poll( &pfd, 1, ms < SC_SSL_WORKER_SLICE ? ms : SC_SSL_WORKER_SLICE );
+		} while( r == 0 || (r < 0 && SOCKET_ERRNO() == EINTR) );
+		if( r < 0 ) {
+			job->sys_error = SOCKET_ERRNO();
+			break;
+		}
+	}
+finish:
+#ifdef _WIN32
+	mode = job->blocking ? 0 : 1;
+	ioctlsocket( job->sock, FIONBIO, &mode );
+#else
+	fcntl( job->sock, F_SETFL, flags );
 #endif
-	if( ud->ssl != NULL )
-		SSL_free( ud->ssl );
-	Safefree( ud->rcvbuf );
-	Safefree( ud->buffer );
-	//if( !sc_ssl_global.destroyed )
-		mod_sc_ssl_ctx_destroy( ctx );
-	Safefree( ud );
 }
 
 const char *my_ssl_error( int code ) {
@@ -1461,6 +4919,19 @@ char *my_strcpy( char *dst, const char *src ) {
 	return dst;
 }
 
+/* copies with malloc(), strings of the contexts are freed by Safefree(),
+ * savepv() allocates from perl */
+char *my_strdup( const char *str ) {
+	char *dst;
+	size_t l;
+	if( str == NULL )
+		return NULL;
+	l = strlen( str ) + 1;
+	Newx( dst, l, char );
+	Copy( str, dst, l, char );
+	return dst;
+}
+
 int my_stricmp( const char *cs, const char *ct ) {
 	register signed char res;
 	while( 1 ) {
@@ -10,6 +10,15 @@
 
 #include <openssl/ssl.h>
 #include <openssl/err.h>
+#include <openssl/rand.h>
+#include <openssl/hmac.h>
+#include <openssl/pem.h>
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+#include <openssl/core_names.h>
+#endif
+#ifndef OPENSSL_NO_OCSP
+#include <openssl/ocsp.h>
+#endif
 
 #undef XLONG
 #undef UXLONG
@@ -107,8 +116,119 @@ void debug_free();
 #ifdef _WIN32
 #define ECONNRESET				WSAECONNRESET
 #define ENOTCONN				WSAENOTCONN
+#undef EWOULDBLOCK
+#define EWOULDBLOCK				WSAEWOULDBLOCK
+#undef ETIMEDOUT
+#define ETIMEDOUT				WSAETIMEDOUT
+#undef ECONNABORTED
+#define ECONNABORTED			WSAECONNABORTED
+#define poll					WSAPoll
+#define SOCKET_ERRNO()			WSAGetLastError()
+#else
+#include <poll.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <pthread.h>
+#define SOCKET_ERRNO()			errno
+#endif
+
+/* native threads and locks, the handshake workers run without a perl
+ * interpreter, so the perl macros do not apply */
+#ifdef _WIN32
+typedef CRITICAL_SECTION		sc_ssl_mutex_t;
+typedef CONDITION_VARIABLE		sc_ssl_cond_t;
+typedef HANDLE					sc_ssl_thread_t;
+#define SC_SSL_MUTEX_INIT(m)	InitializeCriticalSection( (m) )
+#define SC_SSL_MUTEX_LOCK(m)	EnterCriticalSection( (m) )
+#define SC_SSL_MUTEX_UNLOCK(m)	LeaveCriticalSection( (m) )
+#define SC_SSL_MUTEX_DESTROY(m)	DeleteCriticalSection( (m) )
+#define SC_SSL_COND_INIT(c)		InitializeConditionVariable( (c) )
+#define SC_SSL_COND_WAIT(c,m)	SleepConditionVariableCS( (c), (m), INFINITE )
+#define SC_SSL_COND_BROADCAST(c)	WakeAllConditionVariable( (c) )
+#define SC_SSL_COND_DESTROY(c)
+#define SC_SSL_THREAD_RETURN	DWORD WINAPI
+#else
+typedef pthread_mutex_t			sc_ssl_mutex_t;
+typedef pthread_cond_t			sc_ssl_cond_t;
+typedef pthread_t				sc_ssl_thread_t;
+#define SC_SSL_MUTEX_INIT(m)	pthread_mutex_init( (m), NULL )
+#define SC_SSL_MUTEX_LOCK(m)	pthread_mutex_lock( (m) )
+#define SC_SSL_MUTEX_UNLOCK(m)	pthread_mutex_unlock( (m) )
+#define SC_SSL_MUTEX_DESTROY(m)	pthread_mutex_destroy( (m) )
+#define SC_SSL_COND_INIT(c)		pthread_cond_init( (c), NULL )
+#define SC_SSL_COND_WAIT(c,m)	pthread_cond_wait( (c), (m) )
+#define SC_SSL_COND_BROADCAST(c)	pthread_cond_broadcast( (c) )
+#define SC_SSL_COND_DESTROY(c)	pthread_cond_destroy( (c) )
+#define SC_SSL_THREAD_RETURN	void *
+#endif
+
+/* reference counts of shared contexts change in any thread */
+#ifdef _WIN32
+#define SC_SSL_REF_INC(p)		InterlockedIncrement( (LONG volatile *) (p) )
+#define SC_SSL_REF_DEC(p)		InterlockedDecrement( (LONG volatile *) (p) )
+#define SC_SSL_REF_CAS(p,o,n) \
+	(InterlockedCompareExchange( (LONG volatile *) (p), (n), (o) ) == (o))
+#else
+#define SC_SSL_REF_INC(p)		__sync_add_and_fetch( (p), 1 )
+#define SC_SSL_REF_DEC(p)		__sync_sub_and_fetch( (p), 1 )
+#define SC_SSL_REF_CAS(p,o,n)	__sync_bool_compare_and_swap( (p), (o), (n) )
+#endif
+
+/* session cache in memory shared with forked processes, the locks are
+ * robust process-shared mutexes, so a process which dies while holding
+ * one does not block the others */
+#ifndef _WIN32
+#include <sys/mman.h>
+#if ! defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+#define MAP_ANONYMOUS			MAP_ANON
+#endif
+#if defined(MAP_ANONYMOUS) \
+	&& (defined(PTHREAD_MUTEX_ROBUST) || defined(__GLIBC__))
+#define SC_SSL_USE_SHM			1
+#endif
+#endif
+#ifdef SC_SSL_USE_SHM
+typedef pthread_mutex_t			sc_ssl_shm_lock_t;
+#define SC_SSL_SHM_UNLOCK(m)	pthread_mutex_unlock( (m) )
+#else
+typedef int						sc_ssl_shm_lock_t;
 #endif
 
+/* OpenSSL before 1.1.0 locks through callbacks of the application, most
+ * of its locks are taken for reading */
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+#define SC_SSL_LOCK_CALLBACKS
+#ifdef _WIN32
+typedef SRWLOCK					sc_ssl_rwlock_t;
+#define SC_SSL_RWLOCK_INIT(l)	InitializeSRWLock( (l) )
+#define SC_SSL_RWLOCK_RDLOCK(l)	AcquireSRWLockShared( (l) )
+#define SC_SSL_RWLOCK_WRLOCK(l)	AcquireSRWLockExclusive( (l) )
+#define SC_SSL_RWLOCK_RDUNLOCK(l)	ReleaseSRWLockShared( (l) )
+#define SC_SSL_RWLOCK_WRUNLOCK(l)	ReleaseSRWLockExclusive( (l) )
+#define SC_SSL_RWLOCK_DESTROY(l)
+#else
+typedef pthread_rwlock_t		sc_ssl_rwlock_t;
+#define SC_SSL_RWLOCK_INIT(l)	pthread_rwlock_init( (l), NULL )
+#define SC_SSL_RWLOCK_RDLOCK(l)	pthread_rwlock_rdlock( (l) )
+#define SC_SSL_RWLOCK_WRLOCK(l)	pthread_rwlock_wrlock( (l) )
+#define SC_SSL_RWLOCK_RDUNLOCK(l)	pthread_rwlock_unlock( (l) )
+#define SC_SSL_RWLOCK_WRUNLOCK(l)	pthread_rwlock_unlock( (l) )
+#define SC_SSL_RWLOCK_DESTROY(l)	pthread_rwlock_destroy( (l) )
+#endif
+
+struct CRYPTO_dynlock_value {
+	sc_ssl_rwlock_t				lock;
+};
+
+#define X509_up_ref(x)			CRYPTO_add( &(x)->references, 1, CRYPTO_LOCK_X509 )
+#define EVP_PKEY_up_ref(k) \
+	CRYPTO_add( &(k)->references, 1, CRYPTO_LOCK_EVP_PKEY )
+#define X509_get0_notAfter(x)	X509_get_notAfter( (x) )
+#define X509_STORE_CTX_get0_cert(s)			((s)->cert)
+#define X509_STORE_CTX_get0_untrusted(s)	((s)->untrusted)
+#define X509_STORE_CTX_get0_chain(s)		X509_STORE_CTX_get_chain( (s) )
+#endif /* OPENSSL_VERSION_NUMBER < 0x10100000L */
+
 #ifndef AF_INET6
 #define AF_INET6				23
 #endif
@@ -136,17 +256,246 @@ enum ssl_method {
 	tlsv1
 };
 
+/* OpenSSL 3 signs the tickets through EVP_MAC, HMAC_CTX is deprecated */
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+#define SC_SSL_USE_TICKETS		1
+#define SC_SSL_TICKET_EVP		1
+#elif defined(SSL_CTX_set_tlsext_ticket_key_cb)
+#define SC_SSL_USE_TICKETS		1
+#endif
+
+#ifdef SSL_CTX_set_tlsext_servername_callback
+#define SC_SSL_USE_SNI			1
+#endif
+
+#if defined(SSL_CTX_set_tlsext_status_cb) && ! defined(OPENSSL_NO_OCSP)
+#define SC_SSL_USE_OCSP			1
+#endif
+
+#ifdef SSL_OP_ENABLE_KTLS
+/* OpenSSL installs the record keys into the kernel */
+#define SC_SSL_USE_KTLS			1
+#endif
+
+/* ticket keys, the current one and the one before the last rotation */
+#define SC_SSL_TICKET_KEYS		2
+/* default session id context of server contexts */
+#define SC_SSL_SID_CTX			"Socket::Class::SSL"
+/* session cache mode not set */
+#define SC_SSL_SESS_DEFAULT		-1
+
+/* client session store */
+#define SC_SSL_SESS_CASCADE		63
+#define SC_SSL_SESS_STORE_MAX	128
+
+/* shared session cache, slots of a set are replaced least recently used
+ * first, sessions larger than a slot are not shared */
+#define SC_SSL_SHM_WAYS			8
+#define SC_SSL_SHM_DATA			2048
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+#define SC_SSL_SESSION_ID		const unsigned char
+#else
+#define SC_SSL_SESSION_ID		unsigned char
+#endif
+
+/* peer certificate chains verified before, hashed by a sha256 digest */
+#define SC_SSL_VERIFY_CASCADE	63
+#define SC_SSL_VERIFY_MD_SIZE	32
+#define SC_SSL_VERIFY_TIMEOUT	300
+
+/* minimum free space in the plaintext buffer before calling SSL_read(),
+ * the size of a full TLS record */
+#define SC_SSL_RCVBUF_CHUNK		16384
+
+#define SC_SSL_RCVBUF_AVAIL(ud)	((ud)->rcvbuf_len - (ud)->rcvbuf_pos)
+
+#define SC_SSL_OUTBUF_PENDING(ud)	((ud)->outbuf_len - (ud)->outbuf_pos)
+
+#define SC_SSL_NETBUF_PENDING(ud)	((ud)->netbuf_len - (ud)->netbuf_pos)
+
+/* sends records produced by OpenSSL in memory bio mode */
+#define SC_SSL_BIO_FLUSH(socket,ud) \
+	((ud)->mem_bio == SC_SSL_BIO_SOCKET ? my_bio_flush( socket, ud ) : 0)
+
+/* dynamic record sizing, records fit into one tcp segment until
+ * SC_SSL_RECORD_BOOST bytes are sent, and again after an idle time */
+#define SC_SSL_RECORD_SMALL		1369
+#define SC_SSL_RECORD_MAX		16384
+#define SC_SSL_RECORD_BOOST		1048576
+#define SC_SSL_RECORD_IDLE		1000
+
+/* shared pool of plaintext and record buffers, the size classes start
+ * with a full record and double with every class */
+#define SC_SSL_POOL_BASE		17408
+#define SC_SSL_POOL_CLASSES		8
+/* maximum size of the free buffers kept in the pool */
+#define SC_SSL_POOL_MAX			4194304
+
+/* size of a record buffer of OpenSSL, used to estimate the memory usage */
+#define SC_SSL_RECORD_BUFFER	SSL3_RT_MAX_PACKET_SIZE
+
+/* handshake workers, default timeout of a handshake in milliseconds and
+ * the interval the workers look for a shutdown */
+#define SC_SSL_WORKER_TIMEOUT	30000
+#define SC_SSL_WORKER_SLICE		100
+#define SC_SSL_WORKER_MAX		256
+
+/* server names of a listening context, initial size of the hash table and
+ * the longest name */
+#define SC_SSL_SNI_SIZE			16
+#define SC_SSL_SNI_NAME_MAX		255
+
+/* certificates and keys given as PEM data instead of a file name */
+#define SC_SSL_IS_PEM(s)		(strncmp( (s), "-----BEGIN", 10 ) == 0)
+
 typedef struct st_userdata			userdata_t;
 typedef struct st_sc_ssl_global		sc_ssl_global_t;
+typedef struct st_sc_ssl_ticket_key	sc_ssl_ticket_key_t;
+typedef struct st_sc_ssl_session	sc_ssl_session_t;
+typedef struct st_sc_ssl_workers	sc_ssl_workers_t;
+typedef struct st_sc_ssl_job		sc_ssl_job_t;
+typedef struct st_sc_ssl_sni		sc_ssl_sni_t;
+typedef struct st_sc_ssl_verified	sc_ssl_verified_t;
+typedef struct st_sc_ssl_shm_slot	sc_ssl_shm_slot_t;
+typedef struct st_sc_ssl_shm_set	sc_ssl_shm_set_t;
+typedef struct st_sc_ssl_shm		sc_ssl_shm_t;
+typedef struct st_sc_ssl_shared		sc_ssl_shared_t;
+
+struct st_sc_ssl_ticket_key {
+	unsigned char				name[16];
+	unsigned char				hmac_key[32];
+	unsigned char				aes_key[16];
+};
+
+struct st_sc_ssl_session {
+	sc_ssl_session_t			*next;
+	sc_ssl_session_t			*lru_prev;
+	sc_ssl_session_t			*lru_next;
+	unsigned long				hash;
+	char						*key;
+	SSL_SESSION					*session;
+};
+
+struct st_sc_ssl_verified {
+	sc_ssl_verified_t			*next;
+	sc_ssl_verified_t			*newer;
+	sc_ssl_verified_t			*older;
+	unsigned long				hash;
+	long						expires;
+	unsigned char				md[SC_SSL_VERIFY_MD_SIZE];
+};
+
+struct st_sc_ssl_shm_slot {
+	unsigned long				hash;
+	long						expires;
+	unsigned long				used;
+	unsigned int				id_len;
+	unsigned int				data_len;
+	unsigned char				id[SSL_MAX_SSL_SESSION_ID_LENGTH];
+	unsigned char				data[SC_SSL_SHM_DATA];
+};
+
+struct st_sc_ssl_shm_set {
+	sc_ssl_shm_lock_t			lock;
+	unsigned long				clock;
+	sc_ssl_shm_slot_t			slot[SC_SSL_SHM_WAYS];
+};
+
+/* the shared memory, zero filled when mapped */
+struct st_sc_ssl_shm {
+	sc_ssl_shm_lock_t			lock;
+	int							ticket_key_count;
+	sc_ssl_ticket_key_t			ticket_keys[SC_SSL_TICKET_KEYS];
+	volatile long				stored;
+	volatile long				hits;
+	volatile long				misses;
+	volatile long				evicted;
+	int							set_count;
+	sc_ssl_shm_set_t			set[1];
+};
+
+/* the mapping of a process, shared by copies of a context */
+struct st_sc_ssl_shared {
+	sc_ssl_shm_t				*shm;
+	size_t						size;
+	int							slots;
+	volatile int				refcnt;
+};
+
+/* a handshake run by the workers, owned by the queue it is in */
+struct st_sc_ssl_job {
+	sc_ssl_job_t				*next;
+	sc_t						*socket;
+	SSL							*ssl;
+	SOCKET						sock;
+	int							blocking;
+	int							result;
+	int							ssl_error;
+	unsigned long				error;
+	int							sys_error;
+};
+
+/* handshake workers of a listening socket */
+struct st_sc_ssl_workers {
+	sc_ssl_mutex_t				lock;
+	sc_ssl_cond_t				cond;
+	sc_ssl_thread_t				*threads;
+	int							thread_count;
+	int							timeout;
+	volatile int				shutdown;
+	sc_ssl_job_t				*queue;
+	sc_ssl_job_t				*queue_last;
+	sc_ssl_job_t				*done;
+	sc_ssl_job_t				*done_last;
+	int							pending;
+#ifndef _WIN32
+	/* wakes up accept() when a handshake is done */
+	int							wakeup[2];
+	/* the threads do not exist in a forked child */
+	pid_t						pid;
+#endif
+};
+
+struct st_sc_ssl_sni {
+	sc_ssl_sni_t				*next;
+	unsigned long				hash;
+	char						*name;
+	sc_ssl_ctx_t				*ctx;
+};
 
 struct st_userdata {
 	sc_ssl_ctx_t				*sc_ssl_ctx;
 	SSL							*ssl;
 	char						*rcvbuf;
-	int							rcvbuf_len;
-	int							rcvbuf_pos;
+	size_t						rcvbuf_size;
+	size_t						rcvbuf_len;
+	size_t						rcvbuf_pos;
+	char						rcvbuf_skip;
+	char						*outbuf;
+	size_t						outbuf_size;
+	size_t						outbuf_len;
+	size_t						outbuf_pos;
+	size_t						outbuf_max;
+	int							write_retry;
+	int							outbuf_max_age;
+	double						outbuf_time;
+	size_t						record_bytes;
+	double						record_time;
 	char						*buffer;
-	int							buffer_len;
+	size_t						buffer_len;
+	char						*session_key;
+	char						*server_name;
+	sc_ssl_ctx_t				*sni_ctx;
+	int							handshake;
+	int							defer_handshake;
+	int							mem_bio;
+	char						*netbuf;
+	size_t						netbuf_size;
+	size_t						netbuf_len;
+	size_t						netbuf_pos;
+	size_t						mem_buffers;
+	size_t						mem_ssl;
+	sc_ssl_workers_t			*workers;
 	void						*user_data;
 	void						(*free_user_data) ( void *p );
 };
@@ -154,8 +503,11 @@ struct st_userdata {
 
 struct st_sc_ssl_ctx {
 	sc_ssl_ctx_t				*next;
+	sc_ssl_ctx_t				*config_next;
+	char						*config_key;
+	unsigned long				config_hash;
 	int							id;
-	int							refcnt;
+	volatile int				refcnt;
 	int							is_client;
 	enum ssl_method				method_id;
 	/*
@@ -173,18 +525,80 @@ struct st_sc_ssl_ctx {
 	char						*ca_file;
 	char						*ca_path;
 	char						*cipher_list;
+	/* parsed once, the context is rebuilt from them */
+	X509						*cert;
+	STACK_OF(X509)				*chain;
+	EVP_PKEY					*pkey;
+	/* ocsp response stapled to the handshake, locked by the global lock */
+	char						*ocsp_file;
+	unsigned char				*ocsp_response;
+	int							ocsp_response_len;
+	int							ocsp_status;
+	long						ocsp_this_update;
+	long						ocsp_next_update;
+	long						ocsp_stapled;
+	long						ocsp_missed;
+	int							ocsp_stapling;
+	/* contexts selected by the server name of the client */
+	sc_ssl_sni_t				**sni;
+	int							sni_size;
+	int							sni_count;
+	int							session_cache;
+	long						session_cache_size;
+	long						session_timeout;
+	char						*session_id_context;
+	int							no_tickets;
+	int							ktls;
+	int							read_ahead;
+	int							dynamic_records;
+	int							release_buffers;
+	int							ticket_key_count;
+	sc_ssl_ticket_key_t			ticket_keys[SC_SSL_TICKET_KEYS];
+	long						tickets_issued;
+	long						tickets_accepted;
+	long						tickets_renewed;
+	long						tickets_failed;
+	sc_ssl_session_t			*sessions[SC_SSL_SESS_CASCADE + 1];
+	sc_ssl_session_t			*sessions_lru;
+	sc_ssl_session_t			*sessions_lru_last;
+	int							sessions_count;
+	int							sessions_max;
+	long						sessions_offered;
+	long						sessions_resumed;
+	sc_ssl_shared_t				*shared;
+	/* size of the shared cache, mapped after the lookup of the context */
+	int							shared_size;
+	/* peer verification, the cache is locked by the global lock */
+	int							verify_peer;
+	int							verify_max;
+	long						verify_timeout;
+	sc_ssl_verified_t			*verified[SC_SSL_VERIFY_CASCADE + 1];
+	sc_ssl_verified_t			*verified_newest;
+	sc_ssl_verified_t			*verified_oldest;
+	int							verified_count;
+	long						verify_hits;
+	long						verify_misses;
+	long						mem_sockets;
+	long						mem_buffers;
+	long						mem_ssl;
 };
 
 #define SC_SSL_CTX_CASCADE		31
 
 struct st_sc_ssl_global {
 	sc_ssl_ctx_t				*ctx[SC_SSL_CTX_CASCADE + 1];
+	/* implicit contexts by configuration */
+	sc_ssl_ctx_t				*config[SC_SSL_CTX_CASCADE + 1];
 	int							counter;
 	int							destroyed;
-#ifdef USE_ITHREADS
-	perl_mutex					thread_lock;
-#endif
+	sc_ssl_mutex_t				thread_lock;
 	unsigned int				process_id;
+	char						*pool[SC_SSL_POOL_CLASSES];
+	size_t						pool_bytes;
+#ifdef SC_SSL_LOCK_CALLBACKS
+	sc_ssl_rwlock_t				*locks;
+	int							lock_count;
+#endif
 };
 
 extern mod_sc_t *mod_sc;
@@ -237,6 +651,32 @@ const char *mod_sc_ssl_get_version( sc_t *socket );
 int mod_sc_ssl_starttls( sc_t *socket, char **args, int argc );
 int mod_sc_ssl_set_ssl_method( sc_t *socket, const char *s );
 int mod_sc_ssl_set_cipher_list( sc_t *socket, const char *s );
+int mod_sc_ssl_session_reused( sc_t *socket );
+int mod_sc_ssl_handshake( sc_t *socket, int *p_want );
+int mod_sc_ssl_ktls_active( sc_t *socket );
+int mod_sc_ssl_set_output_buffer(
+	sc_t *socket, size_t size, int flags, int max_age
+);
+int mod_sc_ssl_flush( sc_t *socket, size_t *p_pending );
+size_t mod_sc_ssl_get_output_pending( sc_t *socket );
+int mod_sc_ssl_is_readable( sc_t *socket, double timeout, int *readable );
+int mod_sc_ssl_close( sc_t *socket );
+int mod_sc_ssl_bio_write( sc_t *socket, const char *buf, int len, int *p_len );
+int mod_sc_ssl_bio_read( sc_t *socket, char *buf, int len, int *p_len );
+size_t mod_sc_ssl_bio_pending( sc_t *socket );
+int mod_sc_ssl_sendfile(
+	sc_t *socket, int fd, off_t offset, size_t length, size_t *p_len
+);
+int mod_sc_ssl_memory_usage( sc_t *socket, sc_ssl_memory_t *mem );
+int mod_sc_ssl_set_handshake_threads( sc_t *socket, int threads, int timeout );
+int mod_sc_ssl_handshake_pending( sc_t *socket );
+int mod_sc_ssl_add_server_name(
+	sc_t *socket, const char *name, sc_ssl_ctx_t *ctx
+);
+int mod_sc_ssl_remove_server_name( sc_t *socket, const char *name );
+const char *mod_sc_ssl_get_server_name( sc_t *socket );
+int mod_sc_ssl_get_peer_certificate( sc_t *socket, char **p_buf, int *p_len );
+int mod_sc_ssl_get_ocsp_response( sc_t *socket, char **p_buf, int *p_len );
 
 /* ssl context */
 
@@ -254,6 +694,36 @@ int mod_sc_ssl_ctx_set_verify_locations(
 int mod_sc_ssl_ctx_set_cipher_list( sc_ssl_ctx_t *ctx, const char *str );
 int mod_sc_ssl_ctx_check_private_key( sc_ssl_ctx_t *ctx );
 int mod_sc_ssl_ctx_enable_compatibility( sc_ssl_ctx_t *ctx );
+int mod_sc_ssl_ctx_set_session_cache(
+	sc_ssl_ctx_t *ctx, int mode, long size, long timeout
+);
+int mod_sc_ssl_ctx_set_session_id_context(
+	sc_ssl_ctx_t *ctx, const char *str
+);
+int mod_sc_ssl_ctx_set_ticket_key( sc_ssl_ctx_t *ctx, const char *key );
+int mod_sc_ssl_ctx_get_stats( sc_ssl_ctx_t *ctx, sc_ssl_ctx_stats_t *stats );
+int mod_sc_ssl_ctx_set_session_store( sc_ssl_ctx_t *ctx, int max );
+int mod_sc_ssl_ctx_set_ktls( sc_ssl_ctx_t *ctx, int enable );
+int mod_sc_ssl_ctx_set_read_ahead( sc_ssl_ctx_t *ctx, int enable );
+int mod_sc_ssl_ctx_set_dynamic_records( sc_ssl_ctx_t *ctx, int enable );
+int mod_sc_ssl_ctx_set_release_buffers( sc_ssl_ctx_t *ctx, int enable );
+int mod_sc_ssl_ctx_memory_usage( sc_ssl_ctx_t *ctx, sc_ssl_memory_t *mem );
+int mod_sc_ssl_ctx_add_server_name(
+	sc_ssl_ctx_t *ctx, const char *name, sc_ssl_ctx_t *target
+);
+int mod_sc_ssl_ctx_remove_server_name( sc_ssl_ctx_t *ctx, const char *name );
+int mod_sc_ssl_ctx_set_ocsp_response(
+	sc_ssl_ctx_t *ctx, const char *buf, int len
+);
+int mod_sc_ssl_ctx_load_ocsp_response( sc_ssl_ctx_t *ctx, const char *file );
+int mod_sc_ssl_ctx_get_ocsp_status(
+	sc_ssl_ctx_t *ctx, sc_ssl_ocsp_status_t *status
+);
+int mod_sc_ssl_ctx_set_verify_peer( sc_ssl_ctx_t *ctx, int enable );
+int mod_sc_ssl_ctx_set_shared_session_cache( sc_ssl_ctx_t *ctx, int size );
+int mod_sc_ssl_ctx_set_verify_cache(
+	sc_ssl_ctx_t *ctx, int max, long timeout
+);
 
 int mod_sc_ssl_ctx_set_arg(
 	sc_ssl_ctx_t *ctx, char **args, int argc, int is_client,
@@ -267,9 +737,152 @@ int mod_sc_ssl_ctx_init_server( sc_ssl_ctx_t *ctx );
 int remove_context( sc_ssl_ctx_t *ctx );
 void free_context( sc_ssl_ctx_t *ctx );
 void free_userdata( void *p );
+int my_handshake_result( sc_t *socket, userdata_t *ud, int r );
+void my_ssl_free( userdata_t *ud );
+int my_ssl_read_ahead( sc_t *socket, userdata_t *ud );
+int my_ssl_write( sc_t *socket, userdata_t *ud, const char *buf, int len );
+int my_ssl_flush( sc_t *socket, userdata_t *ud );
+int my_ssl_record_size( userdata_t *ud );
+double my_time_ms();
+void my_ssl_attach( sc_t *socket, userdata_t *ud );
+int my_bio_mode( const char *val );
+int my_bio_pump( sc_t *socket, userdata_t *ud, int r );
+int my_bio_flush( sc_t *socket, userdata_t *ud );
+int my_ssl_rcvbuf_read( userdata_t *ud, char *buf, int len, int peek );
+int my_pool_class( size_t size, size_t *p_size );
+char *my_buf_get( userdata_t *ud, size_t size, size_t *p_size );
+void my_buf_put( userdata_t *ud, char *buf, size_t size );
+char *my_buf_resize(
+	userdata_t *ud, char *buf, size_t *p_size, size_t need, size_t keep
+);
+void my_ssl_release( userdata_t *ud );
+void my_mem_update( userdata_t *ud );
+void my_ctx_attach( userdata_t *ud, sc_ssl_ctx_t *ctx );
+void my_pool_free();
+int my_ctx_ref( sc_ssl_ctx_t *ctx );
+void my_locks_init();
+void my_locks_free();
+#ifdef SC_SSL_LOCK_CALLBACKS
+void my_locking_cb( int mode, int n, const char *file, int line );
+#if OPENSSL_VERSION_NUMBER >= 0x10000000L
+void my_threadid_cb( CRYPTO_THREADID *id );
+#else
+unsigned long my_threadid_cb();
+#endif
+struct CRYPTO_dynlock_value *my_dynlock_create_cb( const char *file, int line );
+void my_dynlock_lock_cb(
+	int mode, struct CRYPTO_dynlock_value *l, const char *file, int line
+);
+void my_dynlock_destroy_cb(
+	struct CRYPTO_dynlock_value *l, const char *file, int line
+);
+#endif
+userdata_t *my_accept_setup( userdata_t *ud, sc_t *client );
+int my_workers_start( sc_t *socket, userdata_t *ud, int threads, int timeout );
+void my_workers_stop( userdata_t *ud );
+int my_workers_poll( sc_t *socket, userdata_t *ud, int ms );
+int my_workers_accept( sc_t *socket, userdata_t *ud, sc_t **r_client );
+void my_workers_submit( userdata_t *ud, sc_t *client );
+int my_workers_wait( sc_t *socket, sc_ssl_workers_t *wk, int ms );
+int my_workers_finish( sc_t *socket, sc_ssl_job_t *job, sc_t **r_client );
+SC_SSL_THREAD_RETURN my_workers_thread( void *arg );
+void my_workers_handshake( sc_ssl_workers_t *wk, sc_ssl_job_t *job );
+int my_ctx_set_files(
+	sc_ssl_ctx_t *ctx, const char *crt, const char *pk, const char *cca,
+	const char *caf, const char *cap, const char *ciphlist
+);
+void my_ctx_config_key( sc_ssl_ctx_t *ctx );
+sc_ssl_ctx_t *my_ctx_config_lookup( sc_ssl_ctx_t *ctx );
+void my_ctx_config_register( sc_ssl_ctx_t *ctx );
+void my_ctx_config_remove( sc_ssl_ctx_t *ctx );
+int my_ctx_private( userdata_t *ud );
+BIO *my_pem_open( const char *str );
+int my_ctx_load_certificate( sc_ssl_ctx_t *ctx, const char *crt );
+int my_ctx_load_private_key( sc_ssl_ctx_t *ctx, const char *pk );
+int my_ctx_use_certificate( sc_ssl_ctx_t *ctx );
+void my_ctx_copy_keys( sc_ssl_ctx_t *dst, sc_ssl_ctx_t *src );
+int my_sni_name( char *dst, const char *src );
+sc_ssl_sni_t **my_sni_slot(
+	sc_ssl_ctx_t *ctx, const char *name, unsigned long hash
+);
+sc_ssl_ctx_t *my_sni_find( sc_ssl_ctx_t *ctx, const char *name );
+sc_ssl_ctx_t *my_sni_insert(
+	sc_ssl_ctx_t *ctx, const char *name, sc_ssl_ctx_t *target
+);
+void my_sni_copy( sc_ssl_ctx_t *dst, sc_ssl_ctx_t *src );
+void my_sni_free( sc_ssl_ctx_t *ctx );
+#ifdef SC_SSL_USE_SNI
+int my_servername_cb( SSL *ssl, int *ad, void *arg );
+#endif
+void my_set_server_name( userdata_t *ud, const char *host );
+void my_ocsp_request( userdata_t *ud );
+void my_ocsp_clear( sc_ssl_ctx_t *ctx );
+long my_asn1_time( const ASN1_TIME *t );
+#ifdef SC_SSL_USE_OCSP
+int my_ocsp_store( sc_ssl_ctx_t *ctx, OCSP_RESPONSE *resp );
+int my_ocsp_status_cb( SSL *ssl, void *arg );
+#endif
 const char *my_ssl_error( int code );
+void my_ctx_init_sessions( sc_ssl_ctx_t *ctx, int is_server );
+int my_session_cache_mode( const char *str );
+void my_session_offer(
+	sc_t *socket, userdata_t *ud, const char *host, const char *serv
+);
+int my_session_new_cb( SSL *ssl, SSL_SESSION *session );
+void my_session_store_trim( sc_ssl_ctx_t *ctx, int max );
+unsigned long my_strhash( const char *str );
+sc_ssl_session_t *my_session_find(
+	sc_ssl_ctx_t *ctx, const char *key, unsigned long hash
+);
+void my_session_lru_unlink( sc_ssl_ctx_t *ctx, sc_ssl_session_t *ss );
+void my_session_lru_push( sc_ssl_ctx_t *ctx, sc_ssl_session_t *ss );
+void my_session_remove( sc_ssl_ctx_t *ctx, sc_ssl_session_t *ss );
+void my_ctx_init_verify( sc_ssl_ctx_t *ctx, int is_server );
+int my_verify_cb( X509_STORE_CTX *store, void *arg );
+int my_verify_digest( X509_STORE_CTX *store, unsigned char *md );
+sc_ssl_verified_t *my_verify_find(
+	sc_ssl_ctx_t *ctx, const unsigned char *md, unsigned long hash
+);
+void my_verify_add(
+	sc_ssl_ctx_t *ctx, const unsigned char *md, unsigned long hash,
+	long expires
+);
+void my_verify_remove( sc_ssl_ctx_t *ctx, sc_ssl_verified_t *vf );
+void my_verify_trim( sc_ssl_ctx_t *ctx, int max );
+void my_shared_free( sc_ssl_ctx_t *ctx );
+void my_shared_keys_lock( sc_ssl_ctx_t *ctx );
+void my_shared_keys_unlock( sc_ssl_ctx_t *ctx, int store );
+#ifdef SC_SSL_USE_SHM
+int my_shm_lock_init( sc_ssl_shm_lock_t *m );
+int my_shm_lock( sc_ssl_shm_lock_t *m );
+void my_shm_set_reset( sc_ssl_shm_set_t *set );
+unsigned long my_memhash( const unsigned char *p, size_t len );
+sc_ssl_ctx_t *my_shared_ctx( SSL *ssl );
+int my_shared_new_cb( SSL *ssl, SSL_SESSION *session );
+SSL_SESSION *my_shared_get_cb(
+	SSL *ssl, SC_SSL_SESSION_ID *id, int id_len, int *copy
+);
+#endif
+#ifdef SC_SSL_USE_TICKETS
+int my_ticket_key_init(
+	SSL *ssl, unsigned char *name, unsigned char *iv,
+	EVP_CIPHER_CTX *ectx, int enc, sc_ssl_ticket_key_t *tk
+);
+#ifdef SC_SSL_TICKET_EVP
+int my_ticket_key_cb(
+	SSL *ssl, unsigned char *name, unsigned char *iv,
+	EVP_CIPHER_CTX *ectx, EVP_MAC_CTX *mctx, int enc
+);
+#else
+int my_ticket_key_cb(
+	SSL *ssl, unsigned char *name, unsigned char *iv,
+	EVP_CIPHER_CTX *ectx, HMAC_CTX *hctx, int enc
+);
+#endif
+#endif
 
 char *my_strcpy( char *dst, const char *src );
+char *my_strdup( const char *str );
 int my_stricmp( const char *cs, const char *ct );
 
 #endif /* _SC_SSL_MOD_DEF_H_ */
@@ -0,0 +1,97 @@
+#!perl
+
+print "1..$_tests\n";
+
+require Socket::Class::SSL;
+
+if( $^O eq 'cygwin' ) {
+	_skip_all();
+}
+
+$s = Socket::Class::SSL->new(
+	'certificate' => 'cert/server.crt',
+	'private_key' => 'cert/server.key',
+	'local_addr' => '127.0.0.1',
+	'listen' => 10,
+	'reuseaddr' => 1,
+	'handshake_threads' => 2,
+) or die Socket::Class->error();
+_check( $s->handshake_pending == 0 );
+
+my $pid = fork();
+if( not defined $pid ) {
+	_skip_all();
+}
+elsif( $pid == 0 ) {
+	for my $i( 1 .. 4 ) {
+		$c[$i] = Socket::Class::SSL->new(
+			'remote_addr' => '127.0.0.1',
+			'remote_port' => $s->local_port,
+		) or exit( 1 );
+		$c[$i]->say( "hello $i" ) or exit( 2 );
+	}
+	for my $i( 1 .. 4 ) {
+		$c[$i]->readline eq "bye $i" or exit( 3 );
+	}
+	# a connection without handshake runs into the timeout
+	$p = Socket::Class->new(
+		'remote_addr' => '127.0.0.1',
+		'remote_port' => $s->local_port,
+	) or exit( 4 );
+	$p->is_readable( 5000 );
+	exit( 0 );
+}
+else {
+	$n = 0;
+	for( 1 .. 4 ) {
+		$s->is_readable( 5000 ) or last;
+		$c = $s->accept or last;
+		$c->readline =~ /^hello (\d)$/ or last;
+		$c->say( "bye $1" );
+		$n ++;
+	}
+	_check( $n == 4 );
+	_check( $s->handshake_pending == 0 );
+	_check( $s->set_handshake_threads( 1, 500 ) );
+	$s->set_blocking( 0 );
+	_check( defined( $c = $s->accept ) && ! $c );
+	# the handshake of the silent connection fails after the timeout, the
+	# wait is bounded in case the child is gone already
+	for( 1 .. 50 ) {
+		last if ! defined( $c = $s->accept );
+		$s->wait( 100 );
+	}
+	_check( ! defined $c && $s->handshake_pending == 0 );
+	$s->set_blocking( 1 );
+	waitpid( $pid, 0 );
+	_check( $? == 0 );
+	_check( ! $s->set_handshake_threads( -1 ) );
+	_check( $s->set_handshake_threads( 0 ) );
+}
+
+BEGIN {
+	$_tests = 9;
+	$_pos = 1;
+	unshift @INC, 'blib/lib', 'blib/arch';
+}
+
+sub _check {
+	print "" . ($_[0] ? "ok" : "not ok") . " $_pos\n";
+	$_pos ++;
+	return $_[0];
+}
+
+sub _skip_all {
+	print STDERR "Skipped: probably not supported on this platform\n";
+	for( ; $_pos <= $_tests; $_pos ++ ) {
+		print "ok $_pos\n";
+	}
+	exit;
+}
+
+sub _fail_all {
+	for( ; $_pos <= $_tests; $_pos ++ ) {
+		print "not ok $_pos\n";
+	}
+	exit;
+}
@@ -0,0 +1,114 @@
+#!perl
+
+print "1..$_tests\n";
+
+require Socket::Class::SSL;
+
+if( $^O eq 'cygwin' ) {
+	_skip_all();
+}
+
+# the tenant certificate is given as PEM data
+$crt = _slurp( 'cert/sni.crt' );
+$key = _slurp( 'cert/sni.key' );
+$default = _slurp( 'cert/server.crt' );
+
+$tenant = Socket::Class::SSL::CTX->new(
+	'server' => 1,
+	'certificate' => $crt,
+	'private_key' => $key,
+);
+_check( $tenant ) or _fail_all();
+
+$s = Socket::Class::SSL->new(
+	'certificate' => 'cert/server.crt',
+	'private_key' => 'cert/server.key',
+	'local_addr' => '127.0.0.1',
+	'listen' => 10,
+	'reuseaddr' => 1,
+) or die Socket::Class->error();
+_check( $s->add_server_name( '*.Example.org', $tenant ) );
+_check( ! $s->add_server_name( 'client.example.org',
+	Socket::Class::SSL::CTX->new() ) );
+
+my $pid = fork();
+if( not defined $pid ) {
+	_skip_all();
+}
+elsif( $pid == 0 ) {
+	for $name( 'A.example.org', 'example.org', 'b.example.org',
+		'c.example.org'
+	) {
+		$c = Socket::Class::SSL->new(
+			'remote_addr' => '127.0.0.1',
+			'remote_port' => $s->local_port,
+			'server_name' => $name,
+		) or exit( 1 );
+		$pem = $c->get_peer_certificate or exit( 2 );
+		$pem =~ s/\r//g;
+		$c->say( $pem eq $crt ? 'sni' : $pem eq $default ? 'default' : '?' );
+		$c->readline;
+		$c->close;
+	}
+	exit( 0 );
+}
+else {
+	_check( $c = _accept() ) or _fail_all();
+	_check( $c->get_server_name eq 'A.example.org'
+		&& $c->readline eq 'sni' );
+	$c->say( 'ok' );
+	_check( ($c = _accept()) && $c->readline eq 'default' );
+	$c->say( 'ok' );
+	# names are removed and replaced while the listener is running
+	_check( $s->remove_server_name( '*.example.org' ) );
+	_check( ! $s->remove_server_name( '*.example.org' ) );
+	_check( $s->add_server_name( 'c.example.org', $tenant ) );
+	_check( ($c = _accept()) && $c->readline eq 'default' );
+	$c->say( 'ok' );
+	_check( ($c = _accept()) && $c->readline eq 'sni' );
+	$c->say( 'ok' );
+	waitpid( $pid, 0 );
+	_check( $? == 0 );
+}
+
+BEGIN {
+	$_tests = 12;
+	$_pos = 1;
+	unshift @INC, 'blib/lib', 'blib/arch';
+}
+
+sub _accept {
+	$s->is_readable( 5000 ) or return;
+	return $s->accept;
+}
+
+sub _slurp {
+	my( $fh, $data );
+	open( $fh, '<', $_[0] ) or die "$_[0]: $!";
+	local $/;
+	$data = <$fh>;
+	close( $fh );
+	$data =~ s/\r//g;
+	return $data;
+}
+
+sub _check {
+	print "" . ($_[0] ? "ok" : "not ok") . " $_pos\n";
+	$_pos ++;
+	return $_[0];
+}
+
+sub _skip_all {
+	print STDERR "Skipped: probably not supported on this platform\n";
+	for( ; $_pos <= $_tests; $_pos ++ ) {
+		print "ok $_pos\n";
+	}
+	exit;
+}
+
+sub _fail_all {
+	for( ; $_pos <= $_tests; $_pos ++ ) {
+		print "not ok $_pos\n";
+	}
+	exit;
+}
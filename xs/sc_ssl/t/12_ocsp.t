@@ -0,0 +1,110 @@
+#!perl
+
+print "1..$_tests\n";
+
+require Socket::Class::SSL;
+
+if( $^O eq 'cygwin' ) {
+	_skip_all();
+}
+
+$ocsp = _slurp( 'cert/server.ocsp' );
+
+$ctx = Socket::Class::SSL::CTX->new(
+	'server' => 1,
+	'certificate' => 'cert/server.crt',
+	'private_key' => 'cert/server.key',
+	'ocsp_response' => 'cert/server.ocsp',
+);
+_check( $ctx ) or _fail_all();
+$st = $ctx->get_ocsp_status;
+_check( $st && $st->{'status'} eq 'good'
+	&& $st->{'next_update'} > time + 86400 );
+_check( ! $ctx->set_ocsp_response( 'garbage' ) );
+_check( $ctx->set_ocsp_response( $ocsp ) );
+# the response does not match the certificate
+_check( ! Socket::Class::SSL::CTX->new(
+	'server' => 1,
+	'certificate' => 'cert/sni.crt',
+	'private_key' => 'cert/sni.key',
+	'ocsp_response' => 'cert/server.ocsp',
+) );
+
+$s = Socket::Class::SSL->new(
+	'use_ctx' => $ctx,
+	'local_addr' => '127.0.0.1',
+	'listen' => 10,
+	'reuseaddr' => 1,
+) or die Socket::Class->error();
+
+my $pid = fork();
+if( not defined $pid ) {
+	_skip_all();
+}
+elsif( $pid == 0 ) {
+	for $stapling( 1, 0 ) {
+		$c = Socket::Class::SSL->new(
+			'remote_addr' => '127.0.0.1',
+			'remote_port' => $s->local_port,
+			'ocsp_stapling' => $stapling,
+		) or exit( 1 );
+		$r = $c->get_ocsp_response;
+		defined $r or exit( 2 );
+		$c->say( $r eq $ocsp ? 'stapled' : $r eq '' ? 'none' : '?' );
+		$c->readline;
+		$c->close;
+	}
+	exit( 0 );
+}
+else {
+	_check( ($c = _accept()) && $c->readline eq 'stapled' );
+	$c->say( 'ok' );
+	_check( ($c = _accept()) && $c->readline eq 'none' );
+	$c->say( 'ok' );
+	waitpid( $pid, 0 );
+	_check( $? == 0 );
+	$st = $ctx->get_ocsp_status;
+	_check( $st && $st->{'stapled'} == 1 && $st->{'missed'} == 0 );
+}
+
+BEGIN {
+	$_tests = 9;
+	$_pos = 1;
+	unshift @INC, 'blib/lib', 'blib/arch';
+}
+
+sub _accept {
+	$s->is_readable( 5000 ) or return;
+	return $s->accept;
+}
+
+sub _slurp {
+	my( $fh, $data );
+	open( $fh, '<', $_[0] ) or die "$_[0]: $!";
+	binmode( $fh );
+	local $/;
+	$data = <$fh>;
+	close( $fh );
+	return $data;
+}
+
+sub _check {
+	print "" . ($_[0] ? "ok" : "not ok") . " $_pos\n";
+	$_pos ++;
+	return $_[0];
+}
+
+sub _skip_all {
+	print STDERR "Skipped: probably not supported on this platform\n";
+	for( ; $_pos <= $_tests; $_pos ++ ) {
+		print "ok $_pos\n";
+	}
+	exit;
+}
+
+sub _fail_all {
+	for( ; $_pos <= $_tests; $_pos ++ ) {
+		print "not ok $_pos\n";
+	}
+	exit;
+}
@@ -0,0 +1,106 @@
+#!perl
+
+print "1..$_tests\n";
+
+require Socket::Class::SSL;
+
+if( $^O eq 'cygwin' ) {
+	_skip_all();
+}
+
+$SIG{'PIPE'} = 'IGNORE';
+
+# clients present the self-signed tenant certificate
+$ctx = Socket::Class::SSL::CTX->new(
+	'server' => 1,
+	'certificate' => 'cert/server.crt',
+	'private_key' => 'cert/server.key',
+	'ca_file' => 'cert/sni.crt',
+	'verify_peer' => 1,
+	'verify_cache' => 10,
+	'verify_timeout' => 2,
+);
+_check( $ctx ) or _fail_all();
+
+$s = Socket::Class::SSL->new(
+	'use_ctx' => $ctx,
+	'local_addr' => '127.0.0.1',
+	'listen' => 10,
+	'reuseaddr' => 1,
+) or die Socket::Class->error();
+
+my $pid = fork();
+if( not defined $pid ) {
+	_skip_all();
+}
+elsif( $pid == 0 ) {
+	for $crt( 'sni', 'sni', 'sni', 'server', 'sni' ) {
+		sleep( 3 ) if $n ++ == 4;
+		# sessions are not resumed, every handshake sends the certificate
+		$c = Socket::Class::SSL->new(
+			'remote_addr' => '127.0.0.1',
+			'remote_port' => $s->local_port,
+			'certificate' => "cert/$crt.crt",
+			'private_key' => "cert/$crt.key",
+			'session_store' => 0,
+		) or next;
+		$c->say( $crt );
+		$c->readline;
+		$c->close;
+	}
+	exit( 0 );
+}
+else {
+	for( 1 .. 3 ) {
+		_check( ($c = _accept()) && $c->readline eq 'sni' );
+		$c->say( 'ok' );
+	}
+	$st = $ctx->session_stats;
+	_check( $st->{'verify_misses'} == 1 && $st->{'verify_hits'} == 2
+		&& $st->{'verify_cached'} == 1 );
+	# the untrusted certificate fails the handshake
+	$c = _accept();
+	_check( ! $c || ! defined $c->readline );
+	# the entry expired, the chain is verified again
+	_check( ($c = _accept()) && $c->readline eq 'sni' );
+	$c->say( 'ok' );
+	waitpid( $pid, 0 );
+	_check( $? == 0 );
+	$st = $ctx->session_stats;
+	_check( $st->{'verify_misses'} == 3 && $st->{'verify_hits'} == 2
+		&& $st->{'verify_cached'} == 1 );
+	_check( $ctx->set_verify_cache( 0 )
+		&& $ctx->session_stats->{'verify_cached'} == 0 );
+}
+
+BEGIN {
+	$_tests = 10;
+	$_pos = 1;
+	unshift @INC, 'blib/lib', 'blib/arch';
+}
+
+sub _accept {
+	$s->is_readable( 5000 ) or return;
+	return $s->accept;
+}
+
+sub _check {
+	print "" . ($_[0] ? "ok" : "not ok") . " $_pos\n";
+	$_pos ++;
+	return $_[0];
+}
+
+sub _skip_all {
+	print STDERR "Skipped: probably not supported on this platform\n";
+	for( ; $_pos <= $_tests; $_pos ++ ) {
+		print "ok $_pos\n";
+	}
+	exit;
+}
+
+sub _fail_all {
+	for( ; $_pos <= $_tests; $_pos ++ ) {
+		print "not ok $_pos\n";
+	}
+	exit;
+}
@@ -0,0 +1,108 @@
+#!perl
+
+print "1..$_tests\n";
+
+require Socket::Class::SSL;
+
+if( $^O eq 'cygwin' || $^O eq 'MSWin32' ) {
+	_skip_all();
+}
+
+$SIG{'PIPE'} = 'IGNORE';
+
+# the first connection is accepted by the parent, the resumed one by a
+# worker forked before
+for $tickets( 0, 1 ) {
+	$ctx = Socket::Class::SSL::CTX->new(
+		'server' => 1,
+		'certificate' => 'cert/server.crt',
+		'private_key' => 'cert/server.key',
+		'session_tickets' => $tickets,
+		'shared_session_cache' => 64,
+	) or _fail_all();
+	$s = Socket::Class::SSL->new(
+		'use_ctx' => $ctx,
+		'local_addr' => '127.0.0.1',
+		'listen' => 10,
+		'reuseaddr' => 1,
+	) or die Socket::Class->error();
+	pipe( $rd, $wr ) or _skip_all();
+	$worker = fork();
+	if( not defined $worker ) {
+		_skip_all();
+	}
+	elsif( $worker == 0 ) {
+		close( $wr );
+		<$rd> or exit( 1 );
+		$s->is_readable( 5000 ) or exit( 1 );
+		$c = $s->accept or exit( 1 );
+		$c->say( "hello again" ) or exit( 1 );
+		$c->is_readable( 1000 );
+		exit( $c->session_reused ? 0 : 2 );
+	}
+	close( $rd );
+	# the key is rotated in the parent only
+	$ctx->rotate_ticket_key() if $tickets;
+	$client = fork();
+	if( not defined $client ) {
+		_skip_all();
+	}
+	elsif( $client == 0 ) {
+		close( $wr );
+		$store = Socket::Class::SSL::CTX->new( 'session_store' => 10 )
+			or exit( 1 );
+		$c = Socket::Class::SSL->new(
+			'use_ctx' => $store,
+			'remote_addr' => '127.0.0.1',
+			'remote_port' => $s->local_port,
+		) or exit( 1 );
+		$c->is_readable( 1000 ) or exit( 1 );
+		$c->readline or exit( 1 );
+		$c->reconnect() or exit( 1 );
+		$c->is_readable( 5000 ) or exit( 1 );
+		$c->readline or exit( 1 );
+		exit( $c->session_reused ? 0 : 3 );
+	}
+	_check( $s->is_readable( 5000 ) && ($c = $s->accept) ) or _fail_all();
+	_check( $c->say( "hello client" ) ) or _fail_all();
+	print $wr "accept\n";
+	close( $wr );
+	waitpid( $client, 0 );
+	_check( $? == 0 );
+	waitpid( $worker, 0 );
+	_check( $? == 0 );
+	if( ! $tickets ) {
+		$stats = $ctx->session_stats;
+		_check( $stats->{'shared_stored'} >= 1 );
+		_check( $stats->{'shared_hits'} == 1 );
+	}
+	$c->close();
+	$s->close();
+}
+
+BEGIN {
+	$_tests = 10;
+	$_pos = 1;
+	unshift @INC, 'blib/lib', 'blib/arch';
+}
+
+sub _check {
+	print "" . ($_[0] ? "ok" : "not ok") . " $_pos\n";
+	$_pos ++;
+	return $_[0];
+}
+
+sub _skip_all {
+	print STDERR "Skipped: probably not supported on this platform\n";
+	for( ; $_pos <= $_tests; $_pos ++ ) {
+		print "ok $_pos\n";
+	}
+	exit;
+}
+
+sub _fail_all {
+	for( ; $_pos <= $_tests; $_pos ++ ) {
+		print "not ok $_pos\n";
+	}
+	exit;
+}
@@ -0,0 +1,81 @@
+#!perl
+
+print "1..$_tests\n";
+
+require Socket::Class::SSL;
+
+$ctx = Socket::Class::SSL::CTX->new(
+	'server' => 1,
+	'certificate' => 'cert/server.crt',
+	'private_key' => 'cert/server.key',
+	'session_cache' => 'server',
+	'session_cache_size' => 100,
+	'session_timeout' => 60,
+	'ticket_key' => '00112233445566778899aabbccddeeff' x 4,
+) or die $@;
+_check( $ctx->rotate_ticket_key() );
+_check( ! $ctx->rotate_ticket_key( 'abc' ) );
+# keys of the former length with a 16 byte hmac key
+_check( ! $ctx->rotate_ticket_key( '00' x 48 ) );
+_check( ! $ctx->set_session_id_context( 'x' x 33 ) );
+
+if( $^O eq 'cygwin' ) {
+	_skip_all();
+}
+
+$s = Socket::Class::SSL->new(
+	'use_ctx' => $ctx,
+	'local_addr' => '127.0.0.1',
+	'listen' => 10,
+	'reuseaddr' => 1,
+) or die Socket::Class->error();
+
+my $pid = fork();
+if( not defined $pid ) {
+	_skip_all();
+}
+elsif( $pid == 0 ) {
+	$c = Socket::Class::SSL->new(
+		'remote_addr' => '127.0.0.1',
+		'remote_port' => $s->local_port,
+	) or exit();
+	$c->is_readable( 1000 ) or exit();
+	$c->readline;
+	exit(0);
+}
+else {
+	_check( $c = $s->accept ) or _fail_all();
+	_check( $c->say( "hello client" ) ) or _fail_all();
+	waitpid( $pid, 0 );
+	$stats = $ctx->session_stats;
+	_check( ref $stats eq 'HASH' ) or _fail_all();
+	_check( $stats->{'accept_good'} == 1 );
+	_check( $stats->{'tickets_issued'} + $stats->{'sessions'} > 0 );
+}
+
+BEGIN {
+	$_tests = 9;
+	$_pos = 1;
+	unshift @INC, 'blib/lib', 'blib/arch';
+}
+
+sub _check {
+	print "" . ($_[0] ? "ok" : "not ok") . " $_pos\n";
+	$_pos ++;
+	return $_[0];
+}
+
+sub _skip_all {
+	print STDERR "Skipped: probably not supported on this platform\n";
+	for( ; $_pos <= $_tests; $_pos ++ ) {
+		print "ok $_pos\n";
+	}
+	exit;
+}
+
+sub _fail_all {
+	for( ; $_pos <= $_tests; $_pos ++ ) {
+		print "not ok $_pos\n";
+	}
+	exit;
+}
@@ -0,0 +1,90 @@
+#!perl
+
+print "1..$_tests\n";
+
+require Socket::Class::SSL;
+
+if( $^O eq 'cygwin' ) {
+	_skip_all();
+}
+
+$s = Socket::Class::SSL->new(
+	'certificate' => 'cert/server.crt',
+	'private_key' => 'cert/server.key',
+	'local_addr' => '127.0.0.1',
+	'listen' => 10,
+	'reuseaddr' => 1,
+) or die Socket::Class->error();
+
+my $pid = fork();
+if( not defined $pid ) {
+	_skip_all();
+}
+elsif( $pid == 0 ) {
+	$ctx = Socket::Class::SSL::CTX->new( 'session_store' => 10 )
+		or exit( 1 );
+	$c = Socket::Class::SSL->new(
+		'use_ctx' => $ctx,
+		'remote_addr' => '127.0.0.1',
+		'remote_port' => $s->local_port,
+	) or exit( 1 );
+	$c->is_readable( 1000 ) or exit( 1 );
+	$c->readline or exit( 1 );
+	exit( 2 ) if $c->session_reused;
+	$c->reconnect() or exit( 1 );
+	$c->is_readable( 1000 ) or exit( 1 );
+	$c->readline or exit( 1 );
+	exit( 3 ) if ! $c->session_reused;
+	exit( 4 ) if $ctx->session_stats->{'store_resumed'} != 1;
+	# sockets of the same configuration share the context
+	for $i( 1 .. 2 ) {
+		$c = Socket::Class::SSL->new(
+			'remote_addr' => '127.0.0.1',
+			'remote_port' => $s->local_port,
+		) or exit( 1 );
+		$c->is_readable( 1000 ) or exit( 1 );
+		$c->readline or exit( 1 );
+		exit( 4 + $i ) if ($i == 2) != $c->session_reused;
+		$c->close();
+	}
+	exit( 0 );
+}
+else {
+	_check( $c = $s->accept ) or _fail_all();
+	_check( $c->say( "hello client" ) ) or _fail_all();
+	_check( $s->is_readable( 5000 ) && ($c = $s->accept) ) or _fail_all();
+	_check( $c->say( "hello again" ) ) or _fail_all();
+	for( 1 .. 2 ) {
+		_check( $s->is_readable( 5000 ) && ($c = $s->accept) ) or _fail_all();
+		_check( $c->say( "hello" ) ) or _fail_all();
+	}
+	waitpid( $pid, 0 );
+	_check( $? == 0 );
+}
+
+BEGIN {
+	$_tests = 9;
+	$_pos = 1;
+	unshift @INC, 'blib/lib', 'blib/arch';
+}
+
+sub _check {
+	print "" . ($_[0] ? "ok" : "not ok") . " $_pos\n";
+	$_pos ++;
+	return $_[0];
+}
+
+sub _skip_all {
+	print STDERR "Skipped: probably not supported on this platform\n";
+	for( ; $_pos <= $_tests; $_pos ++ ) {
+		print "ok $_pos\n";
+	}
+	exit;
+}
+
+sub _fail_all {
+	for( ; $_pos <= $_tests; $_pos ++ ) {
+		print "not ok $_pos\n";
+	}
+	exit;
+}
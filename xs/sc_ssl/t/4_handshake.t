@@ -0,0 +1,90 @@
+#!perl
+
+print "1..$_tests\n";
+
+require Socket::Class::SSL;
+
+if( $^O eq 'cygwin' ) {
+	_skip_all();
+}
+
+$s = Socket::Class::SSL->new(
+	'certificate' => 'cert/server.crt',
+	'private_key' => 'cert/server.key',
+	'local_addr' => '127.0.0.1',
+	'listen' => 10,
+	'reuseaddr' => 1,
+	'defer_handshake' => 1,
+) or die Socket::Class->error();
+
+my $pid = fork();
+if( not defined $pid ) {
+	_skip_all();
+}
+elsif( $pid == 0 ) {
+	$c = Socket::Class::SSL->new() or exit( 1 );
+	$c->set_blocking( 0 );
+	$c->connect( '127.0.0.1', $s->local_port ) or exit( 2 );
+	_handshake( $c ) or exit( 3 );
+	$c->set_blocking( 1 );
+	$c->is_readable( 5000 ) or exit( 4 );
+	$c->readline eq 'hello client' or exit( 5 );
+	exit( 0 );
+}
+else {
+	_check( $s->is_readable( 5000 ) && ($c = $s->accept) ) or _fail_all();
+	# the handshake has not been started yet
+	_check( $c->handshake_wants == 1 ) or _fail_all();
+	$c->set_blocking( 0 );
+	_check( _handshake( $c ) ) or _fail_all();
+	_check( $c->handshake_wants == 0 );
+	$c->set_blocking( 1 );
+	_check( $c->say( "hello client" ) ) or _fail_all();
+	waitpid( $pid, 0 );
+	_check( $? == 0 );
+}
+
+sub _handshake {
+	my( $sock ) = @_;
+	my( $r, $want );
+	for( 1 .. 100 ) {
+		$r = $sock->handshake;
+		return undef if ! defined $r;
+		return 1 if $r;
+		$want = $sock->handshake_wants;
+		if( $want == 1 ) {
+			$sock->is_readable( 100 );
+		}
+		elsif( $want == 2 ) {
+			$sock->is_writable( 100 );
+		}
+	}
+	return undef;
+}
+
+BEGIN {
+	$_tests = 6;
+	$_pos = 1;
+	unshift @INC, 'blib/lib', 'blib/arch';
+}
+
+sub _check {
+	print "" . ($_[0] ? "ok" : "not ok") . " $_pos\n";
+	$_pos ++;
+	return $_[0];
+}
+
+sub _skip_all {
+	print STDERR "Skipped: probably not supported on this platform\n";
+	for( ; $_pos <= $_tests; $_pos ++ ) {
+		print "ok $_pos\n";
+	}
+	exit;
+}
+
+sub _fail_all {
+	for( ; $_pos <= $_tests; $_pos ++ ) {
+		print "not ok $_pos\n";
+	}
+	exit;
+}
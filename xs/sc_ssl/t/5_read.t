@@ -0,0 +1,86 @@
+#!perl
+
+print "1..$_tests\n";
+
+require Socket::Class::SSL;
+
+if( $^O eq 'cygwin' ) {
+	_skip_all();
+}
+
+$s = Socket::Class::SSL->new(
+	'certificate' => 'cert/server.crt',
+	'private_key' => 'cert/server.key',
+	'local_addr' => '127.0.0.1',
+	'listen' => 10,
+	'reuseaddr' => 1,
+) or die Socket::Class->error();
+
+my $pid = fork();
+if( not defined $pid ) {
+	_skip_all();
+}
+elsif( $pid == 0 ) {
+	$c = Socket::Class::SSL->new(
+		'remote_addr' => '127.0.0.1',
+		'remote_port' => $s->local_port,
+	) or exit( 1 );
+	# many lines and packets in few records
+	$c->write( join( '', map { "line $_\r\n" } 1 .. 2000 ) ) or exit( 2 );
+	$c->write( "first--second--part" ) or exit( 3 );
+	$c->is_readable( 5000 ) or exit( 4 );
+	$c->readline eq 'go' or exit( 5 );
+	$c->write( "ial line\n" ) or exit( 6 );
+	$c->is_readable( 5000 ) or exit( 7 );
+	exit( 0 );
+}
+else {
+	_check( $s->is_readable( 5000 ) && ($c = $s->accept) ) or _fail_all();
+	$n = 0;
+	for $i( 1 .. 2000 ) {
+		$l = $c->readline;
+		last if $l ne "line $i";
+		$n ++;
+	}
+	_check( $n == 2000 );
+	_check( $c->read_packet( '--' ) eq 'first' );
+	_check( $c->read_packet( '--' ) eq 'second' );
+	# partial lines are kept in non-blocking mode
+	$c->set_blocking( 0 );
+	$l = $c->readline;
+	_check( defined $l && $l eq '' );
+	$c->say( 'go' );
+	$c->set_blocking( 1 );
+	$c->is_readable( 5000 );
+	_check( $c->readline eq 'partial line' );
+	$c->say( 'bye' );
+	waitpid( $pid, 0 );
+	_check( $? == 0 );
+}
+
+BEGIN {
+	$_tests = 7;
+	$_pos = 1;
+	unshift @INC, 'blib/lib', 'blib/arch';
+}
+
+sub _check {
+	print "" . ($_[0] ? "ok" : "not ok") . " $_pos\n";
+	$_pos ++;
+	return $_[0];
+}
+
+sub _skip_all {
+	print STDERR "Skipped: probably not supported on this platform\n";
+	for( ; $_pos <= $_tests; $_pos ++ ) {
+		print "ok $_pos\n";
+	}
+	exit;
+}
+
+sub _fail_all {
+	for( ; $_pos <= $_tests; $_pos ++ ) {
+		print "not ok $_pos\n";
+	}
+	exit;
+}
@@ -0,0 +1,92 @@
+#!perl
+
+print "1..$_tests\n";
+
+require Socket::Class::SSL;
+
+if( $^O eq 'cygwin' ) {
+	_skip_all();
+}
+
+$file = "t/_sendfile.tmp";
+open( FH, '>', $file ) or _skip_all();
+binmode( FH );
+print FH map { chr( $_ % 256 ) x 100 } 1 .. 1000;
+close( FH );
+
+# kernel offload is used where available, the result is the same
+$s = Socket::Class::SSL->new(
+	'certificate' => 'cert/server.crt',
+	'private_key' => 'cert/server.key',
+	'local_addr' => '127.0.0.1',
+	'listen' => 10,
+	'reuseaddr' => 1,
+	'ktls' => 1,
+) or die Socket::Class->error();
+
+my $pid = fork();
+if( not defined $pid ) {
+	_skip_all();
+}
+elsif( $pid == 0 ) {
+	$c = Socket::Class::SSL->new(
+		'remote_addr' => '127.0.0.1',
+		'remote_port' => $s->local_port,
+		'ktls' => 1,
+	) or exit( 1 );
+	defined $c->ktls_active or exit( 2 );
+	$c->sendfile( $file ) == 100000 or exit( 3 );
+	# the offset of the handle does not move
+	open( FH, '<', $file ) or exit( 4 );
+	$c->sendfile( \*FH, 99990, 5 ) == 5 or exit( 4 );
+	sysseek( FH, 0, 1 ) == 0 or exit( 6 );
+	close( FH );
+	$c->readline eq 'bye' or exit( 5 );
+	exit( 0 );
+}
+else {
+	_check( $s->is_readable( 5000 ) && ($c = $s->accept) ) or _fail_all();
+	_check( defined $c->ktls_active );
+	$buf = '';
+	while( length( $buf ) < 100005 ) {
+		$c->read( $tmp, 100005 - length( $buf ) ) or last;
+		$buf .= $tmp;
+	}
+	open( FH, '<', $file );
+	binmode( FH );
+	read( FH, $tmp, 100000 );
+	close( FH );
+	_check( substr( $buf, 0, 100000 ) eq $tmp );
+	_check( substr( $buf, 100000 ) eq substr( $tmp, 99990, 5 ) );
+	$c->say( 'bye' );
+	waitpid( $pid, 0 );
+	_check( $? == 0 );
+	unlink( $file );
+}
+
+BEGIN {
+	$_tests = 5;
+	$_pos = 1;
+	unshift @INC, 'blib/lib', 'blib/arch';
+}
+
+sub _check {
+	print "" . ($_[0] ? "ok" : "not ok") . " $_pos\n";
+	$_pos ++;
+	return $_[0];
+}
+
+sub _skip_all {
+	print STDERR "Skipped: probably not supported on this platform\n";
+	for( ; $_pos <= $_tests; $_pos ++ ) {
+		print "ok $_pos\n";
+	}
+	exit;
+}
+
+sub _fail_all {
+	for( ; $_pos <= $_tests; $_pos ++ ) {
+		print "not ok $_pos\n";
+	}
+	exit;
+}
@@ -0,0 +1,99 @@
+#!perl
+
+print "1..$_tests\n";
+
+require Socket::Class::SSL;
+
+if( $^O eq 'cygwin' ) {
+	_skip_all();
+}
+
+$s = Socket::Class::SSL->new(
+	'certificate' => 'cert/server.crt',
+	'private_key' => 'cert/server.key',
+	'local_addr' => '127.0.0.1',
+	'listen' => 10,
+	'reuseaddr' => 1,
+	'read_ahead' => 1,
+) or die Socket::Class->error();
+
+my $pid = fork();
+if( not defined $pid ) {
+	_skip_all();
+}
+elsif( $pid == 0 ) {
+	$c = Socket::Class::SSL->new(
+		'remote_addr' => '127.0.0.1',
+		'remote_port' => $s->local_port,
+		'dynamic_records' => 1,
+	) or exit( 1 );
+	# small writes are packed into records
+	$c->set_output_buffer( 65536 ) or exit( 2 );
+	for $i( 1 .. 1000 ) {
+		$c->write( "line $i\n" ) or exit( 3 );
+	}
+	$c->output_pending > 0 or exit( 4 );
+	$c->flush or exit( 5 );
+	$c->output_pending == 0 or exit( 6 );
+	# bulk data in growing records
+	$c->write( 'x' x 200000 ) == 200000 or exit( 7 );
+	$c->say( "end" );
+	# the buffer is sent before reading
+	$c->readline eq 'bye' or exit( 8 );
+	$c->close;
+	exit( 0 );
+}
+else {
+	_check( $s->is_readable( 5000 ) && ($c = $s->accept) ) or _fail_all();
+	$n = 0;
+	for $i( 1 .. 1000 ) {
+		$c->is_readable( 5000 ) or last;
+		last if $c->readline ne "line $i";
+		$n ++;
+	}
+	_check( $n == 1000 );
+	# records already read ahead are seen by is_readable
+	$c->set_blocking( 0 );
+	$buf = '';
+	while( length( $buf ) < 200000 ) {
+		$c->is_readable( 5000 ) or last;
+		$c->read( $tmp, 65536 ) or next;
+		$buf .= $tmp;
+	}
+	$c->set_blocking( 1 );
+	_check( $buf eq 'x' x 200000 );
+	_check( $c->readline eq 'end' );
+	_check( $c->set_output_buffer( 1024 ) );
+	$c->say( 'bye' );
+	_check( $c->output_pending > 0 );
+	$c->close;
+	waitpid( $pid, 0 );
+	_check( $? == 0 );
+}
+
+BEGIN {
+	$_tests = 7;
+	$_pos = 1;
+	unshift @INC, 'blib/lib', 'blib/arch';
+}
+
+sub _check {
+	print "" . ($_[0] ? "ok" : "not ok") . " $_pos\n";
+	$_pos ++;
+	return $_[0];
+}
+
+sub _skip_all {
+	print STDERR "Skipped: probably not supported on this platform\n";
+	for( ; $_pos <= $_tests; $_pos ++ ) {
+		print "ok $_pos\n";
+	}
+	exit;
+}
+
+sub _fail_all {
+	for( ; $_pos <= $_tests; $_pos ++ ) {
+		print "not ok $_pos\n";
+	}
+	exit;
+}
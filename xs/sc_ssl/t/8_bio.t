@@ -0,0 +1,116 @@
+#!perl
+
+print "1..$_tests\n";
+
+require Socket::Class::SSL;
+
+if( $^O eq 'cygwin' ) {
+	_skip_all();
+}
+
+# records are moved by the caller
+$cl = Socket::Class::SSL->starttls( $p1 = Socket::Class->new(),
+	'memory_bio' => 'manual',
+) or die Socket::Class->error();
+$sv = Socket::Class::SSL->starttls( $p2 = Socket::Class->new(),
+	'memory_bio' => 'manual',
+	'server' => 1,
+	'certificate' => 'cert/server.crt',
+	'private_key' => 'cert/server.key',
+) or die Socket::Class->error();
+for( 1 .. 20 ) {
+	$r1 = $cl->handshake;
+	$r2 = $sv->handshake;
+	last if ! defined $r1 || ! defined $r2;
+	_pump();
+	last if $r1 && $r2;
+}
+_check( $r1 && $r2 ) or _fail_all();
+_check( ! $cl->bio_pending && ! $sv->bio_pending );
+$cl->say( "hello server" );
+_pump();
+_check( $sv->is_readable( 0 ) && $sv->readline eq 'hello server' );
+$sv->write( 'x' x 100000 );
+_pump();
+$buf = '';
+while( length( $buf ) < 100000 ) {
+	$cl->read( $tmp, 65536 ) or last;
+	$buf .= $tmp;
+}
+_check( $buf eq 'x' x 100000 );
+
+# records go through the socket functions
+$s = Socket::Class::SSL->new(
+	'certificate' => 'cert/server.crt',
+	'private_key' => 'cert/server.key',
+	'local_addr' => '127.0.0.1',
+	'listen' => 10,
+	'reuseaddr' => 1,
+	'memory_bio' => 'socket',
+) or die Socket::Class->error();
+
+my $pid = fork();
+if( not defined $pid ) {
+	_skip_all();
+}
+elsif( $pid == 0 ) {
+	$c = Socket::Class::SSL->new(
+		'remote_addr' => '127.0.0.1',
+		'remote_port' => $s->local_port,
+		'memory_bio' => 'socket',
+	) or exit( 1 );
+	$c->say( "hello server" ) or exit( 2 );
+	$buf = '';
+	while( length( $buf ) < 100000 ) {
+		$c->read( $tmp, 65536 ) or exit( 3 );
+		$buf .= $tmp;
+	}
+	$buf eq 'y' x 100000 or exit( 4 );
+	$c->say( "bye" );
+	exit( 0 );
+}
+else {
+	_check( $s->is_readable( 5000 ) && ($c = $s->accept) ) or _fail_all();
+	_check( $c->readline eq 'hello server' );
+	_check( $c->write( 'y' x 100000 ) == 100000 );
+	_check( $c->readline eq 'bye' );
+	waitpid( $pid, 0 );
+	_check( $? == 0 );
+}
+
+BEGIN {
+	$_tests = 9;
+	$_pos = 1;
+	unshift @INC, 'blib/lib', 'blib/arch';
+}
+
+sub _pump {
+	my( $buf );
+	for( [ $cl, $sv ], [ $sv, $cl ] ) {
+		while( $_->[0]->bio_pending ) {
+			$_->[0]->bio_read( $buf, 65536 ) or last;
+			$_->[1]->bio_write( $buf );
+		}
+	}
+}
+
+sub _check {
+	print "" . ($_[0] ? "ok" : "not ok") . " $_pos\n";
+	$_pos ++;
+	return $_[0];
+}
+
+sub _skip_all {
+	print STDERR "Skipped: probably not supported on this platform\n";
+	for( ; $_pos <= $_tests; $_pos ++ ) {
+		print "ok $_pos\n";
+	}
+	exit;
+}
+
+sub _fail_all {
+	for( ; $_pos <= $_tests; $_pos ++ ) {
+		print "not ok $_pos\n";
+	}
+	exit;
+}
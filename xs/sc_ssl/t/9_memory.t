@@ -0,0 +1,82 @@
+#!perl
+
+print "1..$_tests\n";
+
+require Socket::Class::SSL;
+
+if( $^O eq 'cygwin' ) {
+	_skip_all();
+}
+
+$ctx = Socket::Class::SSL::CTX->new( 'release_buffers' => 1 )
+	or die Socket::Class->error();
+_check( $ctx->memory_usage->{'sockets'} == 0 );
+$cl = Socket::Class::SSL->starttls( $p1 = Socket::Class->new(),
+	'use_ctx' => $ctx,
+	'memory_bio' => 'manual',
+) or die Socket::Class->error();
+$sv = Socket::Class::SSL->starttls( $p2 = Socket::Class->new(),
+	'memory_bio' => 'manual',
+	'server' => 1,
+	'certificate' => 'cert/server.crt',
+	'private_key' => 'cert/server.key',
+) or die Socket::Class->error();
+_check( $ctx->memory_usage->{'sockets'} == 1 );
+for( 1 .. 20 ) {
+	$r1 = $cl->handshake;
+	$r2 = $sv->handshake;
+	last if ! defined $r1 || ! defined $r2;
+	_pump();
+	last if $r1 && $r2;
+}
+_check( $r1 && $r2 ) or _fail_all();
+$cl->say( "hello server" );
+_pump();
+$sv->say( "hello client" );
+_pump();
+_check( $sv->readline eq 'hello server' && $cl->readline eq 'hello client' );
+# nothing left to read, the client is idle now
+$cl->readline;
+$mem = $cl->memory_usage;
+_check( $mem->{'buffers'} == 0 && $mem->{'ssl_buffers'} == 0 );
+_check( $mem->{'pool'} > 0 );
+_check( $sv->memory_usage->{'ssl_buffers'} > 0 );
+undef $cl;
+_check( $ctx->memory_usage->{'sockets'} == 0 );
+
+BEGIN {
+	$_tests = 8;
+	$_pos = 1;
+	unshift @INC, 'blib/lib', 'blib/arch';
+}
+
+sub _pump {
+	my( $buf );
+	for( [ $cl, $sv ], [ $sv, $cl ] ) {
+		while( $_->[0]->bio_pending ) {
+			$_->[0]->bio_read( $buf, 65536 ) or last;
+			$_->[1]->bio_write( $buf );
+		}
+	}
+}
+
+sub _check {
+	print "" . ($_[0] ? "ok" : "not ok") . " $_pos\n";
+	$_pos ++;
+	return $_[0];
+}
+
+sub _skip_all {
+	print STDERR "Skipped: probably not supported on this platform\n";
+	for( ; $_pos <= $_tests; $_pos ++ ) {
+		print "ok $_pos\n";
+	}
+	exit;
+}
+
+sub _fail_all {
+	for( ; $_pos <= $_tests; $_pos ++ ) {
+		print "not ok $_pos\n";
+	}
+	exit;
+}